@@ -28,10 +28,11 @@ void signalHandler(int signum) {
 #endif
 
 // Initialize a new VM instance with default configuration.
-static VM* initializeVM(int argc, const char** argv) {
+static VM* initializeVM(int argc, const char** argv, bool optimize) {
   Configuration config = NewConfiguration();
   config.argument.argc = argc;
   config.argument.argv = argv;
+  config.optimize_level = optimize ? 1 : 0;
 
   if (utilIsAtTy(stderr)) {
     config.use_ansi_escape = true;
@@ -132,6 +133,7 @@ int main(int argc, const char** argv) {
   bool millisecond = false;
   bool bytecode = false;
   bool execute = false;
+  bool optimize = false;
   const char* output_path = NULL;
 
   // Setup parser
@@ -147,6 +149,7 @@ int main(int argc, const char** argv) {
               "Compile source to bytecode (no execution unless -x is set).");
   ap_add_bool(parser, "execute", 'x', &execute, "Execute the script (or bytecode if -b is set).");
   ap_add_str(parser, "output", 'o', &output_path, "Output path for bytecode when using -b.");
+  ap_add_bool(parser, "optimize", 'O', &optimize, "Optimize the compiled bytecode.");
 
   // Parse arguments
   int script_idx = ap_parse(parser, argc, argv);
@@ -178,7 +181,7 @@ int main(int argc, const char** argv) {
   }
 
   // Create and initialize the VM.
-  VM* vm = initializeVM(vm_argc, vm_argv);
+  VM* vm = initializeVM(vm_argc, vm_argv, optimize);
 
   if (!bytecode && !execute) {
     execute = true; // Default behavior: run source.
@@ -183,6 +183,9 @@ typedef enum VarType {
   vFIBER,
   vCLASS,
   vPOINTER,
+  vSET,
+  vITERATOR,
+  vTUPLE,
   vINSTANCE,
 } VarType;
 
@@ -258,6 +261,10 @@ typedef struct Configuration {
   // If true stderr calls will use ansi color codes.
   bool use_ansi_escape;
 
+  // Level of the bytecode optimizations used when compiling the scripts, 0
+  // (the default) disables them.
+  int optimize_level;
+
   // User defined data associated with VM.
   void* user_data;
 
@@ -489,6 +496,15 @@ PUBLIC Handle* GetSlotHandle(VM* vm, int index);
 // is not a valid native instance, an assertion will fail.
 PUBLIC void* GetSlotNativeInstance(VM* vm, int index);
 
+// Returns the raw elements of the typed array (types.Float64Array,
+// types.Int32Array, types.Uint8Array) at the [index] slot without copying.
+// The [length] and the [element_size] in bytes (8 for doubles, 4 for int32_t
+// and 1 for uint8_t) will be written if they're not NULL. Returns NULL if the
+// value isn't a typed array or it's a view of a ByteBuffer which was shrunk.
+// The pointer is only valid till the array (or the viewed buffer) is
+// modified or garbage collected.
+PUBLIC void* GetSlotTypedArray(VM* vm, int index, uint32_t* length, uint32_t* element_size);
+
 // Set the [index] slot value as null.
 PUBLIC void setSlotNull(VM* vm, int index);
 
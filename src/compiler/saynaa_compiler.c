@@ -4,6 +4,7 @@
  */
 
 #include "saynaa_compiler.h"
+#include "saynaa_optimizer.h"
 
 #include "../runtime/saynaa_core.h"
 #include "../runtime/saynaa_vm.h"
@@ -11,6 +12,8 @@
 #include "../utils/saynaa_debug.h"
 #include "../utils/saynaa_utils.h"
 
+#include <math.h>
+
 /*****************************************************************************/
 /* TOKENS                                                                    */
 /*****************************************************************************/
@@ -81,6 +84,7 @@ typedef enum {
   TK_AS,       // as
   TK_FUNCTION, // function
   TK_END,      // end
+  TK_CONST,    // const
 
   TK_NULL,  // null
   TK_IN,    // in
@@ -146,6 +150,7 @@ static _Keyword _keywords[] = {
     {"as", 2, TK_AS},
     {"function", 8, TK_FUNCTION},
     {"end", 3, TK_END},
+    {"const", 5, TK_CONST},
     {"null", 4, TK_NULL},
     {"in", 2, TK_IN},
     {"is", 2, TK_IS},
@@ -224,11 +229,13 @@ typedef enum {
 } FuncType;
 
 typedef struct {
-  const char* name; //< Directly points into the source string.
-  uint32_t length;  //< Length of the name.
-  int depth;        //< The depth the local is defined in.
-  bool is_upvalue;  //< Is this an upvalue for a nested function.
-  int line;         //< The line variable declared for debugging.
+  const char* name;    //< Directly points into the source string.
+  uint32_t length;     //< Length of the name.
+  int depth;           //< The depth the local is defined in.
+  bool is_upvalue;     //< Is this an upvalue for a nested function.
+  bool is_assigned;    //< Is this assigned after it's initialized.
+  bool is_initialized; //< False till the value of 'name = (expr)' is compiled.
+  int line;            //< The line variable declared for debugging.
 } Local;
 
 typedef struct sLoop {
@@ -286,8 +293,27 @@ typedef struct sFunc {
   int upvalue_count;     //< Number of upvalues in [upvalues].
   int upvalue_capacity;  //< Capacity of the upvalues array.
 
+  // Positions of the CAPTURE_LOCAL bytes of the closures created in this
+  // function. Once a captured local goes out of scope and it was never
+  // assigned, they're patched to CAPTURE_COPY, see compilerExitBlock().
+  UintBuffer captures;
+
   int stack_size; //< Current size including locals and temps.
 
+  // Position of the last OP_GET_ATTRIB and the last position a forward jump
+  // was patched to, see exprCall().
+  int attrib_pos;
+  int jump_target;
+
+  // Position of the last OP_PUSH_THIS, see exprAttrib().
+  int this_pos;
+
+  // Position of the last OP_PUSH_GLOBAL_NAME, see exprCall().
+  int global_pos;
+
+  // Position of the last OP_PUSH_CONSTANT of a literal, see exprBinaryOp().
+  int const_pos;
+
   // The actual function pointer which is being compiled.
   Function* ptr;
 
@@ -361,6 +387,7 @@ typedef struct sParser {
 
   bool repl_mode;
   bool parsing_class;
+  Class* current_class; //< The class being compiled if [parsing_class].
   bool need_more_lines; //< True if we need more lines in REPL mode.
 
   // [has_errors] is for all kinds of errors. If it's set we don't terminate
@@ -432,12 +459,29 @@ struct Compiler {
   // meaningless).
   bool is_last_call;
 
-  // Since the compiler manually call some builtin functions we need to cache
-  // the index of the functions in order to prevent search for them each time.
-  int bifn_list_join;
+  // True if the last call expression was compiled as a method call by
+  // exprCall() (which can't be a tail call).
+  bool is_method_call;
+
+  // True if the last call expression was compiled with OP_CALL_DIRECT by
+  // exprCall().
+  bool is_direct_call;
+
+  // True if the last call expression was inlined by exprCall() (which can't
+  // be a tail call).
+  bool is_inline_call;
 
   // Globals defined at compile time (indexes into module->constants).
   UintBuffer global_names;
+
+  // Pairs of a global name index and the constant index of the function it's
+  // defined with, or -1 if it isn't defined by a single function definition.
+  // See compilerDefineGlobal().
+  UintBuffer global_defns;
+
+  // Pairs of a global name index and the constant index of the value it's
+  // declared with the const statement, see compileConstStatement().
+  UintBuffer global_consts;
 };
 
 typedef struct {
@@ -455,10 +499,6 @@ static OpInfo opcode_info[] = {
 /* INITIALIZATION FUNCTIONS                                                  */
 /*****************************************************************************/
 
-// FIXME: Remove this forward declaration once "list_join" is replaced by the BUILD_STRING opcode.
-// Currently required by the compiler initialization to locate "list_join".
-static int findBuiltinFunction(const VM* vm, const char* name, uint32_t length);
-
 // This should be called once the compiler initialized (to access it's fields).
 static void parserInit(Parser* parser, VM* vm, Compiler* compiler,
                        const char* source, const char* path) {
@@ -487,6 +527,7 @@ static void parserInit(Parser* parser, VM* vm, Compiler* compiler,
   parser->repl_mode = !!(compiler->options && compiler->options->repl_mode);
   parser->optional_call_paran = false;
   parser->parsing_class = false;
+  parser->current_class = NULL;
   parser->has_errors = false;
   parser->has_syntax_error = false;
   parser->need_more_lines = false;
@@ -510,8 +551,13 @@ static void compilerInit(Compiler* compiler, VM* vm, const char* source,
   compiler->can_define = true;
   compiler->new_local = false;
   compiler->is_last_call = false;
+  compiler->is_method_call = false;
+  compiler->is_direct_call = false;
+  compiler->is_inline_call = false;
 
   UintBufferInit(&compiler->global_names);
+  UintBufferInit(&compiler->global_defns);
+  UintBufferInit(&compiler->global_consts);
 
   const char* source_path = "@??";
   if (module->path != NULL) {
@@ -522,10 +568,6 @@ static void compilerInit(Compiler* compiler, VM* vm, const char* source,
   }
 
   parserInit(&compiler->parser, vm, compiler, source, source_path);
-
-  // Cache the required built functions.
-  compiler->bifn_list_join = findBuiltinFunction(vm, "list_join", 9);
-  ASSERT(compiler->bifn_list_join >= 0, OOPS);
 }
 
 /*****************************************************************************/
@@ -1515,6 +1557,13 @@ static int findUpvalue(Compiler* compiler, Func* func, const char* name, uint32_
     // Mark the locals as an upvalue to close it when it goes out of the scope.
     func->outer_func->locals[index].is_upvalue = true;
 
+    // If the local isn't initialized yet (ex: 'fn = function() fn() end')
+    // the closure will be created before it's initialized, so it cannot be
+    // copied.
+    if (!func->outer_func->locals[index].is_initialized) {
+      func->outer_func->locals[index].is_assigned = true;
+    }
+
     // Add upvalue to the function and return it's index.
     return addUpvalue(compiler, func, index, true);
   }
@@ -1532,6 +1581,16 @@ static int findUpvalue(Compiler* compiler, Func* func, const char* name, uint32_
   return -1;
 }
 
+// Mark the local that the upvalue at the [index] of the [func] refers to as
+// assigned, so the closures will share it instead of copying it.
+static void compilerMarkUpvalueAssigned(Func* func, int index) {
+  while (!func->upvalues[index].is_immediate) {
+    index = func->upvalues[index].index;
+    func = func->outer_func;
+  }
+  func->outer_func->locals[func->upvalues[index].index].is_assigned = true;
+}
+
 // Result type for an identifier definition.
 typedef enum {
   NAME_NOT_DEFINED,
@@ -1629,6 +1688,8 @@ static int compilerAddGlobalName(Compiler* compiler, const char* name, uint32_t
 static int compilerAddVariable(Compiler* compiler, const char* name,
                                uint32_t length, int line);
 static void compilerChangeStack(Compiler* compiler, int num);
+static void compilerEnterBlock(Compiler* compiler);
+static void compilerExitBlock(Compiler* compiler);
 
 // Forward declaration of grammar functions.
 static void parsePrecedence(Compiler* compiler, Precedence precedence);
@@ -1722,6 +1783,7 @@ GrammarRule rules[] = {
     /* TK_AS          */ NO_RULE,
     /* TK_FUNCTION    */ {exprFunction, NULL, NO_INFIX},
     /* TK_END         */ NO_RULE,
+    /* TK_CONST       */ NO_RULE,
     /* TK_NULL        */ {exprValue, NULL, NO_INFIX},
     /* TK_IN          */ {NULL, exprBinaryOp, PREC_TEST},
     /* TK_IS          */ {NULL, exprBinaryOp, PREC_TEST},
@@ -1752,9 +1814,77 @@ static GrammarRule* getRule(_TokenType type) {
   return &(rules[(int) type]);
 }
 
+static int compilerGlobalConst(Compiler* compiler, int index);
+
+// Record a definition of the global at the name constant [index]. The
+// [fn_index] is the constant index of a top-level function definition, -1 for
+// any other store. A global that only defined once, by a function definition,
+// will be called with OP_CALL_DIRECT.
+static void compilerDefineGlobal(Compiler* compiler, int index, int fn_index) {
+  if (compilerGlobalConst(compiler, index) >= 0) {
+    String* name = moduleGetStringAt(compiler->module, index);
+    semanticError(compiler, compiler->parser.previous,
+                  "Cannot assign to the constant '%s'.", name->data);
+    return;
+  }
+
+  UintBuffer* defns = &compiler->global_defns;
+  for (uint32_t i = 0; i < defns->count; i += 2) {
+    if (defns->data[i] == (uint32_t) index) {
+      defns->data[i + 1] = (uint32_t) -1; // Defined again.
+      return;
+    }
+  }
+  UintBufferWrite(defns, compiler->parser.vm, (uint32_t) index);
+  UintBufferWrite(defns, compiler->parser.vm, (uint32_t) fn_index);
+}
+
+// Returns the constant index of the function the global at the name constant
+// [index] is defined with, if it can be called with OP_CALL_DIRECT otherwise
+// -1.
+static int compilerDirectFunction(Compiler* compiler, int index) {
+  UintBuffer* defns = &compiler->global_defns;
+  for (uint32_t i = 0; i < defns->count; i += 2) {
+    if (defns->data[i] == (uint32_t) index) {
+      return (int) defns->data[i + 1];
+    }
+  }
+  return -1;
+}
+
+// Returns the constant index of the value the global at the name constant
+// [index] is declared with (const NAME = value), otherwise -1.
+static int compilerGlobalConst(Compiler* compiler, int index) {
+  UintBuffer* consts = &compiler->global_consts;
+  for (uint32_t i = 0; i < consts->count; i += 2) {
+    if (consts->data[i] == (uint32_t) index) {
+      return (int) consts->data[i + 1];
+    }
+  }
+  return -1;
+}
+
+// Emit the shortest instruction to push the literal [value] (null, bool,
+// number or string).
+static void emitPushLiteral(Compiler* compiler, Var value) {
+  if (IS_NULL(value)) {
+    emitOpcode(compiler, OP_PUSH_NULL);
+  } else if (IS_BOOL(value)) {
+    emitOpcode(compiler, AS_BOOL(value) ? OP_PUSH_TRUE : OP_PUSH_FALSE);
+  } else if (IS_NUM(value) && AS_NUM(value) == 0.0 && !signbit(AS_NUM(value))) {
+    emitOpcode(compiler, OP_PUSH_0);
+  } else {
+    int index = compilerAddConstant(compiler, value);
+    compiler->func->const_pos = (int) _FN->opcodes.count;
+    emitOpcode(compiler, OP_PUSH_CONSTANT);
+    emitShort(compiler, index);
+  }
+}
+
 // Uses `OP_STORE_GLOBAL_NAME` to store the stack top value into the global at
 // the specified name constant index.
 static void emitStoreGlobal(Compiler* compiler, int index) {
+  compilerDefineGlobal(compiler, index, -1);
   emitOpcode(compiler, OP_STORE_GLOBAL_NAME);
   emitShort(compiler, index);
 }
@@ -1787,6 +1917,7 @@ static void emitPushValue(Compiler* compiler, NameDefnType type, int index) {
       return;
 
     case NAME_GLOBAL_VAR:
+      compiler->func->global_pos = (int) _FN->opcodes.count;
       emitOpcode(compiler, OP_PUSH_GLOBAL_NAME);
       emitShort(compiler, index);
       return;
@@ -1819,6 +1950,7 @@ static void emitStoreValue(Compiler* compiler, NameDefnType type, int index) {
       }
 
     case NAME_LOCAL_VAR:
+      compiler->func->locals[index].is_assigned = true;
       if (index < 9) { //< 0..8 locals have single opcode.
         emitOpcode(compiler, (Opcode) (OP_STORE_LOCAL_0 + index));
       } else {
@@ -1828,6 +1960,7 @@ static void emitStoreValue(Compiler* compiler, NameDefnType type, int index) {
       return;
 
     case NAME_UPVALUE:
+      compilerMarkUpvalueAssigned(compiler->func, index);
       emitOpcode(compiler, OP_STORE_UPVALUE);
       emitShort(compiler, index);
       return;
@@ -1842,7 +1975,8 @@ static void emitStoreValue(Compiler* compiler, NameDefnType type, int index) {
 // is OP_METHOD_CALL the [method] should refer a string in the module's
 // constant pool, otherwise it's ignored.
 static void _compileCall(Compiler* compiler, Opcode call_type, int method) {
-  ASSERT((call_type == OP_CALL) || (call_type == OP_METHOD_CALL) || (call_type == OP_SUPER_CALL),
+  ASSERT((call_type == OP_CALL) || (call_type == OP_METHOD_CALL) || (call_type == OP_SUPER_CALL)
+             || (call_type == OP_CALL_DIRECT),
          OOPS);
   // Compile parameters.
   int argc = 0;
@@ -1868,7 +2002,8 @@ static void _compileCall(Compiler* compiler, Opcode call_type, int method) {
 
   emitByte(compiler, argc);
 
-  if ((call_type == OP_METHOD_CALL) || (call_type == OP_SUPER_CALL)) {
+  if ((call_type == OP_METHOD_CALL) || (call_type == OP_SUPER_CALL)
+      || (call_type == OP_CALL_DIRECT)) {
     ASSERT_INDEX(method, (int) compiler->module->constants.count);
     emitShort(compiler, method);
   }
@@ -1912,6 +2047,7 @@ static void exprLiteral(Compiler* compiler) {
     }
   }
   int index = compilerAddConstant(compiler, value->value);
+  compiler->func->const_pos = (int) _FN->opcodes.count;
   emitOpcode(compiler, OP_PUSH_CONSTANT);
   emitShort(compiler, index);
 }
@@ -1920,29 +2056,29 @@ static void exprLiteral(Compiler* compiler) {
 //
 //     "Hello $name!"
 //
-// This will be compiled as:
+// This will be compiled as (the parts are pushed on the stack and joined
+// with a single allocation, the empty parts are skipped):
 //
-//     list_join(["Hello ", name, "!"])
+//     PUSH_CONSTANT "Hello "
+//     PUSH_GLOBAL   name
+//     PUSH_CONSTANT "!"
+//     BUILD_STRING  3
 //
 static void exprInterpolation(Compiler* compiler) {
-  emitOpcode(compiler, OP_PUSH_BUILTIN_FN);
-  emitByte(compiler, compiler->bifn_list_join);
-
-  emitOpcode(compiler, OP_PUSH_LIST);
-  int size_index = emitShort(compiler, 0);
-
-  int size = 0;
+  int count = 0;
   do {
-    // Push the string on the stack and append it to the list.
-    exprLiteral(compiler);
-    emitOpcode(compiler, OP_LIST_APPEND);
-    size++;
+    // Push the string part on the stack, if it's empty (ex: "${a}${b}") it's
+    // skipped.
+    ASSERT(IS_OBJ_TYPE(compiler->parser.previous.value, OBJ_STRING), OOPS);
+    if (((String*) AS_OBJ(compiler->parser.previous.value))->length != 0) {
+      exprLiteral(compiler);
+      count++;
+    }
 
-    // Compile the expression and append it to the list.
+    // Compile the expression, it'll be converted to string by BUILD_STRING.
     skipNewLines(compiler);
     compileExpression(compiler);
-    emitOpcode(compiler, OP_LIST_APPEND);
-    size++;
+    count++;
     skipNewLines(compiler);
   } while (match(compiler, TK_STRING_INTERP));
 
@@ -1955,21 +2091,21 @@ static void exprInterpolation(Compiler* compiler) {
     String* str = (String*) AS_OBJ(compiler->parser.previous.value);
     if (str->length != 0) {
       exprLiteral(compiler);
-      emitOpcode(compiler, OP_LIST_APPEND);
-      size++;
+      count++;
     }
   }
 
-  patchListSize(compiler, size_index, size);
-
-  // Call the list_join function (which is at the stack top).
-  emitOpcode(compiler, OP_CALL);
-  emitByte(compiler, 1);
+  if (count > MAX_INTERPOLATION_PARTS) {
+    semanticError(compiler, compiler->parser.previous,
+                  "Too many parts in an interpolated string (max is %d).",
+                  MAX_INTERPOLATION_PARTS);
+    return;
+  }
 
-  // After the above call, the lits and the "list_join" function will be
-  // popped from the stack and a string will be pushed. The so the result
-  // stack effect is -1.
-  compilerChangeStack(compiler, -1);
+  // Pop the parts and push the string of them.
+  emitOpcode(compiler, OP_BUILD_STRING);
+  emitShort(compiler, count);
+  compilerChangeStack(compiler, -count + 1);
 }
 
 static void exprFunction(Compiler* compiler) {
@@ -2025,6 +2161,8 @@ static void exprName(Compiler* compiler) {
         // it once the expression is compiled.
         if (name_type == NAME_LOCAL_VAR) {
           new_local = true;
+          if (index >= 0)
+            compiler->func->locals[index].is_initialized = false;
         }
 
         if (!compiler->can_define) {
@@ -2034,6 +2172,8 @@ static void exprName(Compiler* compiler) {
 
       // Compile the assigned value.
       compilePureExpression(compiler);
+      if (new_local && index >= 0)
+        compiler->func->locals[index].is_initialized = true;
 
     } else { // name += / -= / *= ... = (expr);
 
@@ -2081,6 +2221,11 @@ static void exprName(Compiler* compiler) {
       moduleAddString(compiler->module, compiler->parser.vm, start, length, &index);
       emitOpcode(compiler, OP_PUSH_GLOBAL_NAME);
       emitShort(compiler, index);
+    } else if (result.type == NAME_GLOBAL_VAR
+               && compilerGlobalConst(compiler, result.index) >= 0) {
+      // A constant is inlined, it's value is known at compile time.
+      int value_index = compilerGlobalConst(compiler, result.index);
+      emitPushLiteral(compiler, compiler->module->constants.data[value_index]);
     } else {
       emitPushValue(compiler, result.type, result.index);
     }
@@ -2164,10 +2309,15 @@ static bool valueToNumber(Var value, double* out) {
   return false;
 }
 
-static bool tryFoldBinaryConstants(Compiler* compiler, Opcode opcode,
-                                   uint8_t inplace, bool has_inplace) {
+// Fold the binary [opcode] (just emitted) of 2 number literals. The operands
+// should be the literals themselves, [lhs_const] is true if the left hand side
+// was a single literal right before the right hand side at [rhs_start].
+static bool tryFoldBinaryConstants(Compiler* compiler, Opcode opcode, uint8_t inplace,
+                                   bool has_inplace, bool lhs_const, uint32_t rhs_start) {
   if (has_inplace && inplace != 0)
     return false;
+  if (!lhs_const)
+    return false;
 
   bool is_arith = (opcode == OP_ADD || opcode == OP_SUBTRACT
                    || opcode == OP_MULTIPLY || opcode == OP_DIVIDE);
@@ -2193,6 +2343,8 @@ static bool tryFoldBinaryConstants(Compiler* compiler, Opcode opcode,
 
   uint32_t rhs_pos = op_pos - 3;
   uint32_t lhs_pos = rhs_pos - 3;
+  if (rhs_pos != rhs_start || compiler->func->const_pos != (int) rhs_pos)
+    return false;
   if (code->data[lhs_pos] != OP_PUSH_CONSTANT || code->data[rhs_pos] != OP_PUSH_CONSTANT)
     return false;
 
@@ -2237,7 +2389,7 @@ static bool tryFoldBinaryConstants(Compiler* compiler, Opcode opcode,
     }
 
     int index = compilerAddConstant(compiler, VAR_NUM(result));
-    emitByte(compiler, OP_PUSH_CONSTANT);
+    compiler->func->const_pos = emitByte(compiler, OP_PUSH_CONSTANT);
     emitShort(compiler, index);
     return true;
   }
@@ -2274,9 +2426,164 @@ static bool tryFoldBinaryConstants(Compiler* compiler, Opcode opcode,
   return true;
 }
 
+// If the instruction at [pos] pushes a scalar literal (null, bool, number or
+// string) set it to [value] and the instruction size to [length].
+static bool readLiteralPush(Compiler* compiler, uint32_t pos, Var* value, uint32_t* length) {
+  ByteBuffer* code = &_FN->opcodes;
+  if (pos >= code->count)
+    return false;
+
+  *length = 1;
+  switch ((Opcode) code->data[pos]) {
+    case OP_PUSH_NULL:
+      *value = VAR_NULL;
+      return true;
+    case OP_PUSH_0:
+      *value = VAR_NUM(0);
+      return true;
+    case OP_PUSH_TRUE:
+      *value = VAR_TRUE;
+      return true;
+    case OP_PUSH_FALSE:
+      *value = VAR_FALSE;
+      return true;
+
+    case OP_PUSH_CONSTANT:
+      {
+        if (pos + 2 >= code->count)
+          return false;
+        uint16_t index = (uint16_t) ((code->data[pos + 1] << 8) | code->data[pos + 2]);
+        Var constant = compiler->module->constants.data[index];
+        if (IS_OBJ(constant) && !IS_OBJ_TYPE(constant, OBJ_STRING))
+          return false;
+        *value = constant;
+        *length = 3;
+        return true;
+      }
+
+    default:
+      return false;
+  }
+}
+
+// The list or map literal compiled from [start] (it's PUSH_LIST or PUSH_MAP
+// instruction) is rebuilt on every evaluation. If all of it's elements are
+// literals, build it once here as a frozen template in the constant pool and
+// replace the construction with a single CLONE_CONSTANT. Map templates get a
+// perfect index table which the copies inherit.
+static void freezeConstantLiteral(Compiler* compiler, uint32_t start, bool is_map) {
+  if (compiler->parser.has_errors)
+    return;
+
+  ByteBuffer* code = &_FN->opcodes;
+  UintBuffer* lines = &_FN->oplines;
+  VM* vm = compiler->parser.vm;
+
+  uint32_t first = start + (is_map ? 1 : 3);
+  uint8_t insert = is_map ? OP_MAP_INSERT : OP_LIST_APPEND;
+  int values = is_map ? 2 : 1;
+
+  // Empty literals have nothing to share.
+  if (first == code->count)
+    return;
+
+  uint32_t length = 0;
+  Var value;
+  for (uint32_t pos = first; pos < code->count; pos++) {
+    for (int i = 0; i < values; i++) {
+      if (!readLiteralPush(compiler, pos, &value, &length))
+        return;
+      pos += length;
+    }
+    if (pos >= code->count || code->data[pos] != insert)
+      return;
+  }
+
+  Var template;
+  if (is_map) {
+    Map* map = newMap(vm);
+    template = VAR_OBJ(map);
+    vmPushTempRef(vm, &map->_super); // template.
+
+    Var key;
+    for (uint32_t pos = first; pos < code->count; pos += 1) {
+      readLiteralPush(compiler, pos, &key, &length);
+      pos += length;
+      readLiteralPush(compiler, pos, &value, &length);
+      pos += length;
+      mapSet(vm, map, key, value);
+    }
+    mapMakePerfect(vm, map);
+
+  } else {
+    List* list = newList(vm, 0);
+    template = VAR_OBJ(list);
+    vmPushTempRef(vm, &list->_super); // template.
+
+    for (uint32_t pos = first; pos < code->count; pos += 1) {
+      readLiteralPush(compiler, pos, &value, &length);
+      pos += length;
+      listAppend(vm, list, value);
+    }
+  }
+
+  int index = compilerAddConstant(compiler, template);
+  vmPopTempRef(vm); // template.
+
+  // The stack effect of the literal (a single value) doesn't change.
+  code->count = start;
+  lines->count = start;
+  emitByte(compiler, OP_CLONE_CONSTANT);
+  emitShort(compiler, index);
+}
+
+// `value in [...]` against a frozen literal (see freezeConstantLiteral()),
+// the list template is replaced with a set of it's elements and the test is
+// a single hash lookup instead of copying the list and scanning it.
+static bool tryFoldConstantIn(Compiler* compiler, uint32_t rhs_start) {
+  ByteBuffer* code = &_FN->opcodes;
+  UintBuffer* lines = &_FN->oplines;
+  VM* vm = compiler->parser.vm;
+
+  // The right hand side should be just the literal.
+  if (code->count != rhs_start + 3 || code->data[rhs_start] != OP_CLONE_CONSTANT)
+    return false;
+
+  uint16_t index = (uint16_t) ((code->data[rhs_start + 1] << 8) | code->data[rhs_start + 2]);
+  Var template = compiler->module->constants.data[index];
+
+  if (IS_OBJ_TYPE(template, OBJ_LIST)) {
+    List* list = (List*) AS_OBJ(template);
+    Set* set = newSet(vm);
+    vmPushTempRef(vm, &set->_super); // set.
+    for (uint32_t i = 0; i < list->elements.count; i++) {
+      setAdd(vm, set, list->elements.data[i]);
+    }
+    setMakePerfect(vm, set);
+
+    // The list template is only referenced by the CLONE_CONSTANT above.
+    compiler->module->constants.data[index] = VAR_OBJ(set);
+    vmPopTempRef(vm); // set.
+  }
+
+  code->count = rhs_start;
+  lines->count = rhs_start;
+  emitByte(compiler, OP_IN_CONSTANT);
+  emitShort(compiler, index);
+  compilerChangeStack(compiler, -1);
+  return true;
+}
+
 static void exprBinaryOp(Compiler* compiler) {
   _TokenType op = compiler->parser.previous.type;
   skipNewLines(compiler);
+  uint32_t rhs_start = _FN->opcodes.count;
+
+  // The left hand side is a single literal, unless a jump lands after it as
+  // in (a or 1) + 2.
+  bool lhs_const = (compiler->func->const_pos == (int) rhs_start - 3)
+                   && (compiler->func->jump_target != (int) rhs_start);
+
   parsePrecedence(compiler, (Precedence) (getRule(op)->precedence + 1));
 
   // Emits the opcode and 0 (means false) as inplace operation.
@@ -2373,7 +2680,8 @@ static void exprBinaryOp(Compiler* compiler) {
       try_fold = true;
       break;
     case TK_IN:
-      emitOpcode(compiler, OP_IN);
+      if (!tryFoldConstantIn(compiler, rhs_start))
+        emitOpcode(compiler, OP_IN);
       break;
     case TK_IS:
       emitOpcode(compiler, OP_IS);
@@ -2383,7 +2691,8 @@ static void exprBinaryOp(Compiler* compiler) {
   }
 
   if (try_fold) {
-    tryFoldBinaryConstants(compiler, emitted, emitted_inplace, emitted_has_inplace);
+    tryFoldBinaryConstants(compiler, emitted, emitted_inplace, emitted_has_inplace, lhs_const,
+                           rhs_start);
   }
 }
 
@@ -2412,12 +2721,288 @@ static void exprUnaryOp(Compiler* compiler) {
 
 static void exprGrouping(Compiler* compiler) {
   skipNewLines(compiler);
+
+  // () is an empty tuple.
+  if (match(compiler, TK_RPARAN)) {
+    emitOpcode(compiler, OP_BUILD_TUPLE);
+    emitShort(compiler, 0);
+    compilerChangeStack(compiler, 1);
+    return;
+  }
+
   compileExpression(compiler);
   skipNewLines(compiler);
+
+  // (a, b) is a tuple, and (a,) is a tuple of a single element.
+  if (match(compiler, TK_COMMA)) {
+    int count = 1;
+    skipNewLines(compiler);
+    while (peek(compiler) != TK_RPARAN) {
+      compileExpression(compiler);
+      count++;
+      skipNewLines(compiler);
+      if (!match(compiler, TK_COMMA))
+        break;
+      skipNewLines(compiler);
+    }
+    consume(compiler, TK_RPARAN, "Expected ')' after tuple elements.");
+
+    emitOpcode(compiler, OP_BUILD_TUPLE);
+    emitShort(compiler, count);
+    compilerChangeStack(compiler, 1 - count);
+    return;
+  }
+
   consume(compiler, TK_RPARAN, "Expected ')' after expression.");
 }
 
+// Rewind the [parser] to the [state] saved before, the errors found since
+// then are kept.
+static void parserRestore(Parser* parser, const Parser* state) {
+  bool has_errors = parser->has_errors;
+  bool has_syntax_error = parser->has_syntax_error;
+  bool need_more_lines = parser->need_more_lines;
+
+  *parser = *state;
+  parser->has_errors |= has_errors;
+  parser->has_syntax_error |= has_syntax_error;
+  parser->need_more_lines |= need_more_lines;
+}
+
+// The string literals of the saved tokens aren't reachable from the compiler
+// once the parser moved on, pin them till the [state] is restored. Returns
+// the number of pinned values to pop.
+static int parserPinTokens(VM* vm, const Parser* state) {
+  int pinned = 0;
+  const Token* tokens[] = {&state->previous, &state->current, &state->next};
+  for (int i = 0; i < 3; i++) {
+    if (IS_OBJ(tokens[i]->value)) {
+      vmPushTempRef(vm, AS_OBJ(tokens[i]->value)); // token.
+      pinned++;
+    }
+  }
+  return pinned;
+}
+
+// Skip the first element of the list or map literal (its opening bracket is
+// consumed) and returns true if it's followed by a 'for' (a comprehension),
+// then the 'for' will be the current token.
+static bool skipToComprehensionFor(Compiler* compiler) {
+  int depth = 0;  // Open brackets.
+  int blocks = 0; // Open function literals and the blocks inside them.
+
+  for (;;) {
+    _TokenType prev = compiler->parser.previous.type;
+    switch (peek(compiler)) {
+      case TK_EOF:
+      case TK_ERROR:
+        return false;
+
+      case TK_LPARAN:
+      case TK_LBRACKET:
+      case TK_LBRACE:
+        depth++;
+        break;
+
+      case TK_RPARAN:
+      case TK_RBRACKET:
+      case TK_RBRACE:
+        if (depth == 0)
+          return false;
+        depth--;
+        break;
+
+      case TK_COMMA:
+        if (depth == 0 && blocks == 0)
+          return false;
+        break;
+
+      case TK_FOR:
+        if (depth == 0 && blocks == 0)
+          return true;
+        if (blocks > 0)
+          blocks++;
+        break;
+
+      case TK_FUNCTION:
+        blocks++;
+        break;
+
+      case TK_WHILE:
+        if (blocks > 0)
+          blocks++;
+        break;
+
+      // An if statement has an 'end' but the if expression doesn't.
+      case TK_IF:
+        if (blocks > 0
+            && (prev == TK_LINE || prev == TK_SEMICOLLON || prev == TK_RPARAN
+                || prev == TK_DO || prev == TK_THEN || prev == TK_ELSE)) {
+          blocks++;
+        }
+        break;
+
+      case TK_END:
+        if (blocks > 0)
+          blocks--;
+        break;
+
+      default:
+        break;
+    }
+
+    lexToken(compiler);
+    if (compiler->parser.has_syntax_error)
+      return false;
+  }
+}
+
+// Try to compile a list or map comprehension:
+//
+//     [f(x) for x in xs if p(x)]
+//     {k: f(v) for k, v in map}
+//
+// The element comes before its loop in the source, so the parser skips it to
+// compile the loop first and rewinds to compile the element inside the loop
+// body. The result is built in a hidden local with LIST_APPEND_LOCAL (or
+// MAP_INSERT_LOCAL) instead of calling the append method. Returns false
+// (without compiling anything) if it's a regular literal.
+static bool compileComprehension(Compiler* compiler, bool is_map) {
+  VM* vm = compiler->parser.vm;
+
+  Parser start = compiler->parser;
+  int start_pinned = parserPinTokens(vm, &start);
+  if (!skipToComprehensionFor(compiler)) {
+    parserRestore(&compiler->parser, &start);
+    for (int i = 0; i < start_pinned; i++)
+      vmPopTempRef(vm); // token.
+    return false;
+  }
+
+  lexToken(compiler); // Consume TK_FOR.
+  int line = compiler->parser.previous.line;
+
+  consume(compiler, TK_NAME, "Expected an iterator name after 'for'.");
+  Token name = compiler->parser.previous;
+  Token value_name = name;
+  bool has_value = match(compiler, TK_COMMA);
+  if (has_value) {
+    consume(compiler, TK_NAME, "Expected a value name after ','.");
+    value_name = compiler->parser.previous;
+  }
+  consume(compiler, TK_IN, "Expected 'in' after iterator name.");
+
+  if (is_map) {
+    emitOpcode(compiler, OP_PUSH_MAP);
+  } else {
+    emitOpcode(compiler, OP_PUSH_LIST);
+    emitShort(compiler, 0);
+  }
+
+  // The result and the temporaries below it (ex: the callee and arguments of
+  // print(1, [x for x in l])) are taken as locals of the enclosing scope so
+  // the index of the loop locals match their stack slots.
+  int result = compiler->func->stack_size - 1;
+  int temps = compiler->func->stack_size - compiler->func->local_count;
+  if (temps < 0)
+    temps = 0; // Possible with compile errors.
+  for (int i = 0; i < temps; i++) {
+    compilerAddVariable(compiler, "@", 1, line);
+  }
+
+  compilerEnterBlock(compiler); // Loop locals scope.
+
+  compileExpression(compiler);
+  compilerAddVariable(compiler, "@Sequence", 9, line);
+  skipNewLines(compiler);
+
+  // Every element is kept if there is no condition, use the sequence length
+  // as the capacity hint of the result.
+  if (!is_map && peek(compiler) != TK_IF) {
+    emitOpcode(compiler, OP_LIST_RESERVE);
+    emitShort(compiler, result);
+  }
+
+  compilerAddVariable(compiler, "@iterator", 9, line);
+  emitOpcode(compiler, OP_PUSH_NULL);
+  int iter_local = compilerAddVariable(compiler, name.start, name.length, line);
+  emitOpcode(compiler, OP_PUSH_NULL);
+  emitOpcode(compiler, OP_ITER_TEST);
+  if (has_value) {
+    compilerAddVariable(compiler, value_name.start, value_name.length, line);
+    emitOpcode(compiler, OP_PUSH_NULL);
+  }
+
+  // The iteration locals are updated by the ITER instructions.
+  for (int i = iter_local; i < compiler->func->local_count; i++) {
+    compiler->func->locals[i].is_assigned = true;
+  }
+
+  int loop_start = (int) _FN->opcodes.count;
+  emitOpcode(compiler, has_value ? OP_ITER2 : OP_ITER);
+  int forpatch = emitShort(compiler, 0xffff);
+
+  int skip_patch = -1;
+  if (match(compiler, TK_IF)) {
+    skipNewLines(compiler);
+    compileExpression(compiler);
+    emitOpcode(compiler, OP_JUMP_IF_NOT);
+    skip_patch = emitShort(compiler, 0xffff);
+  }
+
+  skipNewLines(compiler);
+  if (is_map) {
+    consume(compiler, TK_RBRACE, "Expected '}' after the map comprehension.");
+  } else {
+    consume(compiler, TK_RBRACKET, "Expected ']' after the list comprehension.");
+  }
+
+  // Rewind to the element and compile it in the loop body.
+  Parser end = compiler->parser;
+  int end_pinned = parserPinTokens(vm, &end);
+  parserRestore(&compiler->parser, &start);
+
+  skipNewLines(compiler);
+  if (is_map) {
+    // Unlike the map literals a name key is a variable ({k: v for k, v in m}).
+    compileExpression(compiler);
+    consume(compiler, TK_COLLON, "Expected ':' after the map comprehension key.");
+    skipNewLines(compiler);
+    compileExpression(compiler);
+    emitOpcode(compiler, OP_MAP_INSERT_LOCAL);
+  } else {
+    compileExpression(compiler);
+    emitOpcode(compiler, OP_LIST_APPEND_LOCAL);
+  }
+  emitShort(compiler, result);
+
+  skipNewLines(compiler);
+  if (peek(compiler) != TK_FOR) {
+    errorAtCurrent(compiler, "Expected 'for' after the comprehension element.");
+  }
+
+  if (skip_patch != -1)
+    patchJump(compiler, skip_patch);
+
+  emitOpcode(compiler, OP_LOOP);
+  emitShort(compiler, (int) _FN->opcodes.count - loop_start + 2);
+  patchJump(compiler, forpatch);
+
+  compilerExitBlock(compiler); // Loop locals scope.
+  compiler->func->local_count -= temps;
+
+  parserRestore(&compiler->parser, &end);
+  for (int i = 0; i < end_pinned + start_pinned; i++)
+    vmPopTempRef(vm); // token.
+
+  return true;
+}
+
 static void exprList(Compiler* compiler) {
+  if (compileComprehension(compiler, false))
+    return;
+
+  uint32_t start = _FN->opcodes.count;
   emitOpcode(compiler, OP_PUSH_LIST);
   int size_index = emitShort(compiler, 0);
 
@@ -2438,9 +3023,14 @@ static void exprList(Compiler* compiler) {
   consume(compiler, TK_RBRACKET, "Expected ']' after list elements.");
 
   patchListSize(compiler, size_index, size);
+  freezeConstantLiteral(compiler, start, false);
 }
 
 static void exprMap(Compiler* compiler) {
+  if (compileComprehension(compiler, true))
+    return;
+
+  uint32_t start = _FN->opcodes.count;
   emitOpcode(compiler, OP_PUSH_MAP);
 
   do {
@@ -2479,10 +3069,240 @@ static void exprMap(Compiler* compiler) {
 
   skipNewLines(compiler);
   consume(compiler, TK_RBRACE, "Expected '}' after map elements.");
+  freezeConstantLiteral(compiler, start, true);
+}
+
+// Returns the optimization level of the compilation, see saynaa_optimizer.h.
+static int compilerOptimizeLevel(Compiler* compiler) {
+  if (compiler->options != NULL)
+    return compiler->options->optimize_level;
+  return compiler->parser.vm->config.optimize_level;
+}
+
+// Emit the opcode [op] (OP_PUSH_LOCAL_0 or OP_STORE_LOCAL_0) for the [local]
+// or [op_n] if it doesn't have a short form, without changing the stack size.
+static void emitInlinedLocal(Compiler* compiler, Opcode op, Opcode op_n, int local) {
+  if (local < 9) {
+    emitByte(compiler, op + local);
+  } else {
+    emitByte(compiler, op_n);
+    emitShort(compiler, local);
+  }
+}
+
+// Inline the call just compiled with OP_CALL_DIRECT to the global name at
+// [index], which is defined by the function at the constant [fn_index]. Only
+// a short function that doesn't jump or call before it returns is inlined. Its
+// arguments on the stack are its locals and its return value slot is the
+// slot of the call. Returns true if the call is inlined.
+static bool compilerInlineCall(Compiler* compiler, int index, int fn_index) {
+  if (compilerOptimizeLevel(compiler) < 1 || (compiler->options && compiler->options->debug))
+    return false;
+
+  ASSERT_INDEX(fn_index, (int) compiler->module->constants.count);
+  Function* callee = (Function*) AS_OBJ(compiler->module->constants.data[fn_index]);
+
+  // The function is still being compiled (a recursive call).
+  for (Func* func = compiler->func; func != NULL; func = func->outer_func) {
+    if (func->ptr == callee)
+      return false;
+  }
+
+  uint32_t count = _FN->opcodes.count;
+  ASSERT(count >= 4 && _FN->opcodes.data[count - 4] == OP_CALL_DIRECT, OOPS);
+  int argc = _FN->opcodes.data[count - 3];
+  if (callee->arity != argc || callee->upvalue_count != 0)
+    return false;
+
+  // Find the size of the code till it returns and the number of the values
+  // above the return value slot at the return.
+  const uint8_t* code = callee->fn->opcodes.data;
+  uint32_t size = 0;
+  int depth = argc;
+  while (size <= MAX_INLINE_SIZE) {
+    Opcode op = (Opcode) code[size];
+    if (op == OP_RETURN)
+      break;
+
+    int stack = opcode_info[op].stack;
+    switch (op) {
+      case OP_BUILD_STRING:
+      case OP_BUILD_TUPLE:
+        stack = 1 - ((code[size + 1] << 8) | code[size + 2]);
+        break;
+
+      // The instructions which depend on the function's frame or jump. The
+      // calls aren't inlined either, otherwise the callee could see the
+      // frames without the inlined one (ex: the debug module).
+      case OP_CALL:
+      case OP_TAIL_CALL:
+      case OP_METHOD_CALL:
+      case OP_CALL_DIRECT:
+      case OP_TAIL_CALL_DIRECT:
+      case OP_PUSH_THIS:
+      case OP_PUSH_UPVALUE:
+      case OP_STORE_UPVALUE:
+      case OP_PUSH_CLOSURE:
+      case OP_CLOSE_UPVALUE:
+      case OP_CREATE_CLASS:
+      case OP_BIND_METHOD:
+      case OP_IMPORT:
+      case OP_IMPORT_WILDCARD:
+      case OP_SUPER_CALL:
+      case OP_INLINE_CALL:
+      case OP_INLINE_RETURN:
+      case OP_UNPACK:
+      case OP_ITER_TEST:
+      case OP_ITER:
+      case OP_ITER2:
+      case OP_JUMP:
+      case OP_LOOP:
+      case OP_JUMP_IF:
+      case OP_JUMP_IF_NOT:
+      case OP_OR:
+      case OP_AND:
+      case OP_GET_FIELD:
+      case OP_SET_FIELD:
+      case OP_REPL_PRINT:
+      case OP_END:
+        return false;
+
+      default:
+        break;
+    }
+
+    depth += stack;
+    size += 1 + opcode_info[op].params;
+  }
+
+  int base = compiler->func->stack_size; //< Slot of the first argument.
+  if (size > MAX_INLINE_SIZE || depth < 0 || depth > UINT8_MAX
+      || base + callee->fn->stack_size > MAX_VARIABLES) {
+    return false;
+  }
+
+  // Replace the OP_CALL_DIRECT, the stack size is already changed for it.
+  _FN->opcodes.count -= 4;
+  _FN->oplines.count -= 4;
+
+  emitByte(compiler, OP_INLINE_CALL);
+  emitByte(compiler, argc);
+  emitShort(compiler, index);
+  emitShort(compiler, fn_index);
+  int skip_patch = emitShort(compiler, 0xffff);
+
+  uint32_t start = _FN->opcodes.count;
+  for (uint32_t ip = 0; ip < size;) {
+    Opcode op = (Opcode) code[ip];
+    uint32_t params = opcode_info[op].params;
+    uint32_t pos = _FN->opcodes.count;
+
+    if (OP_PUSH_LOCAL_0 <= op && op <= OP_PUSH_LOCAL_8) {
+      emitInlinedLocal(compiler, OP_PUSH_LOCAL_0, OP_PUSH_LOCAL_N, base + op - OP_PUSH_LOCAL_0);
+    } else if (OP_STORE_LOCAL_0 <= op && op <= OP_STORE_LOCAL_8) {
+      emitInlinedLocal(compiler, OP_STORE_LOCAL_0, OP_STORE_LOCAL_N, base + op - OP_STORE_LOCAL_0);
+    } else if (op == OP_PUSH_LOCAL_N || op == OP_STORE_LOCAL_N) {
+      int local = base + ((code[ip + 1] << 8) | code[ip + 2]);
+      if (op == OP_PUSH_LOCAL_N) {
+        emitInlinedLocal(compiler, OP_PUSH_LOCAL_0, OP_PUSH_LOCAL_N, local);
+      } else {
+        emitInlinedLocal(compiler, OP_STORE_LOCAL_0, OP_STORE_LOCAL_N, local);
+      }
+    } else if (op == OP_LIST_RESERVE || op == OP_LIST_APPEND_LOCAL || op == OP_MAP_INSERT_LOCAL) {
+      emitByte(compiler, op);
+      emitShort(compiler, base + ((code[ip + 1] << 8) | code[ip + 2]));
+    } else {
+      emitByte(compiler, op);
+      for (uint32_t i = 1; i <= params; i++) {
+        emitByte(compiler, code[ip + i]);
+      }
+    }
+
+    // The inlined code has the lines of the function.
+    for (uint32_t i = pos; i < _FN->opcodes.count; i++) {
+      _FN->oplines.data[i] = callee->fn->oplines.data[ip];
+    }
+    ip += 1 + params;
+  }
+  uint32_t end = _FN->opcodes.count;
+
+  emitByte(compiler, OP_INLINE_RETURN);
+  emitByte(compiler, depth);
+  patchJump(compiler, skip_patch);
+
+  UintBufferWrite(&_FN->inlines, compiler->parser.vm, start);
+  UintBufferWrite(&_FN->inlines, compiler->parser.vm, end);
+  UintBufferWrite(&_FN->inlines, compiler->parser.vm, (uint32_t) fn_index);
+
+  // The stack of the function is above the return value slot.
+  compilerChangeStack(compiler, callee->fn->stack_size);
+  compilerChangeStack(compiler, -callee->fn->stack_size);
+  return true;
 }
 
 static void exprCall(Compiler* compiler) {
+  compiler->is_inline_call = false;
+
+  // Calling an attribute that wasn't compiled as a method call, like
+  // (obj.method)(...), binds the method just to call it. Drop the GET_ATTRIB
+  // and compile it as obj.method(...) unless a jump lands after it, as in
+  // (a or b.method)(...) where the callee isn't always the attribute.
+  int count = (int) _FN->opcodes.count;
+  compiler->is_method_call = (compiler->func->attrib_pos >= 0)
+                             && (compiler->func->attrib_pos == count - 3)
+                             && (compiler->func->jump_target != count);
+
+  if (compiler->is_method_call) {
+    int index = (_FN->opcodes.data[count - 2] << 8) | _FN->opcodes.data[count - 1];
+    _FN->opcodes.count -= 3;
+    _FN->oplines.count -= 3;
+    compiler->func->attrib_pos = -1;
+    _compileCall(compiler, OP_METHOD_CALL, index);
+    return;
+  }
+
+  // Calling a function defined at the module level which is never assigned
+  // again, it'll be resolved by OP_CALL_DIRECT. Only a null is pushed for the
+  // return value instead of the function.
+  if ((compiler->func->global_pos >= 0) && (compiler->func->global_pos == count - 3)
+      && (compiler->func->jump_target != count)
+      && (_FN->opcodes.data[count - 3] == OP_PUSH_GLOBAL_NAME)) {
+    int index = (_FN->opcodes.data[count - 2] << 8) | _FN->opcodes.data[count - 1];
+    int fn_index = compilerDirectFunction(compiler, index);
+    if (fn_index >= 0) {
+      _FN->opcodes.count -= 3;
+      _FN->oplines.count -= 3;
+      compilerChangeStack(compiler, -1);
+      compiler->func->global_pos = -1;
+      emitOpcode(compiler, OP_PUSH_NULL);
+      _compileCall(compiler, OP_CALL_DIRECT, index);
+      compiler->is_inline_call = compilerInlineCall(compiler, index, fn_index);
+      compiler->is_direct_call = !compiler->is_inline_call;
+      return;
+    }
+  }
+
   _compileCall(compiler, OP_CALL, -1);
+  compiler->is_direct_call = false;
+}
+
+// Returns the slot of the declared field [name] of the class being compiled if
+// the attribute is accessed on 'this' (the last opcode is it's OP_PUSH_THIS)
+// otherwise -1. Only the fields at the inline attribute slots have a slot.
+static int _thisFieldSlot(Compiler* compiler, const char* name, int length) {
+  Class* cls = compiler->parser.current_class;
+  if (cls == NULL || cls->fields.count == 0)
+    return -1;
+
+  int count = (int) _FN->opcodes.count;
+  if (compiler->func->this_pos != count - 1 || compiler->func->jump_target == count
+      || _FN->opcodes.data[count - 1] != OP_PUSH_THIS)
+    return -1;
+
+  int slot = classFieldSlot(cls, name, (uint32_t) length);
+  if (slot < 0 || slot >= INSTANCE_INLINE_ATTR_CAPACITY)
+    return -1;
+  return slot;
 }
 
 static void exprAttrib(Compiler* compiler) {
@@ -2504,23 +3324,50 @@ static void exprAttrib(Compiler* compiler) {
   if (_compileOptionalParanCall(compiler, index))
     return;
 
+  int field = _thisFieldSlot(compiler, name, length);
+  if (field >= 0) {
+    // The field is accessed with it's slot and the OP_PUSH_THIS is removed
+    // since OP_GET_FIELD / OP_SET_FIELD operate on this.
+    _FN->opcodes.count--;
+    _FN->oplines.count--;
+    compilerChangeStack(compiler, -1);
+  }
+
   if (compiler->l_value && matchAssignment(compiler)) {
     _TokenType assignment = compiler->parser.previous.type;
     skipNewLines(compiler);
 
     if (assignment != TK_EQ) {
-      emitOpcode(compiler, OP_GET_ATTRIB_KEEP);
-      emitShort(compiler, index);
+      if (field >= 0) {
+        emitOpcode(compiler, OP_GET_FIELD);
+        emitShort(compiler, index);
+        emitByte(compiler, field);
+      } else {
+        emitOpcode(compiler, OP_GET_ATTRIB_KEEP);
+        emitShort(compiler, index);
+      }
       compileExpression(compiler);
       emitAssignedOp(compiler, assignment);
     } else {
       compileExpression(compiler);
     }
 
-    emitOpcode(compiler, OP_SET_ATTRIB);
+    if (field >= 0) {
+      emitOpcode(compiler, OP_SET_FIELD);
+      emitShort(compiler, index);
+      emitByte(compiler, field);
+    } else {
+      emitOpcode(compiler, OP_SET_ATTRIB);
+      emitShort(compiler, index);
+    }
+
+  } else if (field >= 0) {
+    emitOpcode(compiler, OP_GET_FIELD);
     emitShort(compiler, index);
+    emitByte(compiler, field);
 
   } else {
+    compiler->func->attrib_pos = (int) _FN->opcodes.count;
     emitOpcode(compiler, OP_GET_ATTRIB);
     emitShort(compiler, index);
   }
@@ -2614,6 +3461,7 @@ static void exprValue(Compiler* compiler) {
 
 static void exprThis(Compiler* compiler) {
   if (compiler->func->type == FUNC_CONSTRUCTOR || compiler->func->type == FUNC_METHOD) {
+    compiler->func->this_pos = (int) _FN->opcodes.count;
     emitOpcode(compiler, OP_PUSH_THIS);
     return;
   }
@@ -2709,7 +3557,8 @@ static void parsePrecedence(Compiler* compiler, Precedence precedence) {
     infix(compiler);
 
     // TK_LPARAN '(' as infix is the call operator.
-    compiler->is_last_call = (op == TK_LPARAN);
+    compiler->is_last_call = (op == TK_LPARAN) && !compiler->is_method_call
+                             && !compiler->is_inline_call;
   }
 
   compiler->l_value = l_value;
@@ -2764,6 +3613,8 @@ static int compilerAddVariable(Compiler* compiler, const char* name,
   local->length = length;
   local->depth = compiler->scope_depth;
   local->is_upvalue = false;
+  local->is_assigned = false;
+  local->is_initialized = true;
   local->line = line;
   return compiler->func->local_count++;
 
@@ -2825,10 +3676,46 @@ static int compilerPopLocals(Compiler* compiler, int depth) {
   return (compiler->func->local_count - 1) - local;
 }
 
+// Patch the captures of the locals from the index [first] which are never
+// assigned after they're initialized to copy the value into the closures,
+// since no one could observe the difference. Those locals doesn't need to be
+// closed anymore.
+static void compilerPatchCaptures(Compiler* compiler, int first) {
+  UintBuffer* captures = &compiler->func->captures;
+  uint8_t* opcodes = _FN->opcodes.data;
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < captures->count; i++) {
+    uint32_t pos = captures->data[i];
+    int local = (opcodes[pos + 1] << 8) | opcodes[pos + 2];
+    if (local < first) {
+      captures->data[count++] = pos;
+      continue;
+    }
+
+    if (!compiler->func->locals[local].is_assigned) {
+      opcodes[pos] = CAPTURE_COPY;
+    }
+  }
+  captures->count = count;
+
+  for (int i = first; i < compiler->func->local_count; i++) {
+    if (!compiler->func->locals[i].is_assigned) {
+      compiler->func->locals[i].is_upvalue = false;
+    }
+  }
+}
+
 // Exits a block.
 static void compilerExitBlock(Compiler* compiler) {
   ASSERT(compiler->scope_depth > (int) DEPTH_GLOBAL, "Cannot exit toplevel.");
 
+  int first = compiler->func->local_count;
+  while (first > 0 && compiler->func->locals[first - 1].depth >= compiler->scope_depth) {
+    first--;
+  }
+  compilerPatchCaptures(compiler, first);
+
   // Discard all the locals at the current scope.
   int popped = compilerPopLocals(compiler, compiler->scope_depth);
   compiler->func->local_count -= popped;
@@ -2846,6 +3733,12 @@ static void compilerPushFunc(Compiler* compiler, Func* fn, Function* func, FuncT
   fn->upvalue_count = 0;
   fn->upvalue_capacity = 0;
   fn->upvalues = NULL;
+  UintBufferInit(&fn->captures);
+  fn->attrib_pos = -1;
+  fn->jump_target = -1;
+  fn->this_pos = -1;
+  fn->global_pos = -1;
+  fn->const_pos = -1;
   fn->ptr = func;
   fn->depth = compiler->scope_depth;
   compiler->func = fn;
@@ -2952,6 +3845,7 @@ static void patchJump(Compiler* compiler, int addr_index) {
 
   _FN->opcodes.data[addr_index] = (offset >> 8) & 0xff;
   _FN->opcodes.data[addr_index + 1] = offset & 0xff;
+  compiler->func->jump_target = (int) _FN->opcodes.count;
 }
 
 // Update the size value for OP_PUSH_LIST instruction.
@@ -2972,9 +3866,59 @@ typedef enum {
 } BlockType;
 
 static void compileStatement(Compiler* compiler);
+static void compileDestructuring(Compiler* compiler);
 static void compileBlockBody(Compiler* compiler, BlockType type);
 static void compileNamedFunctionStatement(Compiler* compiler);
 
+// If the parent class (the previous token) is a class of this module that is
+// already compiled, it'll be set as the base of the class at compile time to
+// know the slots of the inherited fields. The base will be set again when the
+// class is created at runtime and if it's a different class, the slots will
+// fall back to the attribute names.
+static void _resolveParentFields(Compiler* compiler, Class* cls) {
+  Token* parent = &compiler->parser.previous;
+  int index = moduleGetGlobalIndex(compiler->module, parent->start,
+                                   (uint32_t) parent->length);
+  if (index < 0)
+    return;
+
+  Var value = compiler->module->globals.data[index];
+  if (!IS_OBJ_TYPE(value, OBJ_CLASS))
+    return;
+
+  Class* base = (Class*) AS_OBJ(value);
+  if (base == cls || base->class_of != vINSTANCE)
+    return;
+  cls->super_class = base;
+  classFlattenFields(compiler->parser.vm, cls);
+}
+
+// Compile field declarations of a class body (ex: x, y), the first name is
+// already consumed.
+static void compileClassFields(Compiler* compiler, Class* cls) {
+  VM* _vm = compiler->parser.vm;
+  for (;;) {
+    Token* name = &compiler->parser.previous;
+    if (classFieldSlot(cls, name->start, (uint32_t) name->length) >= 0) {
+      semanticError(compiler, *name, "Field '%.*s' is already declared.",
+                    name->length, name->start);
+    } else {
+      String* field = moduleAddString(compiler->module, _vm, name->start,
+                                      name->length, NULL);
+      StringBufferWrite(&cls->declared_fields, _vm, field);
+      classFlattenFields(_vm, cls);
+    }
+
+    if (!match(compiler, TK_COMMA))
+      break;
+    consume(compiler, TK_NAME, "Expected a field name.");
+    if (compiler->parser.has_syntax_error)
+      return;
+  }
+
+  consumeEndStatement(compiler);
+}
+
 // Compile a class and return it's index in the module's types buffer.
 static int compileClass(Compiler* compiler) {
   ASSERT(compiler->scope_depth == DEPTH_GLOBAL, OOPS);
@@ -2992,6 +3936,7 @@ static int compileClass(Compiler* compiler) {
                         compiler->module, NULL, &cls_index);
   vmPushTempRef(_vm, &cls->_super); // cls.
   compiler->parser.parsing_class = true;
+  compiler->parser.current_class = cls;
 
   checkMaxConstantsReached(compiler, cls_index);
 
@@ -3000,6 +3945,7 @@ static int compileClass(Compiler* compiler) {
     skipNewLines(compiler);
     consume(compiler, TK_NAME, "Expected a parent class name.");
     if (!compiler->parser.has_syntax_error) {
+      _resolveParentFields(compiler, cls);
       exprName(compiler); // Push the super class on the stack.
       has_parent = true;
     }
@@ -3009,6 +3955,7 @@ static int compileClass(Compiler* compiler) {
   } else if (match(compiler, TK_IS)) {
     consume(compiler, TK_NAME, "Expected a parent class name.");
     if (!compiler->parser.has_syntax_error) {
+      _resolveParentFields(compiler, cls);
       exprName(compiler); // Push the super class on the stack.
       has_parent = true;
     }
@@ -3041,7 +3988,15 @@ static int compileClass(Compiler* compiler) {
     // after compiling the class.
     ASSERT(compiler->parser.has_errors || compiler->func->stack_size == 1, OOPS);
 
-    consume(compiler, TK_FUNCTION, "Expected method definition.");
+    if (match(compiler, TK_NAME)) {
+      compileClassFields(compiler, cls);
+      if (compiler->parser.has_syntax_error)
+        break;
+      skipNewLines(compiler);
+      continue;
+    }
+
+    consume(compiler, TK_FUNCTION, "Expected method or field definition.");
     if (compiler->parser.has_syntax_error)
       break;
 
@@ -3061,6 +4016,7 @@ static int compileClass(Compiler* compiler) {
   emitOpcode(compiler, OP_POP); // Pop the class.
 
   compiler->parser.parsing_class = false;
+  compiler->parser.current_class = NULL;
   vmPopTempRef(_vm); // cls.
 
   return cls_index;
@@ -3285,6 +4241,11 @@ static void compileFunction(Compiler* compiler, FuncType fn_type) {
   func->arity = argc;
   compilerChangeStack(compiler, argc);
 
+  // Defined before the body is compiled, so recursive calls are direct too.
+  if (fn_type == FUNC_TOPLEVEL) {
+    compilerDefineGlobal(compiler, global_index, fn_index);
+  }
+
   skipNewLines(compiler);
   if (match(compiler, TK_STRING)) {
     Token* str = &compiler->parser.previous;
@@ -3322,7 +4283,12 @@ static void compileFunction(Compiler* compiler, FuncType fn_type) {
 
   // Capture the upvalues when the closure is created.
   for (int i = 0; i < curr_fn.ptr->upvalue_count; i++) {
-    emitByte(compiler, (curr_fn.upvalues[i].is_immediate) ? 1 : 0);
+    if (curr_fn.upvalues[i].is_immediate) {
+      int pos = emitByte(compiler, CAPTURE_LOCAL);
+      UintBufferWrite(&compiler->func->captures, compiler->parser.vm, (uint32_t) pos);
+    } else {
+      emitByte(compiler, CAPTURE_OUTER);
+    }
     emitShort(compiler, curr_fn.upvalues[i].index);
   }
 
@@ -3333,9 +4299,12 @@ static void compileFunction(Compiler* compiler, FuncType fn_type) {
   if (curr_fn.upvalues != NULL) {
     DEALLOCATE_ARRAY(compiler->parser.vm, curr_fn.upvalues, UpvalueInfo, curr_fn.upvalue_capacity);
   }
+  UintBufferClear(&curr_fn.captures, compiler->parser.vm);
 
   if (fn_type == FUNC_TOPLEVEL) {
-    emitStoreValue(compiler, NAME_GLOBAL_VAR, global_index);
+    // Not using emitStoreGlobal() since it's the definition recorded above.
+    emitOpcode(compiler, OP_STORE_GLOBAL_NAME);
+    emitShort(compiler, global_index);
     emitOpcode(compiler, OP_POP);
 
   } else if (fn_type == FUNC_METHOD || fn_type == FUNC_CONSTRUCTOR) {
@@ -3585,40 +4554,113 @@ static void compilePureExpression(Compiler* compiler) {
   compiler->can_define = can_define;
 }
 
+// Returns 1 or 0 if the condition compiled from [start] is a literal (ex: a
+// constant declared with the const statement) which is true or false, -1 if
+// it's not known at compile time.
+static int compilerConstCondition(Compiler* compiler, uint32_t start) {
+  Var value;
+  uint32_t length = 0;
+  if (!readLiteralPush(compiler, start, &value, &length))
+    return -1;
+  if (start + length != _FN->opcodes.count)
+    return -1;
+  return toBool(value) ? 1 : 0;
+}
+
+// Discard the code compiled from [start] which will never be executed (ex:
+// the body of if DEBUG then ... end). The breaks of the enclosing loops and the
+// captures in the code are dropped with it.
+static void compilerDropCode(Compiler* compiler, uint32_t start) {
+  if (compiler->parser.has_errors)
+    return;
+
+  _FN->opcodes.count = start;
+  _FN->oplines.count = start;
+
+  for (Loop* loop = compiler->loop; loop != NULL; loop = loop->outer_loop) {
+    while (loop->patch_count > 0 && loop->patches[loop->patch_count - 1] >= (int) start) {
+      loop->patch_count--;
+    }
+  }
+
+  UintBuffer* captures = &compiler->func->captures;
+  while (captures->count > 0 && captures->data[captures->count - 1] >= start) {
+    captures->count--;
+  }
+
+  UintBuffer* inlines = &_FN->inlines;
+  while (inlines->count > 0 && inlines->data[inlines->count - 3] >= start) {
+    inlines->count -= 3;
+  }
+
+  Func* func = compiler->func;
+  func->attrib_pos = -1;
+  func->jump_target = -1;
+  func->this_pos = -1;
+  func->global_pos = -1;
+  func->const_pos = -1;
+}
+
 static void compileIfStatement(Compiler* compiler, bool elif) {
   skipNewLines(compiler);
+  uint32_t cond_start = _FN->opcodes.count;
   compilePureExpression(compiler); //< Condition.
 
-  emitOpcode(compiler, OP_JUMP_IF_NOT);
-  int ifpatch = emitShort(compiler, 0xffff); //< Will be patched.
+  // The condition is known at compile time, only the branch which will be
+  // executed is compiled.
+  int condition = compilerConstCondition(compiler, cond_start);
+  if (condition >= 0) {
+    compilerDropCode(compiler, cond_start);
+    compilerChangeStack(compiler, -1);
 
-  compileBlockBody(compiler, BLOCK_IF);
+    uint32_t then_start = _FN->opcodes.count;
+    compileBlockBody(compiler, BLOCK_IF);
+    if (condition == 0)
+      compilerDropCode(compiler, then_start);
+
+    uint32_t else_start = _FN->opcodes.count;
+    if (match(compiler, TK_ELIF)) {
+      compilerEnterBlock(compiler);
+      compileIfStatement(compiler, true);
+      compilerExitBlock(compiler);
+    } else if (match(compiler, TK_ELSE)) {
+      compileBlockBody(compiler, BLOCK_ELSE);
+    }
+    if (condition == 1)
+      compilerDropCode(compiler, else_start);
 
-  if (match(compiler, TK_ELIF)) {
-    // Jump pass else.
-    emitOpcode(compiler, OP_JUMP);
-    int exit_jump = emitShort(compiler, 0xffff); //< Will be patched.
+  } else {
+    emitOpcode(compiler, OP_JUMP_IF_NOT);
+    int ifpatch = emitShort(compiler, 0xffff); //< Will be patched.
 
-    // if (false) jump here.
-    patchJump(compiler, ifpatch);
+    compileBlockBody(compiler, BLOCK_IF);
 
-    compilerEnterBlock(compiler);
-    compileIfStatement(compiler, true);
-    compilerExitBlock(compiler);
+    if (match(compiler, TK_ELIF)) {
+      // Jump pass else.
+      emitOpcode(compiler, OP_JUMP);
+      int exit_jump = emitShort(compiler, 0xffff); //< Will be patched.
 
-    patchJump(compiler, exit_jump);
+      // if (false) jump here.
+      patchJump(compiler, ifpatch);
 
-  } else if (match(compiler, TK_ELSE)) {
-    // Jump pass else.
-    emitOpcode(compiler, OP_JUMP);
-    int exit_jump = emitShort(compiler, 0xffff); //< Will be patched.
+      compilerEnterBlock(compiler);
+      compileIfStatement(compiler, true);
+      compilerExitBlock(compiler);
 
-    patchJump(compiler, ifpatch);
-    compileBlockBody(compiler, BLOCK_ELSE);
-    patchJump(compiler, exit_jump);
+      patchJump(compiler, exit_jump);
 
-  } else {
-    patchJump(compiler, ifpatch);
+    } else if (match(compiler, TK_ELSE)) {
+      // Jump pass else.
+      emitOpcode(compiler, OP_JUMP);
+      int exit_jump = emitShort(compiler, 0xffff); //< Will be patched.
+
+      patchJump(compiler, ifpatch);
+      compileBlockBody(compiler, BLOCK_ELSE);
+      patchJump(compiler, exit_jump);
+
+    } else {
+      patchJump(compiler, ifpatch);
+    }
   }
 
   // elif will not consume the 'end' keyword as it'll be leaved to be consumed
@@ -3666,6 +4708,15 @@ static void compileForStatement(Compiler* compiler) {
   int iter_len = compiler->parser.previous.length;
   int iter_line = compiler->parser.previous.line;
 
+  // The two variable form (for k, v in seq) gets the key and the value.
+  const char* value_name = NULL;
+  int value_len = 0;
+  if (match(compiler, TK_COMMA)) {
+    consume(compiler, TK_NAME, "Expected a value name after ','.");
+    value_name = compiler->parser.previous.start;
+    value_len = compiler->parser.previous.length;
+  }
+
   consume(compiler, TK_IN, "Expected 'in' after iterator name.");
 
   // Compile and store sequence.
@@ -3679,12 +4730,22 @@ static void compileForStatement(Compiler* compiler) {
 
   // Add the iteration value. It'll be updated to each element in an array of
   // each character in a string etc.
-  compilerAddVariable(compiler, iter_name, iter_len, iter_line); // Iter value.
+  int iter_local = compilerAddVariable(compiler, iter_name, iter_len, iter_line); // Iter value.
   emitOpcode(compiler, OP_PUSH_NULL);
 
   // Start the iteration, and check if the sequence is iterable.
   emitOpcode(compiler, OP_ITER_TEST);
 
+  if (value_name != NULL) {
+    compilerAddVariable(compiler, value_name, value_len, iter_line); // Value.
+    emitOpcode(compiler, OP_PUSH_NULL);
+  }
+
+  // The iteration locals are updated by the ITER instructions.
+  for (int i = iter_local; i < compiler->func->local_count; i++) {
+    compiler->func->locals[i].is_assigned = true;
+  }
+
   Loop loop;
   loop.start = (int) _FN->opcodes.count;
   loop.patch_count = 0;
@@ -3693,7 +4754,7 @@ static void compileForStatement(Compiler* compiler) {
   compiler->loop = &loop;
 
   // Compile next iteration.
-  emitOpcode(compiler, OP_ITER);
+  emitOpcode(compiler, (value_name != NULL) ? OP_ITER2 : OP_ITER);
   int forpatch = emitShort(compiler, 0xffff);
 
   compileBlockBody(compiler, BLOCK_LOOP);
@@ -3712,6 +4773,81 @@ static void compileForStatement(Compiler* compiler) {
   compilerExitBlock(compiler); //< Iterator scope.
 }
 
+// Compiles a destructuring assignment:
+//
+//     a, b = pair   # Unpack a tuple (or a list) of 2 elements.
+//     a, b = b, a   # The values are already on the stack, no tuple needed.
+//
+// The new locals are defined (pushed) before compiling the value so their
+// slots are in the order of the names, then each value is stored to its name
+// from the last one.
+static void compileDestructuring(Compiler* compiler) {
+  NameDefnType types[MAX_UNPACK_NAMES];
+  int indexes[MAX_UNPACK_NAMES];
+
+  int count = 0;
+  do {
+    consume(compiler, TK_NAME, "Expected a name to assign.");
+    if (compiler->parser.has_syntax_error)
+      return;
+
+    Token tkname = compiler->parser.previous;
+    if (count == MAX_UNPACK_NAMES) {
+      error(compiler, "Too many names to assign (max " STRINGIFY(MAX_UNPACK_NAMES) ").");
+      return;
+    }
+
+    NameSearchResult result = compilerSearchName(compiler, tkname.start, tkname.length);
+    NameDefnType type = result.type;
+    int index = result.index;
+
+    // Same as a single assignment, see exprName().
+    if (type == NAME_NOT_DEFINED || type == NAME_BUILTIN_FN || type == NAME_BUILTIN_TY) {
+      if (compiler->func->type == FUNC_MAIN && compiler->scope_depth == DEPTH_GLOBAL) {
+        type = NAME_GLOBAL_VAR;
+        index = compilerAddGlobalName(compiler, tkname.start, tkname.length);
+      } else {
+        type = NAME_LOCAL_VAR;
+        index = compilerAddVariable(compiler, tkname.start, tkname.length, tkname.line);
+        emitOpcode(compiler, OP_PUSH_NULL);
+      }
+    }
+
+    types[count] = type;
+    indexes[count] = index;
+    count++;
+  } while (match(compiler, TK_COMMA));
+
+  consume(compiler, TK_EQ, "Expected '=' after the names to assign.");
+  skipNewLines(compiler);
+
+  compilePureExpression(compiler);
+  if (match(compiler, TK_COMMA)) {
+    int values = 1;
+    do {
+      skipNewLines(compiler);
+      compilePureExpression(compiler);
+      values++;
+    } while (match(compiler, TK_COMMA));
+
+    if (values != count) {
+      semanticError(compiler, compiler->parser.previous,
+                    "Expected %d values to assign, got %d.", count, values);
+    }
+  } else {
+    emitOpcode(compiler, OP_UNPACK);
+    emitShort(compiler, count);
+    compilerChangeStack(compiler, count - 1);
+  }
+
+  for (int i = count - 1; i >= 0; i--) {
+    emitStoreValue(compiler, types[i], indexes[i]);
+    emitOpcode(compiler, OP_POP);
+  }
+
+  consumeEndStatement(compiler);
+}
+
 // Compiles a statement. Assignment could be an assignment statement or a new
 // variable declaration, which will be handled.
 static void compileStatement(Compiler* compiler) {
@@ -3727,6 +4863,10 @@ static void compileStatement(Compiler* compiler) {
     lexToken(compiler); // Consume TK_FUNCTION.
     compileNamedFunctionStatement(compiler);
 
+  } else if (match(compiler, TK_CONST)) {
+    error(compiler, "Constants can only be declared at the top level.");
+    return;
+
   } else if (match(compiler, TK_BREAK)) {
     if (compiler->loop == NULL) {
       error(compiler, "Cannot use 'break' outside a loop.");
@@ -3785,9 +4925,15 @@ static void compileStatement(Compiler* compiler) {
       if (compiler->is_last_call) {
         // Tail call optimization disabled at debug mode.
         if (compiler->options && !compiler->options->debug) {
-          ASSERT(_FN->opcodes.count >= 2, OOPS); // OP_CALL, argc
-          ASSERT(_FN->opcodes.data[_FN->opcodes.count - 2] == OP_CALL, OOPS);
-          _FN->opcodes.data[_FN->opcodes.count - 2] = OP_TAIL_CALL;
+          if (compiler->is_direct_call) {
+            ASSERT(_FN->opcodes.count >= 4, OOPS); // OP_CALL_DIRECT, argc, name
+            ASSERT(_FN->opcodes.data[_FN->opcodes.count - 4] == OP_CALL_DIRECT, OOPS);
+            _FN->opcodes.data[_FN->opcodes.count - 4] = OP_TAIL_CALL_DIRECT;
+          } else {
+            ASSERT(_FN->opcodes.count >= 2, OOPS); // OP_CALL, argc
+            ASSERT(_FN->opcodes.data[_FN->opcodes.count - 2] == OP_CALL, OOPS);
+            _FN->opcodes.data[_FN->opcodes.count - 2] = OP_TAIL_CALL;
+          }
         }
       }
 
@@ -3803,6 +4949,9 @@ static void compileStatement(Compiler* compiler) {
   } else if (match(compiler, TK_FOR)) {
     compileForStatement(compiler);
 
+  } else if (peek(compiler) == TK_NAME && compiler->parser.next.type == TK_COMMA) {
+    compileDestructuring(compiler);
+
   } else {
     compiler->new_local = false;
     compileExpression(compiler);
@@ -3873,6 +5022,45 @@ static void compileNamedFunctionStatement(Compiler* compiler) {
   emitOpcode(compiler, OP_POP);
 }
 
+// Compile a constant declaration (const NAME = value), the value should be a
+// null, bool, number or string literal once folded (it could use the other
+// constants). It's stored as a global as well but the uses of it after the
+// declaration are replaced with the value and it cannot be assigned again.
+static void compileConstStatement(Compiler* compiler) {
+  consume(compiler, TK_NAME, "Expected a name after 'const'.");
+  Token name = compiler->parser.previous;
+  consume(compiler, TK_EQ, "Expected '=' after the constant name.");
+  skipNewLines(compiler);
+
+  NameSearchResult result = compilerSearchName(compiler, name.start, name.length);
+  if (result.type == NAME_GLOBAL_VAR) {
+    semanticError(compiler, name, "Name '%.*s' already exists.", name.length, name.start);
+  }
+  int index = compilerAddGlobalName(compiler, name.start, (uint32_t) name.length);
+
+  uint32_t start = _FN->opcodes.count;
+  compilePureExpression(compiler);
+
+  Var value = VAR_NULL;
+  uint32_t length = 0;
+  if (!readLiteralPush(compiler, start, &value, &length) || start + length != _FN->opcodes.count) {
+    semanticError(compiler, name, "Value of the constant '%.*s' isn't a constant expression.",
+                  name.length, name.start);
+  }
+
+  compilerDefineGlobal(compiler, index, -1);
+  emitOpcode(compiler, OP_STORE_GLOBAL_NAME);
+  emitShort(compiler, index);
+  emitOpcode(compiler, OP_POP);
+  consumeEndStatement(compiler);
+
+  if (!compiler->parser.has_errors) {
+    UintBufferWrite(&compiler->global_consts, compiler->parser.vm, (uint32_t) index);
+    UintBufferWrite(&compiler->global_consts, compiler->parser.vm,
+                    (uint32_t) compilerAddConstant(compiler, value));
+  }
+}
+
 // Compile statements that are only valid at the top level of the module. Such
 // as import statement, function define, and if we're running REPL mode top
 // level expression's evaluated value will be printed.
@@ -3894,6 +5082,9 @@ static void compileTopLevelStatement(Compiler* compiler) {
   } else if (match(compiler, TK_FROM)) {
     compileFromImport(compiler);
 
+  } else if (match(compiler, TK_CONST)) {
+    compileConstStatement(compiler);
+
   } else {
     compileStatement(compiler);
   }
@@ -3908,6 +5099,7 @@ CompileOptions newCompilerOptions() {
   options.debug = false;
   options.repl_mode = false;
   options.runtime = false;
+  options.optimize_level = 0;
   return options;
 }
 
@@ -3959,6 +5151,7 @@ Result compile(VM* vm, Module* module, const char* source, const CompileOptions*
   }
 
   emitFunctionEnd(compiler);
+  UintBufferClear(&curr_fn.captures, vm);
 
   vm->compiler = compiler->next_compiler;
 
@@ -3966,6 +5159,21 @@ Result compile(VM* vm, Module* module, const char* source, const CompileOptions*
   if (compiler->parser.has_errors) {
     module->constants.count = constants_count;
     module->globals.count = module->global_names.count = globals_count;
+
+  } else {
+    int optimize_level = compilerOptimizeLevel(compiler);
+    if (optimize_level > 0) {
+      for (uint32_t i = constants_count; i < module->constants.count; i++) {
+        Var constant = module->constants.data[i];
+        if (!IS_OBJ_TYPE(constant, OBJ_FUNC))
+          continue;
+        Function* fn = (Function*) AS_OBJ(constant);
+        if (fn->owner == module && fn != module->body->fn) {
+          optimizeFunction(vm, fn, optimize_level);
+        }
+      }
+      optimizeFunction(vm, module->body->fn, optimize_level);
+    }
   }
 #if DUMP_BYTECODE
   else {
@@ -3980,12 +5188,18 @@ Result compile(VM* vm, Module* module, const char* source, const CompileOptions*
   if (compiler->parser.has_errors) {
     if (compiler->parser.repl_mode && compiler->parser.need_more_lines) {
       UintBufferClear(&compiler->global_names, vm);
+      UintBufferClear(&compiler->global_defns, vm);
+      UintBufferClear(&compiler->global_consts, vm);
       return RESULT_UNEXPECTED_EOF;
     }
     UintBufferClear(&compiler->global_names, vm);
+    UintBufferClear(&compiler->global_defns, vm);
+    UintBufferClear(&compiler->global_consts, vm);
     return RESULT_COMPILE_ERROR;
   }
   UintBufferClear(&compiler->global_names, vm);
+  UintBufferClear(&compiler->global_defns, vm);
+  UintBufferClear(&compiler->global_consts, vm);
   return RESULT_SUCCESS;
 }
 
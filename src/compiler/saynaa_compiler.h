@@ -37,6 +37,10 @@ typedef struct {
   // compile at runtime.
   bool runtime;
 
+  // Level of the optimizations run over the compiled functions (see
+  // saynaa_optimizer.h), 0 means the bytecode is used as it's emitted.
+  int optimize_level;
+
 } CompileOptions;
 
 // Create a new CompilerOptions with the default values and return it.
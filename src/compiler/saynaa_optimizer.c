@@ -0,0 +1,678 @@
+/*
+ * Copyright (c) 2022-2026 Mohamed Abdifatah. All rights reserved.
+ * Distributed Under The MIT License
+ */
+
+#include "saynaa_optimizer.h"
+
+#include "../runtime/saynaa_vm.h"
+#include "saynaa_compiler.h"
+
+// The passes are repeated till nothing changes (a rewrite could enable an
+// other one) but not more than this many times.
+#define MAX_OPTIMIZE_ROUNDS 8
+
+// Max number of jumps followed in a chain while threading a jump.
+#define MAX_THREAD_DEPTH 16
+
+static const uint8_t kParamSizes[] = {
+#define OPCODE(name, params, stack) params,
+#include "../shared/saynaa_opcodes.h"
+#undef OPCODE
+};
+
+// A decoded instruction of the function.
+typedef struct {
+  uint8_t op;     //< The opcode, could be changed by the passes.
+  uint32_t pos;   //< Position of the opcode in the original code.
+  uint32_t size;  //< Number of param bytes (including the closure captures).
+  uint32_t line;  //< Source line of the instruction.
+  int target;     //< Index of the jump target instruction, -1 if not a jump.
+  bool removed;   //< True if it won't be emitted.
+  bool is_target; //< True if it's a target of a jump.
+} Instr;
+
+typedef struct {
+  VM* vm;
+  Function* fn;
+
+  Instr* instrs;
+  uint32_t count;
+
+  // Set by the passes when they rewrite an instruction.
+  bool changed;
+} Optimizer;
+
+static bool isJump(uint8_t op) {
+  switch ((Opcode) op) {
+    case OP_JUMP:
+    case OP_LOOP:
+    case OP_JUMP_IF:
+    case OP_JUMP_IF_NOT:
+    case OP_OR:
+    case OP_AND:
+    case OP_ITER:
+    case OP_ITER2:
+    case OP_INLINE_CALL:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static uint16_t readShort(const uint8_t* code) {
+  return (uint16_t) ((code[0] << 8) | code[1]);
+}
+
+// The jump offset is the last param of a jump instruction (OP_INLINE_CALL has
+// the call params before it) and it's relative to the next instruction.
+#define JUMP_OFFSET_POS(m_pos, m_size) ((m_pos) + 1 + (m_size) - 2)
+
+// Returns the param at [instr], which should have a 2 bytes param.
+static uint16_t instrShort(Optimizer* opt, Instr* instr) {
+  return readShort(opt->fn->fn->opcodes.data + instr->pos + 1);
+}
+
+// Returns the local index if [instr] pushes a local otherwise -1.
+static int pushedLocal(Optimizer* opt, Instr* instr) {
+  if (OP_PUSH_LOCAL_0 <= instr->op && instr->op <= OP_PUSH_LOCAL_8)
+    return instr->op - OP_PUSH_LOCAL_0;
+  if (instr->op == OP_PUSH_LOCAL_N)
+    return instrShort(opt, instr);
+  return -1;
+}
+
+// Returns the local index if [instr] stores a local otherwise -1.
+static int storedLocal(Optimizer* opt, Instr* instr) {
+  if (OP_STORE_LOCAL_0 <= instr->op && instr->op <= OP_STORE_LOCAL_8)
+    return instr->op - OP_STORE_LOCAL_0;
+  if (instr->op == OP_STORE_LOCAL_N)
+    return instrShort(opt, instr);
+  return -1;
+}
+
+// Returns true if the instruction only pushes a value without any side
+// effects, so a push followed by a pop is a no-op.
+static bool isPurePush(Instr* instr) {
+  switch ((Opcode) instr->op) {
+    case OP_PUSH_CONSTANT:
+    case OP_PUSH_NULL:
+    case OP_PUSH_0:
+    case OP_PUSH_TRUE:
+    case OP_PUSH_FALSE:
+    case OP_DUP:
+    case OP_PUSH_LOCAL_0:
+    case OP_PUSH_LOCAL_1:
+    case OP_PUSH_LOCAL_2:
+    case OP_PUSH_LOCAL_3:
+    case OP_PUSH_LOCAL_4:
+    case OP_PUSH_LOCAL_5:
+    case OP_PUSH_LOCAL_6:
+    case OP_PUSH_LOCAL_7:
+    case OP_PUSH_LOCAL_8:
+    case OP_PUSH_LOCAL_N:
+    case OP_PUSH_GLOBAL:
+    case OP_PUSH_BUILTIN_FN:
+    case OP_PUSH_BUILTIN_TY:
+    case OP_PUSH_UPVALUE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// If [instr] pushes a literal, set its truthiness to [truth] and return true.
+static bool literalTruth(Optimizer* opt, Instr* instr, bool* truth) {
+  switch ((Opcode) instr->op) {
+    case OP_PUSH_NULL:
+    case OP_PUSH_0:
+    case OP_PUSH_FALSE:
+      *truth = false;
+      return true;
+
+    case OP_PUSH_TRUE:
+      *truth = true;
+      return true;
+
+    case OP_PUSH_CONSTANT:
+      {
+        uint16_t index = instrShort(opt, instr);
+        ASSERT_INDEX(index, opt->fn->owner->constants.count);
+        *truth = toBool(opt->fn->owner->constants.data[index]);
+        return true;
+      }
+
+    default:
+      return false;
+  }
+}
+
+// Returns the index of the first instruction at or after [index] which isn't
+// removed. The last instruction (OP_END) is never removed.
+static int nextKept(Optimizer* opt, int index) {
+  while ((uint32_t) index < opt->count && opt->instrs[index].removed)
+    index++;
+  return index;
+}
+
+// Returns the index of the last instruction before [index] which isn't
+// removed or -1.
+static int prevKept(Optimizer* opt, int index) {
+  index--;
+  while (index >= 0 && opt->instrs[index].removed)
+    index--;
+  return index;
+}
+
+static void removeInstr(Optimizer* opt, Instr* instr) {
+  instr->removed = true;
+  opt->changed = true;
+}
+
+// Decode the function's opcodes into [opt->instrs] and resolve the jump
+// targets. Returns false if the code couldn't be decoded.
+static bool decodeFunction(Optimizer* opt) {
+  Fn* fn = opt->fn->fn;
+  const uint8_t* code = fn->opcodes.data;
+  uint32_t count = fn->opcodes.count;
+  Module* module = opt->fn->owner;
+
+  if (count == 0 || code[count - 1] != OP_END)
+    return false;
+
+  // Instruction index of each position in the code, -1 if there isn't any
+  // instruction starting at the position.
+  int* index = vmRealloc(opt->vm, NULL, 0, sizeof(int) * count);
+  for (uint32_t i = 0; i < count; i++)
+    index[i] = -1;
+
+  // There can't be more instructions than the bytes.
+  opt->instrs = vmRealloc(opt->vm, NULL, 0, sizeof(Instr) * count);
+  opt->count = 0;
+
+  bool valid = true;
+  uint32_t ip = 0;
+  while (ip < count) {
+    uint8_t op = code[ip];
+    if (op > OP_END) {
+      valid = false;
+      break;
+    }
+
+    // OP_ITER is declared with the iterate type param but only the jump
+    // offset is emitted, see compileForStatement().
+    uint32_t size = (op == OP_ITER) ? 2 : kParamSizes[op];
+    if (op == OP_PUSH_CLOSURE) {
+      if (ip + 3 > count) {
+        valid = false;
+        break;
+      }
+      uint16_t fn_index = readShort(code + ip + 1);
+      if (fn_index >= module->constants.count
+          || !IS_OBJ_TYPE(module->constants.data[fn_index], OBJ_FUNC)) {
+        valid = false;
+        break;
+      }
+      Function* closure_fn = (Function*) AS_OBJ(module->constants.data[fn_index]);
+      size += (uint32_t) closure_fn->upvalue_count * 3;
+    }
+
+    if (ip + 1 + size > count) {
+      valid = false;
+      break;
+    }
+
+    Instr* instr = &opt->instrs[opt->count];
+    instr->op = op;
+    instr->pos = ip;
+    instr->size = size;
+    instr->line = fn->oplines.data[ip];
+    instr->target = -1;
+    instr->removed = false;
+    instr->is_target = false;
+
+    index[ip] = (int) opt->count++;
+    ip += 1 + size;
+  }
+
+  for (uint32_t i = 0; valid && i < opt->count; i++) {
+    Instr* instr = &opt->instrs[i];
+    if (!isJump(instr->op))
+      continue;
+
+    uint32_t offset = readShort(code + JUMP_OFFSET_POS(instr->pos, instr->size));
+    uint32_t from = instr->pos + 1 + instr->size;
+    if (instr->op == OP_LOOP && offset > from) {
+      valid = false;
+      break;
+    }
+
+    uint32_t target = (instr->op == OP_LOOP) ? from - offset : from + offset;
+    if (target >= count || index[target] < 0) {
+      valid = false;
+      break;
+    }
+    instr->target = index[target];
+  }
+
+  vmRealloc(opt->vm, index, sizeof(int) * count, 0);
+  return valid;
+}
+
+// Point the jumps to the removed instructions to the next one (which will be
+// at the same position once emitted) and mark the jump targets.
+static void resolveTargets(Optimizer* opt) {
+  for (uint32_t i = 0; i < opt->count; i++) {
+    opt->instrs[i].is_target = false;
+  }
+
+  for (uint32_t i = 0; i < opt->count; i++) {
+    Instr* instr = &opt->instrs[i];
+    if (instr->removed || instr->target < 0)
+      continue;
+    instr->target = nextKept(opt, instr->target);
+    opt->instrs[instr->target].is_target = true;
+  }
+}
+
+/*****************************************************************************/
+/* PASSES                                                                    */
+/*****************************************************************************/
+
+// A jump to an unconditional jump goes directly to it's target, an 'and' /
+// 'or' jumping to the same test will have the same result and a jump to a
+// return is just a return.
+static void threadJumps(Optimizer* opt) {
+  for (uint32_t i = 0; i < opt->count; i++) {
+    Instr* instr = &opt->instrs[i];
+    if (instr->removed || instr->target < 0)
+      continue;
+
+    bool unconditional = (instr->op == OP_JUMP || instr->op == OP_LOOP);
+
+    for (int depth = 0; depth < MAX_THREAD_DEPTH; depth++) {
+      Instr* target = &opt->instrs[instr->target];
+
+      int next = -1;
+      if (target->op == OP_JUMP || target->op == OP_LOOP) {
+        next = nextKept(opt, target->target);
+      } else if ((instr->op == OP_AND || instr->op == OP_OR) && target->op == instr->op) {
+        next = nextKept(opt, target->target);
+      }
+
+      if (next < 0 || next == instr->target)
+        break;
+
+      // Only the unconditional jumps could go backward (as OP_LOOP).
+      if (!unconditional && next <= (int) i)
+        break;
+
+      instr->target = next;
+      opt->changed = true;
+    }
+
+    if (unconditional && opt->instrs[instr->target].op == OP_RETURN) {
+      instr->op = OP_RETURN;
+      instr->size = 0;
+      instr->target = -1;
+      opt->changed = true;
+    }
+  }
+}
+
+// A conditional jump over an unconditional (forward) jump is the inverted
+// conditional jump to the target of that jump.
+static void invertBranches(Optimizer* opt) {
+  for (uint32_t i = 0; i < opt->count; i++) {
+    Instr* instr = &opt->instrs[i];
+    if (instr->removed || (instr->op != OP_JUMP_IF && instr->op != OP_JUMP_IF_NOT))
+      continue;
+
+    int next = nextKept(opt, (int) i + 1);
+    Instr* jump = &opt->instrs[next];
+    if (jump->op != OP_JUMP || jump->is_target || jump->target <= (int) i)
+      continue;
+    if (instr->target != nextKept(opt, next + 1))
+      continue;
+
+    instr->op = (instr->op == OP_JUMP_IF) ? OP_JUMP_IF_NOT : OP_JUMP_IF;
+    instr->target = jump->target;
+    removeInstr(opt, jump);
+  }
+}
+
+// A literal followed by a conditional jump either always or never jumps.
+static void foldConstantBranches(Optimizer* opt) {
+  for (uint32_t i = 0; i < opt->count; i++) {
+    Instr* instr = &opt->instrs[i];
+    if (instr->removed || instr->is_target)
+      continue;
+
+    if (instr->op != OP_JUMP_IF && instr->op != OP_JUMP_IF_NOT && instr->op != OP_AND
+        && instr->op != OP_OR) {
+      continue;
+    }
+
+    int prev = prevKept(opt, (int) i);
+    bool truth;
+    if (prev < 0 || !literalTruth(opt, &opt->instrs[prev], &truth))
+      continue;
+
+    bool jumps = (instr->op == OP_JUMP_IF || instr->op == OP_OR) ? truth : !truth;
+
+    if (instr->op == OP_JUMP_IF || instr->op == OP_JUMP_IF_NOT) {
+      // The tested value is popped either way.
+      removeInstr(opt, &opt->instrs[prev]);
+      if (jumps)
+        instr->op = OP_JUMP;
+      else
+        removeInstr(opt, instr);
+
+    } else {
+      // The value is kept if it jumps, otherwise it's popped.
+      if (jumps) {
+        instr->op = OP_JUMP;
+        opt->changed = true;
+      } else {
+        removeInstr(opt, &opt->instrs[prev]);
+        removeInstr(opt, instr);
+      }
+    }
+  }
+}
+
+// Remove the instructions which can't be reached from the function entry.
+static void removeUnreachable(Optimizer* opt) {
+  bool* reached = vmRealloc(opt->vm, NULL, 0, sizeof(bool) * opt->count);
+  int* stack = vmRealloc(opt->vm, NULL, 0, sizeof(int) * opt->count);
+  int sp = 0;
+
+  for (uint32_t i = 0; i < opt->count; i++)
+    reached[i] = false;
+
+#define REACH(m_index) \
+  do { \
+    int _index = nextKept(opt, (m_index)); \
+    if ((uint32_t) _index < opt->count && !reached[_index]) { \
+      reached[_index] = true; \
+      stack[sp++] = _index; \
+    } \
+  } while (false)
+
+  REACH(0);
+  while (sp > 0) {
+    Instr* instr = &opt->instrs[stack[--sp]];
+    if (instr->target >= 0)
+      REACH(instr->target);
+
+    switch ((Opcode) instr->op) {
+      case OP_JUMP:
+      case OP_LOOP:
+      case OP_RETURN:
+      case OP_END:
+        break;
+      default:
+        REACH((int) (instr - opt->instrs) + 1);
+        break;
+    }
+  }
+
+#undef REACH
+
+  for (uint32_t i = 0; i < opt->count; i++) {
+    Instr* instr = &opt->instrs[i];
+    if (!instr->removed && !reached[i] && instr->op != OP_END)
+      removeInstr(opt, instr);
+  }
+
+  vmRealloc(opt->vm, stack, sizeof(int) * opt->count, 0);
+  vmRealloc(opt->vm, reached, sizeof(bool) * opt->count, 0);
+}
+
+// Remove the instructions that doesn't change anything: a jump to the next
+// instruction, a pure push followed by a pop, and a local loaded right after
+// it's stored (the stored value is still at the stack top).
+static void removeNoops(Optimizer* opt) {
+  for (uint32_t i = 0; i < opt->count; i++) {
+    Instr* instr = &opt->instrs[i];
+    if (instr->removed)
+      continue;
+
+    int next = nextKept(opt, (int) i + 1);
+    if ((uint32_t) next >= opt->count)
+      break;
+    Instr* after = &opt->instrs[next];
+
+    if (instr->target >= 0 && instr->target == next) {
+      if (instr->op == OP_JUMP) {
+        removeInstr(opt, instr);
+      } else if (instr->op == OP_JUMP_IF || instr->op == OP_JUMP_IF_NOT) {
+        instr->op = OP_POP;
+        instr->size = 0;
+        instr->target = -1;
+        opt->changed = true;
+      }
+      continue;
+    }
+
+    if (after->is_target)
+      continue;
+
+    if (isPurePush(instr) && after->op == OP_POP) {
+      removeInstr(opt, instr);
+      removeInstr(opt, after);
+      continue;
+    }
+
+    int local = storedLocal(opt, instr);
+    if (local >= 0 && after->op == OP_POP) {
+      int load = nextKept(opt, next + 1);
+      if ((uint32_t) load < opt->count && !opt->instrs[load].is_target
+          && pushedLocal(opt, &opt->instrs[load]) == local) {
+        removeInstr(opt, after);
+        removeInstr(opt, &opt->instrs[load]);
+      }
+    }
+  }
+}
+
+// Remove the stores to the locals which are never read in the function.
+static void removeDeadStores(Optimizer* opt) {
+  // A bit for each local index (which is a 2 bytes param).
+  const size_t size = (UINT16_MAX + 1) / 8;
+  uint8_t* read = vmRealloc(opt->vm, NULL, 0, size);
+  memset(read, 0, size);
+
+#define MARK_READ(m_index) read[(m_index) / 8] |= (uint8_t) (1 << ((m_index) % 8))
+#define IS_READ(m_index) (read[(m_index) / 8] & (1 << ((m_index) % 8)))
+
+  const uint8_t* code = opt->fn->fn->opcodes.data;
+  for (uint32_t i = 0; i < opt->count; i++) {
+    Instr* instr = &opt->instrs[i];
+    if (instr->removed)
+      continue;
+
+    int local = pushedLocal(opt, instr);
+    if (local >= 0) {
+      MARK_READ(local);
+      continue;
+    }
+
+    switch ((Opcode) instr->op) {
+      case OP_LIST_RESERVE:
+      case OP_LIST_APPEND_LOCAL:
+      case OP_MAP_INSERT_LOCAL:
+        MARK_READ(instrShort(opt, instr));
+        break;
+
+      case OP_PUSH_CLOSURE:
+        // The captures are 1 byte type and 2 bytes index after the function
+        // index.
+        for (uint32_t pos = instr->pos + 3; pos < instr->pos + 1 + instr->size; pos += 3) {
+          if (code[pos] == CAPTURE_LOCAL || code[pos] == CAPTURE_COPY) {
+            MARK_READ(readShort(code + pos + 1));
+          }
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  for (uint32_t i = 0; i < opt->count; i++) {
+    Instr* instr = &opt->instrs[i];
+    if (instr->removed)
+      continue;
+
+    // The stored value stays at the stack top, only the store is removed.
+    int local = storedLocal(opt, instr);
+    if (local >= 0 && !IS_READ(local))
+      removeInstr(opt, instr);
+  }
+
+#undef MARK_READ
+#undef IS_READ
+
+  vmRealloc(opt->vm, read, size, 0);
+}
+
+/*****************************************************************************/
+/* EMITTING                                                                  */
+/*****************************************************************************/
+
+// Emit the instructions which aren't removed and replace the function's code.
+// Returns false (and doesn't change the function) if a jump doesn't fit.
+static bool emitFunction(Optimizer* opt) {
+  Fn* fn = opt->fn->fn;
+  VM* vm = opt->vm;
+
+  uint32_t* positions = vmRealloc(vm, NULL, 0, sizeof(uint32_t) * opt->count);
+  uint32_t pos = 0;
+  for (uint32_t i = 0; i < opt->count; i++) {
+    positions[i] = pos;
+    if (!opt->instrs[i].removed)
+      pos += 1 + opt->instrs[i].size;
+  }
+
+  ByteBuffer opcodes;
+  UintBuffer oplines;
+  ByteBufferInit(&opcodes);
+  UintBufferInit(&oplines);
+  ByteBufferReserve(&opcodes, vm, pos);
+  UintBufferReserve(&oplines, vm, pos);
+
+  bool valid = true;
+  for (uint32_t i = 0; i < opt->count && valid; i++) {
+    Instr* instr = &opt->instrs[i];
+    if (instr->removed)
+      continue;
+
+    uint8_t op = instr->op;
+    if (instr->target >= 0) {
+      uint32_t from = positions[i] + 1 + instr->size;
+      uint32_t target = positions[instr->target];
+
+      if (op == OP_JUMP || op == OP_LOOP) {
+        op = (target >= from) ? OP_JUMP : OP_LOOP;
+      } else if (target < from) {
+        valid = false;
+        break;
+      }
+
+      uint32_t offset = (op == OP_LOOP) ? from - target : target - from;
+      if (offset > UINT16_MAX) {
+        valid = false;
+        break;
+      }
+
+      ByteBufferWrite(&opcodes, vm, op);
+      for (uint32_t j = 0; j < instr->size - 2; j++) {
+        ByteBufferWrite(&opcodes, vm, fn->opcodes.data[instr->pos + 1 + j]);
+      }
+      ByteBufferWrite(&opcodes, vm, (uint8_t) ((offset >> 8) & 0xff));
+      ByteBufferWrite(&opcodes, vm, (uint8_t) (offset & 0xff));
+
+    } else {
+      ByteBufferWrite(&opcodes, vm, op);
+      for (uint32_t j = 0; j < instr->size; j++) {
+        ByteBufferWrite(&opcodes, vm, fn->opcodes.data[instr->pos + 1 + j]);
+      }
+    }
+
+    for (uint32_t j = 0; j <= instr->size; j++) {
+      UintBufferWrite(&oplines, vm, instr->line);
+    }
+  }
+
+  if (!valid) {
+    vmRealloc(vm, positions, sizeof(uint32_t) * opt->count, 0);
+    ByteBufferClear(&opcodes, vm);
+    UintBufferClear(&oplines, vm);
+    return false;
+  }
+
+  // Move the bounds of the inlined code to the first instruction emitted at
+  // or after them.
+  for (uint32_t i = 0; i < fn->inlines.count; i++) {
+    if (i % 3 == 2)
+      continue; // The function index.
+    uint32_t index = 0;
+    while (index < opt->count && opt->instrs[index].pos < fn->inlines.data[i])
+      index++;
+    fn->inlines.data[i] = (index < opt->count) ? positions[index] : pos;
+  }
+
+  vmRealloc(vm, positions, sizeof(uint32_t) * opt->count, 0);
+
+  ByteBufferClear(&fn->opcodes, vm);
+  UintBufferClear(&fn->oplines, vm);
+  fn->opcodes = opcodes;
+  fn->oplines = oplines;
+  return true;
+}
+
+void optimizeFunction(VM* vm, Function* fn, int level) {
+  if (level <= 0 || fn->is_native || fn->fn == NULL)
+    return;
+
+  Optimizer opt;
+  opt.vm = vm;
+  opt.fn = fn;
+  opt.instrs = NULL;
+  opt.count = 0;
+  opt.changed = false;
+
+  uint32_t capacity = fn->fn->opcodes.count;
+  if (decodeFunction(&opt)) {
+    bool changed = false;
+    for (int round = 0; round < MAX_OPTIMIZE_ROUNDS; round++) {
+      opt.changed = false;
+
+      resolveTargets(&opt);
+      threadJumps(&opt);
+      resolveTargets(&opt);
+      invertBranches(&opt);
+      resolveTargets(&opt);
+      foldConstantBranches(&opt);
+      resolveTargets(&opt);
+      removeUnreachable(&opt);
+      resolveTargets(&opt);
+      removeNoops(&opt);
+      removeDeadStores(&opt);
+
+      if (!opt.changed)
+        break;
+      changed = true;
+    }
+
+    if (changed) {
+      resolveTargets(&opt);
+      emitFunction(&opt);
+    }
+  }
+
+  if (opt.instrs != NULL) {
+    vmRealloc(vm, opt.instrs, sizeof(Instr) * capacity, 0);
+  }
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2022-2026 Mohamed Abdifatah. All rights reserved.
+ * Distributed Under The MIT License
+ */
+
+#pragma once
+
+#include "../shared/saynaa_value.h"
+
+// The optimizer is an optional tier which runs over the bytecode of a function
+// once it's compiled (the single pass compiler can only see a few opcodes
+// back). The opcodes are decoded into a list of instructions with resolved
+// jump targets, rewritten and re-emitted as a compact bytecode. The passes
+// are enabled with the compile option [optimize_level] (0 means disabled).
+//
+//   - Jump threading (a jump to a jump, 'and' / 'or' chains, jump to return)
+//     and inverting a conditional jump over a jump.
+//   - Constant propagation into branches (a literal followed by a jump).
+//   - Dead code (unreachable and no-op instructions) and dead store (locals
+//     which are never read) elimination.
+//   - Copy propagation of a stored local into its next load.
+//
+// The small module functions are inlined by the compiler at the same level,
+// see compilerInlineCall().
+//
+// If the function couldn't be decoded or re-emitted, it'll be left unchanged.
+void optimizeFunction(VM* vm, Function* fn, int level);
@@ -631,6 +631,7 @@ Result CompileStringToBytecode(VM* vm, const char* source, SaynaaBytecode* out)
   CompileOptions options = newCompilerOptions();
   // runtime flag it allow to compile code that return value to module body,
   options.runtime = true;
+  options.optimize_level = vm->config.optimize_level;
   Result result = compile(vm, module, source, &options);
 
   if (result == RESULT_SUCCESS) {
@@ -689,6 +690,7 @@ Result RunREPL(VM* vm) {
 
   CompileOptions options = newCompilerOptions();
   options.repl_mode = true;
+  options.optimize_level = vm->config.optimize_level;
 
   if (inputfn == NULL) {
     if (printerrfn)
@@ -1068,6 +1070,35 @@ void* GetSlotNativeInstance(VM* vm, int index) {
   return inst->native;
 }
 
+void* GetSlotTypedArray(VM* vm, int index, uint32_t* length, uint32_t* element_size) {
+  CHECK_FIBER_EXISTS(vm);
+  VALIDATE_SLOT_INDEX(index);
+
+  if (length != NULL)
+    *length = 0;
+  if (element_size != NULL)
+    *element_size = 0;
+
+  Var value = SLOT(index);
+  if (!IS_OBJ_TYPE(value, OBJ_INST))
+    return NULL;
+
+  Instance* inst = (Instance*) AS_OBJ(value);
+  if (inst->cls->typed_kind == TYPED_NONE)
+    return NULL;
+
+  TypedArray* array = (TypedArray*) inst->native;
+  uint8_t* data = typedArrayData(array);
+  if (data == NULL)
+    return NULL;
+
+  if (length != NULL)
+    *length = array->length;
+  if (element_size != NULL)
+    *element_size = typedElementSize(array->kind);
+  return data;
+}
+
 void setSlotNull(VM* vm, int index) {
   CHECK_FIBER_EXISTS(vm);
   VALIDATE_SLOT_INDEX(index);
@@ -1129,7 +1160,7 @@ uint32_t GetSlotHash(VM* vm, int index) {
   CHECK_FIBER_EXISTS(vm);
   VALIDATE_SLOT_INDEX(index);
   Var value = SLOT(index);
-  ASSERT(!IS_OBJ(value) || isObjectHashable(AS_OBJ(value)->type), OOPS);
+  ASSERT(isValueHashable(value), OOPS);
   return varHashValue(value);
 }
 
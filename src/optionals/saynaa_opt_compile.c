@@ -199,6 +199,7 @@ saynaa_function(_compileRun, "Compile.run() -> Null",
     Module* module = (Module*) AS_OBJ(module_var);
     CompileOptions options = newCompilerOptions();
     options.runtime = true;
+    options.optimize_level = vm->config.optimize_level;
     Result status = compile(vm, module, info->source, &options);
     if (status != RESULT_SUCCESS) {
       if (!VM_HAS_ERROR(vm))
@@ -125,27 +125,25 @@ static saynaa_json* _saynaaToCJson(VM* vm, Var item) {
         saynaa_json* obj = saynaa_json_create_object();
 
         bool err = false;
-        MapEntry* e = map->entries;
-        for (; e < map->entries + map->capacity; e++) {
-          if (IS_UNDEF(e->key))
-            continue;
-
-          if (!IS_OBJ_TYPE(e->key, OBJ_STRING)) {
+        Var key, item_value;
+        uint32_t position = 0;
+        while (mapIterate(map, &position, &key, &item_value)) {
+          if (!IS_OBJ_TYPE(key, OBJ_STRING)) {
             SetRuntimeErrorFmt(vm,
                                "Expected string as json object key, "
                                "instead got type '%s'.",
-                               varTypeName(e->key));
+                               varTypeName(key));
             err = true;
             break;
           }
 
-          saynaa_json* value = _saynaaToCJson(vm, e->value);
+          saynaa_json* value = _saynaaToCJson(vm, item_value);
           if (value == NULL) {
             err = true;
             break;
           }
 
-          saynaa_json_add_item_to_object(obj, ((String*) AS_OBJ(e->key))->data, value);
+          saynaa_json_add_item_to_object(obj, ((String*) AS_OBJ(key))->data, value);
         }
 
         if (err) {
@@ -7,6 +7,13 @@
 
 #include <math.h>
 
+// The SIMD kernels are compiled for x86_64 with GCC/Clang where SSE2 is
+// always available and AVX2 is selected at runtime if the CPU supports it.
+#if defined(__GNUC__) && defined(__x86_64__)
+  #define VEC_X86 1
+  #include <immintrin.h>
+#endif
+
 // M_PI is non standard. For a portable solution, we're defining it ourselves.
 #define PI 3.14159265358979323846
 
@@ -219,6 +226,503 @@ saynaa_function(stdMathRandom, "math.random(value:Number, value:Number) -> Numbe
   setSlotNumber(vm, 0, result);
 }
 
+/*****************************************************************************/
+/* VECTOR KERNELS                                                            */
+/*****************************************************************************/
+
+// Bulk operations over arrays of doubles. Each kernel has a scalar, an SSE2
+// and an AVX2 implementation and the best one supported by the CPU is
+// selected when the module is registered. Note that the vectorized sum and
+// dot re-associate the additions so the result could differ from a
+// sequential sum in the last bits.
+
+typedef double (*VecReduceFn)(const double* x, const double* y, uint32_t n);
+typedef void (*VecBinaryFn)(const double* x, const double* y, double* out, uint32_t n);
+typedef void (*VecUnaryFn)(const double* x, double* out, uint32_t n);
+
+typedef struct {
+  const char* name; // Name of the instruction set.
+  double (*sum)(const double* x, uint32_t n);
+  VecReduceFn dot;
+  void (*axpy)(double a, const double* x, double* y, uint32_t n);
+  void (*scale)(double a, double* x, uint32_t n);
+  VecBinaryFn add, mul, min, max;
+  VecUnaryFn sqrt;
+} VecKernels;
+
+static double _vecSumScalar(const double* x, uint32_t n) {
+  double sum = 0;
+  for (uint32_t i = 0; i < n; i++)
+    sum += x[i];
+  return sum;
+}
+
+static double _vecDotScalar(const double* x, const double* y, uint32_t n) {
+  double sum = 0;
+  for (uint32_t i = 0; i < n; i++)
+    sum += x[i] * y[i];
+  return sum;
+}
+
+static void _vecAxpyScalar(double a, const double* x, double* y, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++)
+    y[i] += a * x[i];
+}
+
+static void _vecScaleScalar(double a, double* x, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++)
+    x[i] *= a;
+}
+
+static void _vecSqrtScalar(const double* x, double* out, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++)
+    out[i] = sqrt(x[i]);
+}
+
+// The scalar min/max has the same semantics of the SIMD min/max instructions
+// which returns the second operand if any of them is NaN.
+#define VEC_ADD(a, b) ((a) + (b))
+#define VEC_MUL(a, b) ((a) * (b))
+#define VEC_MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define VEC_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+#define VEC_BINARY_SCALAR(m_name, m_op)                                              \
+  static void m_name(const double* x, const double* y, double* out, uint32_t n) {    \
+    for (uint32_t i = 0; i < n; i++)                                                 \
+      out[i] = m_op(x[i], y[i]);                                                     \
+  }
+
+VEC_BINARY_SCALAR(_vecAddScalar, VEC_ADD)
+VEC_BINARY_SCALAR(_vecMulScalar, VEC_MUL)
+VEC_BINARY_SCALAR(_vecMinScalar, VEC_MIN)
+VEC_BINARY_SCALAR(_vecMaxScalar, VEC_MAX)
+
+#ifdef VEC_X86
+
+// Defines the SSE2 ([m_vec] = 128, [m_pd] = _mm) or the AVX2 ([m_vec] = 256,
+// [m_pd] = _mm256) kernels, [m_width] is the number of doubles in a register.
+  #define VEC_DEFINE_KERNELS(m_isa, m_target, m_type, m_pd, m_width)                   \
+                                                                                       \
+    m_target static double _vecSum##m_isa(const double* x, uint32_t n) {               \
+      m_type s0 = m_pd##_setzero_pd(), s1 = m_pd##_setzero_pd();                       \
+      uint32_t i = 0;                                                                  \
+      for (; i + 2 * m_width <= n; i += 2 * m_width) {                                 \
+        s0 = m_pd##_add_pd(s0, m_pd##_loadu_pd(x + i));                                \
+        s1 = m_pd##_add_pd(s1, m_pd##_loadu_pd(x + i + m_width));                      \
+      }                                                                                \
+      double lanes[m_width], sum = 0;                                                  \
+      m_pd##_storeu_pd(lanes, m_pd##_add_pd(s0, s1));                                  \
+      for (int l = 0; l < m_width; l++)                                                \
+        sum += lanes[l];                                                               \
+      for (; i < n; i++)                                                               \
+        sum += x[i];                                                                   \
+      return sum;                                                                      \
+    }                                                                                  \
+                                                                                       \
+    m_target static double _vecDot##m_isa(const double* x, const double* y,            \
+                                          uint32_t n) {                                \
+      m_type s0 = m_pd##_setzero_pd(), s1 = m_pd##_setzero_pd();                       \
+      uint32_t i = 0;                                                                  \
+      for (; i + 2 * m_width <= n; i += 2 * m_width) {                                 \
+        s0 = m_pd##_add_pd(s0, m_pd##_mul_pd(m_pd##_loadu_pd(x + i),                   \
+                                             m_pd##_loadu_pd(y + i)));                 \
+        s1 = m_pd##_add_pd(s1, m_pd##_mul_pd(m_pd##_loadu_pd(x + i + m_width),         \
+                                             m_pd##_loadu_pd(y + i + m_width)));       \
+      }                                                                                \
+      double lanes[m_width], sum = 0;                                                  \
+      m_pd##_storeu_pd(lanes, m_pd##_add_pd(s0, s1));                                  \
+      for (int l = 0; l < m_width; l++)                                                \
+        sum += lanes[l];                                                               \
+      for (; i < n; i++)                                                               \
+        sum += x[i] * y[i];                                                            \
+      return sum;                                                                      \
+    }                                                                                  \
+                                                                                       \
+    m_target static void _vecAxpy##m_isa(double a, const double* x, double* y,         \
+                                         uint32_t n) {                                 \
+      m_type va = m_pd##_set1_pd(a);                                                   \
+      uint32_t i = 0;                                                                  \
+      for (; i + m_width <= n; i += m_width) {                                         \
+        m_type vy = m_pd##_loadu_pd(y + i);                                            \
+        vy = m_pd##_add_pd(vy, m_pd##_mul_pd(va, m_pd##_loadu_pd(x + i)));             \
+        m_pd##_storeu_pd(y + i, vy);                                                   \
+      }                                                                                \
+      for (; i < n; i++)                                                               \
+        y[i] += a * x[i];                                                              \
+    }                                                                                  \
+                                                                                       \
+    m_target static void _vecScale##m_isa(double a, double* x, uint32_t n) {           \
+      m_type va = m_pd##_set1_pd(a);                                                   \
+      uint32_t i = 0;                                                                  \
+      for (; i + m_width <= n; i += m_width)                                           \
+        m_pd##_storeu_pd(x + i, m_pd##_mul_pd(va, m_pd##_loadu_pd(x + i)));            \
+      for (; i < n; i++)                                                               \
+        x[i] *= a;                                                                     \
+    }                                                                                  \
+                                                                                       \
+    m_target static void _vecSqrt##m_isa(const double* x, double* out, uint32_t n) {   \
+      uint32_t i = 0;                                                                  \
+      for (; i + m_width <= n; i += m_width)                                           \
+        m_pd##_storeu_pd(out + i, m_pd##_sqrt_pd(m_pd##_loadu_pd(x + i)));             \
+      for (; i < n; i++)                                                               \
+        out[i] = sqrt(x[i]);                                                           \
+    }                                                                                  \
+                                                                                       \
+    VEC_DEFINE_BINARY(_vecAdd##m_isa, m_target, m_pd, m_width, add, VEC_ADD)           \
+    VEC_DEFINE_BINARY(_vecMul##m_isa, m_target, m_pd, m_width, mul, VEC_MUL)           \
+    VEC_DEFINE_BINARY(_vecMin##m_isa, m_target, m_pd, m_width, min, VEC_MIN)           \
+    VEC_DEFINE_BINARY(_vecMax##m_isa, m_target, m_pd, m_width, max, VEC_MAX)
+
+  #define VEC_DEFINE_BINARY(m_name, m_target, m_pd, m_width, m_inst, m_op)             \
+    m_target static void m_name(const double* x, const double* y, double* out,         \
+                                uint32_t n) {                                          \
+      uint32_t i = 0;                                                                  \
+      for (; i + m_width <= n; i += m_width) {                                         \
+        m_pd##_storeu_pd(out + i,                                                      \
+                         m_pd##_##m_inst##_pd(m_pd##_loadu_pd(x + i),                  \
+                                              m_pd##_loadu_pd(y + i)));                \
+      }                                                                                \
+      for (; i < n; i++)                                                               \
+        out[i] = m_op(x[i], y[i]);                                                     \
+    }
+
+VEC_DEFINE_KERNELS(SSE2, , __m128d, _mm, 2)
+VEC_DEFINE_KERNELS(AVX2, __attribute__((target("avx2"))), __m256d, _mm256, 4)
+
+  #undef VEC_DEFINE_KERNELS
+  #undef VEC_DEFINE_BINARY
+
+#endif // VEC_X86
+
+static VecKernels _sVecKernels = {
+  "scalar",      _vecSumScalar, _vecDotScalar, _vecAxpyScalar, _vecScaleScalar,
+  _vecAddScalar, _vecMulScalar, _vecMinScalar, _vecMaxScalar,   _vecSqrtScalar,
+};
+
+// Select the kernels of the best instruction set supported by the CPU.
+static void _vecSelectKernels(void) {
+#ifdef VEC_X86
+  if (__builtin_cpu_supports("avx2")) {
+    VecKernels avx2 = {
+      "avx2",      _vecSumAVX2, _vecDotAVX2, _vecAxpyAVX2, _vecScaleAVX2,
+      _vecAddAVX2, _vecMulAVX2, _vecMinAVX2, _vecMaxAVX2,  _vecSqrtAVX2,
+    };
+    _sVecKernels = avx2;
+  } else {
+    VecKernels sse2 = {
+      "sse2",      _vecSumSSE2, _vecDotSSE2, _vecAxpySSE2, _vecScaleSSE2,
+      _vecAddSSE2, _vecMulSSE2, _vecMinSSE2, _vecMaxSSE2,  _vecSqrtSSE2,
+    };
+    _sVecKernels = sse2;
+  }
+#endif
+}
+
+// An argument of the kernels. Float64Arrays are used in place, the other
+// typed arrays and lists of numbers are unboxed into a temporary buffer.
+typedef struct {
+  double* data;
+  uint32_t length;
+  bool owned;     // True if the [data] is a temporary buffer.
+  TypedKind kind; // Kind of the typed array or TYPED_NONE for lists.
+  List* list;     // The source list or NULL.
+} VecOperand;
+
+static bool _vecOperand(VM* vm, int slot, VecOperand* op) {
+  memset(op, 0, sizeof(VecOperand));
+  Var value = vm->fiber->ret[slot];
+
+  if (IS_OBJ_TYPE(value, OBJ_INST) && ((Instance*) AS_OBJ(value))->cls->typed_kind != TYPED_NONE) {
+    TypedArray* array = (TypedArray*) ((Instance*) AS_OBJ(value))->native;
+    uint8_t* data = typedArrayData(array);
+    if (data == NULL && array->length != 0) {
+      SetRuntimeError(vm, "The viewed ByteBuffer is smaller than the view.");
+      return false;
+    }
+
+    op->length = array->length;
+    op->kind = array->kind;
+    if (array->kind == TYPED_FLOAT64) {
+      op->data = (double*) data;
+      return true;
+    }
+
+    op->owned = true;
+    op->data = Realloc(vm, NULL, sizeof(double) * op->length);
+    for (uint32_t i = 0; i < op->length; i++) {
+      op->data[i] = (array->kind == TYPED_INT32) ? ((int32_t*) data)[i] : data[i];
+    }
+    return true;
+  }
+
+  if (IS_OBJ_TYPE(value, OBJ_LIST)) {
+    List* list = (List*) AS_OBJ(value);
+    for (uint32_t i = 0; i < list->elements.count; i++) {
+      if (!IS_NUM(list->elements.data[i])) {
+        SetRuntimeErrorFmt(vm, "Expected a list of numbers but found %s at index %d.",
+                           varTypeName(list->elements.data[i]), i);
+        return false;
+      }
+    }
+
+    op->list = list;
+    op->length = list->elements.count;
+    op->owned = true;
+    op->data = Realloc(vm, NULL, sizeof(double) * op->length);
+    for (uint32_t i = 0; i < op->length; i++)
+      op->data[i] = AS_NUM(list->elements.data[i]);
+    return true;
+  }
+
+  SetRuntimeErrorFmt(vm, "Expected a typed array or a List but got %s.", varTypeName(value));
+  return false;
+}
+
+// Write back the unboxed values of a list operand and release the
+// temporary buffer.
+static void _vecRelease(VM* vm, VecOperand* op, bool write_back) {
+  if (write_back && op->list != NULL) {
+    for (uint32_t i = 0; i < op->length; i++)
+      op->list->elements.data[i] = VAR_NUM(op->data[i]);
+  }
+  if (op->owned)
+    Realloc(vm, op->data, 0);
+}
+
+// Same as _vecOperand() but the operand will be modified in place so it
+// should be a Float64Array or a List.
+static bool _vecInPlaceOperand(VM* vm, int slot, VecOperand* op) {
+  if (!_vecOperand(vm, slot, op))
+    return false;
+  if (op->list == NULL && op->kind != TYPED_FLOAT64) {
+    _vecRelease(vm, op, false);
+    SetRuntimeError(vm, "Expected a Float64Array or a List to modify in place.");
+    return false;
+  }
+  return true;
+}
+
+static bool _vecCheckLength(VM* vm, const VecOperand* x, const VecOperand* y) {
+  if (x->length != y->length) {
+    SetRuntimeErrorFmt(vm, "Expected arrays of the same length (%d != %d).", x->length,
+                       y->length);
+    return false;
+  }
+  return true;
+}
+
+// Create a Float64Array of [length] zeros at the return slot and returns it's
+// elements, or NULL with an error set. The slots after the [argc] arguments
+// are used as temporaries.
+static double* _vecNewResult(VM* vm, int argc, uint32_t length) {
+  int cls = argc + 1, tmp = argc + 2;
+  reserveSlots(vm, tmp + 1);
+
+  if (!ImportModule(vm, "types", cls))
+    return NULL;
+  if (!GetAttribute(vm, cls, "Float64Array", cls))
+    return NULL;
+
+  setSlotNumber(vm, tmp, length);
+  if (!NewInstance(vm, cls, 0, 1, tmp))
+    return NULL;
+
+  TypedArray* array = (TypedArray*) GetSlotNativeInstance(vm, 0);
+  return (double*) array->data;
+}
+
+// Apply the elementwise [fn] on the arguments and return a new Float64Array.
+static void _vecBinary(VM* vm, VecBinaryFn fn) {
+  VecOperand x, y;
+  if (!_vecOperand(vm, 1, &x))
+    return;
+  if (!_vecOperand(vm, 2, &y)) {
+    _vecRelease(vm, &x, false);
+    return;
+  }
+
+  double* out;
+  if (_vecCheckLength(vm, &x, &y) && (out = _vecNewResult(vm, 2, x.length)) != NULL) {
+    fn(x.data, y.data, out, x.length);
+  }
+
+  _vecRelease(vm, &x, false);
+  _vecRelease(vm, &y, false);
+}
+
+// Apply the [fn] or the element function [elem_fn] (if [fn] is NULL) on the
+// argument and return a new Float64Array.
+static void _vecUnary(VM* vm, VecUnaryFn fn, double (*elem_fn)(double)) {
+  VecOperand x;
+  if (!_vecOperand(vm, 1, &x))
+    return;
+
+  double* out = _vecNewResult(vm, 1, x.length);
+  if (out != NULL) {
+    if (fn != NULL) {
+      fn(x.data, out, x.length);
+    } else {
+      for (uint32_t i = 0; i < x.length; i++)
+        out[i] = elem_fn(x.data[i]);
+    }
+  }
+
+  _vecRelease(vm, &x, false);
+}
+
+saynaa_function(stdMathSum, "math.sum(x:Float64Array|List) -> Number",
+                "Returns the sum of the elements of [x].") {
+  VecOperand x;
+  if (!_vecOperand(vm, 1, &x))
+    return;
+  setSlotNumber(vm, 0, _sVecKernels.sum(x.data, x.length));
+  _vecRelease(vm, &x, false);
+}
+
+saynaa_function(stdMathDot, "math.dot(x:Float64Array|List, y:Float64Array|List) -> Number",
+                "Returns the dot product of [x] and [y].") {
+  VecOperand x, y;
+  if (!_vecOperand(vm, 1, &x))
+    return;
+  if (!_vecOperand(vm, 2, &y)) {
+    _vecRelease(vm, &x, false);
+    return;
+  }
+  if (_vecCheckLength(vm, &x, &y))
+    setSlotNumber(vm, 0, _sVecKernels.dot(x.data, y.data, x.length));
+  _vecRelease(vm, &x, false);
+  _vecRelease(vm, &y, false);
+}
+
+saynaa_function(stdMathAxpy,
+                "math.axpy(a:Number, x:Float64Array|List, y:Float64Array|List) -> Null",
+                "Computes y = a * x + y, the [y] is modified in place.") {
+  double a;
+  if (!ValidateSlotNumber(vm, 1, &a))
+    return;
+
+  VecOperand x, y;
+  if (!_vecOperand(vm, 2, &x))
+    return;
+  if (!_vecInPlaceOperand(vm, 3, &y)) {
+    _vecRelease(vm, &x, false);
+    return;
+  }
+
+  bool valid = _vecCheckLength(vm, &x, &y);
+  if (valid)
+    _sVecKernels.axpy(a, x.data, y.data, x.length);
+  _vecRelease(vm, &x, false);
+  _vecRelease(vm, &y, valid);
+}
+
+saynaa_function(stdMathScale, "math.scale(x:Float64Array|List, a:Number) -> Null",
+                "Multiply each element of [x] by [a] in place.") {
+  double a;
+  if (!ValidateSlotNumber(vm, 2, &a))
+    return;
+
+  VecOperand x;
+  if (!_vecInPlaceOperand(vm, 1, &x))
+    return;
+  _sVecKernels.scale(a, x.data, x.length);
+  _vecRelease(vm, &x, true);
+}
+
+saynaa_function(stdMathAdd, "math.add(x:Float64Array|List, y:Float64Array|List) -> Float64Array",
+                "Returns the elementwise sum of [x] and [y].") {
+  _vecBinary(vm, _sVecKernels.add);
+}
+
+saynaa_function(stdMathMul, "math.mul(x:Float64Array|List, y:Float64Array|List) -> Float64Array",
+                "Returns the elementwise product of [x] and [y].") {
+  _vecBinary(vm, _sVecKernels.mul);
+}
+
+// Returns true if both arguments of the call are numbers and set them to [a]
+// and [b], the min / max of two numbers is a number instead of an array.
+static bool _mathNumberArgs(VM* vm, double* a, double* b) {
+  Var x = vm->fiber->ret[1], y = vm->fiber->ret[2];
+  if (!IS_NUM(x) || !IS_NUM(y))
+    return false;
+  *a = AS_NUM(x);
+  *b = AS_NUM(y);
+  return true;
+}
+
+saynaa_function(stdMathMin,
+                "math.min(x:Number|Float64Array|List, y:Number|Float64Array|List) -> Var",
+                "Returns the minimum of the numbers [x] and [y], or the "
+                "elementwise minimum of the arrays [x] and [y].") {
+  double a, b;
+  if (_mathNumberArgs(vm, &a, &b)) {
+    setSlotNumber(vm, 0, fmin(a, b));
+    return;
+  }
+  _vecBinary(vm, _sVecKernels.min);
+}
+
+saynaa_function(stdMathMax,
+                "math.max(x:Number|Float64Array|List, y:Number|Float64Array|List) -> Var",
+                "Returns the maximum of the numbers [x] and [y], or the "
+                "elementwise maximum of the arrays [x] and [y].") {
+  double a, b;
+  if (_mathNumberArgs(vm, &a, &b)) {
+    setSlotNumber(vm, 0, fmax(a, b));
+    return;
+  }
+  _vecBinary(vm, _sVecKernels.max);
+}
+
+saynaa_function(stdMathMapSqrt, "math.map_sqrt(x:Float64Array|List) -> Float64Array",
+                "Returns the square roots of the elements of [x].") {
+  _vecUnary(vm, _sVecKernels.sqrt, NULL);
+}
+
+saynaa_function(stdMathMapExp, "math.map_exp(x:Float64Array|List) -> Float64Array",
+                "Returns the exponentials of the elements of [x].") {
+  _vecUnary(vm, NULL, exp);
+}
+
+saynaa_function(stdMathMapLog, "math.map_log(x:Float64Array|List) -> Float64Array",
+                "Returns the natural logarithms of the elements of [x].") {
+  _vecUnary(vm, NULL, log);
+}
+
+saynaa_function(stdMathPrefixSum, "math.prefix_sum(x:Float64Array|List) -> Float64Array",
+                "Returns the inclusive prefix sum (running total) of [x].") {
+  VecOperand x;
+  if (!_vecOperand(vm, 1, &x))
+    return;
+
+  double* out = _vecNewResult(vm, 1, x.length);
+  if (out != NULL) {
+    double sum = 0;
+    for (uint32_t i = 0; i < x.length; i++)
+      out[i] = (sum += x.data[i]);
+  }
+  _vecRelease(vm, &x, false);
+}
+
+saynaa_function(stdMathArgmax, "math.argmax(x:Float64Array|List) -> Number",
+                "Returns the index of the (first) largest element of [x].") {
+  VecOperand x;
+  if (!_vecOperand(vm, 1, &x))
+    return;
+
+  if (x.length == 0) {
+    SetRuntimeError(vm, "Cannot get the argmax of an empty array.");
+  } else {
+    uint32_t index = 0;
+    for (uint32_t i = 1; i < x.length; i++) {
+      if (x.data[i] > x.data[index])
+        index = i;
+    }
+    setSlotNumber(vm, 0, index);
+  }
+  _vecRelease(vm, &x, false);
+}
+
 /*****************************************************************************/
 /* MODULE REGISTER                                                           */
 /*****************************************************************************/
@@ -250,6 +754,27 @@ void registerModuleMath(VM* vm) {
   REGISTER_FN(math, "rand", stdMathRand, 0);
   REGISTER_FN(math, "random", stdMathRandom, 2);
 
+  // Name of the instruction set used by the vector kernels.
+  _vecSelectKernels();
+  String* simd = newString(vm, _sVecKernels.name);
+  vmPushTempRef(vm, &simd->_super); // simd.
+  moduleSetGlobal(vm, ((Module*) AS_OBJ(math->value)), "simd", 4, VAR_OBJ(simd));
+  vmPopTempRef(vm); // simd.
+
+  REGISTER_FN(math, "sum", stdMathSum, 1);
+  REGISTER_FN(math, "dot", stdMathDot, 2);
+  REGISTER_FN(math, "axpy", stdMathAxpy, 3);
+  REGISTER_FN(math, "scale", stdMathScale, 2);
+  REGISTER_FN(math, "add", stdMathAdd, 2);
+  REGISTER_FN(math, "mul", stdMathMul, 2);
+  REGISTER_FN(math, "min", stdMathMin, 2);
+  REGISTER_FN(math, "max", stdMathMax, 2);
+  REGISTER_FN(math, "map_sqrt", stdMathMapSqrt, 1);
+  REGISTER_FN(math, "map_exp", stdMathMapExp, 1);
+  REGISTER_FN(math, "map_log", stdMathMapLog, 1);
+  REGISTER_FN(math, "prefix_sum", stdMathPrefixSum, 1);
+  REGISTER_FN(math, "argmax", stdMathArgmax, 1);
+
   registerModule(vm, math);
   releaseHandle(vm, math);
 }
\ No newline at end of file
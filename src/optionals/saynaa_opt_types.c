@@ -14,10 +14,7 @@ saynaa_function(_typesHashable, "types.hashable(value:Var) -> Bool",
   ASSERT(1 < GetSlotsCount(vm), OOPS);
   Var value = vm->fiber->ret[1];
 
-  if (!IS_OBJ(value))
-    setSlotBool(vm, 0, true);
-  else
-    setSlotBool(vm, 0, isObjectHashable(AS_OBJ(value)->type));
+  setSlotBool(vm, 0, isValueHashable(value));
 }
 
 saynaa_function(_typesHash, "types.hash(value:Var) -> Number", "Returns the hash of the [value]") {
@@ -26,7 +23,7 @@ saynaa_function(_typesHash, "types.hash(value:Var) -> Number", "Returns the hash
   ASSERT(1 < GetSlotsCount(vm), OOPS);
   Var value = vm->fiber->ret[1];
 
-  if (IS_OBJ(value) && !isObjectHashable(AS_OBJ(value)->type)) {
+  if (!isValueHashable(value)) {
     SetRuntimeErrorFmt(vm, "Type '%s' is not hashable.", varTypeName(value));
     return;
   }
@@ -317,6 +314,787 @@ saynaa_function(_vectorRepr, "types.Vector._repr()", "") {
   setSlotStringFmt(vm, 0, "[%g, %g, %g]", vec->x, vec->y, vec->z);
 }
 
+/*****************************************************************************/
+/* DEQUE                                                                     */
+/*****************************************************************************/
+
+// Argument [n] (1 based) of the current native method.
+#define ARG(n) (vm->fiber->ret[n])
+
+// A double ended queue on a ring buffer, the capacity is a power of 2 so
+// the physical index is (head + i) & (capacity - 1).
+typedef struct {
+  Var* data;
+  uint32_t capacity;
+  uint32_t head;  // Physical index of the first element.
+  uint32_t count; // Number of elements.
+} Deque;
+
+#define DEQUE_MIN_CAPACITY 8
+#define DEQUE_AT(thiz, i) ((thiz)->data[((thiz)->head + (i)) & ((thiz)->capacity - 1)])
+
+static void* _dequeNew(VM* vm) {
+  Deque* thiz = Realloc(vm, NULL, sizeof(Deque));
+  memset(thiz, 0, sizeof(Deque));
+  return thiz;
+}
+
+static void _dequeDelete(VM* vm, void* ptr) {
+  Deque* thiz = (Deque*) ptr;
+  Realloc(vm, thiz->data, 0);
+  Realloc(vm, thiz, 0);
+}
+
+static void _dequeMark(VM* vm, void* ptr) {
+  Deque* thiz = (Deque*) ptr;
+  for (uint32_t i = 0; i < thiz->count; i++)
+    markValue(vm, DEQUE_AT(thiz, i));
+}
+
+// Make room for one more element, the elements are unwrapped to the start
+// of the new buffer.
+static void _dequeReserve(VM* vm, Deque* thiz) {
+  if (thiz->count < thiz->capacity)
+    return;
+
+  uint32_t capacity = (thiz->capacity == 0) ? DEQUE_MIN_CAPACITY : thiz->capacity * 2;
+  Var* data = Realloc(vm, NULL, sizeof(Var) * capacity);
+  for (uint32_t i = 0; i < thiz->count; i++)
+    data[i] = DEQUE_AT(thiz, i);
+
+  Realloc(vm, thiz->data, 0);
+  thiz->data = data;
+  thiz->capacity = capacity;
+  thiz->head = 0;
+}
+
+// Returns the element index of the integer argument [index] which could be
+// negative (from the end), or -1 with an error set.
+static int64_t _dequeIndex(VM* vm, Deque* thiz, int arg) {
+  int32_t index;
+  if (!ValidateSlotInteger(vm, arg, &index))
+    return -1;
+  if (index < 0)
+    index += (int32_t) thiz->count;
+  if (index < 0 || (uint32_t) index >= thiz->count) {
+    SetRuntimeError(vm, "Deque index out of bound.");
+    return -1;
+  }
+  return index;
+}
+
+saynaa_function(_dequeInit, "types.Deque._init(...)",
+                "Create a deque with the given elements.") {
+  Deque* thiz = GetThis(vm);
+  int argc = GetArgc(vm);
+  for (int i = 1; i <= argc; i++) {
+    _dequeReserve(vm, thiz);
+    DEQUE_AT(thiz, thiz->count++) = ARG(i);
+  }
+}
+
+saynaa_function(_dequePush, "types.Deque.push(value:Var) -> Null",
+                "Add the [value] to the back of the deque.") {
+  Deque* thiz = GetThis(vm);
+  _dequeReserve(vm, thiz);
+  DEQUE_AT(thiz, thiz->count++) = ARG(1);
+}
+
+saynaa_function(_dequePushFront, "types.Deque.pushfront(value:Var) -> Null",
+                "Add the [value] to the front of the deque.") {
+  Deque* thiz = GetThis(vm);
+  _dequeReserve(vm, thiz);
+  thiz->head = (thiz->head - 1) & (thiz->capacity - 1);
+  thiz->data[thiz->head] = ARG(1);
+  thiz->count++;
+}
+
+saynaa_function(_dequePop, "types.Deque.pop() -> Var",
+                "Remove the last element of the deque and return it.") {
+  Deque* thiz = GetThis(vm);
+  if (thiz->count == 0) {
+    SetRuntimeError(vm, "Cannot pop from an empty deque.");
+    return;
+  }
+  RET(DEQUE_AT(thiz, --thiz->count));
+}
+
+saynaa_function(_dequePopFront, "types.Deque.popfront() -> Var",
+                "Remove the first element of the deque and return it.") {
+  Deque* thiz = GetThis(vm);
+  if (thiz->count == 0) {
+    SetRuntimeError(vm, "Cannot pop from an empty deque.");
+    return;
+  }
+  Var value = thiz->data[thiz->head];
+  thiz->head = (thiz->head + 1) & (thiz->capacity - 1);
+  thiz->count--;
+  RET(value);
+}
+
+saynaa_function(_dequeClear, "types.Deque.clear() -> Null",
+                "Remove all the elements of the deque.") {
+  Deque* thiz = GetThis(vm);
+  thiz->head = 0;
+  thiz->count = 0;
+}
+
+saynaa_function(_dequeSubscriptGet, "types.Deque.[](index:Number)", "") {
+  Deque* thiz = GetThis(vm);
+  int64_t index = _dequeIndex(vm, thiz, 1);
+  if (index < 0)
+    return;
+  RET(DEQUE_AT(thiz, index));
+}
+
+saynaa_function(_dequeSubscriptSet, "types.Deque.[]=(index:Number, value:Var)", "") {
+  Deque* thiz = GetThis(vm);
+  int64_t index = _dequeIndex(vm, thiz, 1);
+  if (index < 0)
+    return;
+  DEQUE_AT(thiz, index) = ARG(2);
+}
+
+saynaa_function(_dequeGetter, "types.Deque._getter()", "") {
+  const char* name;
+  uint32_t length;
+  if (!ValidateSlotString(vm, 1, &name, &length))
+    return;
+
+  Deque* thiz = GetThis(vm);
+  if (length == 6 && strncmp(name, "length", length) == 0) {
+    setSlotNumber(vm, 0, thiz->count);
+  }
+}
+
+// The iterator is the index of the current element.
+saynaa_function(_dequeNext, "types.Deque._next(iter:Var) -> Var", "") {
+  Deque* thiz = GetThis(vm);
+  Var iter = ARG(1);
+  double next = IS_NULL(iter) ? 0 : AS_NUM(iter) + 1;
+  RET((next < thiz->count) ? VAR_NUM(next) : VAR_NULL);
+}
+
+saynaa_function(_dequeValue, "types.Deque._value(iter:Var) -> Var", "") {
+  Deque* thiz = GetThis(vm);
+  uint32_t index = (uint32_t) AS_NUM(ARG(1));
+  if (index >= thiz->count) {
+    SetRuntimeError(vm, "Deque changed size during iteration.");
+    return;
+  }
+  RET(DEQUE_AT(thiz, index));
+}
+
+saynaa_function(_dequeRepr, "types.Deque._repr()", "") {
+  Deque* thiz = GetThis(vm);
+  List* list = newList(vm, thiz->count);
+  vmPushTempRef(vm, &list->_super); // list.
+  for (uint32_t i = 0; i < thiz->count; i++)
+    listAppend(vm, list, DEQUE_AT(thiz, i));
+  String* repr = toRepr(vm, VAR_OBJ(list));
+  vmPopTempRef(vm); // list.
+  vmPushTempRef(vm, &repr->_super); // repr.
+  setSlotStringFmt(vm, 0, "Deque%s", repr->data);
+  vmPopTempRef(vm); // repr.
+}
+
+/*****************************************************************************/
+/* HEAP                                                                      */
+/*****************************************************************************/
+
+// A binary min heap. With a key function, the key of a value is computed
+// once on push and compared instead of the value.
+typedef struct {
+  Var key;
+  Var value;
+} HeapItem;
+
+typedef struct {
+  HeapItem* items;
+  uint32_t capacity;
+  uint32_t count;
+  Var key_fn; // The key closure or null.
+
+  // Set while comparing values which could run script code (the < operator
+  // of instances) and modify the heap in the middle of a sift.
+  bool busy;
+} Heap;
+
+static void* _heapNew(VM* vm) {
+  Heap* thiz = Realloc(vm, NULL, sizeof(Heap));
+  memset(thiz, 0, sizeof(Heap));
+  thiz->key_fn = VAR_NULL;
+  return thiz;
+}
+
+static void _heapDelete(VM* vm, void* ptr) {
+  Heap* thiz = (Heap*) ptr;
+  Realloc(vm, thiz->items, 0);
+  Realloc(vm, thiz, 0);
+}
+
+static void _heapMark(VM* vm, void* ptr) {
+  Heap* thiz = (Heap*) ptr;
+  markValue(vm, thiz->key_fn);
+  for (uint32_t i = 0; i < thiz->count; i++) {
+    markValue(vm, thiz->items[i].key);
+    markValue(vm, thiz->items[i].value);
+  }
+}
+
+// Returns a < b, numbers and strings are compared directly. If the
+// comparison failed, an error is set and [failed] will be true.
+static bool _heapLess(VM* vm, Var a, Var b, bool* failed) {
+  if (IS_NUM(a) && IS_NUM(b))
+    return AS_NUM(a) < AS_NUM(b);
+
+  if (IS_OBJ_TYPE(a, OBJ_STRING) && IS_OBJ_TYPE(b, OBJ_STRING)) {
+    String *s1 = (String*) AS_OBJ(a), *s2 = (String*) AS_OBJ(b);
+    uint32_t min = (s1->length < s2->length) ? s1->length : s2->length;
+    int result = memcmp(s1->data, s2->data, min);
+    return (result == 0) ? (s1->length < s2->length) : (result < 0);
+  }
+
+  Var lesser = varLesser(vm, a, b);
+  if (VM_HAS_ERROR(vm)) {
+    *failed = true;
+    return false;
+  }
+  return toBool(lesser);
+}
+
+// Move the item at [index] up to it's place. Returns false on error, the
+// place is found before moving anything so the heap is unchanged on error.
+static bool _heapSiftUp(VM* vm, Heap* thiz, uint32_t index) {
+  bool failed = false;
+  HeapItem item = thiz->items[index];
+  uint32_t place = index;
+  while (place > 0) {
+    uint32_t parent = (place - 1) / 2;
+    if (!_heapLess(vm, item.key, thiz->items[parent].key, &failed))
+      break;
+    place = parent;
+  }
+  if (failed)
+    return false;
+
+  while (index > place) {
+    uint32_t parent = (index - 1) / 2;
+    thiz->items[index] = thiz->items[parent];
+    index = parent;
+  }
+  thiz->items[index] = item;
+  return true;
+}
+
+// Move the item at [index] down to it's place. Returns false on error.
+static bool _heapSiftDown(VM* vm, Heap* thiz, uint32_t index) {
+  bool failed = false;
+  HeapItem item = thiz->items[index];
+  for (;;) {
+    uint32_t child = 2 * index + 1;
+    if (child >= thiz->count)
+      break;
+    if (child + 1 < thiz->count
+        && _heapLess(vm, thiz->items[child + 1].key, thiz->items[child].key, &failed))
+      child++;
+    if (failed || !_heapLess(vm, thiz->items[child].key, item.key, &failed))
+      break;
+    thiz->items[index] = thiz->items[child];
+    index = child;
+  }
+  thiz->items[index] = item;
+  return !failed;
+}
+
+// Compute the key of the [value] with the heap's key function.
+static bool _heapKey(VM* vm, Heap* thiz, Var value, Var* key) {
+  if (IS_NULL(thiz->key_fn)) {
+    *key = value;
+    return true;
+  }
+  Closure* fn = (Closure*) AS_OBJ(thiz->key_fn);
+  if (vmCallFunction(vm, fn, 1, &value, key) != RESULT_SUCCESS)
+    return false;
+  return !VM_HAS_ERROR(vm);
+}
+
+static bool _heapCheckBusy(VM* vm, Heap* thiz) {
+  if (thiz->busy) {
+    SetRuntimeError(vm, "Heap modified during a comparison.");
+    return false;
+  }
+  return true;
+}
+
+// Push the [value] with the [key] and restore the heap order. Returns false
+// if a comparison failed, the item isn't pushed then.
+static bool _heapPushItem(VM* vm, Heap* thiz, Var key, Var value) {
+  if (thiz->count == thiz->capacity) {
+    uint32_t capacity = (thiz->capacity == 0) ? 8 : thiz->capacity * 2;
+    thiz->items = Realloc(vm, thiz->items, sizeof(HeapItem) * capacity);
+    thiz->capacity = capacity;
+  }
+  thiz->items[thiz->count].key = key;
+  thiz->items[thiz->count].value = value;
+  thiz->count++;
+
+  thiz->busy = true;
+  bool sifted = _heapSiftUp(vm, thiz, thiz->count - 1);
+  thiz->busy = false;
+
+  if (!sifted)
+    thiz->count--;
+  return sifted;
+}
+
+saynaa_function(_heapInit, "types.Heap._init([key:Closure])",
+                "Create an empty min heap. If the [key] is given it's called once "
+                "for each pushed value and the results are compared.") {
+  if (!CheckArgcRange(vm, GetArgc(vm), 0, 1))
+    return;
+
+  Heap* thiz = GetThis(vm);
+  if (GetArgc(vm) == 1 && !IS_NULL(ARG(1))) {
+    if (!IS_OBJ_TYPE(ARG(1), OBJ_CLOSURE)) {
+      SetRuntimeError(vm, "Expected a closure at argument 1.");
+      return;
+    }
+    thiz->key_fn = ARG(1);
+  }
+}
+
+saynaa_function(_heapPush, "types.Heap.push(value:Var) -> Null",
+                "Push the [value] to the heap.") {
+  Heap* thiz = GetThis(vm);
+  if (!_heapCheckBusy(vm, thiz))
+    return;
+
+  Var key;
+  if (!_heapKey(vm, thiz, ARG(1), &key))
+    return;
+  if (!_heapPushItem(vm, thiz, key, ARG(1)))
+    return;
+}
+
+saynaa_function(_heapPop, "types.Heap.pop() -> Var",
+                "Remove the smallest value of the heap and return it.") {
+  Heap* thiz = GetThis(vm);
+  if (!_heapCheckBusy(vm, thiz))
+    return;
+  if (thiz->count == 0) {
+    SetRuntimeError(vm, "Cannot pop from an empty heap.");
+    return;
+  }
+
+  Var value = thiz->items[0].value;
+  thiz->items[0] = thiz->items[--thiz->count];
+  if (thiz->count > 0) {
+    // The popped value is only on the return slot while sifting.
+    RET(value);
+    thiz->busy = true;
+    _heapSiftDown(vm, thiz, 0);
+    thiz->busy = false;
+  }
+  RET(value);
+}
+
+saynaa_function(_heapPeek, "types.Heap.peek() -> Var",
+                "Returns the smallest value of the heap without removing it.") {
+  Heap* thiz = GetThis(vm);
+  if (thiz->count == 0) {
+    SetRuntimeError(vm, "Cannot peek an empty heap.");
+    return;
+  }
+  RET(thiz->items[0].value);
+}
+
+saynaa_function(_heapReplace, "types.Heap.replace(value:Var) -> Var",
+                "Pop the smallest value and push the [value] in a single step and "
+                "return the popped value. It's faster than a pop() followed by a "
+                "push().") {
+  Heap* thiz = GetThis(vm);
+  if (!_heapCheckBusy(vm, thiz))
+    return;
+  if (thiz->count == 0) {
+    SetRuntimeError(vm, "Cannot replace in an empty heap.");
+    return;
+  }
+
+  Var key;
+  if (!_heapKey(vm, thiz, ARG(1), &key))
+    return;
+
+  // The key function could have emptied the heap.
+  if (thiz->count == 0) {
+    SetRuntimeError(vm, "Cannot replace in an empty heap.");
+    return;
+  }
+
+  Var value = thiz->items[0].value;
+  thiz->items[0].key = key;
+  thiz->items[0].value = ARG(1);
+  RET(value);
+
+  thiz->busy = true;
+  _heapSiftDown(vm, thiz, 0);
+  thiz->busy = false;
+  RET(value);
+}
+
+saynaa_function(_heapClear, "types.Heap.clear() -> Null",
+                "Remove all the values of the heap.") {
+  Heap* thiz = GetThis(vm);
+  if (!_heapCheckBusy(vm, thiz))
+    return;
+  thiz->count = 0;
+}
+
+saynaa_function(_heapGetter, "types.Heap._getter()", "") {
+  const char* name;
+  uint32_t length;
+  if (!ValidateSlotString(vm, 1, &name, &length))
+    return;
+
+  Heap* thiz = GetThis(vm);
+  if (length == 6 && strncmp(name, "length", length) == 0) {
+    setSlotNumber(vm, 0, thiz->count);
+  }
+}
+
+/*****************************************************************************/
+/* TYPED ARRAYS                                                              */
+/*****************************************************************************/
+
+// Float64Array, Int32Array and Uint8Array share the methods bellow, only the
+// allocators differ to set the element type. Reading and writing in bound
+// indexes with the subscript operator doesn't call the [] methods since the
+// VM does it directly, see typedArrayGet().
+
+static void* _typedArrayNew(VM* vm, TypedKind kind) {
+  TypedArray* thiz = Realloc(vm, NULL, sizeof(TypedArray));
+  memset(thiz, 0, sizeof(TypedArray));
+  thiz->kind = kind;
+  thiz->owner = VAR_NULL;
+  return thiz;
+}
+
+static void* _float64ArrayNew(VM* vm) {
+  return _typedArrayNew(vm, TYPED_FLOAT64);
+}
+
+static void* _int32ArrayNew(VM* vm) {
+  return _typedArrayNew(vm, TYPED_INT32);
+}
+
+static void* _uint8ArrayNew(VM* vm) {
+  return _typedArrayNew(vm, TYPED_UINT8);
+}
+
+static void _typedArrayDelete(VM* vm, void* ptr) {
+  TypedArray* thiz = (TypedArray*) ptr;
+  Realloc(vm, thiz->data, 0);
+  Realloc(vm, thiz, 0);
+}
+
+static void _typedArrayMark(VM* vm, void* ptr) {
+  TypedArray* thiz = (TypedArray*) ptr;
+  markValue(vm, thiz->owner);
+}
+
+static const char* _typedArrayName(TypedKind kind) {
+  switch (kind) {
+    case TYPED_FLOAT64:
+      return "Float64Array";
+    case TYPED_INT32:
+      return "Int32Array";
+    case TYPED_UINT8:
+      return "Uint8Array";
+    case TYPED_NONE:
+      break;
+  }
+  UNREACHABLE();
+  return NULL;
+}
+
+// Returns the data of the array or NULL with an error set if it's a view of
+// a buffer which was shrunk.
+static uint8_t* _typedArrayData(VM* vm, TypedArray* thiz) {
+  uint8_t* data = typedArrayData(thiz);
+  if (data == NULL && thiz->length != 0) {
+    SetRuntimeError(vm, "The viewed ByteBuffer is smaller than the view.");
+  }
+  return data;
+}
+
+static double _typedArrayLoad(const TypedArray* thiz, const uint8_t* data, uint32_t index) {
+  switch (thiz->kind) {
+    case TYPED_FLOAT64:
+      return ((const double*) data)[index];
+    case TYPED_INT32:
+      return ((const int32_t*) data)[index];
+    case TYPED_UINT8:
+      return data[index];
+    case TYPED_NONE:
+      break;
+  }
+  UNREACHABLE();
+  return 0;
+}
+
+// Store the [value] at the [index] if it fits in the element type, otherwise
+// set an error and return false.
+static bool _typedArrayStore(VM* vm, TypedArray* thiz, uint8_t* data, uint32_t index,
+                             Var value) {
+  if (!IS_NUM(value)) {
+    SetRuntimeErrorFmt(vm, "Expected a Number but got %s.", varTypeName(value));
+    return false;
+  }
+
+  double n = AS_NUM(value);
+  switch (thiz->kind) {
+    case TYPED_FLOAT64:
+      ((double*) data)[index] = n;
+      return true;
+
+    case TYPED_INT32:
+      if (floor(n) != n || n < INT32_MIN || n > INT32_MAX) {
+        SetRuntimeError(vm, "Value should be an integer in the Int32 range.");
+        return false;
+      }
+      ((int32_t*) data)[index] = (int32_t) n;
+      return true;
+
+    case TYPED_UINT8:
+      if (floor(n) != n || n < 0x00 || n > 0xff) {
+        SetRuntimeError(vm, "Value should be in range 0x00 to 0xff.");
+        return false;
+      }
+      data[index] = (uint8_t) n;
+      return true;
+
+    case TYPED_NONE:
+      break;
+  }
+  UNREACHABLE();
+  return false;
+}
+
+// Allocate zero initialized storage of [length] elements.
+static bool _typedArrayAlloc(VM* vm, TypedArray* thiz, double length) {
+  uint32_t size = typedElementSize(thiz->kind);
+  if (length < 0 || floor(length) != length || length > UINT32_MAX / size) {
+    SetRuntimeError(vm, "Invalid typed array length.");
+    return false;
+  }
+
+  thiz->length = (uint32_t) length;
+  if (thiz->length != 0) {
+    thiz->data = Realloc(vm, NULL, (size_t) thiz->length * size);
+    memset(thiz->data, 0, (size_t) thiz->length * size);
+  }
+  return true;
+}
+
+// Make the array a view of the ByteBuffer instance [buff] from the [offset]
+// byte with [length] elements. The offset should be aligned to the element
+// size, so the raw data could be used as an array of the element type.
+static bool _typedArrayView(VM* vm, TypedArray* thiz, Var buff) {
+  ByteBuffer* buffer = (ByteBuffer*) ((Instance*) AS_OBJ(buff))->native;
+  uint32_t size = typedElementSize(thiz->kind);
+  int argc = GetArgc(vm);
+
+  int32_t offset = 0, length = -1;
+  if (argc >= 2 && !ValidateSlotInteger(vm, 2, &offset))
+    return false;
+  if (argc >= 3 && !ValidateSlotInteger(vm, 3, &length))
+    return false;
+
+  if (offset < 0 || (uint32_t) offset > buffer->count || offset % size != 0) {
+    SetRuntimeError(vm, "Invalid view offset.");
+    return false;
+  }
+
+  uint32_t available = (buffer->count - (uint32_t) offset) / size;
+  if (length == -1)
+    length = (int32_t) available;
+  if (length < 0 || (uint32_t) length > available) {
+    SetRuntimeError(vm, "View length is out of the buffer's bound.");
+    return false;
+  }
+
+  thiz->buffer = buffer;
+  thiz->offset = (uint32_t) offset;
+  thiz->length = (uint32_t) length;
+  thiz->owner = buff;
+  return true;
+}
+
+saynaa_function(_typedArrayInit, "types.Float64Array._init(source:Number|List|ByteBuffer, ...)",
+                "Create a typed array of [source] number of zeros, or a copy of "
+                "the numbers in the [source] list. If the source is a "
+                "ByteBuffer, the array is a view of the buffer's bytes "
+                "(without copying) starting from an optional offset with an "
+                "optional length.") {
+  if (!CheckArgcRange(vm, GetArgc(vm), 1, 3))
+    return;
+
+  TypedArray* thiz = GetThis(vm);
+  Var source = ARG(1);
+
+  // The _init could be called again on an existing array, drop it's storage.
+  Realloc(vm, thiz->data, 0);
+  thiz->data = NULL;
+  thiz->length = 0;
+  thiz->buffer = NULL;
+  thiz->offset = 0;
+  thiz->owner = VAR_NULL;
+
+  if (IS_OBJ_TYPE(source, OBJ_INST) &&
+      ((Instance*) AS_OBJ(source))->cls->new_fn == _bytebuffNew) {
+    _typedArrayView(vm, thiz, source);
+    return;
+  }
+
+  if (GetArgc(vm) != 1) {
+    SetRuntimeError(vm, "Expected exactly 1 argument.");
+    return;
+  }
+
+  if (IS_NUM(source)) {
+    _typedArrayAlloc(vm, thiz, AS_NUM(source));
+    return;
+  }
+
+  if (IS_OBJ_TYPE(source, OBJ_LIST)) {
+    List* list = (List*) AS_OBJ(source);
+    if (!_typedArrayAlloc(vm, thiz, list->elements.count))
+      return;
+    for (uint32_t i = 0; i < list->elements.count; i++) {
+      if (!_typedArrayStore(vm, thiz, thiz->data, i, list->elements.data[i]))
+        return;
+    }
+    return;
+  }
+
+  SetRuntimeErrorFmt(vm, "Cannot create a %s from %s.", _typedArrayName(thiz->kind),
+                     varTypeName(source));
+}
+
+// Returns the element index of the integer argument [index] which could be
+// negative (from the end), or -1 with an error set.
+static int64_t _typedArrayIndex(VM* vm, TypedArray* thiz, int arg) {
+  int32_t index;
+  if (!ValidateSlotInteger(vm, arg, &index))
+    return -1;
+  if (index < 0)
+    index += (int32_t) thiz->length;
+  if (index < 0 || (uint32_t) index >= thiz->length) {
+    SetRuntimeError(vm, "Index out of bound.");
+    return -1;
+  }
+  return index;
+}
+
+saynaa_function(_typedArraySubscriptGet, "types.Float64Array.[](index:Number)", "") {
+  TypedArray* thiz = GetThis(vm);
+  int64_t index = _typedArrayIndex(vm, thiz, 1);
+  if (index < 0)
+    return;
+  uint8_t* data = _typedArrayData(vm, thiz);
+  if (data == NULL)
+    return;
+  setSlotNumber(vm, 0, _typedArrayLoad(thiz, data, (uint32_t) index));
+}
+
+saynaa_function(_typedArraySubscriptSet,
+                "types.Float64Array.[]=(index:Number, value:Number)", "") {
+  TypedArray* thiz = GetThis(vm);
+  int64_t index = _typedArrayIndex(vm, thiz, 1);
+  if (index < 0)
+    return;
+  uint8_t* data = _typedArrayData(vm, thiz);
+  if (data == NULL)
+    return;
+  _typedArrayStore(vm, thiz, data, (uint32_t) index, ARG(2));
+}
+
+saynaa_function(_typedArrayFill, "types.Float64Array.fill(value:Number) -> Null",
+                "Set all the elements to the [value].") {
+  TypedArray* thiz = GetThis(vm);
+  uint8_t* data = _typedArrayData(vm, thiz);
+  if (data == NULL || thiz->length == 0)
+    return;
+  if (!_typedArrayStore(vm, thiz, data, 0, ARG(1)))
+    return;
+
+  uint32_t size = typedElementSize(thiz->kind);
+  for (uint32_t i = 1; i < thiz->length; i++)
+    memcpy(data + (size_t) i * size, data, size);
+}
+
+saynaa_function(_typedArrayList, "types.Float64Array.list() -> List",
+                "Returns a list of the elements.") {
+  TypedArray* thiz = GetThis(vm);
+  uint8_t* data = _typedArrayData(vm, thiz);
+  if (data == NULL && thiz->length != 0)
+    return;
+
+  List* list = newList(vm, thiz->length);
+  vmPushTempRef(vm, &list->_super); // list.
+  for (uint32_t i = 0; i < thiz->length; i++)
+    listAppend(vm, list, VAR_NUM(_typedArrayLoad(thiz, data, i)));
+  vmPopTempRef(vm); // list.
+  RET(VAR_OBJ(list));
+}
+
+saynaa_function(_typedArrayGetter, "types.Float64Array._getter()", "") {
+  const char* name;
+  uint32_t length;
+  if (!ValidateSlotString(vm, 1, &name, &length))
+    return;
+
+  TypedArray* thiz = GetThis(vm);
+  if (length == 6 && strncmp(name, "length", length) == 0) {
+    setSlotNumber(vm, 0, thiz->length);
+  }
+}
+
+// The iterator is the index of the current element.
+saynaa_function(_typedArrayNext, "types.Float64Array._next(iter:Var) -> Var", "") {
+  TypedArray* thiz = GetThis(vm);
+  Var iter = ARG(1);
+  double next = IS_NULL(iter) ? 0 : AS_NUM(iter) + 1;
+  RET((next < thiz->length) ? VAR_NUM(next) : VAR_NULL);
+}
+
+saynaa_function(_typedArrayValue, "types.Float64Array._value(iter:Var) -> Var", "") {
+  TypedArray* thiz = GetThis(vm);
+  uint8_t* data = _typedArrayData(vm, thiz);
+  if (data == NULL)
+    return;
+  setSlotNumber(vm, 0, _typedArrayLoad(thiz, data, (uint32_t) AS_NUM(ARG(1))));
+}
+
+saynaa_function(_typedArrayRepr, "types.Float64Array._repr()", "") {
+  TypedArray* thiz = GetThis(vm);
+  uint8_t* data = _typedArrayData(vm, thiz);
+  if (data == NULL && thiz->length != 0)
+    return;
+
+  List* list = newList(vm, thiz->length);
+  vmPushTempRef(vm, &list->_super); // list.
+  for (uint32_t i = 0; i < thiz->length; i++)
+    listAppend(vm, list, VAR_NUM(_typedArrayLoad(thiz, data, i)));
+  String* repr = toRepr(vm, VAR_OBJ(list));
+  vmPopTempRef(vm); // list.
+  vmPushTempRef(vm, &repr->_super); // repr.
+  setSlotStringFmt(vm, 0, "%s%s", _typedArrayName(thiz->kind), repr->data);
+  vmPopTempRef(vm); // repr.
+}
+
+#undef ARG
+
 /*****************************************************************************/
 /* MODULE REGISTER                                                           */
 /*****************************************************************************/
@@ -356,6 +1134,71 @@ void registerModuleTypes(VM* vm) {
 
   releaseHandle(vm, cls_vector);
 
+  Handle* cls_deque = NewClass(vm, "Deque", NULL, types, _dequeNew, _dequeDelete,
+                               "A double ended queue with constant time push and "
+                               "pop at both ends.");
+  ((Class*) AS_OBJ(cls_deque->value))->mark_fn = _dequeMark;
+
+  ADD_METHOD(cls_deque, "_init", _dequeInit, -1);
+  ADD_METHOD(cls_deque, "push", _dequePush, 1);
+  ADD_METHOD(cls_deque, "pushfront", _dequePushFront, 1);
+  ADD_METHOD(cls_deque, "pop", _dequePop, 0);
+  ADD_METHOD(cls_deque, "popfront", _dequePopFront, 0);
+  ADD_METHOD(cls_deque, "clear", _dequeClear, 0);
+  ADD_METHOD(cls_deque, "[]", _dequeSubscriptGet, 1);
+  ADD_METHOD(cls_deque, "[]=", _dequeSubscriptSet, 2);
+  ADD_METHOD(cls_deque, "_getter", _dequeGetter, 1);
+  ADD_METHOD(cls_deque, "_next", _dequeNext, 1);
+  ADD_METHOD(cls_deque, "_value", _dequeValue, 1);
+  ADD_METHOD(cls_deque, "_repr", _dequeRepr, 0);
+
+  releaseHandle(vm, cls_deque);
+
+  Handle* cls_heap = NewClass(vm, "Heap", NULL, types, _heapNew, _heapDelete,
+                              "A binary min heap (priority queue).");
+  ((Class*) AS_OBJ(cls_heap->value))->mark_fn = _heapMark;
+
+  ADD_METHOD(cls_heap, "_init", _heapInit, -1);
+  ADD_METHOD(cls_heap, "push", _heapPush, 1);
+  ADD_METHOD(cls_heap, "pop", _heapPop, 0);
+  ADD_METHOD(cls_heap, "peek", _heapPeek, 0);
+  ADD_METHOD(cls_heap, "replace", _heapReplace, 1);
+  ADD_METHOD(cls_heap, "clear", _heapClear, 0);
+  ADD_METHOD(cls_heap, "_getter", _heapGetter, 1);
+
+  releaseHandle(vm, cls_heap);
+
+  const struct {
+    const char* name;
+    NewInstanceFn new_fn;
+    TypedKind kind;
+    const char* docstring;
+  } typed_arrays[] = {
+    {"Float64Array", _float64ArrayNew, TYPED_FLOAT64, "A contiguous array of 64 bit floats."},
+    {"Int32Array", _int32ArrayNew, TYPED_INT32, "A contiguous array of 32 bit signed integers."},
+    {"Uint8Array", _uint8ArrayNew, TYPED_UINT8, "A contiguous array of unsigned bytes."},
+  };
+
+  for (int i = 0; i < (int) (sizeof(typed_arrays) / sizeof(*typed_arrays)); i++) {
+    Handle* cls_typed = NewClass(vm, typed_arrays[i].name, NULL, types, typed_arrays[i].new_fn,
+                                 _typedArrayDelete, typed_arrays[i].docstring);
+    Class* cls = (Class*) AS_OBJ(cls_typed->value);
+    cls->mark_fn = _typedArrayMark;
+    cls->typed_kind = typed_arrays[i].kind;
+
+    ADD_METHOD(cls_typed, "_init", _typedArrayInit, -1);
+    ADD_METHOD(cls_typed, "[]", _typedArraySubscriptGet, 1);
+    ADD_METHOD(cls_typed, "[]=", _typedArraySubscriptSet, 2);
+    ADD_METHOD(cls_typed, "fill", _typedArrayFill, 1);
+    ADD_METHOD(cls_typed, "list", _typedArrayList, 0);
+    ADD_METHOD(cls_typed, "_getter", _typedArrayGetter, 1);
+    ADD_METHOD(cls_typed, "_next", _typedArrayNext, 1);
+    ADD_METHOD(cls_typed, "_value", _typedArrayValue, 1);
+    ADD_METHOD(cls_typed, "_repr", _typedArrayRepr, 0);
+
+    releaseHandle(vm, cls_typed);
+  }
+
   registerModule(vm, types);
   releaseHandle(vm, types);
 }
@@ -110,6 +110,16 @@ static inline bool validateCond(VM* vm, bool condition, const char* err) {
   return true;
 }
 
+// Check if [value] can be an element of a set (or a key of a map). If not,
+// sets an error and returns false.
+static inline bool validateHashable(VM* vm, Var value) {
+  if (!isValueHashable(value)) {
+    VM_SET_ERROR(vm, stringFormat(vm, "$ type is not hashable.", varTypeName(value)));
+    return false;
+  }
+  return true;
+}
+
 // Check if [var] is string for argument at [arg]. If not set error and
 // return false.
 #define VALIDATE_ARG_OBJ(m_class, m_type, m_name) \
@@ -355,14 +365,9 @@ Var varSprintf(VM* vm, String* string, List* args) {
 // Calls a unary operator overload method. If the method does not exists it'll
 // return false, otherwise it'll call the method and return true. If any error
 // occures it'll set an error.
-static inline bool _callUnaryOpMethod(VM* vm, Var thiz, const char* method_name, Var* ret) {
-  Closure* closure = NULL;
-  String* name = newString(vm, method_name);
-  vmPushTempRef(vm, &name->_super); // name.
-  bool has_method = hasMethod(vm, thiz, name, &closure);
-  vmPopTempRef(vm); // name.
-
-  if (!has_method)
+static inline bool _callUnaryOpMethod(VM* vm, Var thiz, OperatorMethod op, Var* ret) {
+  Closure* closure = getClass(vm, thiz)->operator_methods[op];
+  if (closure == NULL)
     return false;
 
   vmCallMethod(vm, thiz, closure, 0, NULL, ret);
@@ -373,14 +378,9 @@ static inline bool _callUnaryOpMethod(VM* vm, Var thiz, const char* method_name,
 // return false, otherwise it'll call the method and return true. If any error
 // occures it'll set an error.
 static inline bool _callBinaryOpMethod(VM* vm, Var thiz, Var other,
-                                       const char* method_name, Var* ret) {
-  Closure* closure = NULL;
-  String* name = newString(vm, method_name);
-  vmPushTempRef(vm, &name->_super); // name.
-  bool has_method = hasMethod(vm, thiz, name, &closure);
-  vmPopTempRef(vm); // name.
-
-  if (!has_method)
+                                       OperatorMethod op, Var* ret) {
+  Closure* closure = getClass(vm, thiz)->operator_methods[op];
+  if (closure == NULL)
     return false;
 
   vmCallMethod(vm, thiz, closure, 1, &other, ret);
@@ -489,6 +489,395 @@ static void _listJoinImpl(VM* vm, List* list, String* sep) {
   RET(VAR_OBJ(str));
 }
 
+/*****************************************************************************/
+/* SORTING                                                                   */
+/*****************************************************************************/
+
+// List.sort() and sorted() are a TimSort: natural runs are found (strictly
+// descending ones are reversed), short runs are extended with binary
+// insertion sort and the runs are merged under the usual stack invariants.
+// It's stable and linear for input that's already (or reverse) ordered.
+//
+// The list is sorted through an array of (key, value) items, with a key
+// function the keys are computed once per element (decorate-sort-undecorate)
+// and without one the key is the value itself. Before sorting, the keys are
+// checked once, so all numbers or all strings are compared directly and only
+// mixed keys go through varLesser().
+
+// Runs shorter than this are extended by binary insertion sort.
+#define SORT_MIN_MERGE 32
+
+// Maximum pending runs, the stack invariants keep it logarithmic in the
+// list length, this is enough for any 32 bit length.
+#define SORT_MAX_RUNS 64
+
+typedef enum {
+  SORT_NUMBERS, // All keys are numbers.
+  SORT_STRINGS, // All keys are strings.
+  SORT_GENERIC, // Anything else, compared with varLesser().
+} SortKind;
+
+typedef struct {
+  Var key;
+  Var value;
+} SortItem;
+
+typedef struct {
+  uint32_t start;
+  uint32_t length;
+} SortRun;
+
+typedef struct {
+  VM* vm;
+  SortKind kind;
+  bool reverse;
+
+  // Set once a generic comparison failed, the remaining comparisons return
+  // false so the sort finishes (as a permutation) without running any more
+  // script code.
+  bool failed;
+
+  SortItem* items; // The items to sort.
+  SortItem* tmp;   // Merge buffer, large enough for half the items.
+
+  SortRun runs[SORT_MAX_RUNS];
+  int run_count;
+} SortState;
+
+static inline bool _sortLess(SortState* s, const SortItem* a, const SortItem* b) {
+  if (s->reverse) {
+    const SortItem* t = a;
+    a = b, b = t;
+  }
+
+  switch (s->kind) {
+    case SORT_NUMBERS:
+      return AS_NUM(a->key) < AS_NUM(b->key);
+
+    case SORT_STRINGS:
+      {
+        String *s1 = (String*) AS_OBJ(a->key), *s2 = (String*) AS_OBJ(b->key);
+        uint32_t min = (s1->length < s2->length) ? s1->length : s2->length;
+        int result = memcmp(s1->data, s2->data, min);
+        if (result == 0)
+          return s1->length < s2->length;
+        return result < 0;
+      }
+
+    case SORT_GENERIC:
+      {
+        if (s->failed)
+          return false;
+        Var lesser = varLesser(s->vm, a->key, b->key);
+        if (VM_HAS_ERROR(s->vm)) {
+          s->failed = true;
+          return false;
+        }
+        return toBool(lesser);
+      }
+  }
+
+  UNREACHABLE();
+  return false;
+}
+
+// Sort items[lo, hi) by binary insertion, items[lo, start) is already sorted.
+static void _sortBinaryInsertion(SortState* s, uint32_t lo, uint32_t hi, uint32_t start) {
+  SortItem* items = s->items;
+  for (; start < hi; start++) {
+    SortItem pivot = items[start];
+    uint32_t left = lo, right = start;
+    while (left < right) {
+      uint32_t mid = left + (right - left) / 2;
+      if (_sortLess(s, &pivot, &items[mid]))
+        right = mid;
+      else
+        left = mid + 1;
+    }
+    memmove(&items[left + 1], &items[left], sizeof(SortItem) * (start - left));
+    items[left] = pivot;
+  }
+}
+
+// Returns the length of the run starting at [lo], a descending run is
+// reversed in place. Descending has to be strict to keep the sort stable.
+static uint32_t _sortCountRun(SortState* s, uint32_t lo, uint32_t hi) {
+  SortItem* items = s->items;
+  uint32_t end = lo + 1;
+  if (end == hi)
+    return 1;
+
+  if (_sortLess(s, &items[end], &items[lo])) {
+    end++;
+    while (end < hi && _sortLess(s, &items[end], &items[end - 1]))
+      end++;
+    for (uint32_t i = lo, j = end - 1; i < j; i++, j--) {
+      SortItem t = items[i];
+      items[i] = items[j], items[j] = t;
+    }
+
+  } else {
+    end++;
+    while (end < hi && !_sortLess(s, &items[end], &items[end - 1]))
+      end++;
+  }
+
+  return end - lo;
+}
+
+// Returns a run length in [SORT_MIN_MERGE / 2, SORT_MIN_MERGE] such that
+// [n] / length is close to, but no more than a power of 2.
+static uint32_t _sortMinRun(uint32_t n) {
+  uint32_t r = 0;
+  while (n >= SORT_MIN_MERGE) {
+    r |= n & 1;
+    n >>= 1;
+  }
+  return n + r;
+}
+
+// Returns the number of items in [run, length) which are not greater than
+// the [key] (where the key goes in the run, after its equals).
+static uint32_t _sortUpperBound(SortState* s, const SortItem* key, const SortItem* run,
+                                uint32_t length) {
+  uint32_t left = 0, right = length;
+  while (left < right) {
+    uint32_t mid = left + (right - left) / 2;
+    if (_sortLess(s, key, &run[mid]))
+      right = mid;
+    else
+      left = mid + 1;
+  }
+  return left;
+}
+
+// Returns the number of items in [run, length) which are less than the [key]
+// (where the key goes in the run, before its equals).
+static uint32_t _sortLowerBound(SortState* s, const SortItem* key, const SortItem* run,
+                                uint32_t length) {
+  uint32_t left = 0, right = length;
+  while (left < right) {
+    uint32_t mid = left + (right - left) / 2;
+    if (_sortLess(s, &run[mid], key))
+      left = mid + 1;
+    else
+      right = mid;
+  }
+  return left;
+}
+
+// Merge the adjacent sorted runs a[0, len_a) and b[0, len_b) where b follows
+// a in memory. The shorter run is moved to the temp buffer, and the merge
+// fills the gap from the side it left.
+static void _sortMerge(SortState* s, SortItem* a, uint32_t len_a, SortItem* b, uint32_t len_b) {
+  SortItem* tmp = s->tmp;
+
+  if (len_a <= len_b) {
+    memcpy(tmp, a, sizeof(SortItem) * len_a);
+    SortItem *dst = a, *t = tmp, *t_end = tmp + len_a, *b_end = b + len_b;
+    while (t < t_end && b < b_end) {
+      if (_sortLess(s, b, t))
+        *dst++ = *b++;
+      else
+        *dst++ = *t++;
+    }
+    memcpy(dst, t, sizeof(SortItem) * (t_end - t));
+
+  } else {
+    memcpy(tmp, b, sizeof(SortItem) * len_b);
+    SortItem *dst = b + len_b, *t = tmp + len_b, *a_end = a + len_a;
+    while (t > tmp && a_end > a) {
+      if (_sortLess(s, t - 1, a_end - 1))
+        *--dst = *--a_end;
+      else
+        *--dst = *--t;
+    }
+    memcpy(a_end, tmp, sizeof(SortItem) * (t - tmp));
+  }
+}
+
+// Merge the pending runs at [i] and [i + 1].
+static void _sortMergeAt(SortState* s, int i) {
+  SortRun* runs = s->runs;
+  SortItem* a = s->items + runs[i].start;
+  SortItem* b = s->items + runs[i + 1].start;
+  uint32_t len_a = runs[i].length, len_b = runs[i + 1].length;
+
+  runs[i].length += len_b;
+  if (i == s->run_count - 3)
+    runs[i + 1] = runs[i + 2];
+  s->run_count--;
+
+  // Items at the start of a which are not greater than b[0] and items at the
+  // end of b which are not less than the last of a are already in place.
+  uint32_t k = _sortUpperBound(s, b, a, len_a);
+  a += k, len_a -= k;
+  if (len_a == 0)
+    return;
+
+  len_b = _sortLowerBound(s, &a[len_a - 1], b, len_b);
+  if (len_b == 0)
+    return;
+
+  _sortMerge(s, a, len_a, b, len_b);
+}
+
+// Merge the pending runs until the invariants below hold for every three
+// consecutive runs X, Y, Z (Z on top):  X > Y + Z  and  Y > Z.
+static void _sortMergeCollapse(SortState* s) {
+  SortRun* runs = s->runs;
+  while (s->run_count > 1) {
+    int n = s->run_count - 2;
+    if ((n > 0 && runs[n - 1].length <= runs[n].length + runs[n + 1].length) ||
+        (n > 1 && runs[n - 2].length <= runs[n - 1].length + runs[n].length)) {
+      if (runs[n - 1].length < runs[n + 1].length)
+        n--;
+    } else if (runs[n].length > runs[n + 1].length) {
+      break;
+    }
+    _sortMergeAt(s, n);
+  }
+}
+
+static void _sortMergeForce(SortState* s) {
+  SortRun* runs = s->runs;
+  while (s->run_count > 1) {
+    int n = s->run_count - 2;
+    if (n > 0 && runs[n - 1].length < runs[n + 1].length)
+      n--;
+    _sortMergeAt(s, n);
+  }
+}
+
+static void _sortItems(SortState* s, uint32_t count) {
+  if (count < SORT_MIN_MERGE) {
+    _sortBinaryInsertion(s, 0, count, _sortCountRun(s, 0, count));
+    return;
+  }
+
+  uint32_t min_run = _sortMinRun(count);
+  uint32_t lo = 0;
+  while (lo < count) {
+    uint32_t length = _sortCountRun(s, lo, count);
+    if (length < min_run) {
+      uint32_t force = (count - lo < min_run) ? count - lo : min_run;
+      _sortBinaryInsertion(s, lo, lo + force, lo + length);
+      length = force;
+    }
+
+    ASSERT(s->run_count < SORT_MAX_RUNS, OOPS);
+    s->runs[s->run_count].start = lo;
+    s->runs[s->run_count].length = length;
+    s->run_count++;
+    _sortMergeCollapse(s);
+
+    lo += length;
+  }
+
+  _sortMergeForce(s);
+}
+
+// Sort the [list] in place, if the [key] isn't NULL it's called once for
+// each element and the results are compared. Returns false if an error was
+// set on the VM, in which case the list is unchanged.
+static bool _listSortImpl(VM* vm, List* list, Closure* key, bool reverse) {
+  uint32_t count = list->elements.count;
+  if (count < 2)
+    return true;
+
+  // The keys list keeps the results of the key function alive.
+  List* keys = NULL;
+  if (key != NULL) {
+    keys = newList(vm, count);
+    vmPushTempRef(vm, &keys->_super); // keys.
+    for (uint32_t i = 0; i < count; i++) {
+      if (list->elements.count != count)
+        break;
+      Var value = list->elements.data[i], result;
+      if (vmCallFunction(vm, key, 1, &value, &result) != RESULT_SUCCESS || VM_HAS_ERROR(vm)) {
+        vmPopTempRef(vm); // keys.
+        return false;
+      }
+      listAppend(vm, keys, result);
+    }
+    if (list->elements.count != count) {
+      vmPopTempRef(vm); // keys.
+      VM_SET_ERROR(vm, newString(vm, "List modified during sort."));
+      return false;
+    }
+  }
+
+  Var* key_data = (keys != NULL) ? keys->elements.data : list->elements.data;
+  SortKind kind = IS_NUM(key_data[0]) ? SORT_NUMBERS
+                  : IS_OBJ_TYPE(key_data[0], OBJ_STRING) ? SORT_STRINGS
+                                                         : SORT_GENERIC;
+  for (uint32_t i = 1; i < count && kind != SORT_GENERIC; i++) {
+    if (kind == SORT_NUMBERS ? !IS_NUM(key_data[i]) : !IS_OBJ_TYPE(key_data[i], OBJ_STRING))
+      kind = SORT_GENERIC;
+  }
+
+  // Generic comparisons could run script code, which may remove elements
+  // from the list while they're only referenced by the items buffer.
+  List* values = NULL;
+  if (kind == SORT_GENERIC) {
+    values = newList(vm, count);
+    vmPushTempRef(vm, &values->_super); // values.
+    for (uint32_t i = 0; i < count; i++)
+      listAppend(vm, values, list->elements.data[i]);
+  }
+
+  SortState s;
+  s.vm = vm;
+  s.kind = kind;
+  s.reverse = reverse;
+  s.failed = false;
+  s.run_count = 0;
+  s.items = ALLOCATE_ARRAY(vm, SortItem, count);
+  s.tmp = ALLOCATE_ARRAY(vm, SortItem, count / 2 + 1);
+
+  for (uint32_t i = 0; i < count; i++) {
+    Var value = (values != NULL) ? values->elements.data[i] : list->elements.data[i];
+    s.items[i].key = (keys != NULL) ? keys->elements.data[i] : value;
+    s.items[i].value = value;
+  }
+
+  _sortItems(&s, count);
+
+  bool success = !s.failed;
+  if (success && list->elements.count != count) {
+    VM_SET_ERROR(vm, newString(vm, "List modified during sort."));
+    success = false;
+  }
+  if (success) {
+    for (uint32_t i = 0; i < count; i++)
+      list->elements.data[i] = s.items[i].value;
+  }
+
+  DEALLOCATE_ARRAY(vm, s.tmp, SortItem, count / 2 + 1);
+  DEALLOCATE_ARRAY(vm, s.items, SortItem, count);
+
+  if (values != NULL)
+    vmPopTempRef(vm); // values.
+  if (keys != NULL)
+    vmPopTempRef(vm); // keys.
+
+  return success;
+}
+
+// Parse the optional (key, reverse) arguments of the sort functions starting
+// at the argument [arg], a null key is the same as no key.
+static bool _validateSortArgs(VM* vm, int arg, Closure** key, bool* reverse) {
+  *key = NULL;
+  *reverse = false;
+  if (ARGC >= arg && !IS_NULL(ARG(arg))) {
+    if (!validateArgClosure(vm, arg, key))
+      return false;
+  }
+  if (ARGC >= arg + 1)
+    *reverse = toBool(ARG(arg + 1));
+  return true;
+}
+
 /*****************************************************************************/
 /* CORE BUILTIN FUNCTIONS                                                    */
 /*****************************************************************************/
@@ -566,6 +955,9 @@ saynaa_function(coreDir, "dir(v:Var) -> List[String]",
     case vSTRING:
     case vLIST:
     case vMAP:
+    case vSET:
+    case vITERATOR:
+    case vTUPLE:
     case vRANGE:
     case vCLOSURE:
     case vFIBER:
@@ -621,7 +1013,7 @@ saynaa_function(coreDir, "dir(v:Var) -> List[String]",
           }
         }
         if (inst->attribs != NULL) {
-          for (uint32_t i = 0; i < inst->attribs->capacity; i++) {
+          for (uint32_t i = 0; i < inst->attribs->used; i++) {
             Var key = (inst->attribs->entries + i)->key;
             if (!IS_UNDEF(key)) {
               ASSERT(IS_OBJ_TYPE(key, OBJ_STRING), OOPS);
@@ -938,6 +1330,7 @@ saynaa_function(coreEval, "eval(expression:String) -> Var",
 
       CompileOptions options = newCompilerOptions();
       options.runtime = true;
+      options.optimize_level = vm->config.optimize_level;
       Result result = compile(vm, new_module, code->data, &options);
 
       if (result == RESULT_SUCCESS) {
@@ -1020,6 +1413,7 @@ saynaa_function(
       } else {
         CompileOptions options = newCompilerOptions();
         options.runtime = true;
+        options.optimize_level = vm->config.optimize_level;
         result = compile(vm, new_module, source, &options);
       }
     }
@@ -1078,9 +1472,9 @@ saynaa_function(
   RET_ERR(newString(vm, "delete() expects a String or an instance."));
 }
 
-saynaa_function(corePcall, "pcall(fn:Closure, ...args) -> List",
+saynaa_function(corePcall, "pcall(fn:Closure, ...args) -> Tuple",
                 "Calls function in protected mode."
-                " Returns [success, result/error].") {
+                " Returns (success, result/error).") {
   int arg_count = ARGC;
   if (arg_count < 1) {
     RET_ERR(newString(vm, "Expected at least 1 argument (the function)."));
@@ -1104,15 +1498,15 @@ saynaa_function(corePcall, "pcall(fn:Closure, ...args) -> List",
 
   bool success = vmPrepareFiber(vm, fiber, call_argc, call_argv);
 
-  List* ret_list = newList(vm, 2);
-  vmPushTempRef(vm, &ret_list->_super); // ret_list.
+  Tuple* ret = newTuple(vm, 2);
+  vmPushTempRef(vm, &ret->_super); // ret.
 
   if (!success) {
     String* err = vm->fiber->error;
     vm->fiber->error = NULL; // clear error
 
-    listAppend(vm, ret_list, VAR_FALSE);
-    listAppend(vm, ret_list, VAR_OBJ(err));
+    ret->items[0] = VAR_FALSE;
+    ret->items[1] = VAR_OBJ(err);
 
   } else {
     // Suppress error reporting
@@ -1142,23 +1536,23 @@ saynaa_function(corePcall, "pcall(fn:Closure, ...args) -> List",
     vm->fiber = last;
 
     if (result == RESULT_SUCCESS) {
-      listAppend(vm, ret_list, VAR_TRUE);
-      listAppend(vm, ret_list, *fiber->ret);
+      ret->items[0] = VAR_TRUE;
+      ret->items[1] = *fiber->ret;
     } else {
-      listAppend(vm, ret_list, VAR_FALSE);
+      ret->items[0] = VAR_FALSE;
       if (fiber->error) {
-        listAppend(vm, ret_list, VAR_OBJ(fiber->error));
+        ret->items[1] = VAR_OBJ(fiber->error);
       } else {
-        listAppend(vm, ret_list, VAR_OBJ(newString(vm, "Unknown Error")));
+        ret->items[1] = VAR_OBJ(newString(vm, "Unknown Error"));
       }
       fiber->error = NULL;
     }
   }
 
-  vmPopTempRef(vm); // ret_list.
+  vmPopTempRef(vm); // ret.
   vmPopTempRef(vm); // fiber.
 
-  RET(VAR_OBJ(ret_list));
+  RET(VAR_OBJ(ret));
 }
 
 // List functions.
@@ -1196,6 +1590,57 @@ saynaa_function(
   _listJoinImpl(vm, list, sep);
 }
 
+saynaa_function(coreSorted, "sorted(seq:Var[, key:Closure, reverse:Bool=false]) -> List",
+                "Returns a new sorted list of the elements of the iterable [seq]. "
+                "The sort is stable, if [key] is given it's called once per element "
+                "and the results are compared instead of the elements.") {
+  if (!CheckArgcRange(vm, ARGC, 1, 3))
+    return;
+
+  Closure* key;
+  bool reverse;
+  if (!_validateSortArgs(vm, 2, &key, &reverse))
+    return;
+
+  Var seq = ARG(1);
+  if (!IS_OBJ(seq)) {
+    RET_ERR(stringFormat(vm, "$ is not iterable.", varTypeName(seq)));
+  }
+
+  List* list = newList(vm, 0);
+  vmPushTempRef(vm, &list->_super); // list.
+  if (IS_OBJ_TYPE(seq, OBJ_LIST)) {
+    List* src = (List*) AS_OBJ(seq);
+    VarBufferReserve(&list->elements, vm, src->elements.count);
+    for (uint32_t i = 0; i < src->elements.count; i++)
+      listAppend(vm, list, src->elements.data[i]);
+
+  } else {
+    Var iterator = VAR_NULL, value = VAR_NULL;
+    while (varIterate(vm, seq, &iterator, &value)) {
+      listAppend(vm, list, value);
+    }
+  }
+
+  if (!VM_HAS_ERROR(vm))
+    _listSortImpl(vm, list, key, reverse);
+  vmPopTempRef(vm); // list.
+
+  RET(VAR_OBJ(list));
+}
+
+saynaa_function(coreIter, "iter(seq:Var) -> Iterator",
+                "Returns a lazy iterator over the iterable [seq], same as "
+                "Iterator(seq).") {
+  Var seq = ARG(1);
+  if (!IS_OBJ(seq)) {
+    RET_ERR(stringFormat(vm, "$ is not iterable.", varTypeName(seq)));
+  }
+  if (IS_OBJ_TYPE(seq, OBJ_ITERATOR))
+    RET(seq);
+  RET(VAR_OBJ(newIterator(vm, seq, NULL, 0)));
+}
+
 static void initializeBuiltinFN(VM* vm, Closure** bfn, const char* name, int length,
                                 int arity, nativeFn ptr, const char* docstring) {
   Function* fn = newFunction(vm, name, length, NULL, true, docstring, NULL);
@@ -1238,6 +1683,8 @@ static void initializeBuiltinFunctions(VM* vm) {
   // List functions.
   INITIALIZE_BUILTIN_FN("list_append", coreListAppend, 2);
   INITIALIZE_BUILTIN_FN("list_join", coreListJoin, -1);
+  INITIALIZE_BUILTIN_FN("sorted", coreSorted, -1);
+  INITIALIZE_BUILTIN_FN("iter", coreIter, 1);
 
 #undef INITIALIZE_BUILTIN_FN
 }
@@ -1335,6 +1782,14 @@ saynaa_function(stdLangBackTrace, "lang.backtrace() -> String",
       const char* path = (fn->owner->path) ? fn->owner->path->data : "<?>";
       const char* fn_name = (fn->name) ? fn->name : "<?>";
 
+      int call_line = line;
+      const Function* inlined = fnInlinedAt(fn, (uint32_t) instruction_index, &call_line);
+      if (inlined != NULL) {
+        const char* inlined_name = (inlined->name) ? inlined->name : "<?>";
+        ByteBufferAddStringFmt(&bb, vm, "%s;%s;%i\n", inlined_name, path, line);
+        line = call_line;
+      }
+
       ByteBufferAddStringFmt(&bb, vm, "%s;%s;%i\n", fn_name, path, line);
     }
 
@@ -1357,7 +1812,7 @@ saynaa_function(stdLangModules, "lang.modules() -> List",
                 "Returns the list of all registered modules.") {
   List* list = newList(vm, 8);
   vmPushTempRef(vm, &list->_super); // list.
-  for (uint32_t i = 0; i < vm->modules->capacity; i++) {
+  for (uint32_t i = 0; i < vm->modules->used; i++) {
     if (!IS_UNDEF(vm->modules->entries[i].key)) {
       Var entry = vm->modules->entries[i].value;
       ASSERT(IS_OBJ_TYPE(entry, OBJ_MODULE), OOPS);
@@ -1504,6 +1959,32 @@ static void _ctorMap(VM* vm) {
   RET(VAR_OBJ(newMap(vm)));
 }
 
+static void _ctorSet(VM* vm) {
+  Set* set = newSet(vm);
+  vmPushTempRef(vm, &set->_super); // set.
+  for (int i = 0; i < ARGC; i++) {
+    if (!validateHashable(vm, ARG(i + 1)))
+      break;
+    setAdd(vm, set, ARG(i + 1));
+  }
+  vmPopTempRef(vm); // set.
+  RET(VAR_OBJ(set));
+}
+
+static void _ctorTuple(VM* vm) {
+  Tuple* tuple = newTuple(vm, (uint32_t) ARGC);
+  for (int i = 0; i < ARGC; i++) {
+    tuple->items[i] = ARG(i + 1);
+  }
+  RET(VAR_OBJ(tuple));
+}
+
+static void _ctorIterator(VM* vm) {
+  if (IS_OBJ_TYPE(ARG(1), OBJ_ITERATOR))
+    RET(ARG(1));
+  RET(VAR_OBJ(newIterator(vm, ARG(1), NULL, 0)));
+}
+
 static void _ctorRange(VM* vm) {
   double from, to;
   if (!validateNumeric(vm, ARG(1), &from, "Argument 1"))
@@ -1647,19 +2128,24 @@ saynaa_function(_stringFind, "String.find(sub:String[, start:Number=0]) -> Numbe
 
   String* thiz = (String*) AS_OBJ(THIS);
 
-  if (thiz->length <= start) {
+  // The indexes are codepoint indexes like the subscript.
+  if ((int64_t) stringCodepointCount(thiz) <= start) {
     RET(VAR_NUM((double) -1));
   }
+  if (start < 0)
+    start = 0;
+  uint32_t from = stringCodepointOffset(vm, thiz, (uint32_t) start);
 
   // Use utilMemMem because strings may contain embedded null bytes.
-  const char* match = (const char*) utilMemMem(thiz->data + start, thiz->length - start,
+  const char* match = (const char*) utilMemMem(thiz->data + from, thiz->length - from,
                                                sub->data, sub->length);
 
   if (match == NULL)
     RET(VAR_NUM((double) -1));
 
   ASSERT_INDEX(match - thiz->data, thiz->capacity);
-  RET(VAR_NUM((double) (match - thiz->data)));
+  uint32_t offset = (uint32_t) (match - thiz->data);
+  RET(VAR_NUM((double) stringCodepointIndex(vm, thiz, offset)));
 }
 
 saynaa_function(_stringRFind, "String.rfind(sub:String[, start:Number=0]) -> Number",
@@ -1680,15 +2166,18 @@ saynaa_function(_stringRFind, "String.rfind(sub:String[, start:Number=0]) -> Num
 
   String* thiz = (String*) AS_OBJ(THIS);
 
-  if ((int64_t) thiz->length <= start) {
+  // The indexes are codepoint indexes like the subscript.
+  uint32_t count = stringCodepointCount(thiz);
+  if ((int64_t) count <= start) {
     RET(VAR_NUM((double) -1));
   }
 
   if (start < 0)
     start = 0;
+  uint32_t from = stringCodepointOffset(vm, thiz, (uint32_t) start);
 
-  const char* haystack = thiz->data + start;
-  size_t haystack_len = thiz->length - start;
+  const char* haystack = thiz->data + from;
+  size_t haystack_len = thiz->length - from;
   const char* needle = sub->data;
   size_t needle_len = sub->length;
 
@@ -1701,7 +2190,7 @@ saynaa_function(_stringRFind, "String.rfind(sub:String[, start:Number=0]) -> Num
     // Mimicking finding last "" could be at end of string.
     // But we searched from `start`.
     // If start=0, full string. Last "" is at length.
-    RET(VAR_NUM((double) thiz->length));
+    RET(VAR_NUM((double) count));
   }
 
   const char* match = NULL;
@@ -1716,7 +2205,8 @@ saynaa_function(_stringRFind, "String.rfind(sub:String[, start:Number=0]) -> Num
   if (match == NULL)
     RET(VAR_NUM((double) -1));
 
-  RET(VAR_NUM((double) (match - thiz->data)));
+  uint32_t offset = (uint32_t) (match - thiz->data);
+  RET(VAR_NUM((double) stringCodepointIndex(vm, thiz, offset)));
 }
 
 saynaa_function(
@@ -1730,38 +2220,43 @@ saynaa_function(
     return;
 
   String* thiz = (String*) AS_OBJ(THIS);
-  int64_t end = (int64_t) thiz->length;
+  int64_t count = (int64_t) stringCodepointCount(thiz);
+  int64_t end = count;
   if (ARGC == 2) {
     if (!validateInteger(vm, ARG(2), &end, "Argument 2"))
       return;
   }
 
   if (start < 0)
-    start = (int64_t) thiz->length + start;
+    start = count + start;
   if (end < 0)
-    end = (int64_t) thiz->length + end;
+    end = count + end;
 
   if (start < 0)
     start = 0;
-  if (end > (int64_t) thiz->length)
-    end = (int64_t) thiz->length;
+  if (end > count)
+    end = count;
 
   if (start >= end)
     RET(VAR_OBJ(newStringLength(vm, NULL, 0)));
 
-  uint32_t length = (uint32_t) (end - start);
-  RET(VAR_OBJ(newStringLength(vm, thiz->data + start, length)));
+  uint32_t from = stringCodepointOffset(vm, thiz, (uint32_t) start);
+  uint32_t to = stringCodepointOffset(vm, thiz, (uint32_t) end);
+  RET(VAR_OBJ(newStringLength(vm, thiz->data + from, to - from)));
 }
 
 saynaa_function(_stringReverse, "String.reverse() -> String",
-                "Returns a copy of the string with reversed bytes.") {
+                "Returns a copy of the string with reversed characters.") {
   String* thiz = (String*) AS_OBJ(THIS);
   if (thiz->length == 0)
     RET(THIS);
 
+  // Each codepoint is copied as a whole to the mirrored position.
   char* buff = (char*) Realloc(vm, NULL, thiz->length);
-  for (uint32_t i = 0; i < thiz->length; i++) {
-    buff[i] = thiz->data[thiz->length - i - 1];
+  for (uint32_t i = 0; i < thiz->length;) {
+    uint32_t width = stringCodepointWidth(thiz, i);
+    memcpy(buff + thiz->length - i - width, thiz->data + i, width);
+    i += width;
   }
   String* out = newStringLength(vm, buff, thiz->length);
   Realloc(vm, buff, 0);
@@ -1798,7 +2293,8 @@ saynaa_function(_stringRep, "String.rep(count:Number) -> String",
 }
 
 saynaa_function(_stringByte, "String.byte(index:Number) -> Number",
-                "Returns the byte value at [index].") {
+                "Returns the byte value at the byte offset [index] (not a "
+                "character index, a multibyte character has more bytes).") {
   int64_t index = 0;
   if (!validateInteger(vm, ARG(1), &index, "Argument 1"))
     return;
@@ -2125,6 +2621,23 @@ saynaa_function(
   _listJoinImpl(vm, list, sep);
 }
 
+saynaa_function(_listSort, "List.sort([key:Closure, reverse:Bool=false]) -> List",
+                "Sorts the list in place and returns it. The sort is stable, if [key] "
+                "is given it's called once per element and the results are compared "
+                "instead of the elements.") {
+  ASSERT(IS_OBJ_TYPE(THIS, OBJ_LIST), OOPS);
+  if (!CheckArgcRange(vm, ARGC, 0, 2))
+    return;
+
+  Closure* key;
+  bool reverse;
+  if (!_validateSortArgs(vm, 1, &key, &reverse))
+    return;
+
+  if (_listSortImpl(vm, (List*) AS_OBJ(THIS), key, reverse))
+    RET(THIS);
+}
+
 saynaa_function(_listClear, "List.clear() -> Null", "Removes all the entries in the list.") {
   listClear(vm, (List*) AS_OBJ(THIS));
 }
@@ -2196,6 +2709,417 @@ saynaa_function(_mapPop, "Map.pop(key:Var) -> Var", "Pops the value at the key a
   RET(value);
 }
 
+saynaa_function(_mapItems, "Map.items() -> Iterator",
+                "Returns a lazy iterator of the (key, value) entries of the map, "
+                "which can be unpacked with for key, value in map.items().") {
+  Iterator* iter = newIterator(vm, THIS, NULL, 0);
+  iter->source_kind = ITER_SOURCE_ITEMS;
+  RET(VAR_OBJ(iter));
+}
+
+saynaa_function(_mapValues, "Map.values() -> Iterator",
+                "Returns a lazy iterator of the values of the map. Unlike the "
+                "values property it doesn't copy them into a new list.") {
+  Iterator* iter = newIterator(vm, THIS, NULL, 0);
+  iter->source_kind = ITER_SOURCE_VALUES;
+  RET(VAR_OBJ(iter));
+}
+
+// Add all the elements of the iterable [seq] to the [set].
+static bool _setAddIterable(VM* vm, Set* set, Var seq) {
+  if (!IS_OBJ(seq)) {
+    VM_SET_ERROR(vm, stringFormat(vm, "$ is not iterable.", varTypeName(seq)));
+    return false;
+  }
+
+  Var iterator = VAR_NULL, value = VAR_NULL;
+  while (varIterate(vm, seq, &iterator, &value)) {
+    if (!validateHashable(vm, value))
+      return false;
+    setAdd(vm, set, value);
+  }
+  return !VM_HAS_ERROR(vm);
+}
+
+saynaa_function(_setAdd, "Set.add(value:Var) -> Set",
+                "Add the [value] to the set and return the Set.") {
+  ASSERT(IS_OBJ_TYPE(THIS, OBJ_SET), OOPS);
+  if (!validateHashable(vm, ARG(1)))
+    return;
+  setAdd(vm, (Set*) AS_OBJ(THIS), ARG(1));
+  RET(THIS);
+}
+
+saynaa_function(_setRemove, "Set.remove(value:Var) -> Bool",
+                "Remove the [value] from the set. Returns false if it wasn't in the "
+                "set.") {
+  Var value = ARG(1);
+  if (!isValueHashable(value))
+    RET(VAR_FALSE);
+  RET(VAR_BOOL(setRemove(vm, (Set*) AS_OBJ(THIS), value)));
+}
+
+saynaa_function(_setHas, "Set.has(value:Var) -> Bool",
+                "Returns true if the [value] is in the set.") {
+  Var value = ARG(1);
+  if (!isValueHashable(value))
+    RET(VAR_FALSE);
+  RET(VAR_BOOL(setHas((Set*) AS_OBJ(THIS), value)));
+}
+
+saynaa_function(_setClear, "Set.clear() -> Null", "Removes all the elements in the set.") {
+  setClear(vm, (Set*) AS_OBJ(THIS));
+}
+
+saynaa_function(_setUnion, "Set.union(other:Var) -> Set",
+                "Returns a new set with the elements of the set and the iterable "
+                "[other].") {
+  Set* thiz = (Set*) AS_OBJ(THIS);
+  Set* result = newSet(vm);
+  vmPushTempRef(vm, &result->_super); // result.
+
+  Var key;
+  uint32_t position = 0;
+  while (setIterate(thiz, &position, &key))
+    setAdd(vm, result, key);
+  _setAddIterable(vm, result, ARG(1));
+
+  vmPopTempRef(vm); // result.
+  RET(VAR_OBJ(result));
+}
+
+// Returns a set with the elements which are (or are not if [keep] is false)
+// in the [other] iterable, in the order of [thiz].
+static void _setFilterImpl(VM* vm, Set* thiz, Var other, bool keep) {
+  Set* lookup = NULL;
+  if (IS_OBJ_TYPE(other, OBJ_SET)) {
+    lookup = (Set*) AS_OBJ(other);
+  } else {
+    lookup = newSet(vm);
+    vmPushTempRef(vm, &lookup->_super); // lookup.
+    bool success = _setAddIterable(vm, lookup, other);
+    vmPopTempRef(vm); // lookup.
+    if (!success)
+      RET(VAR_NULL);
+  }
+  vmPushTempRef(vm, &lookup->_super); // lookup.
+
+  Set* result = newSet(vm);
+  vmPushTempRef(vm, &result->_super); // result.
+
+  Var key;
+  uint32_t position = 0;
+  while (setIterate(thiz, &position, &key)) {
+    if (setHas(lookup, key) == keep)
+      setAdd(vm, result, key);
+  }
+
+  vmPopTempRef(vm); // result.
+  vmPopTempRef(vm); // lookup.
+  RET(VAR_OBJ(result));
+}
+
+saynaa_function(_setIntersection, "Set.intersection(other:Var) -> Set",
+                "Returns a new set with the elements of the set which are also in "
+                "the iterable [other].") {
+  _setFilterImpl(vm, (Set*) AS_OBJ(THIS), ARG(1), true);
+}
+
+saynaa_function(_setDifference, "Set.difference(other:Var) -> Set",
+                "Returns a new set with the elements of the set which are not in "
+                "the iterable [other].") {
+  _setFilterImpl(vm, (Set*) AS_OBJ(THIS), ARG(1), false);
+}
+
+// Pin and unpin the current value of the iterator pipeline, since the stages
+// allocate (calling a closure allocates a fiber) before the value is
+// referenced anywhere else.
+#define ITER_PIN(v) \
+  do { \
+    pinned = IS_OBJ(v); \
+    if (pinned) \
+      vmPushTempRef(vm, AS_OBJ(v)); /* v. */ \
+  } while (false)
+
+#define ITER_UNPIN() \
+  do { \
+    if (pinned) \
+      vmPopTempRef(vm); /* v. */ \
+    pinned = false; \
+  } while (false)
+
+// Returns a new (first, second) tuple, the same as the items of a map.
+static Var _iteratorPair(VM* vm, Var first, Var second) {
+  if (IS_OBJ(first))
+    vmPushTempRef(vm, AS_OBJ(first)); // first.
+  if (IS_OBJ(second))
+    vmPushTempRef(vm, AS_OBJ(second)); // second.
+
+  Tuple* pair = newTuple(vm, 2);
+  pair->items[0] = first;
+  pair->items[1] = second;
+
+  if (IS_OBJ(second))
+    vmPopTempRef(vm); // second.
+  if (IS_OBJ(first))
+    vmPopTempRef(vm); // first.
+  return VAR_OBJ(pair);
+}
+
+// Pull the next raw value from the source of the [iter]. The map views walk
+// the entries directly with the position as the cursor, the items are
+// (key, value) tuples.
+static bool _iteratorPull(VM* vm, Iterator* iter, Var* value) {
+  if (iter->source_kind == ITER_SOURCE_SEQ)
+    return varIterate(vm, iter->source, &iter->cursor, value);
+
+  Map* map = (Map*) AS_OBJ(iter->source);
+  uint32_t position = IS_NULL(iter->cursor) ? 0 : (uint32_t) AS_NUM(iter->cursor);
+  Var key;
+  if (!mapIterate(map, &position, &key, value))
+    return false;
+  iter->cursor = VAR_NUM((double) position);
+
+  if (iter->source_kind == ITER_SOURCE_ITEMS) {
+    // The key and the value are still referenced by the map.
+    Tuple* item = newTuple(vm, 2);
+    item->items[0] = key;
+    item->items[1] = *value;
+    *value = VAR_OBJ(item);
+  }
+  return true;
+}
+
+// Pull the next value from the source of the [iter] and pass it through all
+// the stages in a single loop. Returns false if the iterator is exhausted or
+// an error has been set.
+static bool _iteratorNext(VM* vm, Iterator* iter, Var* value) {
+  if (iter->done)
+    return false;
+
+  // A value has to pass all the stages, once a take stage is over nothing
+  // could come out, so stop without pulling from the source.
+  for (uint32_t i = 0; i < iter->stage_count; i++) {
+    if (iter->stages[i].kind == ITER_TAKE && iter->stages[i].count <= 0) {
+      iter->done = true;
+      return false;
+    }
+  }
+
+  bool pinned = false;
+  for (;;) {
+    Var v;
+    if (!_iteratorPull(vm, iter, &v)) {
+      iter->done = true;
+      return false;
+    }
+    ITER_PIN(v);
+
+    bool dropped = false;
+    for (uint32_t i = 0; i < iter->stage_count && !dropped; i++) {
+      IteratorStage* stage = &iter->stages[i];
+      Var result;
+
+      switch (stage->kind) {
+        case ITER_MAP:
+        case ITER_FILTER:
+          {
+            Closure* fn = (Closure*) AS_OBJ(stage->arg);
+            if (vmCallFunction(vm, fn, 1, &v, &result) != RESULT_SUCCESS || VM_HAS_ERROR(vm)) {
+              ITER_UNPIN();
+              return false;
+            }
+            if (stage->kind == ITER_FILTER) {
+              dropped = !toBool(result);
+              continue;
+            }
+          }
+          break;
+
+        case ITER_TAKE:
+          if (stage->count <= 0) {
+            ITER_UNPIN();
+            iter->done = true;
+            return false;
+          }
+          stage->count--;
+          continue;
+
+        case ITER_ENUMERATE:
+          result = _iteratorPair(vm, VAR_NUM(stage->count), v);
+          stage->count++;
+          break;
+
+        case ITER_ZIP:
+          {
+            Var other;
+            if (!varIterate(vm, stage->arg, &stage->cursor, &other)) {
+              ITER_UNPIN();
+              iter->done = true;
+              return false;
+            }
+            result = _iteratorPair(vm, v, other);
+          }
+          break;
+      }
+
+      ITER_UNPIN();
+      v = result;
+      ITER_PIN(v);
+    }
+
+    ITER_UNPIN();
+    if (!dropped) {
+      *value = v;
+      return true;
+    }
+  }
+}
+
+#undef ITER_PIN
+#undef ITER_UNPIN
+
+// Returns the number of values of a fresh iteration over the [seq] if it's
+// known without iterating, otherwise -1.
+static int64_t _iterableLength(Var seq) {
+  if (!IS_OBJ(seq))
+    return -1;
+
+  Object* obj = AS_OBJ(seq);
+  switch (obj->type) {
+    case OBJ_LIST:
+      return ((List*) obj)->elements.count;
+    case OBJ_MAP:
+      return ((Map*) obj)->count;
+    case OBJ_SET:
+      return ((Set*) obj)->count;
+    case OBJ_TUPLE:
+      return ((Tuple*) obj)->length;
+    case OBJ_RANGE:
+      {
+        Range* range = (Range*) obj;
+        return (int64_t) fabs(range->to - range->from);
+      }
+    default:
+      return -1;
+  }
+}
+
+// Returns the number of values the [iter] will produce if it's known without
+// running it (no filter and the iterables haven't been started), otherwise -1.
+static int64_t _iteratorLengthHint(const Iterator* iter) {
+  if (iter->done)
+    return 0;
+  if (!IS_NULL(iter->cursor))
+    return -1;
+
+  int64_t length = _iterableLength(iter->source);
+  for (uint32_t i = 0; i < iter->stage_count && length >= 0; i++) {
+    const IteratorStage* stage = &iter->stages[i];
+    switch (stage->kind) {
+      case ITER_MAP:
+      case ITER_ENUMERATE:
+        break;
+
+      case ITER_FILTER:
+        return -1;
+
+      case ITER_TAKE:
+        if (stage->count < length)
+          length = (int64_t) stage->count;
+        break;
+
+      case ITER_ZIP:
+        {
+          int64_t other = IS_NULL(stage->cursor) ? _iterableLength(stage->arg) : -1;
+          length = (other < length) ? other : length;
+        }
+        break;
+    }
+  }
+  return length;
+}
+
+// Returns a copy of this iterator with a new stage of [kind] at the end.
+static Iterator* _iteratorChain(VM* vm, IteratorStageKind kind, Var arg) {
+  Iterator* base = (Iterator*) AS_OBJ(THIS);
+  Iterator* iter = newIterator(vm, base->source, base, 1);
+  IteratorStage* stage = &iter->stages[iter->stage_count - 1];
+  stage->kind = kind;
+  stage->arg = arg;
+  return iter;
+}
+
+saynaa_function(_iteratorMap, "Iterator.map(fn:Closure) -> Iterator",
+                "Returns an iterator of fn(value) for each value.") {
+  Closure* fn;
+  if (!validateArgClosure(vm, 1, &fn))
+    return;
+  RET(VAR_OBJ(_iteratorChain(vm, ITER_MAP, ARG(1))));
+}
+
+saynaa_function(_iteratorFilter, "Iterator.filter(fn:Closure) -> Iterator",
+                "Returns an iterator of the values where fn(value) is true.") {
+  Closure* fn;
+  if (!validateArgClosure(vm, 1, &fn))
+    return;
+  RET(VAR_OBJ(_iteratorChain(vm, ITER_FILTER, ARG(1))));
+}
+
+saynaa_function(_iteratorTake, "Iterator.take(count:Number) -> Iterator",
+                "Returns an iterator of the first [count] values.") {
+  int64_t count;
+  if (!validateInteger(vm, ARG(1), &count, "Argument 1"))
+    return;
+  Iterator* iter = _iteratorChain(vm, ITER_TAKE, VAR_NULL);
+  iter->stages[iter->stage_count - 1].count = (double) count;
+  RET(VAR_OBJ(iter));
+}
+
+saynaa_function(_iteratorEnumerate, "Iterator.enumerate([start:Number=0]) -> Iterator",
+                "Returns an iterator of (index, value) tuples, the index starts "
+                "from [start].") {
+  if (!CheckArgcRange(vm, ARGC, 0, 1))
+    return;
+
+  double start = 0;
+  if (ARGC == 1 && !validateNumeric(vm, ARG(1), &start, "Argument 1"))
+    return;
+  Iterator* iter = _iteratorChain(vm, ITER_ENUMERATE, VAR_NULL);
+  iter->stages[iter->stage_count - 1].count = start;
+  RET(VAR_OBJ(iter));
+}
+
+saynaa_function(_iteratorZip, "Iterator.zip(other:Var) -> Iterator",
+                "Returns an iterator of (value, other_value) tuples of the values "
+                "and the values of the iterable [other]. It stops at the end of "
+                "the shorter one.") {
+  RET(VAR_OBJ(_iteratorChain(vm, ITER_ZIP, ARG(1))));
+}
+
+saynaa_function(_iteratorCollect, "Iterator.collect() -> List",
+                "Run the iterator and returns a list of all it's values.") {
+  Iterator* iter = (Iterator*) AS_OBJ(THIS);
+
+  int64_t hint = _iteratorLengthHint(iter);
+  List* list = newList(vm, (hint > 0) ? (uint32_t) hint : 0);
+  vmPushTempRef(vm, &list->_super); // list.
+
+  Var value;
+  while (_iteratorNext(vm, iter, &value)) {
+    if (IS_OBJ(value))
+      vmPushTempRef(vm, AS_OBJ(value)); // value.
+    listAppend(vm, list, value);
+    if (IS_OBJ(value))
+      vmPopTempRef(vm); // value.
+  }
+
+  vmPopTempRef(vm); // list.
+  if (VM_HAS_ERROR(vm))
+    return;
+  RET(VAR_OBJ(list));
+}
+
 saynaa_function(
     _methodBindBind, "MethodBind.bind(instance:Var) -> MethodBind",
     "Bind the method to the instance and the method bind will be returned. The "
@@ -2363,6 +3287,9 @@ static void initializePrimitiveClasses(VM* vm) {
   ADD_CTOR(vRANGE, "@ctorRange", _ctorRange, 2);
   ADD_CTOR(vLIST, "@ctorList", _ctorList, -1);
   ADD_CTOR(vMAP, "@ctorMap", _ctorMap, 0);
+  ADD_CTOR(vSET, "@ctorSet", _ctorSet, -1);
+  ADD_CTOR(vITERATOR, "@ctorIterator", _ctorIterator, 1);
+  ADD_CTOR(vTUPLE, "@ctorTuple", _ctorTuple, -1);
   ADD_CTOR(vFIBER, "@ctorFiber", _ctorFiber, 1);
   ADD_CTOR(vPOINTER, "@ctorPointer", _ctorPointer, 1);
 #undef ADD_CTOR
@@ -2378,14 +3305,6 @@ static void initializePrimitiveClasses(VM* vm) {
     Closure* method = newClosure(vm, fn); \
     vmPushTempRef(vm, &method->_super); /* method. */ \
     ClosureBufferWrite(&vm->builtin_classes[type]->methods, vm, method); \
-    if (vm->builtin_classes[type]->method_lookup == NULL) { \
-      vm->builtin_classes[type]->method_lookup = newMap(vm); \
-    } \
-    String* method_name = newInternedString(vm, name); \
-    vmPushTempRef(vm, &method_name->_super); /* method_name. */ \
-    mapSet(vm, vm->builtin_classes[type]->method_lookup, VAR_OBJ(method_name), \
-           VAR_OBJ(method)); \
-    vmPopTempRef(vm); /* method_name. */ \
     vmPopTempRef(vm); /* method. */ \
     vmPopTempRef(vm); /* fn. */ \
   } while (false)
@@ -2428,11 +3347,29 @@ static void initializePrimitiveClasses(VM* vm) {
   ADD_METHOD(vLIST, "insert", _listInsert, 2);
   ADD_METHOD(vLIST, "join", _listJoin, -1);
   ADD_METHOD(vLIST, "resize", _listResize, 1);
+  ADD_METHOD(vLIST, "sort", _listSort, -1);
 
   ADD_METHOD(vMAP, "clear", _mapClear, 0);
   ADD_METHOD(vMAP, "get", _mapGet, -1);
   ADD_METHOD(vMAP, "has", _mapHas, 1);
   ADD_METHOD(vMAP, "pop", _mapPop, 1);
+  ADD_METHOD(vMAP, "items", _mapItems, 0);
+  ADD_METHOD(vMAP, "values", _mapValues, 0);
+
+  ADD_METHOD(vSET, "add", _setAdd, 1);
+  ADD_METHOD(vSET, "remove", _setRemove, 1);
+  ADD_METHOD(vSET, "has", _setHas, 1);
+  ADD_METHOD(vSET, "clear", _setClear, 0);
+  ADD_METHOD(vSET, "union", _setUnion, 1);
+  ADD_METHOD(vSET, "intersection", _setIntersection, 1);
+  ADD_METHOD(vSET, "difference", _setDifference, 1);
+
+  ADD_METHOD(vITERATOR, "map", _iteratorMap, 1);
+  ADD_METHOD(vITERATOR, "filter", _iteratorFilter, 1);
+  ADD_METHOD(vITERATOR, "take", _iteratorTake, 1);
+  ADD_METHOD(vITERATOR, "enumerate", _iteratorEnumerate, -1);
+  ADD_METHOD(vITERATOR, "zip", _iteratorZip, 1);
+  ADD_METHOD(vITERATOR, "collect", _iteratorCollect, 0);
 
   ADD_METHOD(vMETHOD_BIND, "bind", _methodBindBind, 1);
 
@@ -2446,6 +3383,12 @@ static void initializePrimitiveClasses(VM* vm) {
   ADD_METHOD(vFIBER, "resume", _fiberResume, -1);
 
 #undef ADD_METHOD
+
+  // Flatten the method tables once all the methods are added, the Object
+  // class first since every other builtin class inherit from it.
+  for (int i = 0; i < vINSTANCE; i++) {
+    classFlattenMethods(vm, vm->builtin_classes[i]);
+  }
 }
 
 /*****************************************************************************/
@@ -2468,6 +3411,9 @@ Var preConstructThis(VM* vm, Class* cls) {
     case vSTRING:
     case vLIST:
     case vMAP:
+    case vSET:
+    case vITERATOR:
+    case vTUPLE:
     case vPOINTER:
     case vRANGE:
       return VAR_NULL; // Constructor will override the null.
@@ -2533,18 +3479,10 @@ void bindMethod(VM* vm, Class* cls, Closure* method) {
     cls->magic_methods[METHOD_CALL] = method;
   }
 
-  if (cls->method_lookup == NULL) {
-    cls->method_lookup = newMap(vm);
-  }
-
   if (method->fn->name != NULL) {
     String* method_name = newInternedString(vm, method->fn->name);
     vmPushTempRef(vm, &method_name->_super); // method_name
-
-    if (IS_UNDEF(mapGetStringKey(cls->method_lookup, method_name))) {
-      mapSetStringKey(vm, cls->method_lookup, method_name, VAR_OBJ(method));
-    }
-
+    classBindVtable(vm, cls, method_name, method);
     vmPopTempRef(vm); // method_name
   }
 
@@ -2583,32 +3521,25 @@ Class* getClass(VM* vm, Var instance) {
   return inst->cls;
 }
 
-// Returns a method on a class (it'll walk up the inheritance tree to search
-// and if the method not found, it'll return NULL.
-static inline Closure* clsGetMethod(VM* vm, Class* cls, String* name) {
+// Returns a method on a class (a single probe into it's flattened method
+// table) and if the method not found, it'll return NULL.
+static inline Closure* clsGetMethod(Class* cls, String* name) {
+  int slot = classVtableSlot(cls, name);
+  if (slot >= 0) {
+    Closure* closure = cls->vtable.data[slot];
+    ASSERT(closure->fn->is_method, OOPS);
+    return closure;
+  }
+
+  // Fallback for methods bound to a base class after this class flattened
+  // it's table, or classes that may have direct method-buffer writes.
   Class* cls_ = cls;
   do {
-    if (cls_->method_lookup != NULL) {
-      Var method = mapGetStringKey(cls_->method_lookup, name);
-      if (IS_OBJ_TYPE(method, OBJ_CLOSURE)) {
-        Closure* closure = (Closure*) AS_OBJ(method);
-        ASSERT(closure->fn->is_method, OOPS);
-        return closure;
-      }
-    }
-
-    // Fallback for classes that may have direct method-buffer writes.
     for (int i = 0; i < (int) cls_->methods.count; i++) {
       Closure* method_ = cls_->methods.data[i];
       ASSERT(method_->fn->is_method, OOPS);
       const char* method_name = method_->fn->name;
       if (IS_CSTR_EQ(name, method_name, strlen(method_name))) {
-        if (cls_->method_lookup != NULL) {
-          String* cached_name = newInternedString(vm, method_name);
-          vmPushTempRef(vm, &cached_name->_super); // cached_name
-          mapSetStringKey(vm, cls_->method_lookup, cached_name, VAR_OBJ(method_));
-          vmPopTempRef(vm); // cached_name
-        }
         return method_;
       }
     }
@@ -2628,7 +3559,7 @@ bool hasMethod(VM* vm, Var thiz, String* name, Closure** _method) {
     return true;
   }
 
-  Closure* method_ = clsGetMethod(vm, cls, name);
+  Closure* method_ = clsGetMethod(cls, name);
   if (method_ != NULL) {
     vm->method_cache_class = cls;
     vm->method_cache_name = name;
@@ -2663,7 +3594,7 @@ Closure* getSuperMethod(VM* vm, Var thiz, String* name) {
     return NULL;
   };
 
-  Closure* method = clsGetMethod(vm, super, name);
+  Closure* method = clsGetMethod(super, name);
   if (method == NULL) {
     VM_SET_ERROR(vm, stringFormat(vm, "'@' class has no method named '@'.",
                                   super->name, name));
@@ -2722,26 +3653,27 @@ Closure* getSuperMethod(VM* vm, Var thiz, String* name) {
     } \
   } while (false)
 
-#define CHECK_INST_UNARY_OP(name) \
+#define CHECK_INST_UNARY_OP(op) \
   do { \
     if (IS_OBJ_TYPE(v, OBJ_INST)) { \
       Var result; \
-      if (_callUnaryOpMethod(vm, v, name, &result)) { \
+      if (_callUnaryOpMethod(vm, v, op, &result)) { \
         return result; \
       } \
     } \
   } while (false)
 
-#define CHECK_INST_BINARY_OP(name) \
+// The in-place operator's slot is [op + 1] (see OperatorMethod).
+#define CHECK_INST_BINARY_OP(op) \
   do { \
     if (IS_OBJ_TYPE(v1, OBJ_INST)) { \
       Var result; \
       if (inplace) { \
-        if (_callBinaryOpMethod(vm, v1, v2, name "=", &result)) { \
+        if (_callBinaryOpMethod(vm, v1, v2, (OperatorMethod) ((op) + 1), &result)) { \
           return result; \
         } \
       } \
-      if (_callBinaryOpMethod(vm, v1, v2, name, &result)) { \
+      if (_callBinaryOpMethod(vm, v1, v2, op, &result)) { \
         return result; \
       } \
     } \
@@ -2751,7 +3683,7 @@ Var varPositive(VM* vm, Var v) {
   double n;
   if (isNumeric(v, &n))
     return v;
-  CHECK_INST_UNARY_OP("+thiz");
+  CHECK_INST_UNARY_OP(OPERATOR_POSITIVE);
   UNSUPPORTED_UNARY_OP("unary +");
   return VAR_NULL;
 }
@@ -2760,13 +3692,13 @@ Var varNegative(VM* vm, Var v) {
   double n;
   if (isNumeric(v, &n))
     return VAR_NUM(-AS_NUM(v));
-  CHECK_INST_UNARY_OP("-thiz");
+  CHECK_INST_UNARY_OP(OPERATOR_NEGATIVE);
   UNSUPPORTED_UNARY_OP("unary -");
   return VAR_NULL;
 }
 
 Var varNot(VM* vm, Var v) {
-  CHECK_INST_UNARY_OP("!thiz");
+  CHECK_INST_UNARY_OP(OPERATOR_NOT);
   return VAR_BOOL(!toBool(v));
 }
 
@@ -2774,7 +3706,7 @@ Var varBitNot(VM* vm, Var v) {
   int64_t i;
   if (isInteger(v, &i))
     return VAR_NUM((double) (~i));
-  CHECK_INST_UNARY_OP("~thiz");
+  CHECK_INST_UNARY_OP(OPERATOR_BIT_NOT);
   UNSUPPORTED_UNARY_OP("unary ~");
   return VAR_NULL;
 }
@@ -2816,7 +3748,7 @@ Var varAdd(VM* vm, Var v1, Var v2, bool inplace) {
         break;
     }
   }
-  CHECK_INST_BINARY_OP("+");
+  CHECK_INST_BINARY_OP(OPERATOR_ADD);
   UNSUPPORTED_BINARY_OP("+");
   return VAR_NULL;
 }
@@ -2849,7 +3781,7 @@ Var varModulo(VM* vm, Var v1, Var v2, bool inplace) {
     return result;
   }
 
-  CHECK_INST_BINARY_OP("%");
+  CHECK_INST_BINARY_OP(OPERATOR_MODULO);
   UNSUPPORTED_BINARY_OP("%");
   return VAR_NULL;
 }
@@ -2858,14 +3790,14 @@ Var varModulo(VM* vm, Var v1, Var v2, bool inplace) {
 
 Var varSubtract(VM* vm, Var v1, Var v2, bool inplace) {
   CHECK_NUMERIC_OP(-);
-  CHECK_INST_BINARY_OP("-");
+  CHECK_INST_BINARY_OP(OPERATOR_SUBTRACT);
   UNSUPPORTED_BINARY_OP("-");
   return VAR_NULL;
 }
 
 Var varMultiply(VM* vm, Var v1, Var v2, bool inplace) {
   CHECK_NUMERIC_OP(*);
-  CHECK_INST_BINARY_OP("*");
+  CHECK_INST_BINARY_OP(OPERATOR_MULTIPLY);
 
   if (IS_OBJ_TYPE(v1, OBJ_STRING)) {
     String* left = (String*) AS_OBJ(v1);
@@ -2886,7 +3818,7 @@ Var varMultiply(VM* vm, Var v1, Var v2, bool inplace) {
         return VAR_NULL;
       }
 
-      String* str = newStringLength(vm, "", left->length * (uint32_t) right);
+      String* str = newStringLength(vm, NULL, left->length * (uint32_t) right);
       char* buff = str->data;
       for (int i = 0; i < (int) right; i++) {
         memcpy(buff, left->data, left->length);
@@ -2894,6 +3826,7 @@ Var varMultiply(VM* vm, Var v1, Var v2, bool inplace) {
       }
       ASSERT(buff == str->data + str->length, OOPS);
       str->hash = utilHashString(str->data);
+      stringResetCodepoints(vm, str);
       return VAR_OBJ(str);
     } else {
       VM_SET_ERROR(
@@ -2920,7 +3853,7 @@ Var varDivide(VM* vm, Var v1, Var v2, bool inplace) {
     return VAR_NULL;
   }
 
-  CHECK_INST_BINARY_OP("/");
+  CHECK_INST_BINARY_OP(OPERATOR_DIVIDE);
   UNSUPPORTED_BINARY_OP("/");
   return VAR_NULL;
 }
@@ -2934,49 +3867,49 @@ Var varExponent(VM* vm, Var v1, Var v2, bool inplace) {
     return VAR_NULL;
   }
 
-  CHECK_INST_BINARY_OP("**");
+  CHECK_INST_BINARY_OP(OPERATOR_EXPONENT);
   UNSUPPORTED_BINARY_OP("**");
   return VAR_NULL;
 }
 
 Var varBitAnd(VM* vm, Var v1, Var v2, bool inplace) {
   CHECK_BITWISE_OP(&);
-  CHECK_INST_BINARY_OP("&");
+  CHECK_INST_BINARY_OP(OPERATOR_BIT_AND);
   UNSUPPORTED_BINARY_OP("&");
   return VAR_NULL;
 }
 
 Var varBitOr(VM* vm, Var v1, Var v2, bool inplace) {
   CHECK_BITWISE_OP(|);
-  CHECK_INST_BINARY_OP("|");
+  CHECK_INST_BINARY_OP(OPERATOR_BIT_OR);
   UNSUPPORTED_BINARY_OP("|");
   return VAR_NULL;
 }
 
 Var varBitXor(VM* vm, Var v1, Var v2, bool inplace) {
   CHECK_BITWISE_OP(^);
-  CHECK_INST_BINARY_OP("^");
+  CHECK_INST_BINARY_OP(OPERATOR_BIT_XOR);
   UNSUPPORTED_BINARY_OP("^");
   return VAR_NULL;
 }
 
 Var varBitLshift(VM* vm, Var v1, Var v2, bool inplace) {
   CHECK_BITWISE_OP(<<);
-  CHECK_INST_BINARY_OP("<<");
+  CHECK_INST_BINARY_OP(OPERATOR_BIT_LSHIFT);
   UNSUPPORTED_BINARY_OP("<<");
   return VAR_NULL;
 }
 
 Var varBitRshift(VM* vm, Var v1, Var v2, bool inplace) {
   CHECK_BITWISE_OP(>>);
-  CHECK_INST_BINARY_OP(">>");
+  CHECK_INST_BINARY_OP(OPERATOR_BIT_RSHIFT);
   UNSUPPORTED_BINARY_OP(">>");
   return VAR_NULL;
 }
 
 Var varEqals(VM* vm, Var v1, Var v2) {
   const bool inplace = false;
-  CHECK_INST_BINARY_OP("==");
+  CHECK_INST_BINARY_OP(OPERATOR_EQ);
   return VAR_BOOL(isValuesEqual(v1, v2));
 }
 
@@ -2984,7 +3917,7 @@ Var varGreater(VM* vm, Var v1, Var v2) {
   CHECK_NUMERIC_OP_AS(>, VAR_BOOL);
   CHECK_STRING_OP_AS(>, VAR_BOOL);
   const bool inplace = false;
-  CHECK_INST_BINARY_OP(">");
+  CHECK_INST_BINARY_OP(OPERATOR_GT);
   UNSUPPORTED_BINARY_OP(">");
   return VAR_NULL;
 }
@@ -2993,7 +3926,7 @@ Var varLesser(VM* vm, Var v1, Var v2) {
   CHECK_NUMERIC_OP_AS(<, VAR_BOOL);
   CHECK_STRING_OP_AS(<, VAR_BOOL);
   const bool inplace = false;
-  CHECK_INST_BINARY_OP("<");
+  CHECK_INST_BINARY_OP(OPERATOR_LT);
   UNSUPPORTED_BINARY_OP("<");
   return VAR_NULL;
 }
@@ -3012,7 +3945,7 @@ Var varOpRange(VM* vm, Var v1, Var v2) {
   }
 
   const bool inplace = false;
-  CHECK_INST_BINARY_OP("..");
+  CHECK_INST_BINARY_OP(OPERATOR_RANGE);
   UNSUPPORTED_BINARY_OP("..");
   return VAR_NULL;
 }
@@ -3066,16 +3999,33 @@ bool varContains(VM* vm, Var elem, Var container) {
       }
       break;
 
+    case OBJ_SET:
+      {
+        if (!isValueHashable(elem))
+          return false;
+        return setHas((Set*) obj, elem);
+      }
+
+    case OBJ_TUPLE:
+      {
+        Tuple* tuple = (Tuple*) obj;
+        for (uint32_t i = 0; i < tuple->length; i++) {
+          if (isValuesEqual(elem, tuple->items[i]))
+            return true;
+        }
+        return false;
+      }
+
     default:
       break;
   }
 
-#define v1 container
-#define v2 elem
-  const bool inplace = false;
-  CHECK_INST_BINARY_OP("in");
-#undef v1
-#undef v2
+  if (IS_OBJ_TYPE(container, OBJ_INST)) {
+    Var result;
+    if (_callBinaryOpMethod(vm, container, elem, OPERATOR_IN, &result)) {
+      return toBool(result);
+    }
+  }
 
   VM_SET_ERROR(vm, stringFormat(vm, "Argument of type $ is not iterable.",
                                 varTypeName(container)));
@@ -3234,7 +4184,7 @@ Var varGetAttrib(VM* vm, Var on, String* attrib, bool skipGetter, bool callable)
         String* str = (String*) obj;
         switch (attrib->hash) {
           case CHECK_HASH("length", 0x83d03615):
-            return VAR_NUM((double) (str->length));
+            return VAR_NUM((double) stringCodepointCount(str));
         }
       }
       break;
@@ -3260,8 +4210,10 @@ Var varGetAttrib(VM* vm, Var on, String* attrib, bool skipGetter, bool callable)
             {
               List* list = newList(vm, map->count);
               vmPushTempRef(vm, &list->_super); // list.
-              for (uint32_t i = 0; i < map->order_keys.count; i++) {
-                listAppend(vm, list, map->order_keys.data[i]);
+              Var key;
+              uint32_t position = 0;
+              while (mapIterate(map, &position, &key, NULL)) {
+                listAppend(vm, list, key);
               }
               vmPopTempRef(vm); // list.
               return VAR_OBJ(list);
@@ -3271,9 +4223,10 @@ Var varGetAttrib(VM* vm, Var on, String* attrib, bool skipGetter, bool callable)
             {
               List* list = newList(vm, map->count);
               vmPushTempRef(vm, &list->_super); // list.
-              for (uint32_t i = 0; i < map->order_keys.count; i++) {
-                Var key = map->order_keys.data[i];
-                listAppend(vm, list, mapGet(map, key));
+              Var value;
+              uint32_t position = 0;
+              while (mapIterate(map, &position, NULL, &value)) {
+                listAppend(vm, list, value);
               }
               vmPopTempRef(vm); // list.
               return VAR_OBJ(list);
@@ -3287,6 +4240,15 @@ Var varGetAttrib(VM* vm, Var on, String* attrib, bool skipGetter, bool callable)
       }
       break;
 
+    case OBJ_SET:
+      {
+        switch (attrib->hash) {
+          case CHECK_HASH("length", 0x83d03615):
+            return VAR_NUM((double) (((Set*) obj)->count));
+        }
+      }
+      break;
+
     case OBJ_RANGE:
       {
         Range* range = (Range*) obj;
@@ -3431,7 +4393,7 @@ Var varGetAttrib(VM* vm, Var on, String* attrib, bool skipGetter, bool callable)
           pushed_on = true;
         }
 
-        Closure* method_ = clsGetMethod(vm, cls, attrib);
+        Closure* method_ = clsGetMethod(cls, attrib);
         if (method_ != NULL) {
           Var bound = _newBoundMethod(vm, on, method_);
           if (pushed_on)
@@ -3444,7 +4406,17 @@ Var varGetAttrib(VM* vm, Var on, String* attrib, bool skipGetter, bool callable)
       }
       break;
 
+    case OBJ_TUPLE:
+      {
+        switch (attrib->hash) {
+          case CHECK_HASH("length", 0x83d03615):
+            return VAR_NUM((double) (((Tuple*) obj)->length));
+        }
+      }
+      break;
+
     case OBJ_POINTER:
+    case OBJ_ITERATOR:
       break;
 
     case OBJ_INST:
@@ -3616,26 +4588,33 @@ static bool _normalizeSliceRange(VM* vm, Range* range, uint32_t count,
 static String* _sliceString(VM* vm, String* str, Range* range) {
   int32_t start, length;
   bool reversed;
-  if (!_normalizeSliceRange(vm, range, str->length, &start, &length, &reversed)) {
+  uint32_t count = stringCodepointCount(str);
+  if (!_normalizeSliceRange(vm, range, count, &start, &length, &reversed)) {
     return NULL;
   }
 
   // Optimize case.
-  if (start == 0 && length == str->length && !reversed)
+  if (start == 0 && length == count && !reversed)
     return str;
 
   // TODO: check if length is 1 and return pre allocated character string.
 
-  String* slice = newStringLength(vm, str->data + start, length);
+  uint32_t from = stringCodepointOffset(vm, str, (uint32_t) start);
+  uint32_t to = stringCodepointOffset(vm, str, (uint32_t) (start + length));
+  String* slice = newStringLength(vm, str->data + from, to - from);
   if (!reversed)
     return slice;
 
-  for (int32_t i = 0; i < length / 2; i++) {
-    char tmp = slice->data[i];
-    slice->data[i] = slice->data[length - i - 1];
-    slice->data[length - i - 1] = tmp;
+  // Reverse the codepoints (not the bytes) so multibyte sequences stay valid.
+  char* dst = slice->data + slice->length;
+  for (uint32_t i = from; i < to;) {
+    uint32_t width = stringCodepointWidth(str, i);
+    dst -= width;
+    memcpy(dst, str->data + i, width);
+    i += width;
   }
-  slice->hash = utilHashString(slice->data);
+  ASSERT(dst == slice->data, OOPS);
+  slice->hash = utilHashStringLength(slice->data, slice->length);
   return slice;
 }
 
@@ -3674,15 +4653,18 @@ Var varGetSubscript(VM* vm, Var on, Var key) {
         String* str = ((String*) obj);
 
         if (isInteger(key, &index)) {
+          uint32_t count = stringCodepointCount(str);
           // Normalize index.
           if (index < 0)
-            index = str->length + index;
-          if (index >= str->length || index < 0) {
+            index = count + index;
+          if (index >= count || index < 0) {
             VM_SET_ERROR(vm, newString(vm, "String index out of bound."));
             return VAR_NULL;
           }
           // FIXME: Add static VM characters instead of allocating here.
-          String* c = newStringLength(vm, str->data + index, 1);
+          uint32_t offset = stringCodepointOffset(vm, str, (uint32_t) index);
+          String* c = newStringLength(vm, str->data + offset,
+                                      stringCodepointWidth(str, offset));
           return VAR_OBJ(c);
         }
 
@@ -3720,11 +4702,44 @@ Var varGetSubscript(VM* vm, Var on, Var key) {
       }
       break;
 
+    case OBJ_TUPLE:
+      {
+        int64_t index;
+        Tuple* tuple = (Tuple*) obj;
+
+        if (isInteger(key, &index)) {
+          // Normalize index.
+          if (index < 0)
+            index = tuple->length + index;
+          if (index >= tuple->length || index < 0) {
+            VM_SET_ERROR(vm, newString(vm, "Tuple index out of bound."));
+            return VAR_NULL;
+          }
+          return tuple->items[index];
+        }
+
+        if (IS_OBJ_TYPE(key, OBJ_RANGE)) {
+          int32_t start, length;
+          bool reversed;
+          if (!_normalizeSliceRange(vm, (Range*) AS_OBJ(key), tuple->length, &start,
+                                    &length, &reversed)) {
+            return VAR_NULL;
+          }
+          Tuple* slice = newTuple(vm, (uint32_t) length);
+          for (int32_t i = 0; i < length; i++) {
+            int32_t ind = (reversed) ? start + length - 1 - i : start + i;
+            slice->items[i] = tuple->items[ind];
+          }
+          return VAR_OBJ(slice);
+        }
+      }
+      break;
+
     case OBJ_MAP:
       {
         Var value = mapGet((Map*) obj, key);
         if (IS_UNDEF(value)) {
-          if (IS_OBJ(key) && !isObjectHashable(AS_OBJ(key)->type)) {
+          if (!isValueHashable(key)) {
             VM_SET_ERROR(vm, stringFormat(vm, "Unhashable key '$'.", varTypeName(key)));
           } else {
             String* key_repr = varToString(vm, key, true);
@@ -3745,7 +4760,7 @@ Var varGetSubscript(VM* vm, Var on, Var key) {
     case OBJ_INST:
       {
         Var ret;
-        if (_callBinaryOpMethod(vm, on, key, "[]", &ret)) {
+        if (_callBinaryOpMethod(vm, on, key, OPERATOR_GET_SUBSCRIPT, &ret)) {
           return ret;
         }
       }
@@ -3775,14 +4790,16 @@ void varsetSubscript(VM* vm, Var on, Var key, Var value) {
         int64_t index;
         String* str = ((String*) obj);
 
-        if (isInteger(key, &index)) {
-          // Normalize index.
-          if (index < 0)
-            index = str->length + index;
-          if (index >= str->length || index < 0) {
-            VM_SET_ERROR(vm, newString(vm, "String index out of bound."));
-            return;
-          }
+        if (!validateInteger(vm, key, &index, "String index"))
+          return;
+
+        uint32_t count = stringCodepointCount(str);
+        // Normalize index.
+        if (index < 0)
+          index = count + index;
+        if (index >= count || index < 0) {
+          VM_SET_ERROR(vm, newString(vm, "String index out of bound."));
+          return;
         }
 
         if (!IS_OBJ(value)) {
@@ -3794,8 +4811,23 @@ void varsetSubscript(VM* vm, Var on, Var key, Var value) {
         Object* objValue = AS_OBJ(value);
         if (objValue->type == OBJ_STRING) {
           String* strReplace = ((String*) objValue);
-          str = replaceSubstring(vm, index, str, strReplace);
+
+          // The characters from [index] are replaced in place with the ones
+          // of the replacement, their byte widths could be different.
+          uint32_t replace_count = stringCodepointCount(strReplace);
+          if (replace_count > count - (uint32_t) index) {
+            VM_SET_ERROR(vm, newString(vm, "String index out of bound."));
+            return;
+          }
+          uint32_t from = stringCodepointOffset(vm, str, (uint32_t) index);
+          uint32_t to = stringCodepointOffset(vm, str, (uint32_t) index + replace_count);
+          if (str->length - (to - from) + strReplace->length >= str->capacity) {
+            VM_SET_ERROR(vm, newString(vm, "String subscript replacement is too long."));
+            return;
+          }
+          str = replaceSubstring(vm, from, to - from, str, strReplace);
           str->hash = utilHashString(str->data);
+          stringResetCodepoints(vm, str);
 
           on = VAR_OBJ(str);
 
@@ -3828,9 +4860,13 @@ void varsetSubscript(VM* vm, Var on, Var key, Var value) {
       }
       break;
 
+    case OBJ_TUPLE:
+      VM_SET_ERROR(vm, newString(vm, "Tuple is immutable."));
+      return;
+
     case OBJ_MAP:
       {
-        if (IS_OBJ(key) && !isObjectHashable(AS_OBJ(key)->type)) {
+        if (!isValueHashable(key)) {
           VM_SET_ERROR(vm, stringFormat(vm, "$ type is not hashable.", varTypeName(key)));
         } else {
           mapSet(vm, (Map*) obj, key, value);
@@ -3845,13 +4881,8 @@ void varsetSubscript(VM* vm, Var on, Var key, Var value) {
 
     case OBJ_INST:
       {
-        Closure* closure = NULL;
-        String* name = newString(vm, "[]=");
-        vmPushTempRef(vm, &name->_super); // name.
-        bool has_method = hasMethod(vm, on, name, &closure);
-        vmPopTempRef(vm); // name.
-
-        if (has_method) {
+        Closure* closure = getClass(vm, on)->operator_methods[OPERATOR_SET_SUBSCRIPT];
+        if (closure != NULL) {
           Var args[2] = {key, value};
           vmCallMethod(vm, on, closure, 2, args, NULL);
           return;
@@ -3874,16 +4905,18 @@ bool varIterate(VM* vm, Var seq, Var* iterator, Var* value) {
       {
         if (IS_NULL(*iterator))
           *iterator = VAR_NUM((double) 0);
-        uint32_t iter = (uint32_t) AS_NUM(*iterator);
 
-        // TODO: Need to consider utf8.
+        // The iterator is the byte offset of the next codepoint, so walking
+        // a multibyte string stays linear without the codepoint index.
+        uint32_t iter = (uint32_t) AS_NUM(*iterator);
         String* str = ((String*) obj);
         if (iter >= str->length)
           return false;
 
         // TODO: vm's char (and reusable) strings.
-        *value = VAR_OBJ(newStringLength(vm, str->data + iter, 1));
-        *iterator = VAR_NUM((double) iter + 1);
+        uint32_t width = stringCodepointWidth(str, iter);
+        *value = VAR_OBJ(newStringLength(vm, str->data + iter, width));
+        *iterator = VAR_NUM((double) iter + width);
         return true;
       }
 
@@ -3907,13 +4940,42 @@ bool varIterate(VM* vm, Var seq, Var* iterator, Var* value) {
           *iterator = VAR_NUM((double) 0);
         uint32_t iter = (uint32_t) AS_NUM(*iterator);
 
+        // The iterator is the position of the next entry in the map.
         Map* map = (Map*) obj;
-        if (map->order_keys.count == 0)
+        if (!mapIterate(map, &iter, value, NULL))
           return false;
-        if (iter >= map->order_keys.count)
+
+        *iterator = VAR_NUM((double) iter);
+        return true;
+      }
+
+    case OBJ_SET:
+      {
+        if (IS_NULL(*iterator))
+          *iterator = VAR_NUM((double) 0);
+        uint32_t iter = (uint32_t) AS_NUM(*iterator);
+
+        if (!setIterate((Set*) obj, &iter, value))
           return false;
 
-        *value = map->order_keys.data[iter];
+        *iterator = VAR_NUM((double) iter);
+        return true;
+      }
+
+    case OBJ_ITERATOR:
+      // The iteration state is in the iterator itself.
+      return _iteratorNext(vm, (Iterator*) obj, value);
+
+    case OBJ_TUPLE:
+      {
+        if (IS_NULL(*iterator))
+          *iterator = VAR_NUM((double) 0);
+        uint32_t iter = (uint32_t) AS_NUM(*iterator);
+
+        Tuple* tuple = (Tuple*) obj;
+        if (iter >= tuple->length)
+          return false;
+        *value = tuple->items[iter];
         *iterator = VAR_NUM((double) iter + 1);
         return true;
       }
@@ -3944,12 +5006,12 @@ bool varIterate(VM* vm, Var seq, Var* iterator, Var* value) {
     case OBJ_INST:
       {
         for (;;) {
-          if (!_callBinaryOpMethod(vm, seq, *iterator, LITS__next, iterator))
+          if (!_callBinaryOpMethod(vm, seq, *iterator, OPERATOR_NEXT, iterator))
             break;
           if (IS_NULL(*iterator))
             return false;
 
-          if (!_callBinaryOpMethod(vm, seq, *iterator, LITS__value, value))
+          if (!_callBinaryOpMethod(vm, seq, *iterator, OPERATOR_VALUE, value))
             break;
           return true;
         }
@@ -3970,3 +5032,55 @@ bool varIterate(VM* vm, Var seq, Var* iterator, Var* value) {
   }
   return false;
 }
+
+bool varIterateEntry(VM* vm, Var seq, Var* iterator, Var* key, Var* value) {
+  Object* obj = AS_OBJ(seq);
+
+  // Maps and their items() iterator without stages are walked over the
+  // entries directly, without allocating a pair for each of them.
+  Map* map = NULL;
+  if (obj->type == OBJ_MAP) {
+    map = (Map*) obj;
+  } else if (obj->type == OBJ_ITERATOR) {
+    Iterator* iter = (Iterator*) obj;
+    if (iter->source_kind == ITER_SOURCE_ITEMS && iter->stage_count == 0) {
+      if (iter->done)
+        return false;
+      map = (Map*) AS_OBJ(iter->source);
+      iterator = &iter->cursor;
+    }
+  }
+
+  if (map != NULL) {
+    uint32_t position = IS_NULL(*iterator) ? 0 : (uint32_t) AS_NUM(*iterator);
+    if (!mapIterate(map, &position, key, value)) {
+      if (obj->type == OBJ_ITERATOR)
+        ((Iterator*) obj)->done = true;
+      return false;
+    }
+    *iterator = VAR_NUM((double) position);
+    return true;
+  }
+
+  Var entry;
+  if (!varIterate(vm, seq, iterator, &entry))
+    return false;
+
+  if (IS_OBJ_TYPE(entry, OBJ_TUPLE) && ((Tuple*) AS_OBJ(entry))->length == 2) {
+    Tuple* pair = (Tuple*) AS_OBJ(entry);
+    *key = pair->items[0];
+    *value = pair->items[1];
+    return true;
+  }
+
+  if (IS_OBJ_TYPE(entry, OBJ_LIST) && ((List*) AS_OBJ(entry))->elements.count == 2) {
+    List* pair = (List*) AS_OBJ(entry);
+    *key = pair->elements.data[0];
+    *value = pair->elements.data[1];
+    return true;
+  }
+
+  VM_SET_ERROR(vm, stringFormat(vm, "Expected a (key, value) pair to unpack, got $.",
+                                varTypeName(entry)));
+  return false;
+}
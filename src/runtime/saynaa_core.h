@@ -160,6 +160,11 @@ void varsetSubscript(VM* vm, Var on, Var key, Var value);
 // Returns ture to continue loop, false to break.
 bool varIterate(VM* vm, Var seq, Var* iterator, Var* value);
 
+// Same as varIterate() for the two variable for loop. Maps (and their items()
+// iterator) are walked without any lookup or allocation, other sequences
+// should yield (key, value) tuples or lists which will be unpacked.
+bool varIterateEntry(VM* vm, Var seq, Var* iterator, Var* key, Var* value);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -82,6 +82,7 @@ typedef bool (*CallMethod_t)(VM*, int, const char*, int, int, int);
 typedef bool (*GetAttribute_t)(VM*, int, const char*, int);
 typedef bool (*setAttribute_t)(VM*, int, const char*, int);
 typedef bool (*ImportModule_t)(VM*, const char*, int);
+typedef void* (*GetSlotTypedArray_t)(VM*, int, uint32_t*, uint32_t*);
 
 typedef struct {
   NewConfiguration_t NewConfiguration_ptr;
@@ -158,6 +159,7 @@ typedef struct {
   GetAttribute_t GetAttribute_ptr;
   setAttribute_t setAttribute_ptr;
   ImportModule_t ImportModule_ptr;
+  GetSlotTypedArray_t GetSlotTypedArray_ptr;
 } NativeApi;
 
 #define API_INIT_FN_NAME "InitApi" 
@@ -247,6 +249,7 @@ NativeApi MakeNativeAPI() {
   api.GetAttribute_ptr = GetAttribute;
   api.setAttribute_ptr = setAttribute;
   api.ImportModule_ptr = ImportModule;
+  api.GetSlotTypedArray_ptr = GetSlotTypedArray;
 
   return api;
 }
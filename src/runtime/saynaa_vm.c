@@ -170,6 +170,8 @@ typedef struct {
 
 #define VM_METHOD_INLINE_CACHE_MASK (VM_METHOD_INLINE_CACHE_SIZE - 1u)
 #define VM_ATTRIB_INLINE_CACHE_MASK (VM_ATTRIB_INLINE_CACHE_SIZE - 1u)
+#define VM_CTOR_INLINE_CACHE_MASK (VM_CTOR_INLINE_CACHE_SIZE - 1u)
+#define VM_CALL_INLINE_CACHE_MASK (VM_CALL_INLINE_CACHE_SIZE - 1u)
 
 static inline VMMethodInlineCacheEntry* vmMethodInlineCacheAt(VM* vm, const uint8_t* site) {
   uintptr_t key = (uintptr_t) site;
@@ -181,6 +183,30 @@ static inline VMAttribInlineCacheEntry* vmAttribInlineCacheAt(VM* vm, const uint
   return &vm->attrib_inline_cache[((key >> 2) ^ (key >> 10)) & VM_ATTRIB_INLINE_CACHE_MASK];
 }
 
+// Returns [thiz] as an instance if it has the declared field [name] at the
+// inline attribute [slot] (see Class.fields) otherwise NULL.
+static inline Instance* vmFieldOwner(Var thiz, String* name, uint8_t slot) {
+  if (!IS_OBJ_TYPE(thiz, OBJ_INST))
+    return NULL;
+  Instance* inst = (Instance*) AS_OBJ(thiz);
+  if (slot >= inst->inline_attrib_count)
+    return NULL;
+  String* slot_name = inst->inline_attrib_names[slot];
+  if (slot_name != name && (slot_name == NULL || !IS_STR_EQ(slot_name, name)))
+    return NULL;
+  return inst;
+}
+
+static inline VMCtorInlineCacheEntry* vmCtorInlineCacheAt(VM* vm, const uint8_t* site) {
+  uintptr_t key = (uintptr_t) site;
+  return &vm->ctor_inline_cache[((key >> 2) ^ (key >> 8)) & VM_CTOR_INLINE_CACHE_MASK];
+}
+
+static inline VMCallInlineCacheEntry* vmCallInlineCacheAt(VM* vm, const uint8_t* site) {
+  uintptr_t key = (uintptr_t) site;
+  return &vm->call_inline_cache[((key >> 2) ^ (key >> 8)) & VM_CALL_INLINE_CACHE_MASK];
+}
+
 /*****************************************************************************/
 /* IMPORT HELPERS                                                            */
 /*****************************************************************************/
@@ -353,6 +379,8 @@ void vmInvalidateInlineCaches(VM* vm) {
     // Rare wrap-around: fully clear cache metadata.
     memset(vm->method_inline_cache, 0, sizeof(vm->method_inline_cache));
     memset(vm->attrib_inline_cache, 0, sizeof(vm->attrib_inline_cache));
+    memset(vm->ctor_inline_cache, 0, sizeof(vm->ctor_inline_cache));
+    memset(vm->call_inline_cache, 0, sizeof(vm->call_inline_cache));
     vm->inline_cache_epoch = 1;
   }
 }
@@ -1308,6 +1336,32 @@ static inline void reuseCallFrame(VM* vm, const Closure* closure) {
   vmEnsureStackSize(vm, vm->fiber, needed);
 }
 
+// Returns the global [name] (at the [index] of the constant pool) of the
+// [module]. If it's not defined, the value returned by the module's _missing
+// function is used. Returns VAR_UNDEFINED if the name cannot be resolved or
+// the _missing call failed (error set).
+static Var vmGetGlobal(VM* vm, Module* module, uint16_t index, String* name) {
+  int g_index = moduleGetLinkedGlobal(vm, module, index, module, name);
+  if (g_index != -1)
+    return module->globals.data[g_index];
+
+  int missing_index = moduleGetGlobalIndex(module, LITS__missing,
+                                           (uint32_t) strlen(LITS__missing));
+  if (missing_index != -1) {
+    Var missing = module->globals.data[missing_index];
+    if (IS_OBJ_TYPE(missing, OBJ_CLOSURE)) {
+      Var args[1] = {VAR_OBJ(name)};
+      Var result = VAR_NULL;
+      if (vmCallFunction(vm, (Closure*) AS_OBJ(missing), 1, args, &result) == RESULT_SUCCESS
+          && !IS_NULL(result)) {
+        return result;
+      }
+    }
+  }
+
+  return VAR_UNDEFINED;
+}
+
 // Capture the [local] into an upvalue and return it. If the upvalue already
 // exists on the fiber, it'll return it.
 static Upvalue* captureUpvalue(VM* vm, Fiber* fiber, Var* local) {
@@ -1416,6 +1470,17 @@ static inline bool vmIsNumeric(Var v, double* out) {
   return false;
 }
 
+// Returns the typed array data of [v] if it's an instance of a typed array
+// class, otherwise NULL.
+static inline TypedArray* vmTypedArrayOf(Var v) {
+  if (!IS_OBJ_TYPE(v, OBJ_INST))
+    return NULL;
+  Instance* inst = (Instance*) AS_OBJ(v);
+  if (inst->cls->typed_kind == TYPED_NONE)
+    return NULL;
+  return (TypedArray*) inst->native;
+}
+
 /******************************************************************************
  * RUNTIME                                                                    *
  *****************************************************************************/
@@ -1608,6 +1673,46 @@ L_vm_main_loop:
     DISPATCH();
   }
 
+  OPCODE(CLONE_CONSTANT) : {
+    uint16_t index = READ_SHORT();
+    ASSERT_INDEX(index, module->constants.count);
+    Object* template = AS_OBJ(module->constants.data[index]);
+
+    if (template->type == OBJ_LIST) {
+      List* src = (List*) template;
+      List* list = newList(vm, src->elements.count);
+      memcpy(list->elements.data, src->elements.data, sizeof(Var) * src->elements.count);
+      list->elements.count = src->elements.count;
+      PUSH(VAR_OBJ(list));
+    } else {
+      ASSERT(template->type == OBJ_MAP, OOPS);
+      PUSH(VAR_OBJ(mapCopy(vm, (Map*) template)));
+    }
+    DISPATCH();
+  }
+
+  OPCODE(IN_CONSTANT) : {
+    uint16_t index = READ_SHORT();
+    ASSERT_INDEX(index, module->constants.count);
+    Var container = module->constants.data[index];
+    Var value = PEEK(-1);
+
+    // The templates only have hashable elements, anything else isn't there.
+    bool found = false;
+    if (isValueHashable(value)) {
+      if (IS_OBJ_TYPE(container, OBJ_SET)) {
+        found = setHas((Set*) AS_OBJ(container), value);
+      } else {
+        ASSERT(IS_OBJ_TYPE(container, OBJ_MAP), OOPS);
+        found = !IS_UNDEF(mapGet((Map*) AS_OBJ(container), value));
+      }
+    }
+
+    DROP();
+    PUSH(VAR_BOOL(found));
+    DISPATCH();
+  }
+
   OPCODE(LIST_APPEND) : {
     Var elem = PEEK(-1); // Don't pop yet, we need the reference for gc.
     Var list = PEEK(-2);
@@ -1624,7 +1729,7 @@ L_vm_main_loop:
 
     ASSERT(IS_OBJ_TYPE(on, OBJ_MAP), OOPS);
 
-    if (IS_OBJ(key) && !isObjectHashable(AS_OBJ(key)->type)) {
+    if (!isValueHashable(key)) {
       RUNTIME_ERROR(stringFormat(vm, "$ type is not hashable.", varTypeName(key)));
     }
     mapSet(vm, (Map*) AS_OBJ(on), key, value);
@@ -1650,6 +1755,117 @@ L_vm_main_loop:
     DISPATCH();
   }
 
+  OPCODE(BUILD_STRING) : {
+    uint16_t count = READ_SHORT();
+    Var* values = fiber->sp - count;
+
+    // Objects are converted with their _str method (if any) first, the values
+    // are still on the stack while converting so they won't be collected.
+    for (uint16_t i = 0; i < count; i++) {
+      if (IS_OBJ(values[i]) && !IS_OBJ_TYPE(values[i], OBJ_STRING)) {
+        String* str = varToString(vm, values[i], false);
+        CHECK_ERROR();
+        values[i] = VAR_OBJ(str);
+      }
+    }
+
+    String* str = stringBuild(vm, values, count);
+    fiber->sp -= count;
+    PUSH(VAR_OBJ(str));
+    DISPATCH();
+  }
+
+  OPCODE(LIST_RESERVE) : {
+    uint16_t index = READ_SHORT();
+    Var list = rbp[index + 1]; // +1: rbp[0] is return value.
+    Var seq = PEEK(-1);
+    ASSERT(IS_OBJ_TYPE(list, OBJ_LIST), OOPS);
+
+    double count = 0;
+    if (IS_OBJ_TYPE(seq, OBJ_LIST)) {
+      count = ((List*) AS_OBJ(seq))->elements.count;
+    } else if (IS_OBJ_TYPE(seq, OBJ_RANGE)) {
+      Range* range = (Range*) AS_OBJ(seq);
+      count = fabs(range->to - range->from);
+    }
+    if (count > MAX_RESERVE_HINT)
+      count = MAX_RESERVE_HINT;
+
+    VarBufferReserve(&((List*) AS_OBJ(list))->elements, vm, (size_t) count);
+    DISPATCH();
+  }
+
+  OPCODE(LIST_APPEND_LOCAL) : {
+    uint16_t index = READ_SHORT();
+    Var list = rbp[index + 1]; // +1: rbp[0] is return value.
+    ASSERT(IS_OBJ_TYPE(list, OBJ_LIST), OOPS);
+
+    VarBufferWrite(&((List*) AS_OBJ(list))->elements, vm, PEEK(-1));
+    DROP(); // elem
+    DISPATCH();
+  }
+
+  OPCODE(MAP_INSERT_LOCAL) : {
+    uint16_t index = READ_SHORT();
+    Var map = rbp[index + 1]; // +1: rbp[0] is return value.
+    Var value = PEEK(-1);     // Don't pop yet, we need the reference for gc.
+    Var key = PEEK(-2);       // Don't pop yet, we need the reference for gc.
+    ASSERT(IS_OBJ_TYPE(map, OBJ_MAP), OOPS);
+
+    if (!isValueHashable(key)) {
+      RUNTIME_ERROR(stringFormat(vm, "$ type is not hashable.", varTypeName(key)));
+    }
+    mapSet(vm, (Map*) AS_OBJ(map), key, value);
+
+    DROP(); // value
+    DROP(); // key
+    DISPATCH();
+  }
+
+  OPCODE(BUILD_TUPLE) : {
+    uint16_t count = READ_SHORT();
+
+    // The values are still on the stack while allocating the tuple.
+    Tuple* tuple = newTuple(vm, count);
+    Var* values = fiber->sp - count;
+    for (uint16_t i = 0; i < count; i++) {
+      tuple->items[i] = values[i];
+    }
+    fiber->sp = values;
+    PUSH(VAR_OBJ(tuple));
+    DISPATCH();
+  }
+
+  OPCODE(UNPACK) : {
+    uint16_t count = READ_SHORT();
+    Var value = PEEK(-1); // Don't pop yet, we need the reference for gc.
+
+    const Var* items = NULL;
+    uint32_t length = 0;
+    if (IS_OBJ_TYPE(value, OBJ_TUPLE)) {
+      items = ((Tuple*) AS_OBJ(value))->items;
+      length = ((Tuple*) AS_OBJ(value))->length;
+    } else if (IS_OBJ_TYPE(value, OBJ_LIST)) {
+      items = ((List*) AS_OBJ(value))->elements.data;
+      length = ((List*) AS_OBJ(value))->elements.count;
+    } else {
+      RUNTIME_ERROR(stringFormat(vm, "Cannot unpack a $.", varTypeName(value)));
+    }
+
+    if (length != count) {
+      char expected[STR_INT_BUFF_SIZE], got[STR_INT_BUFF_SIZE];
+      sprintf(expected, "%d", (int) count);
+      sprintf(got, "%d", (int) length);
+      RUNTIME_ERROR(stringFormat(vm, "Expected $ values to unpack, got $.", expected, got));
+    }
+
+    DROP(); // value
+    for (uint32_t i = 0; i < length; i++) {
+      PUSH(items[i]);
+    }
+    DISPATCH();
+  }
+
   OPCODE(PUSH_LOCAL_0) :
       OPCODE(PUSH_LOCAL_1) :
       OPCODE(PUSH_LOCAL_2) :
@@ -1698,31 +1914,13 @@ L_vm_main_loop:
       RUNTIME_ERROR(stringFormat(vm, "Invalid global name in module data."));
     }
 
-    int g_index = moduleGetGlobalIndexByName(vm, module, name);
-    if (g_index == -1) {
-      int missing_index = moduleGetGlobalIndex(module, LITS__missing,
-                                               (uint32_t) strlen(LITS__missing));
-      if (missing_index != -1) {
-        Var missing = module->globals.data[missing_index];
-        if (IS_OBJ_TYPE(missing, OBJ_CLOSURE)) {
-          Var args[1] = {VAR_OBJ(name)};
-          Var result = VAR_NULL;
-          Result call_result = vmCallFunction(vm, (Closure*) AS_OBJ(missing), 1,
-                                              args, &result);
-          if (call_result != RESULT_SUCCESS) {
-            CHECK_ERROR();
-          }
-          if (!IS_NULL(result) && !IS_UNDEF(result)) {
-            PUSH(result);
-            DISPATCH();
-          }
-        }
-      }
-
+    Var value = vmGetGlobal(vm, module, name_index, name);
+    if (IS_UNDEF(value)) {
+      CHECK_ERROR();
       RUNTIME_ERROR(stringFormat(vm, "Name '@' is not defined.", name));
     }
 
-    PUSH(module->globals.data[g_index]);
+    PUSH(value);
     DISPATCH();
   }
 
@@ -1739,7 +1937,13 @@ L_vm_main_loop:
     if (name == NULL) {
       RUNTIME_ERROR(stringFormat(vm, "Invalid global name in module data."));
     }
-    moduleSetGlobal(vm, module, name->data, name->length, PEEK(-1));
+
+    int g_index = moduleGetLinkedGlobal(vm, module, name_index, module, name);
+    if (g_index != -1) {
+      moduleSetGlobalAt(vm, module, (uint32_t) g_index, PEEK(-1));
+    } else {
+      moduleSetGlobal(vm, module, name->data, name->length, PEEK(-1));
+    }
     DISPATCH();
   }
 
@@ -1761,13 +1965,21 @@ L_vm_main_loop:
 
   OPCODE(PUSH_UPVALUE) : {
     uint16_t index = READ_SHORT();
-    PUSH(*(frame->closure->upvalues[index]->ptr));
+    Var value = frame->closure->upvalues[index];
+    if (IS_OBJ_TYPE(value, OBJ_UPVALUE)) {
+      value = *(((Upvalue*) AS_OBJ(value))->ptr);
+    }
+    PUSH(value);
     DISPATCH();
   }
 
   OPCODE(STORE_UPVALUE) : {
     uint16_t index = READ_SHORT();
-    *(frame->closure->upvalues[index]->ptr) = PEEK(-1);
+    Var upvalue = frame->closure->upvalues[index];
+
+    // The compiler never copies an upvalue which is assigned.
+    ASSERT(IS_OBJ_TYPE(upvalue, OBJ_UPVALUE), OOPS);
+    *(((Upvalue*) AS_OBJ(upvalue))->ptr) = PEEK(-1);
     DISPATCH();
   }
 
@@ -1782,15 +1994,29 @@ L_vm_main_loop:
 
     // Capture the vaupes.
     for (int i = 0; i < fn->upvalue_count; i++) {
-      uint8_t is_immediate = READ_BYTE();
+      uint8_t capture = READ_BYTE();
       uint16_t idx = READ_SHORT();
 
-      if (is_immediate) {
-        // rbp[0] is the return value, rbp + 1 is the first local and so on.
-        closure->upvalues[i] = captureUpvalue(vm, fiber, (rbp + 1 + idx));
-      } else {
-        // The upvalue is already captured by the current function, reuse it.
-        closure->upvalues[i] = frame->closure->upvalues[idx];
+      switch ((CaptureType) capture) {
+        case CAPTURE_LOCAL:
+          {
+            // rbp[0] is the return value, rbp + 1 is the first local and so on.
+            Upvalue* upvalue = captureUpvalue(vm, fiber, (rbp + 1 + idx));
+            closure->upvalues[i] = VAR_OBJ(upvalue);
+          }
+          break;
+
+        case CAPTURE_COPY:
+          // The local is never reassigned, a copy of it's value is enough.
+          closure->upvalues[i] = rbp[1 + idx];
+          break;
+
+        case CAPTURE_OUTER:
+        default:
+          // The upvalue is already captured by the current function, reuse it
+          // (it could be a copied value as well).
+          closure->upvalues[i] = frame->closure->upvalues[idx];
+          break;
       }
     }
 
@@ -1821,6 +2047,8 @@ L_vm_main_loop:
 
     Class* drived = (Class*) AS_OBJ(module->constants.data[index]);
     drived->super_class = base;
+    classFlattenMethods(vm, drived);
+    classFlattenFields(vm, drived);
 
     PUSH(VAR_OBJ(drived));
     DISPATCH();
@@ -2051,22 +2279,11 @@ L_vm_main_loop:
     uint16_t index; //< To get the method name.
     String* name;   //< The method name.
 
-    OPCODE(SUPER_CALL) : argc = READ_BYTE();
-    fiber->ret = (fiber->sp - argc - 1);
-    fiber->thiz = *fiber->ret; //< This for the next call.
-    index = READ_SHORT();
-    name = moduleGetStringAt(module, (int) index);
-    Closure* super_method = getSuperMethod(vm, fiber->thiz, name);
-    CHECK_ERROR(); // Will return if super_method is NULL.
-    callable = VAR_OBJ(super_method);
-    goto L_do_call;
-
-    OPCODE(METHOD_CALL) : {
+    OPCODE(SUPER_CALL) : {
       const uint8_t* call_site = ip - 1;
       argc = READ_BYTE();
       fiber->ret = (fiber->sp - argc - 1);
       fiber->thiz = *fiber->ret; //< This for the next call.
-
       index = READ_SHORT();
       name = moduleGetStringAt(module, (int) index);
 
@@ -2078,23 +2295,214 @@ L_vm_main_loop:
         goto L_do_call;
       }
 
+      Closure* super_method = getSuperMethod(vm, fiber->thiz, name);
+      CHECK_ERROR(); // Will return if super_method is NULL.
+
+      mic->site = call_site;
+      mic->epoch = vm->inline_cache_epoch;
+      mic->cls = recv_cls;
+      mic->name = name;
+      mic->method = super_method;
+      mic->slot = UINT32_MAX;
+
+      callable = VAR_OBJ(super_method);
+      goto L_do_call;
+    }
+
+    OPCODE(METHOD_CALL) : {
+      const uint8_t* call_site = ip - 1;
+      argc = READ_BYTE();
+      fiber->ret = (fiber->sp - argc - 1);
+      fiber->thiz = *fiber->ret; //< This for the next call.
+
+      index = READ_SHORT();
+      name = moduleGetStringAt(module, (int) index);
+
+      Class* recv_cls = getClass(vm, fiber->thiz);
+      VMMethodInlineCacheEntry* mic = vmMethodInlineCacheAt(vm, call_site);
+
+      // A function of a module (m.fn()) called from this site before, it's
+      // a global and not a method of the module (method is NULL).
+      if (mic->site == call_site && mic->epoch == vm->inline_cache_epoch
+          && mic->name == name && mic->method == NULL && IS_OBJ_TYPE(fiber->thiz, OBJ_MODULE)) {
+        Module* target = (Module*) AS_OBJ(fiber->thiz);
+        int g_index = moduleGetLinkedGlobal(vm, module, index, target, name);
+        if (g_index != -1) {
+          callable = target->globals.data[g_index];
+          goto L_do_call;
+        }
+      }
+
+      if (mic->site == call_site && mic->epoch == vm->inline_cache_epoch
+          && mic->name == name && mic->method != NULL) {
+        if (mic->cls == recv_cls) {
+          callable = VAR_OBJ(mic->method);
+          goto L_do_call;
+        }
+
+        // A receiver of another class from the same hierarchy has the method
+        // at the same slot of it's flattened table, so the site doesn't need
+        // a lookup when the receiver class changes.
+        uint32_t slot = mic->slot;
+        if (slot < recv_cls->vtable.count
+            && IS_STR_EQ(recv_cls->vtable_names.data[slot], name)) {
+          mic->cls = recv_cls;
+          mic->method = recv_cls->vtable.data[slot];
+          callable = VAR_OBJ(mic->method);
+          goto L_do_call;
+        }
+      }
+
       Closure* resolved_method = NULL;
       if (hasMethod(vm, fiber->thiz, name, &resolved_method)) {
         callable = VAR_OBJ(resolved_method);
 
+        int slot = classVtableSlot(recv_cls, name);
+        if (slot >= 0 && recv_cls->vtable.data[slot] != resolved_method) {
+          slot = -1;
+        }
+
         mic->site = call_site;
         mic->epoch = vm->inline_cache_epoch;
         mic->cls = recv_cls;
         mic->name = name;
         mic->method = resolved_method;
+        mic->slot = (slot >= 0) ? (uint32_t) slot : UINT32_MAX;
         goto L_do_call;
       }
 
+      if (IS_OBJ_TYPE(fiber->thiz, OBJ_MODULE)) {
+        Module* target = (Module*) AS_OBJ(fiber->thiz);
+        int g_index = moduleLinkGlobal(vm, module, index, target, name);
+        if (g_index != -1) {
+          mic->site = call_site;
+          mic->epoch = vm->inline_cache_epoch;
+          mic->cls = recv_cls;
+          mic->name = name;
+          mic->method = NULL;
+          mic->slot = UINT32_MAX;
+          callable = target->globals.data[g_index];
+          goto L_do_call;
+        }
+      }
+
       callable = varGetAttrib(vm, fiber->thiz, name, false, true);
       CHECK_ERROR();
       goto L_do_call;
     }
 
+  L_do_operator_call:
+    // An overloaded binary operator, the method is at the left operand's slot
+    // (see CALL_OPERATOR_METHOD) and the right operand is the argument.
+    argc = 1;
+    fiber->ret = fiber->sp - 2;
+    callable = *fiber->ret;
+    goto L_do_call;
+
+    OPCODE(CALL_DIRECT) : OPCODE(TAIL_CALL_DIRECT) : {
+      const uint8_t* call_site = ip - 1;
+      argc = READ_BYTE();
+      fiber->ret = fiber->sp - argc - 1;
+
+      VMCallInlineCacheEntry* dic = vmCallInlineCacheAt(vm, call_site);
+      if (dic->site == call_site && dic->epoch == vm->inline_cache_epoch) {
+        ip += 2; // Name index.
+        closure = dic->closure;
+
+      } else {
+        index = READ_SHORT();
+        name = moduleGetStringAt(module, (int) index);
+        ASSERT(name != NULL, OOPS);
+
+        callable = vmGetGlobal(vm, module, index, name);
+        if (IS_UNDEF(callable)) {
+          CHECK_ERROR();
+          RUNTIME_ERROR(stringFormat(vm, "Name '@' is not defined.", name));
+        }
+
+        // The global was redefined at runtime, it's called like any other
+        // callable.
+        closure = IS_OBJ_TYPE(callable, OBJ_CLOSURE) ? (const Closure*) AS_OBJ(callable) : NULL;
+        if (closure == NULL || closure->fn->is_native || closure->fn->arity != argc) {
+          goto L_do_call;
+        }
+
+        dic->site = call_site;
+        dic->epoch = vm->inline_cache_epoch;
+        dic->closure = (Closure*) closure;
+      }
+
+      // The return value slot is already null (pushed by the compiler).
+      if (instruction == OP_TAIL_CALL_DIRECT) {
+        reuseCallFrame(vm, closure);
+        LOAD_FRAME();
+      } else {
+        UPDATE_FRAME();
+        pushCallFrame(vm, closure);
+        LOAD_FRAME();
+        CHECK_ERROR(); //< Stack overflow.
+      }
+      DISPATCH();
+    }
+
+    OPCODE(INLINE_CALL) : {
+      const uint8_t* call_site = ip - 1;
+      argc = READ_BYTE();
+      index = READ_SHORT();
+      uint16_t fn_index = READ_SHORT();
+      uint16_t offset = READ_SHORT();
+      fiber->ret = fiber->sp - argc - 1;
+
+      VMCallInlineCacheEntry* dic = vmCallInlineCacheAt(vm, call_site);
+      if (dic->site == call_site && dic->epoch == vm->inline_cache_epoch) {
+        closure = dic->closure;
+
+      } else {
+        name = moduleGetStringAt(module, (int) index);
+        ASSERT(name != NULL, OOPS);
+
+        callable = vmGetGlobal(vm, module, index, name);
+        if (IS_UNDEF(callable)) {
+          CHECK_ERROR();
+          RUNTIME_ERROR(stringFormat(vm, "Name '@' is not defined.", name));
+        }
+
+        closure = IS_OBJ_TYPE(callable, OBJ_CLOSURE) ? (const Closure*) AS_OBJ(callable) : NULL;
+        if (closure == NULL || closure->fn->is_native || closure->fn->arity != argc) {
+          ip += offset;
+          goto L_do_call;
+        }
+
+        dic->site = call_site;
+        dic->epoch = vm->inline_cache_epoch;
+        dic->closure = (Closure*) closure;
+      }
+
+      // Still the inlined function, run the inlined code which follows.
+      ASSERT_INDEX(fn_index, module->constants.count);
+      if (&closure->fn->_super == AS_OBJ(module->constants.data[fn_index])) {
+        DISPATCH();
+      }
+
+      // The global was redefined at runtime, skip the inlined code and call it.
+      ip += offset;
+      UPDATE_FRAME();
+      pushCallFrame(vm, closure);
+      LOAD_FRAME();
+      CHECK_ERROR(); //< Stack overflow.
+      DISPATCH();
+    }
+
+    OPCODE(INLINE_RETURN) : {
+      uint8_t count = READ_BYTE();
+      if (count > 0) {
+        Var ret_value = PEEK(-1);
+        fiber->sp -= count;
+        *(fiber->sp - 1) = ret_value;
+      }
+      DISPATCH();
+    }
+
     OPCODE(CALL) : OPCODE(TAIL_CALL) : {
       argc = READ_BYTE();
       fiber->ret = fiber->sp - argc - 1;
@@ -2123,8 +2531,16 @@ L_vm_main_loop:
     } else if (IS_OBJ_TYPE(callable, OBJ_CLASS)) {
       Class* cls = (Class*) AS_OBJ(callable);
 
-      Closure* new_method = getMagicMethod(cls, METHOD_NEW);
-      if (new_method != NULL) {
+      // The site constructed an instance of the same class before, allocate
+      // it without the generic checks and call the cached _init.
+      VMCtorInlineCacheEntry* cic = vmCtorInlineCacheAt(vm, ip);
+      Closure* new_method = NULL;
+      if (cic->site == ip && cic->epoch == vm->inline_cache_epoch && cic->cls == cls) {
+        fiber->thiz = VAR_OBJ(newInstanceRaw(vm, cls, cic->new_fn));
+        *fiber->ret = fiber->thiz;
+        closure = cic->init;
+
+      } else if ((new_method = getMagicMethod(cls, METHOD_NEW)) != NULL) {
         Var new_instance = VAR_NULL;
         Result new_result = vmCallMethod(vm, VAR_OBJ(cls), new_method, argc,
                                          fiber->ret + 1, &new_instance);
@@ -2175,19 +2591,27 @@ L_vm_main_loop:
 
         closure = (const Closure*) getMagicMethod(cls, METHOD_INIT);
 
-        // No constructor is defined on the class. Just return thiz.
-        if (closure == NULL) {
-          if (argc != 0) {
-            String* msg = stringFormat(vm,
-                                       "Expected exactly 0 argument(s) "
-                                       "for constructor $.",
-                                       cls->name->data);
-            RUNTIME_ERROR(msg);
-          }
+        if (cls->class_of == vINSTANCE) {
+          cic->site = ip;
+          cic->epoch = vm->inline_cache_epoch;
+          cic->cls = cls;
+          cic->init = (Closure*) closure;
+          cic->new_fn = classNewInstanceFn(cls);
+        }
+      }
 
-          fiber->thiz = VAR_UNDEFINED;
-          DISPATCH();
+      // No constructor is defined on the class. Just return thiz.
+      if (closure == NULL) {
+        if (argc != 0) {
+          String* msg = stringFormat(vm,
+                                     "Expected exactly 0 argument(s) "
+                                     "for constructor $.",
+                                     cls->name->data);
+          RUNTIME_ERROR(msg);
         }
+
+        fiber->thiz = VAR_UNDEFINED;
+        DISPATCH();
       }
 
     } else {
@@ -2264,13 +2688,15 @@ L_vm_main_loop:
       CHECK_ERROR();
 
     } else {
-      if (instruction == OP_TAIL_CALL) {
+      if (instruction == OP_TAIL_CALL || instruction == OP_TAIL_CALL_DIRECT) {
         reuseCallFrame(vm, closure);
         LOAD_FRAME(); //< Re-load the frame to vm's execution variables.
 
       } else {
         ASSERT((instruction == OP_CALL) || (instruction == OP_METHOD_CALL)
-                   || (instruction == OP_SUPER_CALL),
+                   || (instruction == OP_SUPER_CALL) || (instruction == OP_CALL_DIRECT)
+                   || (instruction == OP_INLINE_CALL)
+                   || (OP_ADD <= instruction && instruction <= OP_GTEQ),
                OOPS);
 
         UPDATE_FRAME(); //< Update the current frame's ip.
@@ -2321,6 +2747,20 @@ L_vm_main_loop:
     DISPATCH();
   }
 
+  OPCODE(ITER2) : {
+    Var* value = (fiber->sp - 1);
+    Var* key = (fiber->sp - 2);
+    Var* iterator = (fiber->sp - 3);
+    Var seq = PEEK(-4);
+    uint16_t jump_offset = READ_SHORT();
+
+    bool cont = varIterateEntry(vm, seq, iterator, key, value);
+    CHECK_ERROR();
+    if (!cont)
+      JUMP_ITER_EXIT();
+    DISPATCH();
+  }
+
   OPCODE(JUMP) : {
     uint16_t offset = READ_SHORT();
     ip += offset;
@@ -2428,7 +2868,8 @@ L_vm_main_loop:
   OPCODE(GET_ATTRIB) : {
     const uint8_t* attrib_site = ip - 1;
     Var on = PEEK(-1); // Don't pop yet, we need the reference for gc.
-    String* name = moduleGetStringAt(module, READ_SHORT());
+    uint16_t name_index = READ_SHORT();
+    String* name = moduleGetStringAt(module, name_index);
     ASSERT(name != NULL, OOPS);
 
     VMAttribInlineCacheEntry* aic = vmAttribInlineCacheAt(vm, attrib_site);
@@ -2451,7 +2892,25 @@ L_vm_main_loop:
           }
           break;
 
+        case VM_ATTRIB_IC_MODULE_GLOBAL:
+          if (IS_OBJ_TYPE(on, OBJ_MODULE)) {
+            Module* target = (Module*) AS_OBJ(on);
+            int g_index = moduleGetLinkedGlobal(vm, module, name_index, target, name);
+            if (g_index != -1) {
+              value = target->globals.data[g_index];
+              cache_hit = true;
+            }
+          }
+          break;
+
         case VM_ATTRIB_IC_METHOD_BIND:
+          // Only the method lookup is cached. A method bind is a value of
+          // it's own (compared by identity and rebound in place by bind())
+          // so each access still allocates one. The calls which don't need
+          // it are compiled to OP_METHOD_CALL, including (obj.method)(...)
+          // (see exprCall()), but a bind stored in a local and called later
+          // (f = obj.method; f()) isn't, since the single pass compiler
+          // doesn't know how the local is used afterwards.
           if (aic->method != NULL && getClass(vm, on) == aic->receiver_cls
               && (aic->receiver_obj == NULL || (IS_OBJ(on) && AS_OBJ(on) == aic->receiver_obj))) {
             MethodBind* mb = newMethodBind(vm, aic->method);
@@ -2503,6 +2962,13 @@ L_vm_main_loop:
           aic->receiver_obj = NULL;
           aic->method = mb->method;
         }
+
+      } else if (IS_OBJ_TYPE(on, OBJ_MODULE)) {
+        // It's a global of the module (not a method), link the name to it.
+        Module* target = (Module*) AS_OBJ(on);
+        if (moduleLinkGlobal(vm, module, name_index, target, name) != -1) {
+          aic->kind = VM_ATTRIB_IC_MODULE_GLOBAL;
+        }
       }
     }
 
@@ -2514,7 +2980,8 @@ L_vm_main_loop:
   OPCODE(GET_ATTRIB_KEEP) : {
     const uint8_t* attrib_site = ip - 1;
     Var on = PEEK(-1);
-    String* name = moduleGetStringAt(module, READ_SHORT());
+    uint16_t name_index = READ_SHORT();
+    String* name = moduleGetStringAt(module, name_index);
     ASSERT(name != NULL, OOPS);
 
     VMAttribInlineCacheEntry* aic = vmAttribInlineCacheAt(vm, attrib_site);
@@ -2537,7 +3004,19 @@ L_vm_main_loop:
           }
           break;
 
+        case VM_ATTRIB_IC_MODULE_GLOBAL:
+          if (IS_OBJ_TYPE(on, OBJ_MODULE)) {
+            Module* target = (Module*) AS_OBJ(on);
+            int g_index = moduleGetLinkedGlobal(vm, module, name_index, target, name);
+            if (g_index != -1) {
+              value = target->globals.data[g_index];
+              cache_hit = true;
+            }
+          }
+          break;
+
         case VM_ATTRIB_IC_METHOD_BIND:
+          // A new bind on each access, see OP_GET_ATTRIB.
           if (aic->method != NULL && getClass(vm, on) == aic->receiver_cls
               && (aic->receiver_obj == NULL || (IS_OBJ(on) && AS_OBJ(on) == aic->receiver_obj))) {
             MethodBind* mb = newMethodBind(vm, aic->method);
@@ -2589,6 +3068,13 @@ L_vm_main_loop:
           aic->receiver_obj = NULL;
           aic->method = mb->method;
         }
+
+      } else if (IS_OBJ_TYPE(on, OBJ_MODULE)) {
+        // It's a global of the module (not a method), link the name to it.
+        Module* target = (Module*) AS_OBJ(on);
+        if (moduleLinkGlobal(vm, module, name_index, target, name) != -1) {
+          aic->kind = VM_ATTRIB_IC_MODULE_GLOBAL;
+        }
       }
     }
 
@@ -2611,10 +3097,58 @@ L_vm_main_loop:
     DISPATCH();
   }
 
+  OPCODE(GET_FIELD) : {
+    String* name = moduleGetStringAt(module, READ_SHORT());
+    uint8_t slot = READ_BYTE();
+    ASSERT(name != NULL, OOPS);
+
+    Instance* inst = vmFieldOwner(*thiz, name, slot);
+    if (inst != NULL && getMagicMethod(inst->cls, METHOD_GETATTRIBUTE) == NULL) {
+      PUSH(inst->inline_attrib_values[slot]);
+      DISPATCH();
+    }
+
+    // This isn't an instance of the class that declared the field.
+    Var value = varGetAttrib(vm, *thiz, name, false, false);
+    CHECK_ERROR();
+    PUSH(value);
+    DISPATCH();
+  }
+
+  OPCODE(SET_FIELD) : {
+    String* name = moduleGetStringAt(module, READ_SHORT());
+    uint8_t slot = READ_BYTE();
+    ASSERT(name != NULL, OOPS);
+    Var value = PEEK(-1);
+
+    Instance* inst = vmFieldOwner(*thiz, name, slot);
+    if (inst != NULL && getMagicMethod(inst->cls, METHOD_SETATTR) == NULL
+        && getMagicMethod(inst->cls, METHOD_SETTER) == NULL) {
+      inst->inline_attrib_values[slot] = value;
+      DISPATCH();
+    }
+
+    varSetAttrib(vm, *thiz, name, value, false);
+    CHECK_ERROR();
+    DISPATCH();
+  }
+
   OPCODE(GET_SUBSCRIPT) : {
     Var key = PEEK(-1); // Don't pop yet, we need the reference for gc.
     Var on = PEEK(-2);  // Don't pop yet, we need the reference for gc.
-    Var value = varGetSubscript(vm, on, key);
+    Var value;
+
+    // Typed arrays are read directly without calling their [] method, any
+    // other index (negative, out of bound) will go through it.
+    TypedArray* array = vmTypedArrayOf(on);
+    if (array != NULL && typedArrayGet(array, key, &value)) {
+      DROP(); // key
+      DROP(); // on
+      PUSH(value);
+      DISPATCH();
+    }
+
+    value = varGetSubscript(vm, on, key);
     DROP(); // key
     DROP(); // on
     PUSH(value);
@@ -2626,6 +3160,12 @@ L_vm_main_loop:
   OPCODE(GET_SUBSCRIPT_KEEP) : {
     Var key = PEEK(-1);
     Var on = PEEK(-2);
+    Var value;
+    TypedArray* array = vmTypedArrayOf(on);
+    if (array != NULL && typedArrayGet(array, key, &value)) {
+      PUSH(value);
+      DISPATCH();
+    }
     PUSH(varGetSubscript(vm, on, key));
     CHECK_ERROR();
     DISPATCH();
@@ -2635,7 +3175,10 @@ L_vm_main_loop:
     Var value = PEEK(-1); // Don't pop yet, we need the reference for gc.
     Var key = PEEK(-2);   // Don't pop yet, we need the reference for gc.
     Var on = PEEK(-3);    // Don't pop yet, we need the reference for gc.
-    varsetSubscript(vm, on, key, value);
+
+    TypedArray* array = vmTypedArrayOf(on);
+    if (array == NULL || !typedArraySet(array, key, value))
+      varsetSubscript(vm, on, key, value);
     DROP(); // value
     DROP(); // key
     DROP(); // on
@@ -2692,6 +3235,24 @@ L_vm_main_loop:
   // Do not ever use PUSH(binaryOp(vm, POP(), POP()));
   // Function parameters are not evaluated in a defined order in C.
 
+// If the left operand is an instance which overloads the operator, call the
+// method from it's class's operator slot as a regular call of the frame in
+// place of the operands, instead of a nested call from the var*() function.
+#define CALL_OPERATOR_METHOD(op, inplace) \
+  do { \
+    if (IS_OBJ_TYPE(l, OBJ_INST)) { \
+      Closure** methods_ = ((Instance*) AS_OBJ(l))->cls->operator_methods; \
+      Closure* method_ = (inplace) ? methods_[(op) + 1] : NULL; \
+      if (method_ == NULL) \
+        method_ = methods_[op]; \
+      if (method_ != NULL) { \
+        fiber->thiz = l; \
+        *(fiber->sp - 2) = VAR_OBJ(method_); \
+        goto L_do_operator_call; \
+      } \
+    } \
+  } while (false)
+
   OPCODE(ADD) : {
     // Don't pop yet, we need the reference for gc.
     Var r = PEEK(-1), l = PEEK(-2);
@@ -2705,6 +3266,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_ADD, inplace);
     Var result = varAdd(vm, l, r, inplace);
     DROP();
     DROP(); // r, l
@@ -2727,6 +3289,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_SUBTRACT, inplace);
     Var result = varSubtract(vm, l, r, inplace);
     DROP();
     DROP(); // r, l
@@ -2749,6 +3312,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_MULTIPLY, inplace);
     Var result = varMultiply(vm, l, r, inplace);
     DROP();
     DROP(); // r, l
@@ -2775,6 +3339,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_DIVIDE, inplace);
     Var result = varDivide(vm, l, r, inplace);
     DROP();
     DROP(); // r, l
@@ -2797,6 +3362,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_EXPONENT, inplace);
     Var result = varExponent(vm, l, r, inplace);
     DROP();
     DROP(); // r, l
@@ -2823,6 +3389,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_MODULO, inplace);
     Var result = varModulo(vm, l, r, inplace);
     DROP();
     DROP(); // r, l
@@ -2845,6 +3412,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_BIT_AND, inplace);
     Var result = varBitAnd(vm, l, r, inplace);
     DROP();
     DROP(); // r, l
@@ -2867,6 +3435,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_BIT_OR, inplace);
     Var result = varBitOr(vm, l, r, inplace);
     DROP();
     DROP(); // r, l
@@ -2889,6 +3458,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_BIT_XOR, inplace);
     Var result = varBitXor(vm, l, r, inplace);
     DROP();
     DROP(); // r, l
@@ -2911,6 +3481,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_BIT_LSHIFT, inplace);
     Var result = varBitLshift(vm, l, r, inplace);
     DROP();
     DROP(); // r, l
@@ -2933,6 +3504,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_BIT_RSHIFT, inplace);
     Var result = varBitRshift(vm, l, r, inplace);
     DROP();
     DROP(); // r, l
@@ -2962,6 +3534,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_EQ, false);
     Var result = varEqals(vm, l, r);
     DROP();
     DROP(); // r, l
@@ -3009,6 +3582,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_LT, false);
     Var result = varLesser(vm, l, r);
     DROP();
     DROP(); // r, l
@@ -3054,6 +3628,7 @@ L_vm_main_loop:
       PUSH(result);
       DISPATCH();
     }
+    CALL_OPERATOR_METHOD(OPERATOR_GT, false);
     Var result = varGreater(vm, l, r);
     DROP();
     DROP(); // r, l
@@ -3087,6 +3662,8 @@ L_vm_main_loop:
     DISPATCH();
   }
 
+#undef CALL_OPERATOR_METHOD
+
   OPCODE(RANGE) : {
     // Don't pop yet, we need the reference for gc.
     Var r = PEEK(-1), l = PEEK(-2);
@@ -37,6 +37,8 @@ typedef struct NativeLibCacheEntry NativeLibCacheEntry;
 
 #define VM_METHOD_INLINE_CACHE_SIZE 1024u
 #define VM_ATTRIB_INLINE_CACHE_SIZE 2048u
+#define VM_CTOR_INLINE_CACHE_SIZE 256u
+#define VM_CALL_INLINE_CACHE_SIZE 256u
 
 typedef enum {
   VM_ATTRIB_IC_NONE = 0,
@@ -51,6 +53,7 @@ typedef struct {
   Class* cls;
   String* name;
   Closure* method;
+  uint32_t slot; //< Flattened method table slot, valid across the hierarchy.
 } VMMethodInlineCacheEntry;
 
 typedef struct {
@@ -64,6 +67,24 @@ typedef struct {
   Closure* method;
 } VMAttribInlineCacheEntry;
 
+// Constructor call-site cache of a script class without a _new method. The
+// [new_fn] is the native allocator resolved from the class hierarchy.
+typedef struct {
+  const uint8_t* site;
+  uint32_t epoch;
+  Class* cls;
+  Closure* init;
+  NewInstanceFn new_fn;
+} VMCtorInlineCacheEntry;
+
+// Module function resolved by an OP_CALL_DIRECT site, see moduleSetGlobal()
+// for the invalidation once the global is redefined.
+typedef struct {
+  const uint8_t* site;
+  uint32_t epoch;
+  Closure* closure;
+} VMCallInlineCacheEntry;
+
 //  Virtual Machine. It'll contain the state of the execution, stack,
 // heap, and manage memory allocations.
 struct VM {
@@ -162,6 +183,8 @@ struct VM {
   uint32_t inline_cache_epoch;
   VMMethodInlineCacheEntry method_inline_cache[VM_METHOD_INLINE_CACHE_SIZE];
   VMAttribInlineCacheEntry attrib_inline_cache[VM_ATTRIB_INLINE_CACHE_SIZE];
+  VMCtorInlineCacheEntry ctor_inline_cache[VM_CTOR_INLINE_CACHE_SIZE];
+  VMCallInlineCacheEntry call_inline_cache[VM_CALL_INLINE_CACHE_SIZE];
 
 #ifndef NO_DL
   // Loaded native libraries cache, keyed by resolved module path.
@@ -87,6 +87,8 @@ static Result remapFunctionConstants(Function* fn, const uint32_t* remap, uint32
 
     switch ((Opcode) op) {
       case OP_PUSH_CONSTANT:
+      case OP_CLONE_CONSTANT:
+      case OP_IN_CONSTANT:
       case OP_PUSH_GLOBAL_NAME:
       case OP_STORE_GLOBAL_NAME:
       case OP_CREATE_CLASS:
@@ -95,6 +97,8 @@ static Result remapFunctionConstants(Function* fn, const uint32_t* remap, uint32
       case OP_GET_ATTRIB:
       case OP_GET_ATTRIB_KEEP:
       case OP_SET_ATTRIB:
+      case OP_GET_FIELD:
+      case OP_SET_FIELD:
         {
           Result status = remapOpcodeIndex(code + ip, remap, remap_count);
           if (status != RESULT_SUCCESS)
@@ -104,14 +108,27 @@ static Result remapFunctionConstants(Function* fn, const uint32_t* remap, uint32
 
       case OP_METHOD_CALL:
       case OP_SUPER_CALL:
+      case OP_CALL_DIRECT:
+      case OP_TAIL_CALL_DIRECT:
         {
-          // METHOD_CALL/SUPER_CALL encode argc first, then the 16-bit name index.
+          // The calls with a name encode argc first, then the 16-bit name index.
           Result status = remapOpcodeIndex(code + ip + 1, remap, remap_count);
           if (status != RESULT_SUCCESS)
             REMAP_FAIL(status);
         }
         break;
 
+      case OP_INLINE_CALL:
+        {
+          // argc, the 16-bit name index then the inlined function index.
+          Result status = remapOpcodeIndex(code + ip + 1, remap, remap_count);
+          if (status == RESULT_SUCCESS)
+            status = remapOpcodeIndex(code + ip + 3, remap, remap_count);
+          if (status != RESULT_SUCCESS)
+            REMAP_FAIL(status);
+        }
+        break;
+
       case OP_PUSH_CLOSURE:
         {
           Result status = remapOpcodeIndex(code + ip, remap, remap_count);
@@ -145,6 +162,14 @@ static Result remapFunctionConstants(Function* fn, const uint32_t* remap, uint32
 
     ip += params;
   }
+
+  // The inlined function of each (start, end, function) in the side table.
+  for (uint32_t i = 2; i < fn->fn->inlines.count; i += 3) {
+    uint32_t index = fn->fn->inlines.data[i];
+    if (index >= remap_count)
+      REMAP_FAIL(RESULT_BYTECODE_INVALID_FORMAT);
+    fn->fn->inlines.data[i] = remap[index];
+  }
 #undef REMAP_FAIL
 
   return RESULT_SUCCESS;
@@ -507,6 +532,9 @@ typedef enum {
   SAYNAA_BC_CONST_STRING = 3,
   SAYNAA_BC_CONST_FUNCTION = 4,
   SAYNAA_BC_CONST_CLASS = 5,
+  SAYNAA_BC_CONST_LIST = 6,
+  SAYNAA_BC_CONST_MAP = 7,
+  SAYNAA_BC_CONST_SET = 8,
 } SaynaaBytecodeConstTag;
 
 static void bc_write_u8(ByteBuffer* out, VM* vm, uint8_t value) {
@@ -605,6 +633,144 @@ static bool bc_read_double(BytecodeReader* reader, double* out) {
   return true;
 }
 
+// Write an element of a frozen literal template. The templates only have
+// scalar elements (see freezeConstantLiteral() in the compiler) which are
+// written with the same tags as the constants.
+static Result bc_write_scalar(ByteBuffer* out, VM* vm, Var value) {
+  if (IS_NULL(value)) {
+    bc_write_u8(out, vm, SAYNAA_BC_CONST_NULL);
+  } else if (IS_BOOL(value)) {
+    bc_write_u8(out, vm, SAYNAA_BC_CONST_BOOL);
+    bc_write_u8(out, vm, AS_BOOL(value) ? 1 : 0);
+  } else if (IS_NUM(value)) {
+    bc_write_u8(out, vm, SAYNAA_BC_CONST_NUMBER);
+    bc_write_double(out, vm, AS_NUM(value));
+  } else if (IS_OBJ_TYPE(value, OBJ_STRING)) {
+    String* str = (String*) AS_OBJ(value);
+    bc_write_u8(out, vm, SAYNAA_BC_CONST_STRING);
+    bc_write_varu(out, vm, str->length);
+    if (str->length > 0) {
+      ByteBufferAddString(out, vm, str->data, str->length);
+    }
+  } else {
+    return RESULT_BYTECODE_UNSUPPORTED_CONST;
+  }
+  return RESULT_SUCCESS;
+}
+
+// Read an element written by bc_write_scalar(). A string element isn't
+// reachable by the gc till it's added to the template.
+static Result bc_read_scalar(BytecodeReader* reader, VM* vm, Var* out) {
+  uint8_t tag = 0;
+  if (!bc_read_u8(reader, &tag))
+    return RESULT_BYTECODE_TRUNCATED;
+
+  switch ((SaynaaBytecodeConstTag) tag) {
+    case SAYNAA_BC_CONST_NULL:
+      *out = VAR_NULL;
+      return RESULT_SUCCESS;
+
+    case SAYNAA_BC_CONST_BOOL:
+      {
+        uint8_t value = 0;
+        if (!bc_read_u8(reader, &value))
+          return RESULT_BYTECODE_TRUNCATED;
+        *out = VAR_BOOL(value != 0);
+        return RESULT_SUCCESS;
+      }
+
+    case SAYNAA_BC_CONST_NUMBER:
+      {
+        double value = 0;
+        if (!bc_read_double(reader, &value))
+          return RESULT_BYTECODE_TRUNCATED;
+        *out = VAR_NUM(value);
+        return RESULT_SUCCESS;
+      }
+
+    case SAYNAA_BC_CONST_STRING:
+      {
+        uint64_t length64 = 0;
+        Result status = bc_read_varu(reader, UINT32_MAX, &length64);
+        if (status != RESULT_SUCCESS)
+          return status;
+        if (length64 > reader->size - reader->offset)
+          return RESULT_BYTECODE_TRUNCATED;
+
+        uint32_t length = (uint32_t) length64;
+        *out = VAR_OBJ(newInternedStringLength(
+            vm, (const char*) (reader->data + reader->offset), length));
+        reader->offset += length;
+        return RESULT_SUCCESS;
+      }
+
+    default:
+      return RESULT_BYTECODE_INVALID_FORMAT;
+  }
+}
+
+// Read the elements of a frozen literal template with the [tag] into a new
+// list, map or set.
+static Result bc_read_template(BytecodeReader* reader, VM* vm, uint8_t tag, Var* out) {
+  uint64_t count64 = 0;
+  Result status = bc_read_varu(reader, UINT32_MAX, &count64);
+  if (status != RESULT_SUCCESS)
+    return status;
+  if (count64 > reader->size - reader->offset)
+    return RESULT_BYTECODE_TRUNCATED;
+  uint32_t count = (uint32_t) count64;
+
+  Var template_var;
+  if (tag == SAYNAA_BC_CONST_LIST) {
+    template_var = VAR_OBJ(newList(vm, count));
+  } else if (tag == SAYNAA_BC_CONST_MAP) {
+    template_var = VAR_OBJ(newMap(vm));
+  } else {
+    template_var = VAR_OBJ(newSet(vm));
+  }
+  Object* template = AS_OBJ(template_var);
+  vmPushTempRef(vm, template); // template.
+
+  for (uint32_t i = 0; i < count && status == RESULT_SUCCESS; i++) {
+    Var key = VAR_NULL, value = VAR_NULL;
+    status = bc_read_scalar(reader, vm, &key);
+    if (status != RESULT_SUCCESS)
+      break;
+
+    if (IS_OBJ(key))
+      vmPushTempRef(vm, AS_OBJ(key)); // key.
+
+    if (tag == SAYNAA_BC_CONST_LIST) {
+      listAppend(vm, ((List*) template), key);
+    } else if (tag == SAYNAA_BC_CONST_SET) {
+      setAdd(vm, (Set*) template, key);
+    } else {
+      status = bc_read_scalar(reader, vm, &value);
+      if (status == RESULT_SUCCESS) {
+        if (IS_OBJ(value))
+          vmPushTempRef(vm, AS_OBJ(value)); // value.
+        mapSet(vm, (Map*) template, key, value);
+        if (IS_OBJ(value))
+          vmPopTempRef(vm); // value.
+      }
+    }
+
+    if (IS_OBJ(key))
+      vmPopTempRef(vm); // key.
+  }
+
+  if (status == RESULT_SUCCESS) {
+    if (tag == SAYNAA_BC_CONST_MAP)
+      mapMakePerfect(vm, (Map*) template);
+    else if (tag == SAYNAA_BC_CONST_SET)
+      setMakePerfect(vm, (Set*) template);
+    *out = template_var;
+  }
+
+  vmPopTempRef(vm); // template.
+  return status;
+}
+
 static int find_constant_index(Module* module, Var value) {
   for (uint32_t i = 0; i < module->constants.count; i++) {
     if (isValuesSame(module->constants.data[i], value))
@@ -714,6 +880,11 @@ Result saynaa_bytecode_serialize_module(VM* vm, Module* module, ByteBuffer* out)
           for (uint32_t j = 0; j < fn->fn->oplines.count; j++) {
             bc_write_varu(out, vm, fn->fn->oplines.data[j]);
           }
+
+          bc_write_varu(out, vm, fn->fn->inlines.count);
+          for (uint32_t j = 0; j < fn->fn->inlines.count; j++) {
+            bc_write_varu(out, vm, fn->fn->inlines.data[j]);
+          }
         }
         break;
 
@@ -732,6 +903,57 @@ Result saynaa_bytecode_serialize_module(VM* vm, Module* module, ByteBuffer* out)
             bc_write_varu(out, vm, 0);
           }
           bc_write_varu(out, vm, (uint64_t) cls->class_of);
+          bc_write_varu(out, vm, cls->declared_fields.count);
+          for (uint32_t j = 0; j < cls->declared_fields.count; j++) {
+            bc_write_string_obj_nullable(out, vm, cls->declared_fields.data[j]);
+          }
+        }
+        break;
+
+      case OBJ_LIST:
+        {
+          List* list = (List*) obj;
+          bc_write_u8(out, vm, SAYNAA_BC_CONST_LIST);
+          bc_write_varu(out, vm, list->elements.count);
+          for (uint32_t j = 0; j < list->elements.count; j++) {
+            Result status = bc_write_scalar(out, vm, list->elements.data[j]);
+            if (status != RESULT_SUCCESS)
+              return status;
+          }
+        }
+        break;
+
+      case OBJ_MAP:
+        {
+          Map* map = (Map*) obj;
+          bc_write_u8(out, vm, SAYNAA_BC_CONST_MAP);
+          bc_write_varu(out, vm, map->count);
+
+          uint32_t position = 0;
+          Var key, value;
+          while (mapIterate(map, &position, &key, &value)) {
+            Result status = bc_write_scalar(out, vm, key);
+            if (status == RESULT_SUCCESS)
+              status = bc_write_scalar(out, vm, value);
+            if (status != RESULT_SUCCESS)
+              return status;
+          }
+        }
+        break;
+
+      case OBJ_SET:
+        {
+          Set* set = (Set*) obj;
+          bc_write_u8(out, vm, SAYNAA_BC_CONST_SET);
+          bc_write_varu(out, vm, set->count);
+
+          uint32_t position = 0;
+          Var key;
+          while (setIterate(set, &position, &key)) {
+            Result status = bc_write_scalar(out, vm, key);
+            if (status != RESULT_SUCCESS)
+              return status;
+          }
         }
         break;
 
@@ -967,6 +1189,27 @@ Result saynaa_bytecode_deserialize_module(VM* vm, Module* module,
             fn->fn->oplines.count = oplines_count;
           }
 
+          // The inlined code side table, (start, end, function) entries.
+          uint64_t inlines_count64 = 0;
+          status = bc_read_varu(&reader, UINT32_MAX, &inlines_count64);
+          if (status == RESULT_SUCCESS && inlines_count64 % 3 != 0)
+            status = RESULT_BYTECODE_INVALID_FORMAT;
+          if (status != RESULT_SUCCESS) {
+            vmPopTempRef(vm); // fn.
+            return status;
+          }
+          for (uint32_t j = 0; j < (uint32_t) inlines_count64; j++) {
+            uint64_t value64 = 0;
+            status = bc_read_varu(&reader, UINT32_MAX, &value64);
+            if (status == RESULT_SUCCESS && j % 3 != 2 && value64 > opcodes_count64)
+              status = RESULT_BYTECODE_INVALID_FORMAT;
+            if (status != RESULT_SUCCESS) {
+              vmPopTempRef(vm); // fn.
+              return status;
+            }
+            UintBufferWrite(&fn->fn->inlines, vm, (uint32_t) value64);
+          }
+
           VarBufferWrite(&module->constants, vm, VAR_OBJ(fn));
           if (needs_remap) {
             remap[i] = module->constants.count - 1;
@@ -1001,6 +1244,19 @@ Result saynaa_bytecode_deserialize_module(VM* vm, Module* module,
           Class* cls = newClassRaw(vm, module, name, doc);
           vmPushTempRef(vm, &cls->_super); // cls.
           cls->class_of = (VarType) (uint8_t) class_of64;
+
+          uint64_t field_count = 0;
+          status = bc_read_varu(&reader, UINT8_MAX, &field_count);
+          for (uint64_t j = 0; status == RESULT_SUCCESS && j < field_count; j++) {
+            String* field = NULL;
+            status = bc_read_module_string(&reader, vm, false, &field);
+            if (status == RESULT_SUCCESS)
+              StringBufferWrite(&cls->declared_fields, vm, field);
+          }
+          if (status != RESULT_SUCCESS) {
+            vmPopTempRef(vm); // cls.
+            return status;
+          }
           VarBufferWrite(&module->constants, vm, VAR_OBJ(cls));
           if (needs_remap) {
             remap[i] = module->constants.count - 1;
@@ -1009,6 +1265,24 @@ Result saynaa_bytecode_deserialize_module(VM* vm, Module* module,
         }
         break;
 
+      case SAYNAA_BC_CONST_LIST:
+      case SAYNAA_BC_CONST_MAP:
+      case SAYNAA_BC_CONST_SET:
+        {
+          Var template = VAR_NULL;
+          status = bc_read_template(&reader, vm, tag, &template);
+          if (status != RESULT_SUCCESS)
+            goto cleanup;
+
+          vmPushTempRef(vm, AS_OBJ(template)); // template.
+          VarBufferWrite(&module->constants, vm, template);
+          if (needs_remap) {
+            remap[i] = module->constants.count - 1;
+          }
+          vmPopTempRef(vm); // template.
+        }
+        break;
+
       default:
         status = RESULT_BYTECODE_UNSUPPORTED_CONST;
         goto cleanup;
@@ -18,7 +18,7 @@
 // Payload format magic and version. Bump when the payload layout changes.
 #define SAYNAA_BYTECODE_PAYLOAD_MAGIC "SAYNAA"
 #define SAYNAA_BYTECODE_PAYLOAD_MAGIC_SIZE 6
-#define SAYNAA_BYTECODE_PAYLOAD_VERSION 3
+#define SAYNAA_BYTECODE_PAYLOAD_VERSION 11
 
 typedef struct SaynaaBytecodeHeader {
   uint8_t magic[SAYNAA_BYTECODE_MAGIC_SIZE];
@@ -82,12 +82,23 @@
 // defined as MAX_STR_INTERP_DEPTH below.
 #define MAX_STR_INTERP_DEPTH 64
 
+// The maximum number of parts (strings and expressions) of an interpolated
+// string, since it's the 2 bytes operand of OP_BUILD_STRING.
+#define MAX_INTERPOLATION_PARTS 0xffff
+
 // The maximum address possible to jump. Similar limitation as above.
 #define MAX_JUMP (1 << 16)
 
 // Max number of break statement in a loop statement to patch.
 #define MAX_BREAK_PATCH 256
 
+// Max number of names in a destructuring assignment (a, b, c = ...).
+#define MAX_UNPACK_NAMES 64
+
+// Max size of the code of a function (till it returns) to be inlined at the
+// call sites by the compiler.
+#define MAX_INLINE_SIZE 32
+
 // Set this to dump compiled opcodes of each functions.
 #define DUMP_BYTECODE 0
 
@@ -114,6 +125,10 @@
 // The initial minimum capacity of a buffer to allocate.
 #define MIN_CAPACITY 8
 
+// The maximum capacity a list comprehension reserves up front from the length
+// of its sequence, longer results will grow as usual.
+#define MAX_RESERVE_HINT (1 << 20)
+
 // The size of the error message buffer, used ar vsnprintf (since c99) buffer.
 #define ERROR_MESSAGE_SIZE 1024
 
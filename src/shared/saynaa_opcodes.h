@@ -57,6 +57,49 @@ OPCODE(MAP_INSERT, 0, -2)
 // Insert the value with an auto-incremented integer key.
 OPCODE(MAP_APPEND, 0, -1)
 
+// Pop the top N values from the stack and push a string of them converted to
+// strings and concatenated. Used in interpolated string construction.
+// param: 2 bytes N.
+OPCODE(BUILD_STRING, 2, -0) //< Stack size will calculated at compile time.
+
+// Comprehensions build their result in a hidden local while the loop locals
+// are on top of it, so these work on a local instead of the stack top.
+//
+// Reserve the list local for the length of the sequence at the stack top if
+// it's a List or a Range (only emitted if every element is kept).
+// param: 2 bytes index of the list local.
+OPCODE(LIST_RESERVE, 2, 0)
+
+// Pop the stack top and append it to the list local.
+// param: 2 bytes index of the list local.
+OPCODE(LIST_APPEND_LOCAL, 2, -1)
+
+// Pop the top 2 values (key, value) and insert them to the map local.
+// param: 2 bytes index of the map local.
+OPCODE(MAP_INSERT_LOCAL, 2, -2)
+
+// Pop the top [count] values and push a tuple of them (in the same order).
+// Used in tuple literals.
+// param: 2 bytes count.
+OPCODE(BUILD_TUPLE, 2, -0) //< Stack size will be calculated at compile time.
+
+// Replace the tuple (or list) at the stack top with its [count] elements, the
+// last element will be the stack top. Used in destructuring assignments.
+// param: 2 bytes count.
+OPCODE(UNPACK, 2, -0) //< Stack size will be calculated at compile time.
+
+// Literals of only constant elements are built once by the compiler and kept
+// in the constant pool as frozen templates, which are never pushed as is.
+//
+// Push a shallow copy of the list or map template at [index].
+// params: 2 byte (uint16_t) index value.
+OPCODE(CLONE_CONSTANT, 2, 1)
+
+// Replace the stack top with true if it's in the set or map template at
+// [index] (a `value in [...]` test against a constant literal).
+// params: 2 byte (uint16_t) index value.
+OPCODE(IN_CONSTANT, 2, 0)
+
 // Push stack local on top of the stack. Locals at 0 to 8 marked explicitly
 // since it's performance critical.
 // params: PUSH_LOCAL_N -> 1 byte count value.
@@ -122,7 +165,8 @@ OPCODE(PUSH_UPVALUE, 2, 1)
 OPCODE(STORE_UPVALUE, 2, 0)
 
 // Push a closure for the function at the constant pool with index of the
-// first 2 bytes arguments.
+// first 2 bytes arguments. It's followed by a 1 byte CaptureType and a 2 byte
+// index for each upvalue of the function.
 // params: 2 byte index.
 OPCODE(PUSH_CLOSURE, 2, 1)
 
@@ -182,6 +226,38 @@ OPCODE(CALL, 1, -0) //< Stack size will calculated at compile time.
 // params: 1 byte argc.
 OPCODE(TAIL_CALL, 1, -0) //< Stack size will calculated at compile time.
 
+// Call the function defined at the module level with the global name at the
+// index without it on the stack, instead the slot of it (where the return
+// value will be placed) is pushed as null before the arguments. The function
+// is resolved and cached for the call site, if it's not a script function
+// taking exactly argc arguments (redefined at runtime) it's called like
+// OP_CALL does.
+// params: 1 byte argc.
+//         2 bytes global name index in the constant pool.
+OPCODE(CALL_DIRECT, 3, -0) //< Stack size will calculated at compile time.
+
+// Same as OP_CALL_DIRECT but reuse the caller's frame like OP_TAIL_CALL.
+// params: 1 byte argc.
+//         2 bytes global name index in the constant pool.
+OPCODE(TAIL_CALL_DIRECT, 3, -0) //< Stack size will calculated at compile time.
+
+// A call to a module function inlined by the compiler, the stack is the same
+// as OP_CALL_DIRECT and the code of the function follows this instruction.
+// If the global is still the inlined function the inlined code runs,
+// otherwise the global is called like OP_CALL_DIRECT after jumping over the
+// inlined code.
+// params: 1 byte argc.
+//         2 bytes global name index in the constant pool.
+//         2 bytes inlined function index in the constant pool.
+//         2 bytes jump offset to the end of the inlined code.
+OPCODE(INLINE_CALL, 7, -0) //< Stack size will calculated at compile time.
+
+// End of an inlined call, the stack top is the return value and the other
+// values (arguments and locals) are popped till the return value slot.
+// param: 1 byte number of the values above the return value slot, if it's 0
+//        the return value slot itself is the return value.
+OPCODE(INLINE_RETURN, 1, -0) //< Stack size will calculated at compile time.
+
 // Starts the iteration and test the sequence if it's iterable, before the
 // iteration instead of checking it everytime.
 OPCODE(ITER_TEST, 0, 0)
@@ -193,6 +269,12 @@ OPCODE(ITER_TEST, 0, 0)
 // param: 2 bytes jump offset if the iteration should stop.
 OPCODE(ITER, 3, 0)
 
+// Same as ITER for the two variable form (for k, v in seq), the stack top
+// will be the value, next the key, the iterator and the container. Maps are
+// walked directly and the other sequences should yield [key, value] pairs.
+// param: 2 bytes jump offset if the iteration should stop.
+OPCODE(ITER2, 2, 0)
+
 // Jumps forward by [offset]. ie. ip += offset.
 // param: 2 bytes jump address offset.
 OPCODE(JUMP, 2, 0)
@@ -239,6 +321,16 @@ OPCODE(GET_ATTRIB_KEEP, 2, 1)
 // param: 2 byte attrib name index.
 OPCODE(SET_ATTRIB, 2, -1)
 
+// Push the declared field of this at the slot. If this doesn't have the field
+// at the slot, the attribute will be looked up with it's name.
+// param: 2 byte field name index, 1 byte field slot.
+OPCODE(GET_FIELD, 3, 1)
+
+// Update the declared field of this at the slot to the stack top value and
+// leave the value on the stack (falls back to the name as GET_FIELD).
+// param: 2 byte field name index, 1 byte field slot.
+OPCODE(SET_FIELD, 3, 0)
+
 // Pop var, key, get value and push the result.
 OPCODE(GET_SUBSCRIPT, 0, -1)
 
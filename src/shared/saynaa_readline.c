@@ -58,7 +58,7 @@ static Module* find_module_safe(VM* vm, const char* name) {
   if (map->count == 0 || !map->entries)
     return NULL;
 
-  for (uint32_t i = 0; i < map->capacity; i++) {
+  for (uint32_t i = 0; i < map->used; i++) {
     MapEntry* entry = &map->entries[i];
     if (IS_UNDEF(entry->key))
       continue;
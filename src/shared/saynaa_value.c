@@ -10,6 +10,7 @@
 
 #include <ctype.h>
 #include <math.h>
+#include <stddef.h>
 
 #if defined(__GNUC__)
 #pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
@@ -31,6 +32,25 @@
 // capacity by the GROW_FACTOR.
 #define GROW_FACTOR 2
 
+// The largest index table that fits in int8 and int16 slots. The entries are
+// at most MAP_LOAD_PERCENT of the capacity so their positions always fit.
+#define MAP_INDEX8_CAPACITY 128
+#define MAP_INDEX16_CAPACITY 32768
+
+// Returns the size of a single index slot of a map with the [capacity].
+static inline size_t _mapSlotSize(uint32_t capacity) {
+  if (capacity <= MAP_INDEX8_CAPACITY)
+    return sizeof(int8_t);
+  if (capacity <= MAP_INDEX16_CAPACITY)
+    return sizeof(int16_t);
+  return sizeof(int32_t);
+}
+
+// Returns the allocated size of the map's index table in bytes.
+static inline size_t _mapIndexBytes(const Map* thiz) {
+  return _mapSlotSize(thiz->capacity) * thiz->capacity;
+}
+
 #define _MAX(a, b) ((a) > (b) ? (a) : (b))
 #define _MIN(a, b) ((a) < (b) ? (a) : (b))
 
@@ -158,6 +178,7 @@ static void popMarkedObjectsInternal(Object* obj, VM* vm) {
       {
         vm->bytes_allocated += sizeof(String);
         vm->bytes_allocated += ((size_t) ((String*) obj)->capacity);
+        vm->bytes_allocated += sizeof(uint32_t) * ((String*) obj)->cp_index_count;
       }
       break;
 
@@ -173,14 +194,58 @@ static void popMarkedObjectsInternal(Object* obj, VM* vm) {
     case OBJ_MAP:
       {
         Map* map = (Map*) obj;
-        for (uint32_t i = 0; i < map->capacity; i++) {
+        for (uint32_t i = 0; i < map->used; i++) {
           if (IS_UNDEF(map->entries[i].key))
             continue;
           markValue(vm, map->entries[i].key);
           markValue(vm, map->entries[i].value);
         }
         vm->bytes_allocated += sizeof(Map);
-        vm->bytes_allocated += sizeof(MapEntry) * map->capacity;
+        for (uint32_t i = 0; i < map->array_count; i++) {
+          if (!IS_UNDEF(map->array[i]))
+            markValue(vm, map->array[i]);
+        }
+        vm->bytes_allocated += sizeof(MapEntry) * map->entries_size;
+        vm->bytes_allocated += _mapIndexBytes(map);
+        vm->bytes_allocated += sizeof(Var) * map->array_capacity;
+      }
+      break;
+
+    case OBJ_SET:
+      {
+        Set* set = (Set*) obj;
+        for (uint32_t i = 0; i < set->used; i++) {
+          if (!IS_UNDEF(set->entries[i].key))
+            markValue(vm, set->entries[i].key);
+        }
+        vm->bytes_allocated += sizeof(Set);
+        vm->bytes_allocated += sizeof(SetEntry) * set->entries_size;
+        vm->bytes_allocated += _mapSlotSize(set->capacity) * set->capacity;
+      }
+      break;
+
+    case OBJ_ITERATOR:
+      {
+        Iterator* iter = (Iterator*) obj;
+        markValue(vm, iter->source);
+        markValue(vm, iter->cursor);
+        for (uint32_t i = 0; i < iter->stage_count; i++) {
+          markValue(vm, iter->stages[i].arg);
+          markValue(vm, iter->stages[i].cursor);
+        }
+        vm->bytes_allocated += sizeof(Iterator);
+        vm->bytes_allocated += sizeof(IteratorStage) * iter->stage_count;
+      }
+      break;
+
+    case OBJ_TUPLE:
+      {
+        Tuple* tuple = (Tuple*) obj;
+        for (uint32_t i = 0; i < tuple->length; i++) {
+          markValue(vm, tuple->items[i]);
+        }
+        vm->bytes_allocated += sizeof(Tuple);
+        vm->bytes_allocated += sizeof(Var) * tuple->length;
       }
       break;
 
@@ -202,6 +267,13 @@ static void popMarkedObjectsInternal(Object* obj, VM* vm) {
           markObject(vm, &module->global_indices->_super);
         }
 
+        for (uint32_t i = 0; i < module->links_count; i++) {
+          if (module->links[i].module != NULL) {
+            markObject(vm, &module->links[i].module->_super);
+          }
+        }
+        vm->bytes_allocated += sizeof(GlobalLink) * module->links_count;
+
         markVarBuffer(vm, &module->globals);
         vm->bytes_allocated += sizeof(Var) * module->globals.capacity;
 
@@ -230,6 +302,7 @@ static void popMarkedObjectsInternal(Object* obj, VM* vm) {
 
           vm->bytes_allocated += sizeof(uint8_t) * fn->opcodes.capacity;
           vm->bytes_allocated += sizeof(uint32_t) * fn->oplines.capacity;
+          vm->bytes_allocated += sizeof(uint32_t) * fn->inlines.capacity;
         }
       }
       break;
@@ -239,11 +312,11 @@ static void popMarkedObjectsInternal(Object* obj, VM* vm) {
         Closure* closure = (Closure*) obj;
         markObject(vm, &closure->fn->_super);
         for (int i = 0; i < closure->fn->upvalue_count; i++) {
-          markObject(vm, &(closure->upvalues[i]->_super));
+          markValue(vm, closure->upvalues[i]);
         }
 
         vm->bytes_allocated += sizeof(Closure);
-        vm->bytes_allocated += sizeof(Upvalue*) * closure->fn->upvalue_count;
+        vm->bytes_allocated += sizeof(Var) * closure->fn->upvalue_count;
       }
       break;
 
@@ -306,8 +379,18 @@ static void popMarkedObjectsInternal(Object* obj, VM* vm) {
         markObject(vm, &cls->name->_super);
         if (cls->method_lookup != NULL)
           markObject(vm, &cls->method_lookup->_super);
+        markClosureBuffer(vm, &cls->vtable);
+        markStringBuffer(vm, &cls->vtable_names);
+        markStringBuffer(vm, &cls->declared_fields);
+        markStringBuffer(vm, &cls->fields);
         markObject(vm, &cls->static_attribs->_super);
-        // don't need to mark magic_methods, they are all in cls->methods.
+
+        // The magic methods of a script class are all in cls->methods but
+        // the constructors of the builtin classes are only referenced here.
+        for (int i = 0; i < MAX_MAGIC_METHODS; i++) {
+          if (cls->magic_methods[i] != NULL && cls->magic_methods[i] != (Closure*) -1)
+            markObject(vm, &cls->magic_methods[i]->_super);
+        }
 
         markClosureBuffer(vm, &cls->methods);
         vm->bytes_allocated += sizeof(Closure) * cls->methods.capacity;
@@ -328,6 +411,15 @@ static void popMarkedObjectsInternal(Object* obj, VM* vm) {
         if (inst->attribs != NULL)
           markObject(vm, &inst->attribs->_super);
 
+        if (inst->native != NULL) {
+          for (Class* cls = inst->cls; cls != NULL; cls = cls->super_class) {
+            if (cls->mark_fn != NULL) {
+              cls->mark_fn(vm, inst->native);
+              break;
+            }
+          }
+        }
+
         vm->bytes_allocated += sizeof(Instance);
       }
       break;
@@ -363,16 +455,50 @@ static String* _allocateString(VM* vm, size_t length) {
   string->length = (uint32_t) length;
   string->data[length] = '\0';
   string->capacity = (uint32_t) (length + 1);
+  string->utf8_state = STRING_UTF8_UNKNOWN;
+  string->cp_length = 0;
+  string->cp_index_count = 0;
+  string->cp_index = NULL;
   return string;
 }
 
-String* newStringLength(VM* vm, const char* text, uint32_t length) {
-  ASSERT(length == 0 || text != NULL, "Unexpected NULL string.");
+// Returns true if [byte] is a UTF-8 continuation byte (10xxxxxx).
+#define IS_UTF8_CONT(byte) ((((uint8_t) (byte)) & 0xC0) == 0x80)
 
+// Scan the bytes of the string once to flag it as ASCII or multibyte and
+// count its codepoints. A codepoint starts at every byte which isn't a
+// continuation byte, so malformed sequences never split or drop bytes.
+static void _stringScanUtf8(String* string) {
+  const uint8_t* c = (const uint8_t*) string->data;
+  const uint8_t* end = c + string->length;
+
+  uint32_t high = 0, cont = 0;
+  for (; c < end; c++) {
+    high += (*c >> 7);
+    cont += IS_UTF8_CONT(*c);
+  }
+
+  if (high == 0) {
+    string->utf8_state = STRING_UTF8_ASCII;
+    string->cp_length = string->length;
+    return;
+  }
+
+  string->utf8_state = STRING_UTF8_MULTIBYTE;
+  string->cp_length = string->length - cont;
+
+  // A leading stray continuation byte is a codepoint of it's own.
+  if (IS_UTF8_CONT(string->data[0]))
+    string->cp_length++;
+}
+
+String* newStringLength(VM* vm, const char* text, uint32_t length) {
   String* string = _allocateString(vm, length);
 
-  if (length != 0 && text != NULL)
+  if (length != 0 && text != NULL) {
     memcpy(string->data, text, length);
+    _stringScanUtf8(string);
+  }
   string->hash = utilHashStringLength(string->data, string->length);
 
   return string;
@@ -393,8 +519,10 @@ String* newInternedStringLength(VM* vm, const char* text, uint32_t length) {
   }
 
   String* string = _allocateString(vm, length);
-  if (length != 0 && text != NULL)
+  if (length != 0 && text != NULL) {
     memcpy(string->data, text, length);
+    _stringScanUtf8(string);
+  }
   string->hash = hash;
 
   if (length <= max_interned_length) {
@@ -435,12 +563,73 @@ Map* newMap(VM* vm) {
   varInitObject(&map->_super, vm, OBJ_MAP);
   map->capacity = 0;
   map->count = 0;
+  map->hash_count = 0;
+  map->used = 0;
+  map->entries_size = 0;
+  map->index = NULL;
   map->entries = NULL;
-  VarBufferInit(&map->order_keys);
+  map->array = NULL;
+  map->array_count = 0;
+  map->array_capacity = 0;
   map->next_index = 0;
   return map;
 }
 
+Set* newSet(VM* vm) {
+  Set* set = ALLOCATE(vm, Set);
+  varInitObject(&set->_super, vm, OBJ_SET);
+  set->capacity = 0;
+  set->count = 0;
+  set->used = 0;
+  set->entries_size = 0;
+  set->index = NULL;
+  set->entries = NULL;
+  return set;
+}
+
+Iterator* newIterator(VM* vm, Var source, const Iterator* base, uint32_t extra) {
+  Iterator* iter = ALLOCATE(vm, Iterator);
+  varInitObject(&iter->_super, vm, OBJ_ITERATOR);
+  iter->source = source;
+  iter->source_kind = (base != NULL) ? base->source_kind : ITER_SOURCE_SEQ;
+  iter->cursor = VAR_NULL;
+  iter->done = false;
+  iter->stage_count = 0;
+  iter->stages = NULL;
+
+  uint32_t count = (base != NULL) ? base->stage_count : 0;
+  if (count + extra == 0)
+    return iter;
+
+  vmPushTempRef(vm, &iter->_super); // iter.
+  iter->stages = ALLOCATE_ARRAY(vm, IteratorStage, count + extra);
+  vmPopTempRef(vm); // iter.
+
+  if (base != NULL) {
+    iter->cursor = base->cursor;
+    iter->done = base->done;
+    memcpy(iter->stages, base->stages, sizeof(IteratorStage) * count);
+  }
+  for (uint32_t i = count; i < count + extra; i++) {
+    iter->stages[i].kind = ITER_MAP;
+    iter->stages[i].arg = VAR_NULL;
+    iter->stages[i].cursor = VAR_NULL;
+    iter->stages[i].count = 0;
+  }
+  iter->stage_count = count + extra;
+  return iter;
+}
+
+Tuple* newTuple(VM* vm, uint32_t length) {
+  Tuple* tuple = ALLOCATE_DYNAMIC(vm, Tuple, length, Var);
+  varInitObject(&tuple->_super, vm, OBJ_TUPLE);
+  tuple->length = length;
+  for (uint32_t i = 0; i < length; i++) {
+    tuple->items[i] = VAR_NULL;
+  }
+  return tuple;
+}
+
 Range* newRange(VM* vm, double from, double to) {
   Range* range = ALLOCATE(vm, Range);
   varInitObject(&range->_super, vm, OBJ_RANGE);
@@ -505,6 +694,7 @@ Function* newFunction(VM* vm, const char* name, int length, Module* owner,
       Fn* fn = ALLOCATE(vm, Fn);
       ByteBufferInit(&fn->opcodes);
       UintBufferInit(&fn->oplines);
+      UintBufferInit(&fn->inlines);
       fn->stack_size = 0;
       func->fn = fn;
     }
@@ -533,6 +723,7 @@ Function* newFunctionRaw(VM* vm, Module* owner, String* name, String* docstring,
   Fn* fn = ALLOCATE(vm, Fn);
   ByteBufferInit(&fn->opcodes);
   UintBufferInit(&fn->oplines);
+  UintBufferInit(&fn->inlines);
   fn->stack_size = 0;
   func->fn = fn;
 
@@ -540,12 +731,39 @@ Function* newFunctionRaw(VM* vm, Module* owner, String* name, String* docstring,
   return func;
 }
 
+Function* fnInlinedAt(const Function* fn, uint32_t index, int* line) {
+  if (fn->is_native)
+    return NULL;
+
+  const UintBuffer* inlines = &fn->fn->inlines;
+  for (uint32_t i = 0; i < inlines->count; i += 3) {
+    uint32_t start = inlines->data[i], end = inlines->data[i + 1];
+    if (index < start || end <= index)
+      continue;
+
+    // The inlined code follows the OP_INLINE_CALL at the call line. The table
+    // could be loaded from a bytecode file, so it's not trusted.
+    uint32_t fn_index = inlines->data[i + 2];
+    if (start == 0 || start > fn->fn->oplines.count || fn_index >= fn->owner->constants.count)
+      return NULL;
+    Var inlined = fn->owner->constants.data[fn_index];
+    if (!IS_OBJ_TYPE(inlined, OBJ_FUNC))
+      return NULL;
+
+    *line = (int) fn->fn->oplines.data[start - 1];
+    return (Function*) AS_OBJ(inlined);
+  }
+  return NULL;
+}
+
 Closure* newClosure(VM* vm, Function* fn) {
-  Closure* closure = ALLOCATE_DYNAMIC(vm, Closure, fn->upvalue_count, Upvalue*);
+  Closure* closure = ALLOCATE_DYNAMIC(vm, Closure, fn->upvalue_count, Var);
   varInitObject(&closure->_super, vm, OBJ_CLOSURE);
 
   closure->fn = fn;
-  memset(closure->upvalues, 0, sizeof(Upvalue*) * fn->upvalue_count);
+  for (int i = 0; i < fn->upvalue_count; i++) {
+    closure->upvalues[i] = VAR_NULL;
+  }
 
   return closure;
 }
@@ -655,6 +873,10 @@ Class* newClass(VM* vm, const char* name, int length, Class* super,
   vmPushTempRef(vm, &cls->_super); // class.
 
   ClosureBufferInit(&cls->methods);
+  ClosureBufferInit(&cls->vtable);
+  StringBufferInit(&cls->vtable_names);
+  StringBufferInit(&cls->declared_fields);
+  StringBufferInit(&cls->fields);
   cls->method_lookup = newMap(vm);
   cls->static_attribs = newMap(vm);
 
@@ -678,6 +900,8 @@ Class* newClass(VM* vm, const char* name, int length, Class* super,
     cls->name = newInternedStringLength(vm, name, (uint32_t) length);
   }
 
+  if (super != NULL) classFlattenMethods(vm, cls);
+
   vmPopTempRef(vm); // class.
   return cls;
 }
@@ -691,6 +915,10 @@ Class* newClassRaw(VM* vm, Module* owner, String* name, String* docstring) {
   vmPushTempRef(vm, &cls->_super); // class.
 
   ClosureBufferInit(&cls->methods);
+  ClosureBufferInit(&cls->vtable);
+  StringBufferInit(&cls->vtable_names);
+  StringBufferInit(&cls->declared_fields);
+  StringBufferInit(&cls->fields);
   cls->method_lookup = newMap(vm);
   cls->static_attribs = newMap(vm);
 
@@ -705,10 +933,129 @@ Class* newClassRaw(VM* vm, Module* owner, String* name, String* docstring) {
   cls->owner = owner;
   cls->name = name;
 
+  if (cls->super_class != NULL) classFlattenMethods(vm, cls);
+
   vmPopTempRef(vm); // class.
   return cls;
 }
 
+// Method names of the operators, in the order of the OperatorMethod enum.
+static const char* const operator_method_names[MAX_OPERATOR_METHODS] = {
+  "+", "+=", "-", "-=", "*", "*=", "/", "/=", "%", "%=", "**", "**=",
+  "&", "&=", "|", "|=", "^", "^=", "<<", "<<=", ">>", ">>=",
+  "==", ">", "<", "..", "in", "[]", "[]=",
+  "+this", "-this", "~this", "!this", "_next", "_value",
+};
+
+// Returns the operator slot of the method [name] or -1 if the name isn't an
+// operator method.
+static int _operatorMethodOf(const String* name) {
+  for (int i = 0; i < MAX_OPERATOR_METHODS; i++) {
+    if (IS_CSTR_EQ(name, operator_method_names[i],
+                   strlen(operator_method_names[i]))) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Returns true if the method at the [slot] of the class's table is the one
+// inherited from it's base class (ie. not overridden yet).
+static inline bool _classSlotInherited(const Class* cls, uint32_t slot) {
+  const Class* super = cls->super_class;
+  return super != NULL && slot < super->vtable.count &&
+         cls->vtable.data[slot] == super->vtable.data[slot];
+}
+
+int classVtableSlot(Class* cls, String* name) {
+  if (cls->method_lookup == NULL) return -1;
+  Var slot = mapGetStringKey(cls->method_lookup, name);
+  if (!IS_NUM(slot)) return -1;
+  return (int) AS_NUM(slot);
+}
+
+void classBindVtable(VM* vm, Class* cls, String* name, Closure* method) {
+  if (cls->method_lookup == NULL) {
+    cls->method_lookup = newMap(vm);
+  }
+
+  int slot = classVtableSlot(cls, name);
+  if (slot < 0) {
+    Var index = VAR_NUM((double) cls->vtable.count);
+    ClosureBufferWrite(&cls->vtable, vm, method);
+    StringBufferWrite(&cls->vtable_names, vm, name);
+    mapSetStringKey(vm, cls->method_lookup, name, index);
+
+  } else if (_classSlotInherited(cls, (uint32_t) slot)) {
+    cls->vtable.data[slot] = method;
+
+  } else {
+    return; // The first method with the name is kept.
+  }
+
+  int op = _operatorMethodOf(name);
+  if (op >= 0) cls->operator_methods[op] = method;
+}
+
+void classFlattenMethods(VM* vm, Class* cls) {
+  cls->vtable.count = 0;
+  cls->vtable_names.count = 0;
+  if (cls->method_lookup == NULL) {
+    cls->method_lookup = newMap(vm);
+  } else {
+    mapClear(vm, cls->method_lookup);
+  }
+
+  memset(cls->operator_methods, 0, sizeof(cls->operator_methods));
+
+  Class* super = cls->super_class;
+  if (super != NULL) {
+    memcpy(cls->operator_methods, super->operator_methods,
+           sizeof(cls->operator_methods));
+    for (uint32_t i = 0; i < super->vtable.count; i++) {
+      ClosureBufferWrite(&cls->vtable, vm, super->vtable.data[i]);
+      StringBufferWrite(&cls->vtable_names, vm, super->vtable_names.data[i]);
+      mapSetStringKey(vm, cls->method_lookup, super->vtable_names.data[i],
+                      VAR_NUM((double) i));
+    }
+  }
+
+  for (uint32_t i = 0; i < cls->methods.count; i++) {
+    Closure* method = cls->methods.data[i];
+    if (method->fn->name == NULL) continue;
+    String* name = newInternedString(vm, method->fn->name);
+    vmPushTempRef(vm, &name->_super); // name.
+    classBindVtable(vm, cls, name, method);
+    vmPopTempRef(vm); // name.
+  }
+}
+
+int classFieldSlot(Class* cls, const char* name, uint32_t length) {
+  for (uint32_t i = 0; i < cls->fields.count; i++) {
+    if (IS_CSTR_EQ(cls->fields.data[i], name, length))
+      return (int) i;
+  }
+  return -1;
+}
+
+void classFlattenFields(VM* vm, Class* cls) {
+  cls->fields.count = 0;
+
+  Class* super = cls->super_class;
+  if (super != NULL) {
+    for (uint32_t i = 0; i < super->fields.count; i++) {
+      StringBufferWrite(&cls->fields, vm, super->fields.data[i]);
+    }
+  }
+
+  for (uint32_t i = 0; i < cls->declared_fields.count; i++) {
+    String* name = cls->declared_fields.data[i];
+    if (classFieldSlot(cls, name->data, name->length) < 0) {
+      StringBufferWrite(&cls->fields, vm, name);
+    }
+  }
+}
+
 Pointer* newPointer(VM* vm, void* native_ptr, Destructor destructor) {
   Pointer* pointer = ALLOCATE(vm, Pointer);
   varInitObject((Object*) pointer, vm, OBJ_POINTER);
@@ -732,27 +1079,44 @@ Closure* newNativeClosure(VM* vm, const char* name, nativeFn fptr, int arity,
 Instance* newInstance(VM* vm, Class* cls) {
   ASSERT(cls->class_of == vINSTANCE, "Cannot create an instace of builtin "
                                      "class with newInstance() function.");
+  return newInstanceRaw(vm, cls, classNewInstanceFn(cls));
+}
+
+NewInstanceFn classNewInstanceFn(Class* cls) {
+  while (cls != NULL) {
+    if (cls->new_fn != NULL)
+      return cls->new_fn;
+    cls = cls->super_class;
+  }
+  return NULL;
+}
 
+Instance* newInstanceRaw(VM* vm, Class* cls, NewInstanceFn new_fn) {
   Instance* inst = ALLOCATE(vm, Instance);
-  memset(inst, 0, sizeof(Instance));
   varInitObject(&inst->_super, vm, OBJ_INST);
 
-  vmPushTempRef(vm, &inst->_super); // inst.
-
+  // The inline attribute slots are not cleared, only the first
+  // [inline_attrib_count] of them are ever read.
   inst->cls = cls;
   inst->native = NULL;
-  while (cls != NULL) {
-    if (cls->new_fn != NULL) {
-      inst->native = cls->new_fn(vm);
-      break;
-    }
-    cls = cls->super_class;
+  inst->attribs = NULL;
+
+  // The declared fields are placed at their layout slots, initialized to null.
+  uint32_t field_count = cls->fields.count;
+  if (field_count > INSTANCE_INLINE_ATTR_CAPACITY)
+    field_count = INSTANCE_INLINE_ATTR_CAPACITY;
+  for (uint32_t i = 0; i < field_count; i++) {
+    inst->inline_attrib_names[i] = cls->fields.data[i];
+    inst->inline_attrib_values[i] = VAR_NULL;
   }
+  inst->inline_attrib_count = (uint8_t) field_count;
 
-  inst->inline_attrib_count = 0;
-  inst->attribs = NULL;
+  if (new_fn != NULL) {
+    vmPushTempRef(vm, &inst->_super); // inst.
+    inst->native = new_fn(vm);
+    vmPopTempRef(vm); // inst.
+  }
 
-  vmPopTempRef(vm); // inst.
   return inst;
 }
 
@@ -943,7 +1307,7 @@ String* stringReplace(VM* vm, String* thiz, String* old, String* new_, int32_t c
     // Note that since we're not allocating anything else here, this string
     // doesn't needs to pushed to VM's temp references.
     if (replacedc == 0) {
-      replaced = newStringLength(vm, "", length);
+      replaced = newStringLength(vm, NULL, length);
       d = replaced->data;
     }
 
@@ -1006,13 +1370,115 @@ void* _memmem(const void* l, size_t l_len, const void* s, size_t s_len) {
   return NULL;
 }
 
+uint32_t stringCodepointCount(String* thiz) {
+  if (thiz->utf8_state == STRING_UTF8_UNKNOWN)
+    _stringScanUtf8(thiz);
+  return thiz->cp_length;
+}
+
+uint32_t stringCodepointWidth(String* thiz, uint32_t offset) {
+  ASSERT(offset < thiz->length, OOPS);
+  uint32_t end = offset + 1;
+  while (end < thiz->length && IS_UTF8_CONT(thiz->data[end]))
+    end++;
+  return end - offset;
+}
+
+// Build the sparse codepoint index of a multibyte string: cp_index[i] is the
+// byte offset of the codepoint (i * STRING_CP_INDEX_STRIDE).
+static void _stringBuildCodepointIndex(VM* vm, String* thiz) {
+  ASSERT(thiz->utf8_state == STRING_UTF8_MULTIBYTE, OOPS);
+  ASSERT(thiz->cp_index == NULL, OOPS);
+
+  uint32_t count = thiz->cp_length / STRING_CP_INDEX_STRIDE + 1;
+  uint32_t* index = ALLOCATE_ARRAY(vm, uint32_t, count);
+
+  uint32_t cp = 0, entry = 0;
+  for (uint32_t i = 0; i < thiz->length; i += stringCodepointWidth(thiz, i), cp++) {
+    if (cp % STRING_CP_INDEX_STRIDE == 0)
+      index[entry++] = i;
+  }
+  // Codepoint count is a multiple of the stride, the last entry is the end.
+  if (entry < count)
+    index[entry++] = thiz->length;
+  ASSERT(entry == count, OOPS);
+
+  thiz->cp_index = index;
+  thiz->cp_index_count = count;
+}
+
+uint32_t stringCodepointOffset(VM* vm, String* thiz, uint32_t index) {
+  uint32_t count = stringCodepointCount(thiz);
+  ASSERT(index <= count, OOPS);
+
+  if (thiz->utf8_state == STRING_UTF8_ASCII)
+    return index;
+  if (index == count)
+    return thiz->length;
+
+  // Short strings are cheaper to walk than to index.
+  uint32_t offset = 0, skip = index;
+  if (count > STRING_CP_INDEX_STRIDE) {
+    if (thiz->cp_index == NULL)
+      _stringBuildCodepointIndex(vm, thiz);
+    offset = thiz->cp_index[index / STRING_CP_INDEX_STRIDE];
+    skip = index % STRING_CP_INDEX_STRIDE;
+  }
+
+  while (skip-- > 0)
+    offset += stringCodepointWidth(thiz, offset);
+  return offset;
+}
+
+uint32_t stringCodepointIndex(VM* vm, String* thiz, uint32_t offset) {
+  ASSERT(offset <= thiz->length, OOPS);
+  uint32_t count = stringCodepointCount(thiz);
+
+  if (thiz->utf8_state == STRING_UTF8_ASCII)
+    return offset;
+  if (offset == thiz->length)
+    return count;
+
+  // Start from the last indexed codepoint at or before the offset.
+  uint32_t index = 0, pos = 0;
+  if (count > STRING_CP_INDEX_STRIDE) {
+    if (thiz->cp_index == NULL)
+      _stringBuildCodepointIndex(vm, thiz);
+    uint32_t low = 0, high = thiz->cp_index_count;
+    while (high - low > 1) {
+      uint32_t mid = low + (high - low) / 2;
+      if (thiz->cp_index[mid] <= offset)
+        low = mid;
+      else
+        high = mid;
+    }
+    index = low * STRING_CP_INDEX_STRIDE;
+    pos = thiz->cp_index[low];
+  }
+
+  while (pos < offset) {
+    pos += stringCodepointWidth(thiz, pos);
+    index++;
+  }
+  return index;
+}
+
+void stringResetCodepoints(VM* vm, String* thiz) {
+  if (thiz->cp_index != NULL) {
+    DEALLOCATE_ARRAY(vm, thiz->cp_index, uint32_t, thiz->cp_index_count);
+  }
+  thiz->cp_index = NULL;
+  thiz->cp_index_count = 0;
+  thiz->utf8_state = STRING_UTF8_UNKNOWN;
+}
+
 List* stringSplit(VM* vm, String* thiz, String* sep) {
   List* list = newList(vm, 0);
   vmPushTempRef(vm, &list->_super); // list.
 
   if (sep == NULL || sep->length == 0) {
-    for (uint32_t i = 0; i < thiz->length; i++) {
-      String* ch = newStringLength(vm, &thiz->data[i], 1);
+    for (uint32_t i = 0; i < thiz->length; i += stringCodepointWidth(thiz, i)) {
+      String* ch = newStringLength(vm, &thiz->data[i], stringCodepointWidth(thiz, i));
       vmPushTempRef(vm, &ch->_super); // ch
       listAppend(vm, list, VAR_OBJ(ch));
       vmPopTempRef(vm); // ch
@@ -1130,9 +1596,119 @@ String* stringJoin(VM* vm, String* str1, String* str2) {
   return string;
 }
 
-String* replaceSubstring(VM* vm, uint32_t index, String* str, String* replace) {
+// Integers which are exactly representable in a double are written without
+// going through sprintf(DOUBLE_FMT), that gives the same digits for them.
+#define STRING_BUILD_MAX_INT 1e15
+
+// Returns the number of characters of the number [value] as an integer, if
+// [buff] isn't NULL the characters are written to it (not null terminated).
+static uint32_t _stringBuildInt(double value, char* buff) {
+  char digits[STR_DBL_BUFF_SIZE];
+  uint64_t n = (uint64_t) fabs(value);
+  uint32_t count = 0;
+  do {
+    digits[count++] = (char) ('0' + (n % 10));
+    n /= 10;
+  } while (n != 0);
+
+  uint32_t length = count + ((value < 0) ? 1 : 0);
+  if (buff != NULL) {
+    if (value < 0)
+      *buff++ = '-';
+    while (count != 0)
+      *buff++ = digits[--count];
+  }
+  return length;
+}
+
+// Returns true if the number [value] is written by _stringBuildInt().
+static inline bool _stringBuildIsInt(double value) {
+  return value == floor(value) && fabs(value) < STRING_BUILD_MAX_INT
+         && !(value == 0 && signbit(value));
+}
+
+String* stringBuild(VM* vm, Var* values, uint32_t count) {
+  size_t length = 0;
+
+  for (uint32_t i = 0; i < count; i++) {
+    Var value = values[i];
+
+    if (IS_OBJ_TYPE(value, OBJ_STRING)) {
+      length += ((String*) AS_OBJ(value))->length;
+
+    } else if (IS_NULL(value)) {
+      length += 4;
+
+    } else if (IS_BOOL(value)) {
+      length += AS_BOOL(value) ? 4 : 5;
+
+    } else {
+      ASSERT(IS_NUM(value), OOPS);
+      double num = AS_NUM(value);
+      if (_stringBuildIsInt(num)) {
+        length += _stringBuildInt(num, NULL);
+      } else {
+        String* str = toString(vm, value);
+        values[i] = VAR_OBJ(str);
+        length += str->length;
+      }
+    }
+  }
+
+  // If it's a single string there is nothing to build.
+  if (count == 1 && IS_OBJ_TYPE(values[0], OBJ_STRING)) {
+    return (String*) AS_OBJ(values[0]);
+  }
+
+  String* string = _allocateString(vm, length);
+  char* buff = string->data;
+
+  for (uint32_t i = 0; i < count; i++) {
+    Var value = values[i];
+
+    if (IS_OBJ_TYPE(value, OBJ_STRING)) {
+      String* str = (String*) AS_OBJ(value);
+      memcpy(buff, str->data, str->length);
+      buff += str->length;
+
+    } else if (IS_NULL(value)) {
+      memcpy(buff, "null", 4);
+      buff += 4;
+
+    } else if (IS_BOOL(value)) {
+      if (AS_BOOL(value)) {
+        memcpy(buff, "true", 4);
+        buff += 4;
+      } else {
+        memcpy(buff, "false", 5);
+        buff += 5;
+      }
+
+    } else {
+      buff += _stringBuildInt(AS_NUM(value), buff);
+    }
+  }
+  // Null byte already existed. From _allocateString.
+
+  if (length != 0) {
+    _stringScanUtf8(string);
+  }
+  string->hash = utilHashStringLength(string->data, string->length);
+  return string;
+}
+
+String* replaceSubstring(VM* vm, uint32_t index, uint32_t span, String* str,
+                         String* replace) {
+  ASSERT(index + span <= str->length, OOPS);
+  uint32_t length = str->length - span + replace->length;
+  ASSERT(length < str->capacity, OOPS);
+
   char* stringValue = str->data;
-  strncpy(stringValue + index, replace->data, replace->length);
+  memmove(stringValue + index + replace->length, stringValue + index + span,
+          str->length - index - span);
+  memcpy(stringValue + index, replace->data, replace->length);
+  str->length = length;
+  stringValue[length] = '\0';
   return str;
 }
 
@@ -1241,6 +1817,19 @@ static uint32_t _hashObject(Object* obj) {
       {
         return utilHashBits((uint64_t) obj);
       }
+
+    case OBJ_TUPLE:
+      {
+        // Mix the hashes of the elements in order, so (1, 2) and (2, 1)
+        // have different hashes.
+        Tuple* tuple = (Tuple*) obj;
+        uint32_t hash = 0x345678 ^ tuple->length;
+        for (uint32_t i = 0; i < tuple->length; i++) {
+          hash = (hash * 1000003) ^ varHashValue(tuple->items[i]);
+        }
+        return hash;
+      }
+
     default:
       break;
   }
@@ -1253,6 +1842,10 @@ uint32_t varHashValue(Var v) {
   if (IS_OBJ(v))
     return _hashObject(AS_OBJ(v));
 
+  // -0 == 0 (see isValuesEqual()) so both should have the same hash.
+  if (IS_NUM(v) && AS_NUM(v) == 0)
+    v = VAR_NUM(0);
+
 #if VAR_NAN_TAGGING
   return utilHashBits(v);
 #else
@@ -1277,113 +1870,193 @@ uint32_t varHashValue(Var v) {
 #endif
 }
 
-// Find the entry with the [key]. Returns true if found and set [result] to
-// point to the entry, return false otherwise and points [result] to where
-// the entry should be inserted.
-static bool _mapFindEntry(Map* thiz, Var key, MapEntry** result) {
-  // An empty map won't contain the key.
-  if (thiz->capacity == 0)
-    return false;
+// Index table slot markers. A slot is either empty, a tombstone of a deleted
+// entry or the position of the entry in the map's entries array.
+#define MAP_SLOT_EMPTY (-1)
+#define MAP_SLOT_DELETED (-2)
+
+// Returns the number of entries a map with the index [capacity] can hold.
+static inline uint32_t _mapEntriesSize(uint32_t capacity) {
+  return (uint32_t) (((uint64_t) capacity * MAP_LOAD_PERCENT) / 100);
+}
+
+// Access a slot of an index table (shared by the Map and the Set) with the
+// slot width of it's [capacity].
+static inline int32_t _indexSlotGet(const void* index, uint32_t capacity, uint32_t slot) {
+  if (capacity <= MAP_INDEX8_CAPACITY)
+    return ((const int8_t*) index)[slot];
+  if (capacity <= MAP_INDEX16_CAPACITY)
+    return ((const int16_t*) index)[slot];
+  return ((const int32_t*) index)[slot];
+}
+
+static inline void _indexSlotSet(void* index, uint32_t capacity, uint32_t slot, int32_t value) {
+  if (capacity <= MAP_INDEX8_CAPACITY)
+    ((int8_t*) index)[slot] = (int8_t) value;
+  else if (capacity <= MAP_INDEX16_CAPACITY)
+    ((int16_t*) index)[slot] = (int16_t) value;
+  else
+    ((int32_t*) index)[slot] = value;
+}
+
+static inline int32_t _mapSlotGet(const Map* thiz, uint32_t slot) {
+  return _indexSlotGet(thiz->index, thiz->capacity, slot);
+}
+
+static inline void _mapSlotSet(Map* thiz, uint32_t slot, int32_t value) {
+  _indexSlotSet(thiz->index, thiz->capacity, slot, value);
+}
+
+// The entries of a Map and a Set both start with the key followed by it's
+// cached hash (see MapEntry and SetEntry), so the probing and the rebuild of
+// the index table below only need the size of an entry.
+#define INDEX_ENTRY_KEY(entry) (*(const Var*) (entry))
+#define INDEX_ENTRY_HASH(entry) \
+  (*(const uint32_t*) ((const uint8_t*) (entry) + offsetof(SetEntry, hash)))
 
-  ASSERT((thiz->capacity & (thiz->capacity - 1)) == 0, OOPS);
+// Find the [key] in an index table of [capacity] slots over the [entries]
+// of [entry_size] bytes. Returns the slot of the key if found, otherwise
+// returns -1 and set [insert] to the slot where the key should be inserted
+// (the first tombstone in the probe sequence if any).
+static inline int64_t _indexFind(const void* index, uint32_t capacity, const void* entries,
+                                 size_t entry_size, Var key, uint32_t hash,
+                                 uint32_t* insert) {
+  ASSERT(capacity != 0, OOPS);
+  ASSERT((capacity & (capacity - 1)) == 0, OOPS);
+  ASSERT(offsetof(MapEntry, hash) == offsetof(SetEntry, hash), OOPS);
 
-  // The [start_index] is where the entry supposed to be if there wasn't any
+  // The [start] is where the key supposed to be if there wasn't any
   // collision occurred. It'll be the start index for the linear probing.
-  uint32_t mask = thiz->capacity - 1;
-  uint32_t start_index = varHashValue(key) & mask;
-  uint32_t index = start_index;
+  uint32_t mask = capacity - 1;
+  uint32_t start = hash & mask;
+  uint32_t slot = start;
 
-  // Keep track of the first tombstone after the [start_index] if we don't
-  // find the key anywhere. The tombstone would be the entry at where we will
-  // have to insert the key/value pair.
-  MapEntry* tombstone = NULL;
+  // Keep track of the first tombstone after the [start] if we don't find
+  // the key anywhere. That's where the key will be inserted.
+  int64_t tombstone = -1;
 
   do {
-    MapEntry* entry = &thiz->entries[index];
+    int32_t position = _indexSlotGet(index, capacity, slot);
 
-    if (IS_UNDEF(entry->key)) {
-      ASSERT(IS_BOOL(entry->value), OOPS);
+    if (position == MAP_SLOT_EMPTY) {
+      if (insert != NULL)
+        *insert = (tombstone != -1) ? (uint32_t) tombstone : slot;
+      return -1;
 
-      if (IS_TRUE(entry->value)) {
-        // We've found a tombstone, if we haven't found one [tombstone] should
-        // be updated. We still need to keep search for if the key exists.
-        if (tombstone == NULL)
-          tombstone = entry;
+    } else if (position == MAP_SLOT_DELETED) {
+      if (tombstone == -1)
+        tombstone = slot;
 
-      } else {
-        // We've found a new empty slot and the key isn't found. If
-        // we've found a tombstone along the sequence we could use that
-        // entry otherwise the entry at the current index.
+    } else {
+      // Compare the cached hash first (cheap tag check), then the keys.
+      const uint8_t* entry = (const uint8_t*) entries + (size_t) position * entry_size;
+      if (INDEX_ENTRY_HASH(entry) == hash && isValuesEqual(INDEX_ENTRY_KEY(entry), key))
+        return slot;
+    }
 
-        *result = (tombstone != NULL) ? tombstone : entry;
-        return false;
-      }
+    slot = (slot + 1) & mask;
+  } while (slot != start);
 
-    } else if (isValuesEqual(entry->key, key)) {
-      // We've found the key.
-      *result = entry;
-      return true;
-    }
+  // The index table is filled with tombstones.
+  ASSERT(tombstone != -1, OOPS);
+  if (insert != NULL)
+    *insert = (uint32_t) tombstone;
+  return -1;
+}
 
-    index = (index + 1) & mask;
+// Returns the first empty slot for [hash]. Only used when rebuilding the
+// index table, which doesn't have any tombstones or duplicate keys.
+static inline uint32_t _indexFreeSlot(const void* index, uint32_t capacity, uint32_t hash) {
+  uint32_t mask = capacity - 1;
+  uint32_t slot = hash & mask;
+  while (_indexSlotGet(index, capacity, slot) != MAP_SLOT_EMPTY)
+    slot = (slot + 1) & mask;
+  return slot;
+}
 
-  } while (index != start_index);
+// Allocate an index table of [capacity] empty slots.
+static void* _indexAllocate(VM* vm, uint32_t capacity) {
+  void* index = vmRealloc(vm, NULL, 0, _mapSlotSize(capacity) * capacity);
 
-  // If we reach here means the map is filled with tombstone. Set the first
-  // tombstone as result for the next insertion and return false.
-  ASSERT(tombstone != NULL, OOPS);
-  *result = tombstone;
-  return false;
+  // All bits set is MAP_SLOT_EMPTY (-1) for every slot width.
+  memset(index, 0xff, _mapSlotSize(capacity) * capacity);
+  return index;
 }
 
-// String-key specialization for hot-path attribute/name lookups.
-static bool _mapFindStringEntry(Map* thiz, String* key, MapEntry** result) {
-  if (thiz->capacity == 0)
-    return false;
+// Copy the live entries of [from] after the [used] entries of a rebuilt
+// index table, dropping the deleted ones. Returns the new used count.
+static uint32_t _indexInsertEntries(void* index, uint32_t capacity, void* entries,
+                                    uint32_t used, const void* from, uint32_t count,
+                                    size_t entry_size) {
+  for (uint32_t i = 0; i < count; i++) {
+    const uint8_t* entry = (const uint8_t*) from + (size_t) i * entry_size;
+    if (IS_UNDEF(INDEX_ENTRY_KEY(entry)))
+      continue;
+
+    memcpy((uint8_t*) entries + (size_t) used * entry_size, entry, entry_size);
+    uint32_t slot = _indexFreeSlot(index, capacity, INDEX_ENTRY_HASH(entry));
+    _indexSlotSet(index, capacity, slot, (int32_t) used++);
+  }
+  return used;
+}
 
-  ASSERT((thiz->capacity & (thiz->capacity - 1)) == 0, OOPS);
+// Returns the index capacity to rebuild a map or a set of [count] live
+// entries with. It's grown if less than a quarter of the entries would be
+// free after the deleted ones are compacted, otherwise a table churning
+// near it's size would be rebuilt every few insertions.
+static inline uint32_t _indexRebuildCapacity(uint32_t capacity, uint32_t count) {
+  if (capacity == 0)
+    capacity = MIN_CAPACITY;
+  while (_mapEntriesSize(capacity) <= count + count / 3)
+    capacity *= GROW_FACTOR;
+  return capacity;
+}
+
+static inline int64_t _mapFindSlot(const Map* thiz, Var key, uint32_t hash, uint32_t* insert) {
+  return _indexFind(thiz->index, thiz->capacity, thiz->entries, sizeof(MapEntry), key, hash,
+                    insert);
+}
+
+// String-key specialization for hot-path attribute/name lookups.
+static int64_t _mapFindStringSlot(const Map* thiz, String* key, uint32_t* insert) {
+  ASSERT(thiz->capacity != 0, OOPS);
 
   uint32_t mask = thiz->capacity - 1;
-  uint32_t start_index = key->hash & mask;
-  uint32_t index = start_index;
-  MapEntry* tombstone = NULL;
+  uint32_t start = key->hash & mask;
+  uint32_t slot = start;
+  int64_t tombstone = -1;
 
   do {
-    MapEntry* entry = &thiz->entries[index];
+    int32_t position = _mapSlotGet(thiz, slot);
 
-    if (IS_UNDEF(entry->key)) {
-      ASSERT(IS_BOOL(entry->value), OOPS);
+    if (position == MAP_SLOT_EMPTY) {
+      if (insert != NULL)
+        *insert = (tombstone != -1) ? (uint32_t) tombstone : slot;
+      return -1;
 
-      if (IS_TRUE(entry->value)) {
-        if (tombstone == NULL)
-          tombstone = entry;
-
-      } else {
-        *result = (tombstone != NULL) ? tombstone : entry;
-        return false;
-      }
+    } else if (position == MAP_SLOT_DELETED) {
+      if (tombstone == -1)
+        tombstone = slot;
 
-    } else if (IS_OBJ_TYPE(entry->key, OBJ_STRING)) {
-      String* entry_key = (String*) AS_OBJ(entry->key);
-      if (entry_key == key
-          || (entry_key->hash == key->hash && entry_key->length == key->length
-              && memcmp(entry_key->data, key->data, key->length) == 0)) {
-        *result = entry;
-        return true;
+    } else {
+      const MapEntry* entry = &thiz->entries[position];
+      if (entry->hash == key->hash && IS_OBJ_TYPE(entry->key, OBJ_STRING)) {
+        String* entry_key = (String*) AS_OBJ(entry->key);
+        if (entry_key == key
+            || (entry_key->length == key->length
+                && memcmp(entry_key->data, key->data, key->length) == 0)) {
+          return slot;
+        }
       }
-
-    } else if (isValuesEqual(entry->key, VAR_OBJ(key))) {
-      *result = entry;
-      return true;
     }
 
-    index = (index + 1) & mask;
-
-  } while (index != start_index);
+    slot = (slot + 1) & mask;
+  } while (slot != start);
 
-  ASSERT(tombstone != NULL, OOPS);
-  *result = tombstone;
-  return false;
+  ASSERT(tombstone != -1, OOPS);
+  if (insert != NULL)
+    *insert = (uint32_t) tombstone;
+  return -1;
 }
 
 static inline bool _mapIsIntegerKey(Var key, int64_t* value) {
@@ -1404,51 +2077,161 @@ static inline bool _mapIsIntegerKey(Var key, int64_t* value) {
   return true;
 }
 
-// Add the key, value pair to the entries array of the map. Returns true if
-// the entry added for the first time and false for replaced value.
-static bool _mapInsertEntry(Map* thiz, Var key, Var value) {
-  ASSERT(thiz->capacity != 0, "Should ensure the capacity before inserting.");
+// If the [key] is a whole number in the range of the map's array part set
+// [index] and return true. The slot could still be a hole.
+static inline bool _mapArrayIndex(const Map* thiz, Var key, uint32_t* index) {
+  if (thiz->array_count == 0 || !IS_NUM(key))
+    return false;
 
-  MapEntry* result;
-  if (_mapFindEntry(thiz, key, &result)) {
-    // Key already found, just replace the value.
-    result->value = value;
+  double number = AS_NUM(key);
+  if (!(number >= 0 && number < (double) thiz->array_count))
     return false;
-  } else {
-    result->key = key;
-    result->value = value;
-    return true;
-  }
+
+  uint32_t i = (uint32_t) number;
+  if ((double) i != number)
+    return false;
+  *index = i;
+  return true;
+}
+
+// Returns true if the [key] is the next key of the array part.
+static inline bool _mapIsArrayNext(const Map* thiz, Var key) {
+  return IS_NUM(key) && AS_NUM(key) == (double) thiz->array_count;
 }
 
-// Resize the map's size to the given [capacity].
-static void _mapResize(VM* vm, Map* thiz, uint32_t capacity) {
+// Append the [value] at the end of the map's array part.
+static void _mapArrayAppend(VM* vm, Map* thiz, Var value) {
+  if (thiz->array_count == thiz->array_capacity) {
+    uint32_t capacity = thiz->array_capacity * GROW_FACTOR;
+    if (capacity < MIN_CAPACITY)
+      capacity = MIN_CAPACITY;
+    thiz->array = (Var*) vmRealloc(vm, thiz->array, sizeof(Var) * thiz->array_capacity,
+                                   sizeof(Var) * capacity);
+    thiz->array_capacity = capacity;
+  }
+  thiz->array[thiz->array_count++] = value;
+}
+
+// Resize the map's index table to the given [capacity] and compact the
+// entries array, dropping the deleted entries while keeping the order.
+//
+// This is also where the array part is rebalanced. The array part always
+// comes before the hash part in iteration order, so the leading hash
+// entries which continue the array keys (array_count, array_count + 1, ...)
+// are moved to the array. If [demote] is true the array part is moved in
+// front of the hash entries instead (when it became too sparse).
+static void _mapResize(VM* vm, Map* thiz, uint32_t capacity, bool demote) {
   if ((capacity & (capacity - 1)) != 0)
     capacity = (uint32_t) utilPowerOf2Ceil((int) capacity);
 
   if (capacity < MIN_CAPACITY)
     capacity = MIN_CAPACITY;
 
-  MapEntry* old_entries = thiz->entries;
+  // When demoting, the live keys of the array part are moved to the entries.
+  ASSERT(_mapEntriesSize(capacity) >= (demote ? thiz->count : thiz->hash_count), OOPS);
+
+  void* old_index = thiz->index;
   uint32_t old_capacity = thiz->capacity;
+  MapEntry* old_entries = thiz->entries;
+  uint32_t old_entries_size = thiz->entries_size;
+  uint32_t old_used = thiz->used;
 
-  thiz->entries = ALLOCATE_ARRAY(vm, MapEntry, capacity);
+  uint32_t entries_size = _mapEntriesSize(capacity);
+  MapEntry* entries = ALLOCATE_ARRAY(vm, MapEntry, entries_size);
+  void* index = _indexAllocate(vm, capacity);
+
+  // Nothing below allocates, the map is switched to the new buffers here.
+  thiz->index = index;
+  thiz->entries = entries;
   thiz->capacity = capacity;
-  for (uint32_t i = 0; i < capacity; i++) {
-    thiz->entries[i].key = VAR_UNDEFINED;
-    thiz->entries[i].value = VAR_FALSE;
+  thiz->entries_size = entries_size;
+  thiz->used = 0;
+  thiz->hash_count = 0;
+
+  if (demote) {
+    for (uint32_t i = 0; i < thiz->array_count; i++) {
+      if (IS_UNDEF(thiz->array[i]))
+        continue;
+      MapEntry* entry = &thiz->entries[thiz->used];
+      entry->key = VAR_NUM((double) i);
+      entry->value = thiz->array[i];
+      entry->hash = varHashValue(entry->key);
+      _mapSlotSet(thiz, _indexFreeSlot(index, capacity, entry->hash), (int32_t) thiz->used++);
+    }
+    thiz->array_count = 0;
   }
 
-  // Insert the old entries to the new entries.
-  for (uint32_t i = 0; i < old_capacity; i++) {
-    // Skip the empty entries or tombstones.
-    if (IS_UNDEF(old_entries[i].key))
+  uint32_t i = 0;
+  for (; !demote && i < old_used; i++) {
+    MapEntry* entry = &old_entries[i];
+    if (IS_UNDEF(entry->key))
       continue;
+    if (!_mapIsArrayNext(thiz, entry->key))
+      break;
+
+    // Capacity was reserved before the swap so this can't trigger a gc
+    // while the entries are half moved.
+    ASSERT(thiz->array_count < thiz->array_capacity, OOPS);
+    thiz->array[thiz->array_count++] = entry->value;
+  }
 
-    _mapInsertEntry(thiz, old_entries[i].key, old_entries[i].value);
+  thiz->used = _indexInsertEntries(index, capacity, entries, thiz->used, old_entries + i,
+                                   old_used - i, sizeof(MapEntry));
+  thiz->hash_count = thiz->used;
+
+  if (old_index != NULL)
+    vmRealloc(vm, old_index, _mapSlotSize(old_capacity) * old_capacity, 0);
+  if (old_entries != NULL)
+    DEALLOCATE_ARRAY(vm, old_entries, MapEntry, old_entries_size);
+}
+
+// Reserve the array part for the leading hash entries that could be
+// promoted by the next resize (see _mapResize()).
+static void _mapReservePromotion(VM* vm, Map* thiz) {
+  uint32_t next = thiz->array_count;
+  for (uint32_t i = 0; i < thiz->used; i++) {
+    MapEntry* entry = &thiz->entries[i];
+    if (IS_UNDEF(entry->key))
+      continue;
+    if (!IS_NUM(entry->key) || AS_NUM(entry->key) != (double) next)
+      break;
+    next++;
   }
 
-  DEALLOCATE_ARRAY(vm, old_entries, MapEntry, old_capacity);
+  if (next <= thiz->array_capacity)
+    return;
+
+  uint32_t capacity = (uint32_t) utilPowerOf2Ceil((int) next);
+  thiz->array = (Var*) vmRealloc(vm, thiz->array, sizeof(Var) * thiz->array_capacity,
+                                 sizeof(Var) * capacity);
+  thiz->array_capacity = capacity;
+}
+
+// Make sure there is a free entry at the end of the entries array. If the
+// entries are exhausted, the map is grown if it's mostly filled with live
+// entries otherwise rebuilt at the same size to compact the deleted entries
+// and their tombstones.
+static inline void _mapEnsureEntry(VM* vm, Map* thiz) {
+  if (thiz->used < thiz->entries_size)
+    return;
+
+  _mapReservePromotion(vm, thiz);
+  _mapResize(vm, thiz, _indexRebuildCapacity(thiz->capacity, thiz->hash_count), false);
+}
+
+// Append a new entry to the entries array and point the index [slot] to it.
+static inline void _mapAppendEntry(Map* thiz, uint32_t slot, Var key, uint32_t hash,
+                                   Var value) {
+  ASSERT(thiz->used < thiz->entries_size, OOPS);
+
+  uint32_t position = thiz->used++;
+  MapEntry* entry = &thiz->entries[position];
+  entry->key = key;
+  entry->value = value;
+  entry->hash = hash;
+  _mapSlotSet(thiz, slot, (int32_t) position);
+  thiz->hash_count++;
+  thiz->count++;
 }
 
 Var mapGet(Map* thiz, Var key) {
@@ -1456,26 +2239,29 @@ Var mapGet(Map* thiz, Var key) {
     return mapGetStringKey(thiz, (String*) AS_OBJ(key));
   }
 
-  if (thiz->capacity == 0)
+  uint32_t array_index;
+  if (_mapArrayIndex(thiz, key, &array_index) && !IS_UNDEF(thiz->array[array_index]))
+    return thiz->array[array_index];
+
+  if (thiz->hash_count == 0)
     return VAR_UNDEFINED;
 
-  MapEntry* entry;
-  if (_mapFindEntry(thiz, key, &entry))
-    return entry->value;
-  return VAR_UNDEFINED;
+  int64_t slot = _mapFindSlot(thiz, key, varHashValue(key), NULL);
+  if (slot == -1)
+    return VAR_UNDEFINED;
+  return thiz->entries[_mapSlotGet(thiz, (uint32_t) slot)].value;
 }
 
 Var mapGetStringKey(Map* thiz, String* key) {
   ASSERT(key != NULL, OOPS);
 
-  if (thiz->capacity == 0)
+  if (thiz->hash_count == 0)
     return VAR_UNDEFINED;
 
-  MapEntry* entry;
-  if (_mapFindStringEntry(thiz, key, &entry))
-    return entry->value;
-
-  return VAR_UNDEFINED;
+  int64_t slot = _mapFindStringSlot(thiz, key, NULL);
+  if (slot == -1)
+    return VAR_UNDEFINED;
+  return thiz->entries[_mapSlotGet(thiz, (uint32_t) slot)].value;
 }
 
 void mapSet(VM* vm, Map* thiz, Var key, Var value) {
@@ -1484,17 +2270,32 @@ void mapSet(VM* vm, Map* thiz, Var key, Var value) {
     return;
   }
 
-  // If map is about to fill, resize it first.
-  if (thiz->count + 1 > thiz->capacity * MAP_LOAD_PERCENT / 100) {
-    uint32_t capacity = thiz->capacity * GROW_FACTOR;
-    if (capacity < MIN_CAPACITY)
-      capacity = MIN_CAPACITY;
-    _mapResize(vm, thiz, capacity);
+  uint32_t array_index;
+  if (_mapArrayIndex(thiz, key, &array_index) && !IS_UNDEF(thiz->array[array_index])) {
+    thiz->array[array_index] = value;
+    return;
   }
 
-  if (_mapInsertEntry(thiz, key, value)) {
-    thiz->count++; //< A new key added.
-    VarBufferWrite(&thiz->order_keys, vm, key);
+  uint32_t hash = varHashValue(key);
+  uint32_t insert = 0;
+  int64_t slot = (thiz->hash_count != 0) ? _mapFindSlot(thiz, key, hash, &insert) : -1;
+
+  if (slot != -1) {
+    thiz->entries[_mapSlotGet(thiz, (uint32_t) slot)].value = value;
+
+  } else if (thiz->hash_count == 0 && _mapIsArrayNext(thiz, key)) {
+    // The hash part is empty, so the next array key will still be iterated
+    // in insertion order from the array part.
+    _mapArrayAppend(vm, thiz, value);
+    thiz->count++;
+
+  } else {
+    // Resizing will rebuild the index, find the slot again.
+    if (thiz->hash_count == 0 || thiz->used >= thiz->entries_size) {
+      _mapEnsureEntry(vm, thiz);
+      _mapFindSlot(thiz, key, hash, &insert);
+    }
+    _mapAppendEntry(thiz, insert, key, hash, value);
   }
 
   int64_t index = 0;
@@ -1506,72 +2307,106 @@ void mapSet(VM* vm, Map* thiz, Var key, Var value) {
 void mapSetStringKey(VM* vm, Map* thiz, String* key, Var value) {
   ASSERT(key != NULL, OOPS);
 
-  if (thiz->count + 1 > thiz->capacity * MAP_LOAD_PERCENT / 100) {
-    uint32_t capacity = thiz->capacity * GROW_FACTOR;
-    if (capacity < MIN_CAPACITY)
-      capacity = MIN_CAPACITY;
-    _mapResize(vm, thiz, capacity);
-  }
+  uint32_t insert = 0;
+  int64_t slot = (thiz->hash_count != 0) ? _mapFindStringSlot(thiz, key, &insert) : -1;
 
-  MapEntry* entry;
-  if (_mapFindStringEntry(thiz, key, &entry)) {
-    entry->value = value;
+  if (slot != -1) {
+    thiz->entries[_mapSlotGet(thiz, (uint32_t) slot)].value = value;
     return;
   }
 
-  entry->key = VAR_OBJ(key);
-  entry->value = value;
-  thiz->count++;
-  VarBufferWrite(&thiz->order_keys, vm, VAR_OBJ(key));
+  if (thiz->hash_count == 0 || thiz->used >= thiz->entries_size) {
+    _mapEnsureEntry(vm, thiz);
+    _mapFindStringSlot(thiz, key, &insert);
+  }
+  _mapAppendEntry(thiz, insert, VAR_OBJ(key), key->hash, value);
 }
 
 void mapClear(VM* vm, Map* thiz) {
   if (thiz->capacity > MAP_CLEAR_RETAIN_CAPACITY) {
-    DEALLOCATE_ARRAY(vm, thiz->entries, MapEntry, thiz->capacity);
+    vmRealloc(vm, thiz->index, _mapIndexBytes(thiz), 0);
+    DEALLOCATE_ARRAY(vm, thiz->entries, MapEntry, thiz->entries_size);
+    thiz->index = NULL;
     thiz->entries = NULL;
     thiz->capacity = 0;
-  } else {
-    for (uint32_t i = 0; i < thiz->capacity; i++) {
-      thiz->entries[i].key = VAR_UNDEFINED;
-      thiz->entries[i].value = VAR_FALSE;
-    }
+    thiz->entries_size = 0;
+  } else if (thiz->capacity != 0) {
+    memset(thiz->index, 0xff, _mapIndexBytes(thiz));
+  }
+
+  if (thiz->array_capacity > MAP_CLEAR_RETAIN_CAPACITY) {
+    DEALLOCATE_ARRAY(vm, thiz->array, Var, thiz->array_capacity);
+    thiz->array = NULL;
+    thiz->array_capacity = 0;
   }
 
   thiz->count = 0;
+  thiz->hash_count = 0;
+  thiz->used = 0;
+  thiz->array_count = 0;
+  thiz->next_index = 0;
+}
 
-  if (thiz->order_keys.capacity > MAP_CLEAR_RETAIN_CAPACITY) {
-    VarBufferClear(&thiz->order_keys, vm);
-  } else {
-    thiz->order_keys.count = 0;
+// Remove the key at [index] of the array part. Returns the removed value.
+static Var _mapArrayRemove(VM* vm, Map* thiz, uint32_t index) {
+  Var value = thiz->array[index];
+  thiz->array[index] = VAR_UNDEFINED;
+  thiz->count--;
+
+  // Trailing holes are dropped so the keys can be appended again.
+  while (thiz->array_count > 0 && IS_UNDEF(thiz->array[thiz->array_count - 1]))
+    thiz->array_count--;
+
+  // If most of the array part is holes (ie. a queue of integer keys) move
+  // the rest to the hash part so the array doesn't grow without bound.
+  uint32_t array_live = thiz->count - thiz->hash_count;
+  if (thiz->array_count > MIN_CAPACITY && array_live * 2 < thiz->array_count) {
+    if (IS_OBJ(value))
+      vmPushTempRef(vm, AS_OBJ(value));
+
+    uint32_t capacity = (thiz->capacity != 0) ? thiz->capacity : MIN_CAPACITY;
+    while (_mapEntriesSize(capacity) <= thiz->hash_count + array_live)
+      capacity *= GROW_FACTOR;
+    _mapResize(vm, thiz, capacity, true);
+
+    if (IS_OBJ(value))
+      vmPopTempRef(vm);
   }
 
-  thiz->next_index = 0;
+  return value;
 }
 
 Var mapRemoveKey(VM* vm, Map* thiz, Var key) {
-  MapEntry* entry;
-  if (!_mapFindEntry(thiz, key, &entry))
+  uint32_t array_index;
+  if (_mapArrayIndex(thiz, key, &array_index) && !IS_UNDEF(thiz->array[array_index])) {
+    Var value = _mapArrayRemove(vm, thiz, array_index);
+    if (thiz->count == 0)
+      mapClear(vm, thiz);
+    return value;
+  }
+
+  if (thiz->hash_count == 0)
     return VAR_UNDEFINED;
 
-  // Set the key as VAR_UNDEFINED to mark is as an available slow and set it's
-  // value to VAR_TRUE for tombstone.
+  int64_t slot = _mapFindSlot(thiz, key, varHashValue(key), NULL);
+  if (slot == -1)
+    return VAR_UNDEFINED;
+
+  // Leave a hole in the entries (to keep the order of the rest) and a
+  // tombstone in the index table, both are dropped on the next resize. The
+  // hole isn't reused even if it's the last entry, since the tombstone still
+  // takes it's slot: the index has a slot for every used entry and the
+  // entries running out is what compacts the tombstones (see
+  // _mapEnsureEntry()).
+  MapEntry* entry = &thiz->entries[_mapSlotGet(thiz, (uint32_t) slot)];
   Var value = entry->value;
   entry->key = VAR_UNDEFINED;
-  entry->value = VAR_TRUE;
+  entry->value = VAR_NULL;
+  _mapSlotSet(thiz, (uint32_t) slot, MAP_SLOT_DELETED);
 
+  thiz->hash_count--;
   thiz->count--;
 
-  for (uint32_t i = 0; i < thiz->order_keys.count; i++) {
-    if (isValuesEqual(thiz->order_keys.data[i], key)) {
-      if (i + 1 < thiz->order_keys.count) {
-        memmove(&thiz->order_keys.data[i], &thiz->order_keys.data[i + 1],
-                (thiz->order_keys.count - i - 1) * sizeof(Var));
-      }
-      thiz->order_keys.count--;
-      break;
-    }
-  }
-
   if (IS_OBJ(value))
     vmPushTempRef(vm, AS_OBJ(value));
 
@@ -1581,7 +2416,7 @@ Var mapRemoveKey(VM* vm, Map* thiz, Var key) {
 
   } else if ((thiz->capacity > MIN_CAPACITY)
              && (thiz->capacity / (GROW_FACTOR * GROW_FACTOR))
-                    > ((thiz->count * 100) / MAP_LOAD_PERCENT)) {
+                    > ((thiz->hash_count * 100) / MAP_LOAD_PERCENT)) {
     // We grow the map when it's filled 75% (MAP_LOAD_PERCENT) by 2
     // (GROW_FACTOR) but we're not shrink the map when it's half filled (ie.
     // half of the capacity is 75%). Instead we wait till it'll become 1/4 is
@@ -1592,7 +2427,8 @@ Var mapRemoveKey(VM* vm, Map* thiz, Var key) {
     if (capacity < MIN_CAPACITY)
       capacity = MIN_CAPACITY;
 
-    _mapResize(vm, thiz, capacity);
+    _mapReservePromotion(vm, thiz);
+    _mapResize(vm, thiz, capacity, false);
   }
 
   if (IS_OBJ(value))
@@ -1601,6 +2437,354 @@ Var mapRemoveKey(VM* vm, Map* thiz, Var key) {
   return value;
 }
 
+bool mapIterate(const Map* thiz, uint32_t* position, Var* key, Var* value) {
+  // Positions [0, array_count) are the array part, followed by the entries.
+  uint32_t i = *position;
+  for (; i < thiz->array_count; i++) {
+    if (IS_UNDEF(thiz->array[i]))
+      continue;
+
+    if (key != NULL)
+      *key = VAR_NUM((double) i);
+    if (value != NULL)
+      *value = thiz->array[i];
+    *position = i + 1;
+    return true;
+  }
+
+  for (i -= thiz->array_count; i < thiz->used; i++) {
+    const MapEntry* entry = &thiz->entries[i];
+    if (IS_UNDEF(entry->key))
+      continue;
+
+    if (key != NULL)
+      *key = entry->key;
+    if (value != NULL)
+      *value = entry->value;
+    *position = thiz->array_count + i + 1;
+    return true;
+  }
+
+  *position = thiz->array_count + thiz->used;
+  return false;
+}
+
+Map* mapCopy(VM* vm, Map* thiz) {
+  Map* map = newMap(vm);
+  vmPushTempRef(vm, &map->_super); // map.
+
+  // The counts are set after the buffers are allocated, so a gc in between
+  // won't mark the uninitialized entries.
+  if (thiz->capacity != 0) {
+    size_t index_bytes = _mapIndexBytes(thiz);
+    map->index = vmRealloc(vm, NULL, 0, index_bytes);
+    memcpy(map->index, thiz->index, index_bytes);
+    map->capacity = thiz->capacity;
+
+    map->entries = ALLOCATE_ARRAY(vm, MapEntry, thiz->entries_size);
+    map->entries_size = thiz->entries_size;
+    memcpy(map->entries, thiz->entries, sizeof(MapEntry) * thiz->used);
+    map->used = thiz->used;
+    map->hash_count = thiz->hash_count;
+  }
+
+  if (thiz->array_capacity != 0) {
+    map->array = ALLOCATE_ARRAY(vm, Var, thiz->array_capacity);
+    map->array_capacity = thiz->array_capacity;
+    memcpy(map->array, thiz->array, sizeof(Var) * thiz->array_count);
+    map->array_count = thiz->array_count;
+  }
+
+  map->count = thiz->count;
+  map->next_index = thiz->next_index;
+
+  vmPopTempRef(vm); // map.
+  return map;
+}
+
+// The largest growth (as a power of 2) of the index table to find a perfect
+// capacity, past that the collisions are cheaper than the memory.
+#define PERFECT_HASH_MAX_GROW 3
+
+// Returns the smallest power of 2 capacity starting from [capacity] where
+// the live [entries] (see _indexFind()) all have a distinct home slot, or 0
+// if there isn't any within PERFECT_HASH_MAX_GROW doublings.
+static uint32_t _perfectCapacity(VM* vm, const void* entries, uint32_t used,
+                                 size_t entry_size, uint32_t live, uint32_t capacity) {
+  uint32_t* hashes = ALLOCATE_ARRAY(vm, uint32_t, live);
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < used; i++) {
+    const uint8_t* entry = (const uint8_t*) entries + (size_t) i * entry_size;
+    if (!IS_UNDEF(INDEX_ENTRY_KEY(entry)))
+      hashes[count++] = INDEX_ENTRY_HASH(entry);
+  }
+
+  uint32_t max_capacity = capacity << PERFECT_HASH_MAX_GROW;
+  uint8_t* taken = ALLOCATE_ARRAY(vm, uint8_t, max_capacity);
+
+  uint32_t found = 0;
+  for (; capacity <= max_capacity && found == 0; capacity *= GROW_FACTOR) {
+    memset(taken, 0, capacity);
+    uint32_t mask = capacity - 1, i = 0;
+    for (; i < count; i++) {
+      uint32_t slot = hashes[i] & mask;
+      if (taken[slot])
+        break;
+      taken[slot] = 1;
+    }
+    if (i == count)
+      found = capacity;
+  }
+
+  DEALLOCATE_ARRAY(vm, taken, uint8_t, max_capacity);
+  DEALLOCATE_ARRAY(vm, hashes, uint32_t, live);
+  return found;
+}
+
+bool mapMakePerfect(VM* vm, Map* thiz) {
+  if (thiz->hash_count == 0)
+    return true;
+
+  uint32_t capacity = _perfectCapacity(vm, thiz->entries, thiz->used, sizeof(MapEntry),
+                                       thiz->hash_count, thiz->capacity);
+
+  if (capacity == 0)
+    return false;
+  _mapResize(vm, thiz, capacity, false);
+  return true;
+}
+
+static inline int64_t _setFindSlot(const Set* thiz, Var key, uint32_t hash, uint32_t* insert) {
+  return _indexFind(thiz->index, thiz->capacity, thiz->entries, sizeof(SetEntry), key, hash,
+                    insert);
+}
+
+// Rebuild the set with the index [capacity], the live entries are compacted.
+static void _setResize(VM* vm, Set* thiz, uint32_t capacity) {
+  if (capacity < MIN_CAPACITY)
+    capacity = MIN_CAPACITY;
+  ASSERT((capacity & (capacity - 1)) == 0, OOPS);
+  ASSERT(_mapEntriesSize(capacity) >= thiz->count, OOPS);
+
+  void* old_index = thiz->index;
+  uint32_t old_capacity = thiz->capacity;
+  SetEntry* old_entries = thiz->entries;
+  uint32_t old_entries_size = thiz->entries_size;
+
+  uint32_t entries_size = _mapEntriesSize(capacity);
+  SetEntry* entries = ALLOCATE_ARRAY(vm, SetEntry, entries_size);
+  void* index = _indexAllocate(vm, capacity);
+
+  thiz->used = _indexInsertEntries(index, capacity, entries, 0, old_entries, thiz->used,
+                                   sizeof(SetEntry));
+  thiz->index = index;
+  thiz->entries = entries;
+  thiz->capacity = capacity;
+  thiz->entries_size = entries_size;
+
+  if (old_index != NULL)
+    vmRealloc(vm, old_index, _mapSlotSize(old_capacity) * old_capacity, 0);
+  if (old_entries != NULL)
+    DEALLOCATE_ARRAY(vm, old_entries, SetEntry, old_entries_size);
+}
+
+bool setHas(Set* thiz, Var key) {
+  if (thiz->count == 0)
+    return false;
+  return _setFindSlot(thiz, key, varHashValue(key), NULL) != -1;
+}
+
+bool setAdd(VM* vm, Set* thiz, Var key) {
+  uint32_t hash = varHashValue(key), insert = 0;
+  if (thiz->capacity != 0 && _setFindSlot(thiz, key, hash, &insert) != -1)
+    return false;
+
+  if (thiz->used >= thiz->entries_size) {
+    // Grow if the entries are live, otherwise compact the deleted ones.
+    uint32_t capacity = _indexRebuildCapacity(thiz->capacity, thiz->count);
+
+    if (IS_OBJ(key))
+      vmPushTempRef(vm, AS_OBJ(key)); // key.
+    _setResize(vm, thiz, capacity);
+    if (IS_OBJ(key))
+      vmPopTempRef(vm); // key.
+
+    _setFindSlot(thiz, key, hash, &insert);
+  }
+
+  uint32_t position = thiz->used++;
+  thiz->entries[position].key = key;
+  thiz->entries[position].hash = hash;
+  _indexSlotSet(thiz->index, thiz->capacity, insert, (int32_t) position);
+  thiz->count++;
+  return true;
+}
+
+bool setRemove(VM* vm, Set* thiz, Var key) {
+  if (thiz->count == 0)
+    return false;
+
+  int64_t slot = _setFindSlot(thiz, key, varHashValue(key), NULL);
+  if (slot == -1)
+    return false;
+
+  int32_t position = _indexSlotGet(thiz->index, thiz->capacity, (uint32_t) slot);
+  thiz->entries[position].key = VAR_UNDEFINED;
+  _indexSlotSet(thiz->index, thiz->capacity, (uint32_t) slot, MAP_SLOT_DELETED);
+  thiz->count--;
+
+  if (thiz->count == 0) {
+    setClear(vm, thiz);
+
+  } else if ((thiz->capacity > MIN_CAPACITY)
+             && (thiz->capacity / (GROW_FACTOR * GROW_FACTOR))
+                    > ((thiz->count * 100) / MAP_LOAD_PERCENT)) {
+    // Shrink when it's 1/4 filled, see mapRemoveKey().
+    _setResize(vm, thiz, thiz->capacity / (GROW_FACTOR * GROW_FACTOR));
+  }
+
+  return true;
+}
+
+void setClear(VM* vm, Set* thiz) {
+  if (thiz->capacity > MAP_CLEAR_RETAIN_CAPACITY) {
+    vmRealloc(vm, thiz->index, _mapSlotSize(thiz->capacity) * thiz->capacity, 0);
+    DEALLOCATE_ARRAY(vm, thiz->entries, SetEntry, thiz->entries_size);
+    thiz->index = NULL;
+    thiz->entries = NULL;
+    thiz->capacity = 0;
+    thiz->entries_size = 0;
+  } else if (thiz->capacity != 0) {
+    memset(thiz->index, 0xff, _mapSlotSize(thiz->capacity) * thiz->capacity);
+  }
+
+  thiz->count = 0;
+  thiz->used = 0;
+}
+
+bool setMakePerfect(VM* vm, Set* thiz) {
+  if (thiz->count == 0)
+    return true;
+
+  uint32_t capacity = _perfectCapacity(vm, thiz->entries, thiz->used, sizeof(SetEntry),
+                                       thiz->count, thiz->capacity);
+
+  if (capacity == 0)
+    return false;
+  _setResize(vm, thiz, capacity);
+  return true;
+}
+
+bool setIterate(const Set* thiz, uint32_t* position, Var* key) {
+  for (uint32_t i = *position; i < thiz->used; i++) {
+    if (IS_UNDEF(thiz->entries[i].key))
+      continue;
+    *key = thiz->entries[i].key;
+    *position = i + 1;
+    return true;
+  }
+
+  *position = thiz->used;
+  return false;
+}
+
+uint32_t typedElementSize(TypedKind kind) {
+  switch (kind) {
+    case TYPED_FLOAT64:
+      return sizeof(double);
+    case TYPED_INT32:
+      return sizeof(int32_t);
+    case TYPED_UINT8:
+      return sizeof(uint8_t);
+    case TYPED_NONE:
+      break;
+  }
+  UNREACHABLE();
+  return 0;
+}
+
+uint8_t* typedArrayData(const TypedArray* thiz) {
+  if (thiz->buffer == NULL)
+    return thiz->data;
+
+  uint64_t end = (uint64_t) thiz->offset + (uint64_t) thiz->length * typedElementSize(thiz->kind);
+  if (end > thiz->buffer->count)
+    return NULL;
+  return thiz->buffer->data + thiz->offset;
+}
+
+// Returns the element index of the [key] if it's an in bound integer index
+// or -1.
+static int64_t _typedArrayIndex(const TypedArray* thiz, Var key) {
+  if (!IS_NUM(key))
+    return -1;
+  double index = AS_NUM(key);
+  if (!(index >= 0 && index < thiz->length) || floor(index) != index)
+    return -1;
+  return (int64_t) index;
+}
+
+bool typedArrayGet(const TypedArray* thiz, Var key, Var* value) {
+  int64_t index = _typedArrayIndex(thiz, key);
+  if (index < 0)
+    return false;
+
+  uint8_t* data = typedArrayData(thiz);
+  if (data == NULL)
+    return false;
+
+  switch (thiz->kind) {
+    case TYPED_FLOAT64:
+      *value = VAR_NUM(((double*) data)[index]);
+      return true;
+    case TYPED_INT32:
+      *value = VAR_NUM(((int32_t*) data)[index]);
+      return true;
+    case TYPED_UINT8:
+      *value = VAR_NUM(data[index]);
+      return true;
+    case TYPED_NONE:
+      break;
+  }
+  return false;
+}
+
+bool typedArraySet(TypedArray* thiz, Var key, Var value) {
+  if (!IS_NUM(value))
+    return false;
+
+  int64_t index = _typedArrayIndex(thiz, key);
+  if (index < 0)
+    return false;
+
+  uint8_t* data = typedArrayData(thiz);
+  if (data == NULL)
+    return false;
+
+  double n = AS_NUM(value);
+  switch (thiz->kind) {
+    case TYPED_FLOAT64:
+      ((double*) data)[index] = n;
+      return true;
+
+    case TYPED_INT32:
+      if (floor(n) != n || n < INT32_MIN || n > INT32_MAX)
+        return false;
+      ((int32_t*) data)[index] = (int32_t) n;
+      return true;
+
+    case TYPED_UINT8:
+      if (floor(n) != n || n < 0x00 || n > 0xff)
+        return false;
+      data[index] = (uint8_t) n;
+      return true;
+
+    case TYPED_NONE:
+      break;
+  }
+  return false;
+}
+
 bool fiberHasError(Fiber* fiber) {
   return fiber->error != NULL;
 }
@@ -1618,6 +2802,8 @@ void freeObject(VM* vm, Object* thiz) {
     case OBJ_STRING:
       {
         String* str = (String*) thiz;
+        if (str->cp_index != NULL)
+          DEALLOCATE_ARRAY(vm, str->cp_index, uint32_t, str->cp_index_count);
         DEALLOCATE_DYNAMIC(vm, str, String, str->capacity, char);
         return;
       };
@@ -1632,8 +2818,10 @@ void freeObject(VM* vm, Object* thiz) {
     case OBJ_MAP:
       {
         Map* map = (Map*) thiz;
-        DEALLOCATE_ARRAY(vm, map->entries, MapEntry, map->capacity);
-        VarBufferClear(&map->order_keys, vm);
+        if (map->index != NULL)
+          vmRealloc(vm, map->index, _mapIndexBytes(map), 0);
+        DEALLOCATE_ARRAY(vm, map->entries, MapEntry, map->entries_size);
+        DEALLOCATE_ARRAY(vm, map->array, Var, map->array_capacity);
         DEALLOCATE(vm, thiz, Map);
         return;
       }
@@ -1650,6 +2838,9 @@ void freeObject(VM* vm, Object* thiz) {
         VarBufferClear(&module->globals, vm);
         UintBufferClear(&module->global_names, vm);
         VarBufferClear(&module->constants, vm);
+        if (module->links != NULL) {
+          DEALLOCATE_ARRAY(vm, module->links, GlobalLink, module->links_count);
+        }
 #ifndef NO_DL
         if (module->handle)
           vmUnloadDlHandle(vm, module->handle);
@@ -1664,6 +2855,7 @@ void freeObject(VM* vm, Object* thiz) {
         if (!func->is_native) {
           ByteBufferClear(&func->fn->opcodes, vm);
           UintBufferClear(&func->fn->oplines, vm);
+          UintBufferClear(&func->fn->inlines, vm);
           DEALLOCATE(vm, func->fn, Fn);
         }
         DEALLOCATE(vm, thiz, Function);
@@ -1672,7 +2864,7 @@ void freeObject(VM* vm, Object* thiz) {
 
     case OBJ_CLOSURE:
       {
-        DEALLOCATE_DYNAMIC(vm, thiz, Closure, ((Closure*) thiz)->fn->upvalue_count, Upvalue*);
+        DEALLOCATE_DYNAMIC(vm, thiz, Closure, ((Closure*) thiz)->fn->upvalue_count, Var);
         return;
       }
 
@@ -1701,10 +2893,38 @@ void freeObject(VM* vm, Object* thiz) {
       {
         Class* cls = (Class*) thiz;
         ClosureBufferClear(&cls->methods, vm);
+        ClosureBufferClear(&cls->vtable, vm);
+        StringBufferClear(&cls->vtable_names, vm);
+        StringBufferClear(&cls->declared_fields, vm);
+        StringBufferClear(&cls->fields, vm);
         DEALLOCATE(vm, cls, Class);
         return;
       }
 
+    case OBJ_SET:
+      {
+        Set* set = (Set*) thiz;
+        if (set->index != NULL)
+          vmRealloc(vm, set->index, _mapSlotSize(set->capacity) * set->capacity, 0);
+        DEALLOCATE_ARRAY(vm, set->entries, SetEntry, set->entries_size);
+        DEALLOCATE(vm, thiz, Set);
+        return;
+      }
+
+    case OBJ_ITERATOR:
+      {
+        Iterator* iter = (Iterator*) thiz;
+        DEALLOCATE_ARRAY(vm, iter->stages, IteratorStage, iter->stage_count);
+        DEALLOCATE(vm, thiz, Iterator);
+        return;
+      }
+
+    case OBJ_TUPLE:
+      {
+        DEALLOCATE_DYNAMIC(vm, thiz, Tuple, ((Tuple*) thiz)->length, Var);
+        return;
+      }
+
     case OBJ_POINTER:
       {
         Pointer* pointer = (Pointer*) thiz;
@@ -1845,7 +3065,7 @@ uint32_t moduleSetGlobal(VM* vm, Module* module, const char* name, uint32_t leng
   int g_index = moduleGetGlobalIndex(module, name, length);
   if (g_index != -1) {
     ASSERT(g_index < (int) module->globals.count, OOPS);
-    module->globals.data[g_index] = value;
+    moduleSetGlobalAt(vm, module, (uint32_t) g_index, value);
     module->global_lookup_name_cache = moduleGetStringAt(
         module, (int) module->global_names.data[g_index]);
     module->global_lookup_index_cache = g_index;
@@ -1869,6 +3089,41 @@ uint32_t moduleSetGlobal(VM* vm, Module* module, const char* name, uint32_t leng
   return module->globals.count - 1;
 }
 
+void moduleSetGlobalAt(VM* vm, Module* module, uint32_t g_index, Var value) {
+  ASSERT_INDEX(g_index, module->globals.count);
+
+  // A function could be cached by the OP_CALL_DIRECT sites.
+  Var old = module->globals.data[g_index];
+  if (IS_OBJ_TYPE(old, OBJ_CLOSURE) && !isValuesSame(old, value)) {
+    vmInvalidateInlineCaches(vm);
+  }
+
+  module->globals.data[g_index] = value;
+}
+
+int moduleLinkGlobal(VM* vm, Module* module, uint32_t index, Module* target, String* name) {
+  int g_index = moduleGetGlobalIndexByName(vm, target, name);
+  if (g_index == -1)
+    return -1;
+
+  if (index >= module->links_count) {
+    uint32_t count = module->constants.count;
+    ASSERT(index < count, OOPS);
+    module->links = (GlobalLink*) vmRealloc(vm, module->links,
+                                            sizeof(GlobalLink) * module->links_count,
+                                            sizeof(GlobalLink) * count);
+    memset(module->links + module->links_count, 0,
+           sizeof(GlobalLink) * (count - module->links_count));
+    module->links_count = count;
+  }
+
+  GlobalLink* link = &module->links[index];
+  link->module = target;
+  link->layout = target->globals_layout;
+  link->slot = (uint32_t) g_index;
+  return g_index;
+}
+
 int moduleGetGlobalIndex(Module* module, const char* name, uint32_t length) {
   for (uint32_t i = 0; i < module->global_names.count; i++) {
     uint32_t name_index = module->global_names.data[i];
@@ -1892,6 +3147,11 @@ bool moduleDeleteGlobal(VM* vm, Module* module, const char* name, uint32_t lengt
   }
 
   uint32_t idx = (uint32_t) g_index;
+  if (IS_OBJ_TYPE(module->globals.data[idx], OBJ_CLOSURE)) {
+    vmInvalidateInlineCaches(vm);
+  }
+  module->globals_layout++;
+
   if (idx + 1 < module->globals.count) {
     memmove(&module->globals.data[idx], &module->globals.data[idx + 1],
             (module->globals.count - idx - 1) * sizeof(Var));
@@ -1959,6 +3219,12 @@ VarType getObjVarType(ObjectType type) {
       return vCLASS;
     case OBJ_POINTER:
       return vPOINTER;
+    case OBJ_SET:
+      return vSET;
+    case OBJ_ITERATOR:
+      return vITERATOR;
+    case OBJ_TUPLE:
+      return vTUPLE;
     case OBJ_INST:
       return vINSTANCE;
   }
@@ -1995,6 +3261,12 @@ ObjectType getVarObjType(VarType type) {
       return OBJ_CLASS;
     case vPOINTER:
       return OBJ_POINTER;
+    case vSET:
+      return OBJ_SET;
+    case vITERATOR:
+      return OBJ_ITERATOR;
+    case vTUPLE:
+      return OBJ_TUPLE;
     case vINSTANCE:
       return OBJ_INST;
   }
@@ -2047,6 +3319,12 @@ const char* getObjectTypeName(ObjectType type) {
       return "Class";
     case OBJ_POINTER:
       return "Pointer";
+    case OBJ_SET:
+      return "Set";
+    case OBJ_ITERATOR:
+      return "Iterator";
+    case OBJ_TUPLE:
+      return "Tuple";
     case OBJ_INST:
       return "Inst";
   }
@@ -2157,18 +3435,47 @@ bool isValuesEqual(Var v1, Var v2) {
         return true;
       }
 
+    case OBJ_TUPLE:
+      {
+        Tuple *t1 = (Tuple*) o1, *t2 = (Tuple*) o2;
+        if (t1->length != t2->length)
+          return false;
+        for (uint32_t i = 0; i < t1->length; i++) {
+          if (!isValuesEqual(t1->items[i], t2->items[i]))
+            return false;
+        }
+        return true;
+      }
+
     case OBJ_MAP:
       {
         Map *m1 = (Map*) o1, *m2 = (Map*) o2;
 
-        MapEntry* e = m1->entries;
-        for (; e < m1->entries + m1->capacity; e++) {
-          if (IS_UNDEF(e->key))
-            continue;
-          Var v = mapGet(m2, e->key);
+        if (m1->count != m2->count)
+          return false;
+
+        Var key, value;
+        uint32_t position = 0;
+        while (mapIterate(m1, &position, &key, &value)) {
+          Var v = mapGet(m2, key);
           if (IS_UNDEF(v))
             return false;
-          if (!isValuesEqual(e->value, v))
+          if (!isValuesEqual(value, v))
+            return false;
+        }
+        return true;
+      }
+
+    case OBJ_SET:
+      {
+        Set *s1 = (Set*) o1, *s2 = (Set*) o2;
+        if (s1->count != s2->count)
+          return false;
+
+        Var key;
+        uint32_t position = 0;
+        while (setIterate(s1, &position, &key)) {
+          if (!setHas(s2, key))
             return false;
         }
         return true;
@@ -2180,8 +3487,24 @@ bool isValuesEqual(Var v1, Var v2) {
 }
 
 bool isObjectHashable(ObjectType type) {
-  // Only String and Range are hashable (since they're immutable).
-  return type == OBJ_STRING || type == OBJ_RANGE || type == OBJ_CLASS;
+  // Only the immutable types are hashable.
+  return type == OBJ_STRING || type == OBJ_RANGE || type == OBJ_CLASS || type == OBJ_TUPLE;
+}
+
+bool isValueHashable(Var v) {
+  if (!IS_OBJ(v))
+    return true;
+
+  Object* obj = AS_OBJ(v);
+  if (obj->type != OBJ_TUPLE)
+    return isObjectHashable(obj->type);
+
+  Tuple* tuple = (Tuple*) obj;
+  for (uint32_t i = 0; i < tuple->length; i++) {
+    if (!isValueHashable(tuple->items[i]))
+      return false;
+  }
+  return true;
 }
 
 // This will prevent recursive list/map from crash when calling to_string, by
@@ -2320,10 +3643,28 @@ static void _toStringInternal(VM* vm, const Var v, ByteBuffer* buff,
           return;
         }
 
+      case OBJ_TUPLE:
+        {
+          // A tuple can't contain itself, only through a mutable container
+          // which will be checked for the recursion. (1,) has a trailing
+          // comma to not look like a grouping.
+          const Tuple* tuple = (const Tuple*) obj;
+          ByteBufferWrite(buff, vm, '(');
+          for (uint32_t i = 0; i < tuple->length; i++) {
+            if (i != 0)
+              ByteBufferAddString(buff, vm, ", ", 2);
+            _toStringInternal(vm, tuple->items[i], buff, outer, true);
+          }
+          if (tuple->length == 1)
+            ByteBufferWrite(buff, vm, ',');
+          ByteBufferWrite(buff, vm, ')');
+          return;
+        }
+
       case OBJ_MAP:
         {
           const Map* map = (const Map*) obj;
-          if (map->order_keys.count == 0) {
+          if (map->count == 0) {
             ByteBufferAddString(buff, vm, "{}", 2);
             return;
           }
@@ -2343,13 +3684,12 @@ static void _toStringInternal(VM* vm, const Var v, ByteBuffer* buff,
           seq_map.map = map;
 
           ByteBufferWrite(buff, vm, '{');
-          for (uint32_t i = 0; i < map->order_keys.count; i++) {
-            if (i != 0)
+          Var key, value;
+          uint32_t position = 0;
+          for (bool first = true; mapIterate(map, &position, &key, &value); first = false) {
+            if (!first)
               ByteBufferAddString(buff, vm, ", ", 2);
 
-            Var key = map->order_keys.data[i];
-            Var value = mapGet((Map*) map, key);
-
             _toStringInternal(vm, key, buff, &seq_map, true);
             ByteBufferWrite(buff, vm, ':');
             _toStringInternal(vm, value, buff, &seq_map, true);
@@ -2359,6 +3699,23 @@ static void _toStringInternal(VM* vm, const Var v, ByteBuffer* buff,
           return;
         }
 
+      case OBJ_SET:
+        {
+          // The elements are hashable (immutable) so a set can't be
+          // recursive.
+          const Set* set = (const Set*) obj;
+          ByteBufferAddString(buff, vm, "Set{", 4);
+          Var key;
+          uint32_t position = 0;
+          for (bool first = true; setIterate(set, &position, &key); first = false) {
+            if (!first)
+              ByteBufferAddString(buff, vm, ", ", 2);
+            _toStringInternal(vm, key, buff, outer, true);
+          }
+          ByteBufferWrite(buff, vm, '}');
+          return;
+        }
+
       case OBJ_RANGE:
         {
           const Range* range = (const Range*) obj;
@@ -2512,6 +3869,12 @@ static void _toStringInternal(VM* vm, const Var v, ByteBuffer* buff,
           return;
         }
 
+      case OBJ_ITERATOR:
+        {
+          ByteBufferAddString(buff, vm, "[Iterator]", 10);
+          return;
+        }
+
       case OBJ_INST:
         {
           const Instance* inst = (const Instance*) obj;
@@ -2585,8 +3948,13 @@ bool toBool(Var v) {
     case OBJ_FIBER:
     case OBJ_CLASS:
     case OBJ_POINTER:
+    case OBJ_ITERATOR:
     case OBJ_INST:
       return true;
+    case OBJ_SET:
+      return ((Set*) o)->count != 0;
+    case OBJ_TUPLE:
+      return ((Tuple*) o)->length != 0;
   }
 
   UNREACHABLE();
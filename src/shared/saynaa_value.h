@@ -234,6 +234,9 @@ typedef struct Object Object;
 typedef struct String String;
 typedef struct List List;
 typedef struct Map Map;
+typedef struct Set Set;
+typedef struct Iterator Iterator;
+typedef struct Tuple Tuple;
 typedef struct Range Range;
 typedef struct Module Module;
 typedef struct Function Function;
@@ -261,6 +264,19 @@ void ByteBufferAddString(ByteBuffer* thiz, VM* vm, const char* str, uint32_t len
 // Add formated string to the byte buffer.
 void ByteBufferAddStringFmt(ByteBuffer* thiz, VM* vm, const char* fmt, ...);
 
+// A function callback of the native classes which hold script values in
+// their native data, called at the GC's marking phase to mark them with
+// markValue(). Same as DeleteInstanceFn, it must not allocate any objects.
+typedef void (*MarkInstanceFn)(VM* vm, void* native);
+
+// Element types of the typed arrays.
+typedef enum {
+  TYPED_NONE = 0,
+  TYPED_FLOAT64,
+  TYPED_INT32,
+  TYPED_UINT8,
+} TypedKind;
+
 // Type enums of the heap allocated types.
 typedef enum {
   OBJ_STRING = 0,
@@ -275,6 +291,9 @@ typedef enum {
   OBJ_FIBER,
   OBJ_CLASS,
   OBJ_POINTER,
+  OBJ_SET,
+  OBJ_ITERATOR,
+  OBJ_TUPLE,
   OBJ_INST, // OBJ_INST should be the last element of this enums (don't move).
 } ObjectType;
 
@@ -285,12 +304,29 @@ struct Object {
   Object* next;    //< Next object in the heap allocated link list.
 };
 
+// Encoding state of a string's bytes, used to pick the codepoint access path.
+typedef enum {
+  STRING_UTF8_UNKNOWN = 0, //< Not scanned yet (data written after allocation).
+  STRING_UTF8_ASCII,       //< Every byte is a codepoint, indexing is O(1).
+  STRING_UTF8_MULTIBYTE,   //< Contains multibyte sequences, uses \ref cp_index.
+} StringUtf8State;
+
+// A sparse codepoint -> byte offset index entry is recorded for every
+// [STRING_CP_INDEX_STRIDE] codepoints of a multibyte string.
+#define STRING_CP_INDEX_STRIDE 32
+
 struct String {
   Object _super;
 
   uint32_t hash;     //< 32 bit hash value of the string.
   uint32_t length;   //< Length of the string in \ref data.
   uint32_t capacity; //< Size of allocated \ref data.
+
+  uint8_t utf8_state;       //< One of \ref StringUtf8State.
+  uint32_t cp_length;       //< Number of codepoints (valid once scanned).
+  uint32_t cp_index_count;  //< Number of entries in \ref cp_index.
+  uint32_t* cp_index;       //< Lazily built sparse codepoint offsets or NULL.
+
   char data[DYNAMIC_TAIL_ARRAY];
 };
 
@@ -301,22 +337,111 @@ struct List {
 };
 
 typedef struct {
-  // If the key is VAR_UNDEFINED it's an empty slot and if the value is false
-  // the entry is new and available, if true it's a tombstone - the entry
-  // previously used but then deleted.
+  // Entries are stored densely in insertion order. A deleted entry keeps it's
+  // position with the key set to VAR_UNDEFINED till the next resize compacts
+  // the entries array.
 
-  Var key;   //< The entry's key or VAR_UNDEFINED of the entry is not in use.
-  Var value; //< The entry's value.
+  // The key and the hash are laid out the same as a SetEntry, the index
+  // table code is shared by both.
+
+  Var key;       //< The entry's key or VAR_UNDEFINED if it was deleted.
+  uint32_t hash; //< Cached hash of the key, compared before the keys.
+  Var value;     //< The entry's value.
 } MapEntry;
 
+// The map is a compact ordered hash table (same layout as CPython's dict).
+// [index] is an open addressed table of [capacity] slots each of which is the
+// position of an entry in [entries] (or an empty/deleted marker). The slot
+// width is 8, 16 or 32 bits depending on the capacity so small maps have a
+// tiny index which fits in a cache line.
+//
+// Like Lua tables, the map also has an array part: values of the dense
+// integer keys 0, 1, 2 ... are stored in [array] and indexed directly. Keys
+// are only appended to the array while the hash part is empty, so the array
+// part is always first in insertion order. A deleted array key leaves a hole
+// (VAR_UNDEFINED) and re-inserting it goes to the hash part.
 struct Map {
   Object _super;
 
-  uint32_t capacity;    //< Allocated entry's count.
-  uint32_t count;       //< Number of entries in the map.
-  MapEntry* entries;    //< Pointer to the contiguous array.
-  VarBuffer order_keys; //< Keys in insertion order.
-  int64_t next_index;   //< Next auto key for value-only entries.
+  uint32_t capacity;       //< Number of slots in the \ref index table.
+  uint32_t count;          //< Number of live keys in the map (both parts).
+  uint32_t hash_count;     //< Number of live entries in the hash part.
+  uint32_t used;           //< Number of used entries (live + deleted).
+  uint32_t entries_size;   //< Allocated entries count (usable capacity).
+  void* index;             //< Index table of int8/int16/int32 slots.
+  MapEntry* entries;       //< Entries in insertion order.
+  Var* array;              //< Array part, values of the keys [0, array_count).
+  uint32_t array_count;    //< Number of array slots in use (with holes).
+  uint32_t array_capacity; //< Allocated size of the \ref array.
+  int64_t next_index;      //< Next auto key for value-only entries.
+};
+
+typedef struct {
+  Var key;       //< The element or VAR_UNDEFINED if it was deleted.
+  uint32_t hash; //< Cached hash of the element.
+} SetEntry;
+
+// A set of hashable values, it's the map's hash part without the values:
+// the same variable width [index] table over dense [entries] which are kept
+// in insertion order.
+struct Set {
+  Object _super;
+
+  uint32_t capacity;     //< Number of slots in the \ref index table.
+  uint32_t count;        //< Number of elements in the set.
+  uint32_t used;         //< Number of used entries (live + deleted).
+  uint32_t entries_size; //< Allocated entries count.
+  void* index;           //< Index table of int8/int16/int32 slots.
+  SetEntry* entries;     //< Entries in insertion order.
+};
+
+// Stages of a lazy iterator pipeline.
+typedef enum {
+  ITER_MAP,       //< Replace the value with fn(value).
+  ITER_FILTER,    //< Drop the value if fn(value) is false.
+  ITER_TAKE,      //< Stop after [count] values.
+  ITER_ENUMERATE, //< Replace the value with (index, value).
+  ITER_ZIP,       //< Replace the value with (value, next of another iterable).
+} IteratorStageKind;
+
+// What an iterator pulls from its source.
+typedef enum {
+  ITER_SOURCE_SEQ,    //< The values of varIterate() over the source.
+  ITER_SOURCE_VALUES, //< The values of the source map.
+  ITER_SOURCE_ITEMS,  //< The (key, value) tuples of the source map.
+} IteratorSourceKind;
+
+typedef struct {
+  IteratorStageKind kind;
+  Var arg;      //< The function of map/filter or the iterable of zip.
+  Var cursor;   //< The iterator of the zip's iterable.
+  double count; //< Remaining count of take or the next index of enumerate.
+} IteratorStage;
+
+// A lazy iterator over an iterable [source], the values are pulled from the
+// source one at a time and passed through all the [stages] in a single loop,
+// so chaining stages (iter(x).map(f).filter(g)) doesn't create intermediate
+// iterators or lists.
+struct Iterator {
+  Object _super;
+
+  Var source;                     //< The iterable the values are pulled from.
+  IteratorSourceKind source_kind; //< What's pulled from the source.
+  Var cursor;                     //< The iterator (position) over the source.
+  bool done;                      //< True once the iterator is exhausted.
+  uint32_t stage_count;           //< Number of the stages.
+  IteratorStage* stages;          //< The stages in the order they're applied.
+};
+
+// An immutable sequence of values. The elements are allocated inline after
+// the header so a tuple is a single allocation, which makes it cheaper than
+// a list to return multiple values. A tuple is hashable if all its elements
+// are hashable.
+struct Tuple {
+  Object _super;
+
+  uint32_t length;               //< Number of the elements.
+  Var items[DYNAMIC_TAIL_ARRAY]; //< The elements.
 };
 
 struct Range {
@@ -326,6 +451,14 @@ struct Range {
   double to;   //< End of the range exclusive.
 };
 
+// A global of a module resolved for a global name referenced by the code of a
+// module (the same or another one), see Module.links.
+typedef struct {
+  Module* module;  //< The module of the global, NULL if it's not linked.
+  uint32_t layout; //< The [globals_layout] of the module when it's linked.
+  uint32_t slot;   //< Index of the global in the module's globals.
+} GlobalLink;
+
 // Module is a collection of globals, functions, classes and top
 // level statements, they can be imported in other modules generally a
 // script will compiled to a module.
@@ -361,6 +494,17 @@ struct Module {
   String* global_lookup_name_cache;
   int32_t global_lookup_index_cache;
 
+  // Incremented when a global is deleted, since it moves the globals after it
+  // and the links to this module's globals are no longer valid.
+  uint32_t globals_layout;
+
+  // Link table of the global names (and module attributes) referenced by the
+  // code of this module, indexed by the name's index in the constant pool.
+  // A name is linked to a global of the module it's accessed on once it's
+  // found, after that the access is an index load. See moduleLinkGlobal().
+  GlobalLink* links;
+  uint32_t links_count;
+
   // Top level statements of a module are compiled to an implicit function
   // body which will be executed if it's imported for the first time.
   Closure* body;
@@ -384,6 +528,12 @@ typedef struct {
   ByteBuffer opcodes; //< Buffer of opcodes.
   UintBuffer oplines; //< Line number of opcodes for debug (1 based).
   int stack_size;     //< Maximum size of stack required.
+
+  // Calls inlined by the compiler, triples of the start and end position of
+  // the inlined code and the constant index of the inlined function. The
+  // oplines of the inlined code are the lines of the function, see
+  // fnInlinedAt() for the backtraces.
+  UintBuffer inlines;
 } Fn;
 
 #define ARITY_VARIADIC -1
@@ -460,13 +610,27 @@ struct Function {
 // ran out of it's scope / popped from stack, the upvalue will make it's own
 // copy of that variable to make sure that a closure referenceing the variable
 // via this upvalue has still access to the variable.
+//
+// If the compiler can prove that a captured variable is never reassigned
+// after it's initialized (like 'bar' above) sharing is not needed and the
+// value itself is copied into the closure when it's created (a flat capture).
+// So an element of [upvalues] is either an Upvalue object shared with the
+// enclosing function or the captured value.
 struct Closure {
   Object _super;
 
   Function* fn;
-  Upvalue* upvalues[DYNAMIC_TAIL_ARRAY];
+  Var upvalues[DYNAMIC_TAIL_ARRAY];
 };
 
+// The kind of an upvalue capture, written by the compiler for each upvalue
+// after the OP_PUSH_CLOSURE instruction.
+typedef enum {
+  CAPTURE_OUTER = 0, //< Reuse the upvalue of the enclosing closure.
+  CAPTURE_LOCAL = 1, //< Share a local of the enclosing function.
+  CAPTURE_COPY = 2,  //< Copy a local which is never reassigned.
+} CaptureType;
+
 // Method bounds are first class callable of methods. That are bound to an
 // instace which will be used as the this when the underlying method invoked.
 // If the vallue [instance] is VAR_UNDEFINED it's unbound and cannot be
@@ -600,6 +764,49 @@ typedef enum {
   MAX_MAGIC_METHODS,
 } MagicMethod;
 
+// Operator overloading methods of a class, these are dispatched from the
+// operator's slot of the class instead of a method lookup by name. Every
+// in-place operator directly follows it's operator so the slot of an in-place
+// operator is [op + 1].
+typedef enum {
+  OPERATOR_ADD,                // +
+  OPERATOR_ADD_INPLACE,        // +=
+  OPERATOR_SUBTRACT,           // -
+  OPERATOR_SUBTRACT_INPLACE,   // -=
+  OPERATOR_MULTIPLY,           // *
+  OPERATOR_MULTIPLY_INPLACE,   // *=
+  OPERATOR_DIVIDE,             // /
+  OPERATOR_DIVIDE_INPLACE,     // /=
+  OPERATOR_MODULO,             // %
+  OPERATOR_MODULO_INPLACE,     // %=
+  OPERATOR_EXPONENT,           // **
+  OPERATOR_EXPONENT_INPLACE,   // **=
+  OPERATOR_BIT_AND,            // &
+  OPERATOR_BIT_AND_INPLACE,    // &=
+  OPERATOR_BIT_OR,             // |
+  OPERATOR_BIT_OR_INPLACE,     // |=
+  OPERATOR_BIT_XOR,            // ^
+  OPERATOR_BIT_XOR_INPLACE,    // ^=
+  OPERATOR_BIT_LSHIFT,         // <<
+  OPERATOR_BIT_LSHIFT_INPLACE, // <<=
+  OPERATOR_BIT_RSHIFT,         // >>
+  OPERATOR_BIT_RSHIFT_INPLACE, // >>=
+  OPERATOR_EQ,                 // ==
+  OPERATOR_GT,                 // >
+  OPERATOR_LT,                 // <
+  OPERATOR_RANGE,              // ..
+  OPERATOR_IN,                 // in
+  OPERATOR_GET_SUBSCRIPT,      // []
+  OPERATOR_SET_SUBSCRIPT,      // []=
+  OPERATOR_POSITIVE,           // +this
+  OPERATOR_NEGATIVE,           // -this
+  OPERATOR_BIT_NOT,            // ~this
+  OPERATOR_NOT,                // !this
+  OPERATOR_NEXT,               // _next
+  OPERATOR_VALUE,              // _value
+  MAX_OPERATOR_METHODS,
+} OperatorMethod;
+
 struct Class {
   Object _super;
 
@@ -624,12 +831,34 @@ struct Class {
   // Magic methods, ctor/getter/setter etc.
   Closure* magic_methods[MAX_MAGIC_METHODS];
 
+  // Operator overloading methods (including the inherited ones) or NULL if
+  // the operator isn't overloaded. Updated with the [vtable].
+  Closure* operator_methods[MAX_OPERATOR_METHODS];
+
   // A buffer of methods of the class.
   ClosureBuffer methods;
 
-  // Cached method-name -> method closure map for fast lookup.
+  // The flattened method table of the class, including the inherited
+  // methods. An inherited method keeps the slot it has in the base class and
+  // an override replaces it in place, so a slot is valid for every class
+  // derived from the class that first defined the name.
+  ClosureBuffer vtable;
+
+  // Interned name of the method at each slot of the [vtable].
+  StringBuffer vtable_names;
+
+  // Method-name -> slot index (number) of the [vtable].
   Map* method_lookup;
 
+  // Names of the fields declared in the class body (not including the
+  // inherited ones).
+  StringBuffer declared_fields;
+
+  // Field layout of the instances, the inherited fields first followed by the
+  // declared fields of the class. The first INSTANCE_INLINE_ATTR_CAPACITY
+  // fields are placed at the same inline attribute slots of every instance.
+  StringBuffer fields;
+
   // Static attributes of the class.
   Map* static_attribs;
 
@@ -637,6 +866,15 @@ struct Class {
   // For script/ builtin types it'll be NULL.
   NewInstanceFn new_fn;
   DeleteInstanceFn delete_fn;
+
+  // Optional marker of the values referenced by a native instance's data,
+  // see MarkInstanceFn.
+  MarkInstanceFn mark_fn;
+
+  // Element type of the typed array classes (types.Float64Array, ...), their
+  // native data is a TypedArray which the VM subscripts directly. It's
+  // TYPED_NONE for every other class.
+  TypedKind typed_kind;
 };
 
 // Pointer struct for native types to interact with API.
@@ -679,12 +917,27 @@ struct Instance {
   Map* attribs;
 };
 
+// Unboxed contiguous numeric storage of the typed arrays. A view doesn't own
+// it's data, it points [offset] bytes into the [buffer] of a ByteBuffer
+// instance ([owner], marked to keep it alive) and the data is fetched on each
+// access since the buffer could be re-allocated with writes.
+typedef struct {
+  uint8_t* data;      // Owned elements, NULL for views.
+  uint32_t length;    // Number of elements.
+  TypedKind kind;     // Type of the elements.
+  ByteBuffer* buffer; // Viewed buffer or NULL.
+  uint32_t offset;    // Byte offset of the view in the buffer.
+  Var owner;          // The instance of the [buffer] or null.
+} TypedArray;
+
 /*****************************************************************************/
 /* "CONSTRUCTORS"                                                            */
 /*****************************************************************************/
 
 void varInitObject(Object* thiz, VM* vm, ObjectType type);
 
+// Allocate a string of [length] bytes copied from [text]. If [text] is NULL
+// the bytes are left uninitialized for the caller to fill.
 String* newStringLength(VM* vm, const char* text, uint32_t length);
 
 // Returns an interned short string (for identifier/name heavy paths).
@@ -715,6 +968,16 @@ List* newList(VM* vm, uint32_t size);
 
 Map* newMap(VM* vm);
 
+Set* newSet(VM* vm);
+
+// Allocate a new iterator over the [source] with a copy of the state and the
+// stages of the [base] iterator (if it's not NULL) followed by [extra] stages
+// for the caller to initialize.
+Iterator* newIterator(VM* vm, Var source, const Iterator* base, uint32_t extra);
+
+// Allocate a new tuple of [length] null elements for the caller to set.
+Tuple* newTuple(VM* vm, uint32_t length);
+
 Range* newRange(VM* vm, double from, double to);
 
 Module* newModule(VM* vm);
@@ -740,6 +1003,11 @@ Function* newFunction(VM* vm, const char* name, int length, Module* owner,
 Function* newFunctionRaw(VM* vm, Module* owner, String* name, String* docstring,
                          int arity, bool is_method, int upvalue_count);
 
+// Returns the function inlined by the compiler at the opcode position [index]
+// of the [fn] and set the line of the call to [line], if the position isn't
+// in an inlined code it returns NULL.
+Function* fnInlinedAt(const Function* fn, uint32_t index, int* line);
+
 // If the module is not NULL, the name and the class object will be added to
 // the module's constant pool. The class will be added to the modules global
 // as well.
@@ -749,6 +1017,25 @@ Class* newClass(VM* vm, const char* name, int length, Class* super,
 // Allocate a new script class without registering it in the module.
 Class* newClassRaw(VM* vm, Module* owner, String* name, String* docstring);
 
+// Rebuild the flattened method table of the class from it's base class's
+// table and it's own methods. The base class should already be flattened.
+void classFlattenMethods(VM* vm, Class* cls);
+
+// Add the [method] to the flattened method table of the class. If the name is
+// inherited the base class's method will be overridden, otherwise if the
+// class already has a method with the name, the first one is kept.
+void classBindVtable(VM* vm, Class* cls, String* name, Closure* method);
+
+// Returns the [vtable] slot of the method [name] or -1 if not found.
+int classVtableSlot(Class* cls, String* name);
+
+// Rebuild the field layout of the class from it's base class's layout and
+// it's declared fields.
+void classFlattenFields(VM* vm, Class* cls);
+
+// Returns the layout slot of the field [name] or -1 if not found.
+int classFieldSlot(Class* cls, const char* name, uint32_t length);
+
 // Function to create a new Pointer object for Android API interaction.
 Pointer* newPointer(VM* vm, void* native_ptr, Destructor destructor);
 
@@ -758,6 +1045,14 @@ Closure* newNativeClosure(VM* vm, const char* name, nativeFn fptr, int arity,
 // Allocate new instance with of the base [type].
 Instance* newInstance(VM* vm, Class* cls);
 
+// Allocate new instance of a script class with an already resolved native
+// allocator [new_fn] of the class (see classNewInstanceFn()).
+Instance* newInstanceRaw(VM* vm, Class* cls, NewInstanceFn new_fn);
+
+// Returns the native allocator of the class, inherited from the nearest
+// native base class or NULL if the class isn't a native class.
+NewInstanceFn classNewInstanceFn(Class* cls);
+
 /*****************************************************************************/
 /* METHODS                                                                   */
 /*****************************************************************************/
@@ -802,6 +1097,25 @@ String* stringStrip(VM* vm, String* thiz);
 // the original string will be returned.
 String* stringReplace(VM* vm, String* thiz, String* old, String* new_, int count);
 
+// Returns the number of UTF-8 codepoints in the string. ASCII strings answer
+// in O(1), others are scanned once and the count is cached on the string.
+uint32_t stringCodepointCount(String* thiz);
+
+// Returns the byte offset of the codepoint at [index] (which must be less than
+// or equal to the codepoint count). Multibyte strings build a sparse offset
+// index on first use so repeated lookups don't rescan from the start.
+uint32_t stringCodepointOffset(VM* vm, String* thiz, uint32_t index);
+
+// Returns the index of the codepoint starting at the byte [offset] (which must
+// be less than or equal to the byte length), the inverse of the above.
+uint32_t stringCodepointIndex(VM* vm, String* thiz, uint32_t offset);
+
+// Returns the byte width of the codepoint starting at byte [offset].
+uint32_t stringCodepointWidth(String* thiz, uint32_t offset);
+
+// Drop the cached codepoint data of a string after its bytes are modified.
+void stringResetCodepoints(VM* vm, String* thiz);
+
 // Split the string into a list of string separated by [sep]. String [sep] must
 // If [sep] == "", split string into characters.
 List* stringSplit(VM* vm, String* thiz, String* sep);
@@ -816,6 +1130,13 @@ String* stringFormat(VM* vm, const char* fmt, ...);
 // Which would be faster than using "@@" format.
 String* stringJoin(VM* vm, String* str1, String* str2);
 
+// Create a new string by concatenating the [count] [values], which should be
+// strings, null, booleans or numbers. The values are written directly to the
+// result so only a single string is allocated, except for non integer numbers
+// which are replaced with their string in the [values] array (so it should be
+// reachable by the GC, ex: the VM's stack).
+String* stringBuild(VM* vm, Var* values, uint32_t count);
+
 // You replace a string by specifying the place you want to replace and
 // you replace one or more strings, if it is one, it will be replaced
 // by the index you specified, otherwise the index you specified and
@@ -823,7 +1144,11 @@ String* stringJoin(VM* vm, String* str1, String* str2);
 //     for example: x = "Hello World"
 //                  x[6] = "Ok"
 //                  print(x)     output: "Hello Okrld"
-String* replaceSubstring(VM* vm, uint32_t index, String* str, String* replace);
+// The [span] bytes from the byte [index] are replaced with the bytes of the
+// [replace] (which could have a different byte width), the result should fit
+// in the capacity of the string.
+String* replaceSubstring(VM* vm, uint32_t index, uint32_t span, String* str,
+                         String* replace);
 
 // An inline function/macro implementation of listAppend(). Set below 0 to 1,
 // to make the implementation a static inline function, it's totally okey to
@@ -872,6 +1197,55 @@ void mapClear(VM* vm, Map* thiz);
 // otherwise return VAR_UNDEFINED.
 Var mapRemoveKey(VM* vm, Map* thiz, Var key);
 
+// Walk the map in insertion order. [position] should be 0 for the first call
+// and it'll be advanced past the returned entry. Returns false when there
+// are no more entries. [key] and [value] could be NULL.
+bool mapIterate(const Map* thiz, uint32_t* position, Var* key, Var* value);
+
+// Returns a shallow copy of the map with the same index table, entries order
+// and array part. Used to instantiate the frozen literal map templates.
+Map* mapCopy(VM* vm, Map* thiz);
+
+// Rebuild the index table of a map that won't be modified anymore (a frozen
+// literal template) so every key is at it's home slot and a lookup is a single
+// probe. Returns false (and keeps the table) if no such capacity was found.
+bool mapMakePerfect(VM* vm, Map* thiz);
+
+// Returns true if the [key] is in the set. The key should be hashable.
+bool setHas(Set* thiz, Var key);
+
+// Add the [key] to the set. Returns false if it was already there. The key
+// should be hashable.
+bool setAdd(VM* vm, Set* thiz, Var key);
+
+// Remove the [key] from the set. Returns false if it wasn't in the set.
+bool setRemove(VM* vm, Set* thiz, Var key);
+
+// Remove all the elements from the set.
+void setClear(VM* vm, Set* thiz);
+
+// Walk the set in insertion order, same as mapIterate().
+bool setIterate(const Set* thiz, uint32_t* position, Var* key);
+
+// Same as mapMakePerfect() for a set.
+bool setMakePerfect(VM* vm, Set* thiz);
+
+// Returns the size of a typed array element of the [kind] in bytes.
+uint32_t typedElementSize(TypedKind kind);
+
+// Returns the first element of the typed array. For a view it'll return NULL
+// if the viewed buffer was shrunk bellow the end of the view.
+uint8_t* typedArrayData(const TypedArray* thiz);
+
+// Fast path of the typed array subscript, returns false if the [key] isn't
+// an in bound integer index (or the data isn't available) without setting
+// any error, so the caller could fallback to the [] method.
+bool typedArrayGet(const TypedArray* thiz, Var key, Var* value);
+
+// Fast path of the typed array subscript set, same as typedArrayGet() it'll
+// also return false if the [value] cannot be stored in the element type.
+bool typedArraySet(TypedArray* thiz, Var key, Var value);
+
 // Returns true if the fiber has error, and if it has any the fiber cannot be
 // resumed anymore.
 bool fiberHasError(Fiber* fiber);
@@ -903,6 +1277,28 @@ int moduleGetGlobalIndex(Module* module, const char* name, uint32_t length);
 // lookup map and is intended for runtime hot paths.
 int moduleGetGlobalIndexByName(VM* vm, Module* module, String* name);
 
+// Update the value of the global at the [g_index] of the [module].
+void moduleSetGlobalAt(VM* vm, Module* module, uint32_t g_index, Var value);
+
+// Returns the index of the global [name] of the [target] module, accessed by
+// the code of the [module] with the name at the [index] of it's constant pool,
+// or -1 if not found. Once found the name is linked to the global in the link
+// table of the [module], see moduleGetLinkedGlobal().
+int moduleLinkGlobal(VM* vm, Module* module, uint32_t index, Module* target, String* name);
+
+// Returns the linked global of the name [index] if it's linked to the
+// [target] module's global, otherwise resolve it with moduleLinkGlobal().
+static inline int moduleGetLinkedGlobal(VM* vm, Module* module, uint32_t index,
+                                        Module* target, String* name) {
+  if (index < module->links_count) {
+    GlobalLink* link = &module->links[index];
+    if (link->module == target && link->layout == target->globals_layout) {
+      return (int) link->slot;
+    }
+  }
+  return moduleLinkGlobal(vm, module, index, target, name);
+}
+
 // Delete a global by name. Returns true if deleted, false if not found.
 bool moduleDeleteGlobal(VM* vm, Module* module, const char* name, uint32_t length);
 
@@ -954,9 +1350,13 @@ bool isValuesEqual(Var v1, Var v2);
 // Return the hash value of the variable. (variable should be hashable).
 uint32_t varHashValue(Var v);
 
-// Return true if the object type is hashable.
+// Return true if the object type is hashable. A tuple also needs all of its
+// elements to be hashable, see isValueHashable().
 bool isObjectHashable(ObjectType type);
 
+// Return true if the value can be used as a map key or a set element.
+bool isValueHashable(Var v);
+
 // Returns the string version of the [value].
 String* toString(VM* vm, const Var value);
 
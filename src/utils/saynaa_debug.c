@@ -177,20 +177,8 @@ void reportCompileTimeError(VM* vm, const char* path, int line, const char* sour
   ByteBufferClear(&buff, vm);
 }
 
-static void _reportStackFrame(VM* vm, CallFrame* frame) {
+static void _reportFunctionLine(VM* vm, const Function* fn, int line) {
   WriteFn writefn = vm->config.stderr_write;
-  const Function* fn = frame->closure->fn;
-  ASSERT(!fn->is_native, OOPS);
-
-  // After fetching the instruction the ip will be inceased so we're
-  // reducing it by 1. But stack overflows are occure before executing
-  // any instruction of that function, so the instruction_index possibly
-  // be -1 (set it to zero in that case).
-  int instruction_index = (int) (frame->ip - fn->fn->opcodes.data) - 1;
-  if (instruction_index == -1)
-    instruction_index++;
-
-  int line = fn->fn->oplines.data[instruction_index];
 
   if (fn->owner->path == NULL) {
     writefn(vm, "  [at:");
@@ -214,6 +202,31 @@ static void _reportStackFrame(VM* vm, CallFrame* frame) {
   }
 }
 
+static void _reportStackFrame(VM* vm, CallFrame* frame) {
+  const Function* fn = frame->closure->fn;
+  ASSERT(!fn->is_native, OOPS);
+
+  // After fetching the instruction the ip will be inceased so we're
+  // reducing it by 1. But stack overflows are occure before executing
+  // any instruction of that function, so the instruction_index possibly
+  // be -1 (set it to zero in that case).
+  int instruction_index = (int) (frame->ip - fn->fn->opcodes.data) - 1;
+  if (instruction_index == -1)
+    instruction_index++;
+
+  int line = fn->fn->oplines.data[instruction_index];
+
+  // The code of an inlined call is reported as a frame of its function.
+  int call_line = line;
+  const Function* inlined = fnInlinedAt(fn, (uint32_t) instruction_index, &call_line);
+  if (inlined != NULL) {
+    _reportFunctionLine(vm, inlined, line);
+    line = call_line;
+  }
+
+  _reportFunctionLine(vm, fn, line);
+}
+
 void reportRuntimeError(VM* vm, Fiber* fiber) {
   WriteFn writefn = vm->config.stderr_write;
   if (writefn == NULL)
@@ -357,6 +370,8 @@ void dumpFunctionCode(VM* vm, Function* func) {
     Opcode op = (Opcode) func->fn->opcodes.data[i++];
     switch (op) {
       case OP_PUSH_CONSTANT:
+      case OP_CLONE_CONSTANT:
+      case OP_IN_CONSTANT:
         {
           int index = READ_SHORT();
           ASSERT_INDEX((uint32_t) index, func->owner->constants.count);
@@ -380,6 +395,12 @@ void dumpFunctionCode(VM* vm, Function* func) {
         break;
 
       case OP_PUSH_LIST:
+      case OP_LIST_RESERVE:
+      case OP_LIST_APPEND_LOCAL:
+      case OP_MAP_INSERT_LOCAL:
+      case OP_BUILD_TUPLE:
+      case OP_BUILD_STRING:
+      case OP_UNPACK:
         SHORT_ARG();
         break;
 
@@ -578,6 +599,8 @@ void dumpFunctionCode(VM* vm, Function* func) {
 
       case OP_SUPER_CALL:
       case OP_METHOD_CALL:
+      case OP_CALL_DIRECT:
+      case OP_TAIL_CALL_DIRECT:
         {
           int argc = READ_BYTE();
           int index = READ_SHORT();
@@ -595,6 +618,32 @@ void dumpFunctionCode(VM* vm, Function* func) {
           break;
         }
 
+      case OP_INLINE_CALL:
+        {
+          int argc = READ_BYTE();
+          int index = READ_SHORT();
+          (void) READ_SHORT(); // Inlined function index.
+          int offset = READ_SHORT();
+          String* name = moduleGetStringAt(func->owner, index);
+          ASSERT(name != NULL, OOPS);
+
+          // Prints: %5d (argc) %d '%s' (ip:%d)\n
+          PRINT_INT(argc);
+          PRINT(" (argc) ");
+
+          _PRINT_INT(index, 0);
+          PRINT(" '");
+          PRINT(name->data);
+          PRINT("' (ip:");
+          _PRINT_INT(i + offset, 0);
+          PRINT(")\n");
+          break;
+        }
+
+      case OP_INLINE_RETURN:
+        BYTE_ARG();
+        break;
+
       case OP_CALL:
         // Prints: %5d (argc)\n
         PRINT_INT(READ_BYTE());
@@ -612,6 +661,7 @@ void dumpFunctionCode(VM* vm, Function* func) {
         break;
 
       case OP_ITER:
+      case OP_ITER2:
       case OP_JUMP:
       case OP_JUMP_IF:
       case OP_JUMP_IF_NOT:
@@ -658,6 +708,24 @@ void dumpFunctionCode(VM* vm, Function* func) {
         }
         break;
 
+      case OP_GET_FIELD:
+      case OP_SET_FIELD:
+        {
+          int index = READ_SHORT();
+          int slot = READ_BYTE();
+          String* name = moduleGetStringAt(func->owner, index);
+          ASSERT(name != NULL, OOPS);
+
+          // Prints: %5d '%s' (slot:%d)\n
+          PRINT_INT(index);
+          PRINT(" '");
+          PRINT(name->data);
+          PRINT("' (slot:");
+          _PRINT_INT(slot, 0);
+          PRINT(")\n");
+        }
+        break;
+
       case OP_GET_SUBSCRIPT:
       case OP_GET_SUBSCRIPT_KEEP:
       case OP_SET_SUBSCRIPT:
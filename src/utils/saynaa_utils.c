@@ -227,7 +227,7 @@ uint32_t utilHashString(const char* string) {
   uint32_t hash = FNV_offset_basis_32_bit;
 
   for (const char* c = string; *c != '\0'; c++) {
-    hash ^= *c;
+    hash ^= (uint8_t) *c;
     hash *= FNV_prime_32_bit;
   }
 
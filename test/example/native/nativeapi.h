@@ -61,6 +61,9 @@ typedef enum VarType {
   vFIBER,
   vCLASS,
   vPOINTER,
+  vSET,
+  vITERATOR,
+  vTUPLE,
   vINSTANCE,
 } VarType;
 
@@ -209,6 +212,7 @@ typedef bool (*CallMethod_t)(VM*, int, const char*, int, int, int);
 typedef bool (*GetAttribute_t)(VM*, int, const char*, int);
 typedef bool (*setAttribute_t)(VM*, int, const char*, int);
 typedef bool (*ImportModule_t)(VM*, const char*, int);
+typedef void* (*GetSlotTypedArray_t)(VM*, int, uint32_t*, uint32_t*);
 
 typedef struct {
   NewConfiguration_t NewConfiguration_ptr;
@@ -285,6 +289,7 @@ typedef struct {
   GetAttribute_t GetAttribute_ptr;
   setAttribute_t setAttribute_ptr;
   ImportModule_t ImportModule_ptr;
+  GetSlotTypedArray_t GetSlotTypedArray_ptr;
 } NativeApi;
 
 Configuration NewConfiguration();
@@ -334,6 +339,7 @@ const char* GetSlotString(VM* vm, int index, uint32_t* length);
 void* GetSlotPointer(VM* vm, int index, void* native_ptr, Destructor destructor);
 Handle* GetSlotHandle(VM* vm, int index);
 void* GetSlotNativeInstance(VM* vm, int index);
+void* GetSlotTypedArray(VM* vm, int index, uint32_t* length, uint32_t* element_size);
 void setSlotNull(VM* vm, int index);
 void setSlotBool(VM* vm, int index, bool value);
 void setSlotNumber(VM* vm, int index, double value);
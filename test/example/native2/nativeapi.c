@@ -84,6 +84,7 @@ EXPORT void InitApi(NativeApi* api) {
   native_api.GetAttribute_ptr = api->GetAttribute_ptr;
   native_api.setAttribute_ptr = api->setAttribute_ptr;
   native_api.ImportModule_ptr = api->ImportModule_ptr;
+  native_api.GetSlotTypedArray_ptr = api->GetSlotTypedArray_ptr;
 }
 Configuration NewConfiguration() {
   return native_api.NewConfiguration_ptr();
@@ -273,6 +274,10 @@ void* GetSlotNativeInstance(VM* vm, int index) {
   return native_api.GetSlotNativeInstance_ptr(vm, index);
 }
 
+void* GetSlotTypedArray(VM* vm, int index, uint32_t* length, uint32_t* element_size) {
+  return native_api.GetSlotTypedArray_ptr(vm, index, length, element_size);
+}
+
 void setSlotNull(VM* vm, int index) {
   native_api.setSlotNull_ptr(vm, index);
 }
@@ -44,6 +44,7 @@ class TestExp:
         self.expect_output = []
         self.expect_runtime_error = None
         self.expect_exit_code = 0
+        self.args = []
         self.skip = False
 
     @staticmethod
@@ -57,6 +58,7 @@ class TestExp:
                 #   # expect: <text>          -> Expect line in stdout
                 #   # expect error: <text>    -> Expect substring in stderr
                 #   # expect exit: <int>      -> Expect exit code
+                #   # args: <flags>           -> Interpreter flags before the file
                 #   # skip                    -> Skip test
                 
                 if '#' not in line:
@@ -74,6 +76,8 @@ class TestExp:
                         exp.expect_exit_code = int(comment[12:].strip())
                     except ValueError:
                         pass
+                elif comment.startswith('args:'):
+                    exp.args.extend(comment[5:].split())
                 elif comment.startswith('skip'):
                     exp.skip = True
                     
@@ -101,7 +105,7 @@ def run_single_test(test_file, interpreter, timeout):
     
     try:
         proc = subprocess.Popen(
-            [str(interpreter), str(test_file)],
+            [str(interpreter)] + exp.args + [str(test_file)],
             stdout=subprocess.PIPE,
             stderr=subprocess.PIPE,
             stdin=subprocess.PIPE,